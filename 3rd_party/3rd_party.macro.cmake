@@ -4,4 +4,5 @@ set (PROJECT_3RD_PARTY_ROOT_DIR ${CMAKE_CURRENT_LIST_DIR})
 
 include("${PROJECT_3RD_PARTY_ROOT_DIR}/libuv/libuv.cmake")
 include("${PROJECT_3RD_PARTY_ROOT_DIR}/msgpack/msgpack.cmake")
+include("${PROJECT_3RD_PARTY_ROOT_DIR}/zlib/zlib.cmake")
 include("${PROJECT_3RD_PARTY_ROOT_DIR}/atframe_utils/libatframe_utils.cmake")
\ No newline at end of file
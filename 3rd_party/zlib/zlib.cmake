@@ -0,0 +1,18 @@
+﻿# =========== 3rdparty zlib ==================
+# zlib is optional, it's used to compress large io_stream frames
+if (ATBUS_MACRO_ENABLE_ZLIB)
+    find_package(ZLIB)
+endif()
+
+if(ZLIB_FOUND)
+    EchoWithColor(COLOR GREEN "-- Dependency: zlib found.(${ZLIB_LIBRARIES})")
+
+    set (3RD_PARTY_ZLIB_INC_DIR ${ZLIB_INCLUDE_DIRS})
+    set (3RD_PARTY_ZLIB_LINK_NAME ${ZLIB_LIBRARIES})
+
+    include_directories(${3RD_PARTY_ZLIB_INC_DIR})
+    add_compiler_define(ATBUS_MACRO_WITH_ZLIB=1)
+else()
+    EchoWithColor(COLOR YELLOW "-- Dependency: zlib not found or disabled, io_stream frame compression is unavailable")
+    set (3RD_PARTY_ZLIB_LINK_NAME "")
+endif()
@@ -54,6 +54,7 @@ namespace atbus {
                 REG_FD,            /** 关联了fd到node或endpoint，清理的时候需要移除 **/
                 ACCESS_SHARE_ADDR, /** 共享内部地址（内存通道的地址共享） **/
                 ACCESS_SHARE_HOST, /** 共享物理机（共享内存通道的物理机共享） **/
+                UNRELIABLE,        /** 不可靠连接（udp通道，只用于发送可丢弃的数据消息） **/
                 RESETTING,         /** 正在执行重置（防止递归死循环） **/
                 DESTRUCTING,       /** 正在执行析构（屏蔽某些接口） **/
                 MAX
@@ -123,6 +124,26 @@ namespace atbus {
          */
         int push(const void *buffer, size_t s);
 
+        /**
+         * @brief 转移数据块所有权并发送
+         * @param buffer 数据块地址，调用后由connection负责释放（无论成功与否）
+         * @param s 数据块长度
+         * @param free_fn 释放数据块的函数，为NULL时使用free
+         * @return 0或错误码
+         * @note 进程内的内存通道直接传递指针，不会拷贝数据；其他通道退化为push后释放
+         */
+        int push_ptr(void *buffer, size_t s, channel::mem_ptr_free_fn_t free_fn);
+
+        /**
+         * @brief 转移数据块所有权并作为控制消息发送
+         * @param buffer 数据块地址，调用后由connection负责释放（无论成功与否）
+         * @param s 数据块长度
+         * @param free_fn 释放数据块的函数，为NULL时使用free
+         * @return 0或错误码
+         * @note io_stream连接的控制消息优先于已经排队的数据消息发送；其他通道等同于push_ptr
+         */
+        int push_ctrl(void *buffer, size_t s, channel::mem_ptr_free_fn_t free_fn);
+
         /**
          * @brief 获取连接的地址
          */
@@ -157,6 +178,103 @@ namespace atbus {
 
         inline const stat_t &get_statistic() const { return stat_; }
 
+        /**
+         * @brief 在线扩容共享内存通道（仅监听端可用）
+         * @param new_key 新通道的共享内存Key
+         * @param new_size 新通道的长度
+         * @return 0或错误码
+         * @note 发送端会在下一条消息开始前切换到新通道，旧通道的数据读完后才会开始读新通道
+         * @note 旧通道读空后还有发送者登记为正在写入(比如写入时崩溃)时，最多等待ATBUS_MACRO_MEM_MIGRATE_DRAIN_TIMEOUT秒
+         * @note 不支持在线扩容的旧版本发送端不会切换，切换后它们写入旧通道的数据会丢失，所有发送端都升级后才能使用
+         */
+        int migrate_shm(key_t new_key, size_t new_size);
+
+        /**
+         * @brief 设置io_stream连接发送消息的校验方式
+         * @param checksum_type 校验方式(channel::io_stream_checksum_t::type)
+         * @return 0或错误码
+         * @note 仅在对端支持新的消息格式时可用，设置后不能再切换回旧格式
+         * @note I/O线程中的连接这里只检查参数，由I/O线程在之前发送的消息之后设置
+         */
+        int set_iostream_checksum(int checksum_type);
+
+        /**
+         * @brief 设置io_stream连接发送消息的压缩方式
+         * @param algorithm 压缩算法(channel::io_stream_compress_t::type)，EN_CA_NONE则关闭压缩
+         * @param threshold 数据长度不小于这个值的消息才压缩
+         * @param level 压缩等级
+         * @return 0或错误码
+         * @note 必须先切换到新的消息格式，并且对端支持这种压缩算法。I/O线程中的连接同样异步设置
+         */
+        int set_iostream_compression(int algorithm, size_t threshold, int level);
+
+        /**
+         * @brief 获取io_stream连接的压缩统计信息
+         * @return 压缩统计信息，不是io_stream连接或者是I/O线程中的连接时返回NULL
+         */
+        const channel::io_stream_compress_stat_t *get_iostream_compress_stat() const;
+
+        /**
+         * @brief 获取io_stream连接的发送延迟统计(从发送开始计时，排队时间和写完成时间的直方图)
+         * @return 发送延迟统计，不是io_stream连接或者没有开启EN_CONF_LATENCY_STAT时返回NULL
+         */
+        const channel::io_stream_latency_stat_t *get_iostream_latency_stat() const;
+
+        /**
+         * @brief 设置io_stream连接的延迟合并发送
+         * @param size 延迟数据的长度上限，小于这个长度的消息会延迟发送，0则关闭并立即发送已延迟的消息
+         * @param delay 最长延迟时间，微秒
+         * @return 0或错误码
+         * @note I/O线程中的连接同样异步设置
+         */
+        int set_iostream_cork(size_t size, uint64_t delay);
+
+        /**
+         * @brief 暂停读取io_stream连接的数据，未读取的数据留在内核缓冲区里，由TCP的流量控制让对端减慢发送
+         * @return 0或错误码
+         * @note 本次已经读到的消息仍然会回调，暂停期间也不会发现对端断开。I/O线程中的连接异步暂停
+         */
+        int pause_iostream_read();
+
+        /**
+         * @brief 恢复读取io_stream连接的数据
+         * @return 0或错误码
+         */
+        int resume_iostream_read();
+
+        /**
+         * @brief 创建匿名共享内存接收通道，用于把同机的unix socket连接升级为共享内存通道(仅linux)
+         * @param addr 连接地址，两端使用相同的地址
+         * @param len 接收通道的长度
+         * @param fd 导出接收通道的描述符，发送给对端后由调用者关闭
+         * @return 0或错误码
+         * @note 通过attach_shm_fd关联对端的接收通道后才会变为已连接状态
+         */
+        int init_shm_fd(const char *addr, size_t len, int *fd);
+
+        /**
+         * @brief 关联对端创建的匿名共享内存通道，作为发送通道
+         * @param fd 对端接收通道的描述符，调用后可以关闭
+         * @return 0或错误码
+         */
+        int attach_shm_fd(int fd);
+
+        /**
+         * @brief 通过unix socket连接发送描述符
+         * @param fd 要发送的描述符，调用后可以关闭
+         * @param buffer 附带的数据块地址，不能为空
+         * @param s 数据块长度
+         * @return 0或错误码
+         */
+        int push_fd(int fd, const void *buffer, size_t s);
+
+        /**
+         * @brief 取出unix socket连接收到的描述符，需要在收到附带的消息时调用
+         * @param fd 导出描述符，由调用者关闭
+         * @return 0或错误码，没有描述符时返回EN_ATBUS_ERR_NO_DATA
+         */
+        int pop_fd(int *fd);
+
     public:
         static void iostream_on_listen_cb(channel::io_stream_channel *channel, channel::io_stream_connection *connection, int status,
                                           void *buffer, size_t s);
@@ -165,6 +283,8 @@ namespace atbus {
 
         static void iostream_on_recv_cb(channel::io_stream_channel *channel, channel::io_stream_connection *connection, int status,
                                         void *buffer, size_t s);
+        static void iostream_on_recv_batch_cb(channel::io_stream_channel *channel, channel::io_stream_connection *connection, int status,
+                                              void *buffer, size_t s);
         static void iostream_on_accepted(channel::io_stream_channel *channel, channel::io_stream_connection *connection, int status,
                                          void *buffer, size_t s);
         static void iostream_on_connected(channel::io_stream_channel *channel, channel::io_stream_connection *connection, int status,
@@ -186,10 +306,40 @@ namespace atbus {
 
         static int mem_push_fn(connection &conn, const void *buffer, size_t s);
 
+        static int mem_push_ptr_fn(connection &conn, void *buffer, size_t s, channel::mem_ptr_free_fn_t free_fn);
+
         static int ios_free_fn(node &n, connection &conn);
 
         static int ios_push_fn(connection &conn, const void *buffer, size_t s);
 
+        static int shm_fd_proc_fn(node &n, connection &conn, time_t sec, time_t usec);
+
+        static int shm_fd_free_fn(node &n, connection &conn);
+
+        static int shm_fd_push_fn(connection &conn, const void *buffer, size_t s);
+
+        static void iostream_shard_on_listen_cb(channel::io_stream_shards *shards, uint64_t conn_id, int status, void *buffer, size_t s);
+        static void iostream_shard_on_connected_cb(channel::io_stream_shards *shards, uint64_t conn_id, int status, void *buffer,
+                                                   size_t s);
+        static void iostream_shard_on_accepted(channel::io_stream_shards *shards, uint64_t conn_id, int status, void *buffer, size_t s);
+        static void iostream_shard_on_disconnected(channel::io_stream_shards *shards, uint64_t conn_id, int status, void *buffer,
+                                                   size_t s);
+        static void iostream_shard_on_recv_cb(channel::io_stream_shards *shards, uint64_t conn_id, int status, void *buffer, size_t s);
+        static void iostream_shard_on_send_failed(channel::io_stream_shards *shards, uint64_t conn_id, int status, void *buffer,
+                                                  size_t s);
+
+        static int ios_shard_free_fn(node &n, connection &conn);
+        static int ios_shard_listen_free_fn(node &n, connection &conn);
+
+        static int ios_shard_push_fn(connection &conn, const void *buffer, size_t s);
+
+        static void udp_on_recv_cb(channel::udp_channel *channel, channel::udp_socket *socket, const sockaddr *addr, int status,
+                                   void *buffer, size_t s);
+
+        static int udp_free_fn(node &n, connection &conn);
+
+        static int udp_push_fn(connection &conn, const void *buffer, size_t s);
+
         static bool unpack(void *res, connection &conn, atbus::protocol::msg &m, void *buffer, size_t s);
 
     private:
@@ -212,6 +362,11 @@ namespace atbus {
             channel::shm_channel *channel;
             key_t shm_key;
             size_t len;
+
+            // 在线扩容时接收端的新通道，旧通道读完后切换
+            channel::shm_channel *migrate_channel;
+            key_t migrate_shm_key;
+            size_t migrate_len;
         } conn_data_shm;
 
         typedef struct {
@@ -219,20 +374,43 @@ namespace atbus {
             channel::io_stream_connection *conn;
         } conn_data_ios;
 
+        // I/O线程中的io_stream连接，通过连接ID和消息队列收发数据
+        typedef struct {
+            channel::io_stream_shards *shards;
+            uint64_t conn_id;
+        } conn_data_ios_shard;
+
+        // 匿名共享内存通道是单工的，每端读自己创建的通道，写对端创建的通道
+        typedef struct {
+            channel::shm_channel *recv_channel;
+            channel::shm_channel *send_channel;
+        } conn_data_shm_fd;
+
+        // 监听端只关联socket，发送端只有对端地址（发送时由udp通道选择socket）
+        typedef struct {
+            channel::udp_socket *socket;
+            channel::udp_peer_t peer;
+        } conn_data_udp;
+
         typedef struct {
             typedef union {
                 conn_data_mem mem;
                 conn_data_shm shm;
                 conn_data_ios ios_fd;
+                conn_data_ios_shard ios_shard;
+                conn_data_shm_fd shm_fd;
+                conn_data_udp udp;
             } shared_t;
             typedef int (*proc_fn_t)(node &n, connection &conn, time_t sec, time_t usec);
             typedef int (*free_fn_t)(node &n, connection &conn);
             typedef int (*push_fn_t)(connection &conn, const void *buffer, size_t s);
+            typedef int (*push_ptr_fn_t)(connection &conn, void *buffer, size_t s, channel::mem_ptr_free_fn_t free_fn);
 
             shared_t shared;
             proc_fn_t proc_fn;
             free_fn_t free_fn;
             push_fn_t push_fn;
+            push_ptr_fn_t push_ptr_fn;
         } connection_data_t;
         connection_data_t conn_data_;
         stat_t stat_;
@@ -54,6 +54,7 @@ namespace atbus {
 
                 MUTABLE_FLAGS,
                 GLOBAL_ROUTER = MUTABLE_FLAGS, /** 全局路由表 **/
+                READ_PAUSED,                   /** 暂停读取（只能通过pause_read和resume_read修改） **/
                 MAX
             };
         } flag_t;
@@ -118,6 +119,20 @@ namespace atbus {
          */
         uint32_t get_flags() const;
 
+        /**
+         * @brief 暂停读取所有io_stream数据连接的数据，之后添加的数据连接也会暂停读取
+         *        内存和共享内存通道在暂停期间也不再读取
+         * @return 暂停的数据连接数量(包括在proc中读取的共享内存通道)
+         * @note 用于接收端处理不过来时让对端减慢发送，控制连接不暂停，所以ping和注册消息不受影响
+         */
+        size_t pause_read();
+
+        /**
+         * @brief 恢复读取所有io_stream数据连接的数据
+         * @return 恢复的数据连接数量
+         */
+        size_t resume_read();
+
         /**
          * @breif 获取自身的资源holder
          */
@@ -135,6 +150,9 @@ namespace atbus {
         connection *get_data_connection(endpoint *ep) const;
         connection *get_data_connection(endpoint *ep, bool reuse_ctrl) const;
 
+        /** 获取udp连接，没有时使用数据连接 **/
+        connection *get_unreliable_connection(endpoint *ep) const;
+
         /** 增加错误计数 **/
         size_t add_stat_fault();
 
@@ -160,6 +178,13 @@ namespace atbus {
         size_t get_stat_pull_times() const;
         size_t get_stat_pull_size() const;
 
+        /**
+         * @brief 合并所有io_stream连接的发送延迟统计，需要开启EN_CONF_LATENCY_STAT
+         * @param out 输出合并后的统计，会先清空
+         * @return 合并的io_stream连接数量
+         */
+        size_t get_stat_iostream_latency(channel::io_stream_latency_stat_t &out) const;
+
         inline const node *get_owner() const { return owner_; }
 
     private:
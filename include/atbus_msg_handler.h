@@ -34,6 +34,8 @@ namespace atbus {
 
         static int send_transfer_rsp(node &n, protocol::msg &, int32_t ret_code);
 
+        static int send_shm_fd(int32_t msg_id, node &n, connection &conn, int32_t ret_code, uint32_t seq, const char *addr, int fd);
+
         static int send_msg(node &n, connection &conn, const protocol::msg &m);
 
 
@@ -50,6 +52,8 @@ namespace atbus {
         static int on_recv_node_conn_syn(node &n, connection *conn, protocol::msg &, int status, int errcode);
         static int on_recv_node_ping(node &n, connection *conn, protocol::msg &, int status, int errcode);
         static int on_recv_node_pong(node &n, connection *conn, protocol::msg &, int status, int errcode);
+        static int on_recv_node_shm_fd_req(node &n, connection *conn, protocol::msg &, int status, int errcode);
+        static int on_recv_node_shm_fd_rsp(node &n, connection *conn, protocol::msg &, int status, int errcode);
     };
 }
 
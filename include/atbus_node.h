@@ -42,6 +42,9 @@ namespace atbus {
         struct conf_flag_t {
             enum type {
                 EN_CONF_GLOBAL_ROUTER, /** 全局路由表 **/
+                EN_CONF_REUSE_PORT,    /** 监听时启用SO_REUSEPORT，多个节点(可以在不同线程或进程)可以监听同一个地址 **/
+                EN_CONF_TCP_QUICKACK,  /** io_stream的tcp连接启用TCP_QUICKACK **/
+                EN_CONF_LATENCY_STAT,  /** 统计io_stream连接的发送延迟，不能和io_loop_number一起使用 **/
                 EN_CONF_MAX
             };
         };
@@ -71,16 +74,37 @@ namespace atbus {
 
             // ===== 连接配置 =====
             int backlog;
-            time_t first_idle_timeout; /** 第一个包允许的空闲时间，秒 **/
-            time_t ping_interval;      /** ping包间隔，秒 **/
-            time_t retry_interval;     /** 重试包间隔，秒 **/
-            size_t fault_tolerant;     /** 容错次数，次 **/
+            time_t first_idle_timeout;      /** 第一个包允许的空闲时间，秒 **/
+            time_t ping_interval;           /** ping包间隔，秒 **/
+            time_t retry_interval;          /** 重试包间隔，秒 **/
+            size_t fault_tolerant;          /** 容错次数，次 **/
+            time_t dns_cache_ttl;           /** 域名解析结果的缓存时间，秒，0则不缓存 **/
+            time_t dns_negative_cache_ttl;  /** 域名解析失败的缓存时间，秒 **/
+            uint64_t connect_attempt_delay; /** 域名解析出多个地址时依次发起连接的间隔，毫秒 **/
+            uint64_t close_timeout;         /** reset时等待发送完成的最长时间，毫秒，超时后强制关闭剩下的连接 **/
+            size_t io_loop_number;          /** tcp连接收发数据的I/O线程数量，连接按hash固定在一个线程上，0则在ev_loop中收发。
+                                               不能和EN_CONF_LATENCY_STAT一起使用，I/O线程中的连接也没有压缩统计 **/
 
             // ===== 缓冲区配置 =====
             size_t msg_size;           /** 数据包大小 **/
             size_t recv_buffer_size;   /** 接收缓冲区，和数据包大小有关 **/
             size_t send_buffer_size;   /** 发送缓冲区限制 **/
             size_t send_buffer_number; /** 发送缓冲区静态Buffer数量限制，0则为动态缓冲区 **/
+            size_t send_window_size;   /** 每个连接同时进行的写请求数量上限 **/
+            int frame_checksum;        /** io_stream发送消息的校验方式(channel::io_stream_checksum_t::type)，对端支持时生效 **/
+            size_t compress_threshold; /** io_stream消息压缩阈值，数据长度不小于这个值时压缩，0则不压缩。两端都支持时生效 **/
+            int compress_level;        /** io_stream消息压缩等级 **/
+            size_t send_cork_size;     /** io_stream延迟合并发送的数据长度上限，小于这个长度的消息会延迟发送，0则不延迟 **/
+            uint64_t send_cork_delay;  /** io_stream延迟合并发送的最长时间，微秒。proc结束时也会发送所有延迟的消息 **/
+            size_t shm_upgrade_size;   /** 同机的unix socket连接升级为匿名共享内存通道时每个方向的通道长度，0则不升级(默认值，仅linux) **/
+            size_t udp_msg_size;       /** udp通道单个数据报的最大长度(打包后的消息)，超过的消息发送失败。默认不会在以太网上分片 **/
+
+            // ===== socket内核参数，0则使用系统默认值 =====
+            size_t sock_send_buffer;   /** tcp和udp的SO_SNDBUF **/
+            size_t sock_recv_buffer;   /** tcp和udp的SO_RCVBUF **/
+            int sock_busy_poll;        /** tcp的SO_BUSY_POLL，微秒 **/
+            size_t sock_notsent_lowat; /** tcp的TCP_NOTSENT_LOWAT **/
+            int sock_tos;              /** tcp的IP_TOS或IPV6_TCLASS **/
         } conf_t;
 
         typedef std::map<bus_id_t, endpoint::ptr_t> endpoint_collection_t;
@@ -130,6 +154,14 @@ namespace atbus {
             void operator()(channel::io_stream_channel *p) const;
         };
 
+        struct udp_channel_del {
+            void operator()(channel::udp_channel *p) const;
+        };
+
+        struct io_stream_shards_del {
+            void operator()(channel::io_stream_shards *p) const;
+        };
+
     public:
         static ptr_t create();
         ~node();
@@ -197,6 +229,16 @@ namespace atbus {
          */
         int disconnect(bus_id_t id);
 
+        /**
+         * @brief 在线扩容监听的共享内存通道
+         * @param addr 监听的共享内存通道地址
+         * @param new_key 新通道的共享内存Key
+         * @param new_size 新通道的长度
+         * @return 0或错误码
+         * @note 旧地址仍然可以连接，发送端会通过旧通道头部的迁移信息切换到新通道
+         */
+        int migrate_shm_channel(const char *addr, key_t new_key, size_t new_size);
+
 
         /**
          * @brief 发送数据
@@ -211,6 +253,18 @@ namespace atbus {
          */
         int send_data(bus_id_t tid, int type, const void *buffer, size_t s, bool require_rsp = false);
 
+        /**
+         * @brief 通过不可靠的udp通道发送数据，适合可以丢弃的实时数据(比如位置同步)
+         * @param tid 发送目标ID
+         * @param type 自定义类型，将作为msg.head.type字段传递。可用于业务区分服务类型
+         * @param buffer 数据块地址
+         * @param s 数据块长度
+         * @return 0或错误码，打包后超过udp_msg_size时返回EN_ATBUS_ERR_INVALID_SIZE
+         * @note 只有直连的端点使用udp通道，需要转发或者没有udp连接时使用普通的数据连接。不保证送达和顺序，也没有失败通知
+         *       接收端只接受从发送端注册的udp监听地址发出的数据报，所以发送端也要监听udp地址
+         */
+        int send_data_unreliable(bus_id_t tid, int type, const void *buffer, size_t s);
+
         /**
          * @brief 发送数据消息
          * @param tid 发送目标ID
@@ -299,9 +353,31 @@ namespace atbus {
          */
         bool is_endpoint_available(bus_id_t tid) const;
 
+        /**
+         * @brief 暂停读取直连端点的io_stream数据连接，用于消息处理不过来时通过TCP的流量控制让对端减慢发送
+         * @param tid 目标端点ID
+         * @return 0或错误码，没有可以暂停的数据连接(比如只有控制连接)时返回EN_ATBUS_ERR_ATNODE_NO_CONNECTION并且不暂停
+         * @note 控制连接仍然读取，暂停期间ping和注册消息不受影响
+         */
+        int pause_read(bus_id_t tid);
+
+        /**
+         * @brief 恢复读取直连端点的io_stream数据连接
+         * @param tid 目标端点ID
+         * @return 0或错误码
+         */
+        int resume_read(bus_id_t tid);
+
     public:
         channel::io_stream_channel *get_iostream_channel();
 
+        channel::udp_channel *get_udp_channel();
+
+        /**
+         * @brief 获取在I/O线程中收发数据的io_stream通道，conf_t::io_loop_number为0或者初始化失败时返回NULL
+         */
+        channel::io_stream_shards *get_iostream_shards();
+
         inline const endpoint *get_self_endpoint() const { return self_ ? self_.get() : NULL; }
 
         inline const endpoint *get_parent_endpoint() const { return node_father_.node_.get(); }
@@ -340,6 +416,11 @@ namespace atbus {
 
         bool add_proc_connection(connection::ptr_t conn);
         bool remove_proc_connection(const std::string &conn_key);
+        connection::ptr_t get_proc_connection(const std::string &conn_key) const;
+
+        bool add_iostream_shard_connection(uint64_t conn_id, connection *conn);
+        bool remove_iostream_shard_connection(uint64_t conn_id);
+        connection *get_iostream_shard_connection(uint64_t conn_id) const;
 
         bool add_connection_timer(connection::ptr_t conn);
 
@@ -466,6 +547,9 @@ namespace atbus {
         adapter::loop_t *ev_loop_;
         std::unique_ptr<channel::io_stream_channel, io_stream_channel_del> iostream_channel_;
         std::unique_ptr<channel::io_stream_conf> iostream_conf_;
+        std::unique_ptr<channel::udp_channel, udp_channel_del> udp_channel_;
+        std::unique_ptr<channel::io_stream_shards, io_stream_shards_del> iostream_shards_;
+        detail::auto_select_map<uint64_t, connection *>::type iostream_shard_connections_; // I/O线程中的连接，只在回调中查找
         evt_msg_t event_msg_;
 
         // ============ 定时器 ============
@@ -129,6 +129,16 @@ namespace atbus {
 
             int front(void *&pointer, size_t &nread, size_t &nwrite);
 
+            /**
+             * @brief get the first several buffer blocks without pop them
+             * @param blocks output block list, the first one is the same as front()
+             * @param max_number max number of blocks to output
+             * @param skip_number skip the first skip_number blocks
+             * @note blocks in static mode may be not continuous in memory when the circle buffer turns around
+             * @return number of blocks outputed
+             */
+            size_t front_blocks(buffer_block **blocks, size_t max_number, size_t skip_number = 0);
+
             buffer_block *back();
 
             int back(void *&pointer, size_t &nread, size_t &nwrite);
@@ -179,6 +189,8 @@ namespace atbus {
 
             buffer_block *static_back();
 
+            size_t static_front_blocks(buffer_block **blocks, size_t max_number, size_t skip_number);
+
             int static_push_back(void *&pointer, size_t s);
 
             int static_push_front(void *&pointer, size_t s);
@@ -197,6 +209,8 @@ namespace atbus {
 
             buffer_block *dynamic_back();
 
+            size_t dynamic_front_blocks(buffer_block **blocks, size_t max_number, size_t skip_number);
+
             int dynamic_push_back(void *&pointer, size_t s);
 
             int dynamic_push_front(void *&pointer, size_t s);
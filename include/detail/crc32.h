@@ -9,6 +9,15 @@
 namespace atbus {
     namespace detail {
         uint32_t crc32(uint32_t crc, const unsigned char *s, size_t l);
+
+        /**
+         * @brief crc32c(Castagnoli), use SSE4.2 instruction if available
+         * @param crc result of last block, 0 for the first block
+         * @param s data address
+         * @param l data length
+         * @return crc32c checksum
+         */
+        uint32_t crc32c(uint32_t crc, const unsigned char *s, size_t l);
     }
 }
 
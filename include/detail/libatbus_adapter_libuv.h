@@ -15,8 +15,11 @@ namespace atbus {
         typedef uv_pipe_t pipe_t;
         typedef uv_tty_t tty_t;
         typedef uv_tcp_t tcp_t;
+        typedef uv_udp_t udp_t;
         typedef uv_handle_t handle_t;
         typedef uv_timer_t timer_t;
+        typedef uv_async_t async_t;
+        typedef uv_thread_t thread_t;
 
         typedef uv_os_fd_t fd_t;
 
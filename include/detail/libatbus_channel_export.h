@@ -16,6 +16,7 @@
 #include <stdint.h>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "libatbus_adapter_libuv.h"
 #include "libatbus_config.h"
@@ -33,6 +34,25 @@ namespace atbus {
         extern int mem_init(void *buf, size_t len, mem_channel **channel, const mem_conf *conf);
         extern int mem_send(mem_channel *channel, const void *buf, size_t len);
         extern int mem_recv(mem_channel *channel, void *buf, size_t len, size_t *recv_size);
+
+        // memory channel - pointer passing mode(only available in the same process, and there can be only one receiver)
+        // the ownership of buf will be transferred to the channel only when mem_send_ptr returns 0
+        // a block is received after the data written by mem_send before it, so the receiver must call both mem_recv_ptr and
+        // mem_recv when the senders use both, mem_recv_ptr and mem_recv return EN_ATBUS_ERR_NO_DATA until the earlier data is read
+        // mem_clear_ptr drops the pending blocks and frees the cached queue nodes, call it after all the senders stop
+        extern int mem_send_ptr(mem_channel *channel, void *buf, size_t len, mem_ptr_free_fn_t free_fn);
+        extern int mem_recv_ptr(mem_channel *channel, void **buf, size_t *len, mem_ptr_free_fn_t *free_fn);
+        extern void mem_free_ptr(void *buf, size_t len, mem_ptr_free_fn_t free_fn);
+        extern size_t mem_clear_ptr(mem_channel *channel);
+
+        // memory channel - online migration, the receiver publishes the new channel and the senders switch to it at a record boundary
+        // mem_migrate_drained stops waiting for a sender that is still writing after the old channel is empty for
+        // ATBUS_MACRO_MEM_MIGRATE_DRAIN_TIMEOUT seconds, so a crashed sender can not block the switch forever
+        // senders built before online migration ignore the flag and keep writing to the old channel, their data is lost after
+        // the receiver switches, so only migrate when all the senders support it
+        extern int mem_migrate(mem_channel *channel, int64_t key, size_t size);
+        extern bool mem_get_migrate(mem_channel *channel, int64_t *key, size_t *size);
+        extern bool mem_migrate_drained(mem_channel *channel);
         extern std::pair<size_t, size_t> mem_last_action();
         extern void mem_show_channel(mem_channel *channel, std::ostream &out, bool need_node_status, size_t need_node_data);
 
@@ -43,10 +63,27 @@ namespace atbus {
         extern int shm_close(key_t shm_key);
         extern int shm_send(shm_channel *channel, const void *buf, size_t len);
         extern int shm_recv(shm_channel *channel, void *buf, size_t len, size_t *recv_size);
+
+        // online resize: create a larger channel with new_key, and publish it in the header of the old channel
+        // shm_send on the old channel will return EN_ATBUS_ERR_CHANNEL_MIGRATED after that, senders should call
+        // shm_get_migrate and switch to the new channel. The receiver should drain the old channel until
+        // shm_migrate_drained returns true and then close it. The same limits of mem_migrate_drained apply here.
+        extern int shm_migrate(shm_channel *channel, key_t new_key, size_t new_len, shm_channel **new_channel, const shm_conf *conf);
+        extern bool shm_get_migrate(shm_channel *channel, key_t *new_key, size_t *new_len);
+        extern bool shm_migrate_drained(shm_channel *channel);
         extern std::pair<size_t, size_t> shm_last_action();
         extern void shm_show_channel(shm_channel *channel, std::ostream &out, bool need_node_status, size_t need_node_data);
 #endif
 
+#ifdef ATBUS_CHANNEL_SHM_FD
+        // anonymous shared memory channel(memfd), the fd can be sent to another process on the same host by io_stream_send_fd
+        // the memory is released after all the processes closed the fd and called shm_close_fd, the fd can be closed after attached
+        // the size of fd is sealed by shm_init_fd, and shm_attach_fd rejects the fd which can still be shrunk or grown
+        extern int shm_init_fd(size_t len, int *fd, shm_channel **channel, const shm_conf *conf);
+        extern int shm_attach_fd(int fd, shm_channel **channel, const shm_conf *conf);
+        extern int shm_close_fd(shm_channel *channel);
+#endif
+
         // stream channel(tcp,pipe(unix socket) and etc. udp is not a stream)
         extern void io_stream_init_configure(io_stream_conf *conf);
 
@@ -55,6 +92,14 @@ namespace atbus {
         // it will block and wait for all connections are disconnected success.
         extern int io_stream_close(io_stream_channel *channel);
 
+        // disconnect all connections without blocking, pending data is written until timeout milliseconds later
+        // then the remaining connections are closed and their unsent data is dropped
+        // callback is called with EN_ATBUS_ERR_SUCCESS or EN_ATBUS_ERR_CHANNEL_CLOSE_TIMEOUT when all connections and requests finished,
+        // io_stream_close should be called after that(not in the callback) to release the channel, and it returns immediately
+        // if io_stream_close is called before that, the callback is dropped but it still blocks no longer than the timeout
+        extern int io_stream_close_async(io_stream_channel *channel, uint64_t timeout, io_stream_callback_t callback, void *priv_data,
+                                         size_t priv_size);
+
         extern int io_stream_run(io_stream_channel *channel, adapter::run_mode_t mode = adapter::RUN_NOWAIT);
 
         extern int io_stream_listen(io_stream_channel *channel, const channel_address_t &addr, io_stream_callback_t callback,
@@ -63,12 +108,139 @@ namespace atbus {
         extern int io_stream_connect(io_stream_channel *channel, const channel_address_t &addr, io_stream_callback_t callback,
                                      void *priv_data, size_t priv_size);
 
+        // connect to the ipv4/ipv6 addresses one by one every io_stream_conf::connect_attempt_delay milliseconds(happy eyeballs)
+        // the first successful connection is kept and the others are closed, callback is called only once
+        // dns:// addresses resolved to more than one address also connect this way
+        extern int io_stream_connect_any(io_stream_channel *channel, const std::vector<channel_address_t> &addrs,
+                                         io_stream_callback_t callback, void *priv_data, size_t priv_size);
+
         extern int io_stream_disconnect(io_stream_channel *channel, io_stream_connection *connection, io_stream_callback_t callback);
         extern int io_stream_disconnect_fd(io_stream_channel *channel, adapter::fd_t fd, io_stream_callback_t callback);
         extern int io_stream_try_write(io_stream_connection *connection);
+
+        // try to write directly when the connection is idle and EN_FN_WRITEN is not set, EN_FN_WRITEN_BATCH of the frames written
+        // this way is still called in the event loop after io_stream_send returns
         extern int io_stream_send(io_stream_connection *connection, const void *buf, size_t len);
 
+        // send buf without copying it into the send buffer, it's written after the frame head with writev
+        // the ownership of buf will be transferred to the connection only when io_stream_send_ptr returns 0
+        // free_fn is called after buf is written, or dropped when the connection is closed. it's never compressed
+        // len is counted in io_stream_conf::send_buffer_max_size, EN_ATBUS_ERR_BUFF_LIMIT is returned when the limit is exceeded
+        extern int io_stream_send_ptr(io_stream_connection *connection, void *buf, size_t len, mem_ptr_free_fn_t free_fn);
+
+        // control messages are written before all the messages queued by io_stream_send, and they are never delayed by cork
+        // they are queued as normal messages before the switch marker of io_stream_set_checksum is written
+        extern int io_stream_send_ctrl(io_stream_connection *connection, const void *buf, size_t len);
+
+        // send a file descriptor with buf(not empty) by SCM_RIGHTS, only available on unix sockets, fd is duplicated and can be closed
+        // after this call. the receiver should call io_stream_recv_fd when buf is received, the fd must be closed by the receiver
+        // return EN_ATBUS_ERR_NO_DATA if there is no pending fd
+        extern int io_stream_send_fd(io_stream_connection *connection, adapter::fd_t fd, const void *buf, size_t len);
+        extern int io_stream_recv_fd(io_stream_connection *connection, adapter::fd_t *fd);
+
+        // stop reading from the socket until io_stream_resume_read is called, the unread data stays in the kernel buffer and
+        // the flow control of tcp slows down the sender. frames already read are still delivered in the current callback
+        // disconnection by peer is also detected after resuming
+        extern int io_stream_pause_read(io_stream_connection *connection);
+        extern int io_stream_resume_read(io_stream_connection *connection);
+
+        // set checksum type(io_stream_checksum_t::type) of the frames sent after this call
+        // a switch marker is sent before the first new format frame, so it can not be switched back to EN_CS_LEGACY
+        // only call it when the peer supports the new frame format
+        extern int io_stream_set_checksum(io_stream_connection *connection, int checksum_type);
+
+        // supported compression algorithms(bitwise or of io_stream_compress_t::type)
+        extern int io_stream_compress_algorithms();
+
+        // compress frames whose data length is not less than threshold with algorithm(io_stream_compress_t::type)
+        // only available after io_stream_set_checksum switched to the new frame format, and the peer must support the algorithm
+        // EN_FN_WRITEN of a compressed frame will receive the compressed data, EN_FN_WRITEN_BATCH still counts the original length
+        extern int io_stream_set_compression(io_stream_connection *connection, int algorithm, size_t threshold, int level);
+
+        // delay small frames(shorter than size) up to delay microseconds, and write them with one writev
+        // the frames are also written when the delayed data reaches size or io_stream_flush is called. size = 0 disables it
+        extern int io_stream_set_cork(io_stream_connection *connection, size_t size, uint64_t delay);
+
+        // write the delayed frames now
+        extern int io_stream_flush(io_stream_connection *connection);
+        extern int io_stream_flush_all(io_stream_channel *channel);
+
+        // remove the cached dns result of host, or all the cached results if host is NULL
+        // a connection failure also removes the cached results of its address
+        extern int io_stream_flush_dns_cache(io_stream_channel *channel, const char *host);
+
+        // latency histogram of io_stream_connection::latency_stat, values are in microseconds
+        // latency_stat is NULL unless io_stream_conf::enable_latency_stat is set, it's allocated when the first frame is sent
+        // percentile is in [0, 100], the result is the upper bound of the bucket, and is never greater than the max value
+        extern void io_stream_latency_record(io_stream_latency_histogram_t *histogram, uint64_t usec);
+        extern void io_stream_latency_merge(io_stream_latency_histogram_t *dst, const io_stream_latency_histogram_t *src);
+        extern uint64_t io_stream_latency_percentile(const io_stream_latency_histogram_t *histogram, double percentile);
+        extern void io_stream_latency_reset(io_stream_latency_histogram_t *histogram);
+
         extern void io_stream_show_channel(io_stream_channel *channel, std::ostream &out);
+
+        // stream channels running in worker threads, all the callbacks are called in the thread of ev_loop
+        // tcp listen sockets are created in every worker with SO_REUSEPORT, so the kernel spreads connections by hash
+        // unix sockets are listened by the first worker, connect picks the worker by the hash of address
+        extern void io_stream_shard_init_configure(io_stream_shard_conf *conf);
+        extern int io_stream_shard_init(io_stream_shards *shards, adapter::loop_t *ev_loop, const io_stream_shard_conf *conf);
+
+        // stop and join all workers, all connections are closed and no callback will be called after this
+        // pending data is written until io_stream_shard_conf::close_timeout milliseconds later
+        extern int io_stream_shard_close(io_stream_shards *shards);
+
+        // callback is called once with the conn_id of the new connection(0 for listen) when all workers finished it
+        extern int io_stream_shard_listen(io_stream_shards *shards, const channel_address_t &addr, io_stream_shard_callback_t callback,
+                                          void *priv_data, size_t priv_size);
+        extern int io_stream_shard_connect(io_stream_shards *shards, const channel_address_t &addr, io_stream_shard_callback_t callback,
+                                           void *priv_data, size_t priv_size);
+
+        // close the listen sockets of addr in all workers, the connections accepted from them are kept
+        extern int io_stream_shard_close_listen(io_stream_shards *shards, const channel_address_t &addr);
+
+        // buf is copied into the queue of worker, and written by the worker without copying it again
+        // return EN_ATBUS_ERR_BUFF_LIMIT if the worker can not catch up. if the worker fails to send it later(the connection is
+        // closed or its send buffer exceeds stream_conf.send_buffer_max_size), EN_FN_WRITEN is called with the error and the message
+        extern int io_stream_shard_send(io_stream_shards *shards, uint64_t conn_id, const void *buf, size_t len);
+        extern int io_stream_shard_disconnect(io_stream_shards *shards, uint64_t conn_id);
+
+        // same as io_stream_send_ctrl, io_stream_set_checksum, io_stream_set_compression and io_stream_set_cork, but run by the worker
+        // the parameters are checked here, the commands run after the messages sent before them, and are ignored if the
+        // connection is closed. EN_FN_WRITEN is called with the error and the message if the worker fails to send a ctrl message
+        extern int io_stream_shard_send_ctrl(io_stream_shards *shards, uint64_t conn_id, const void *buf, size_t len);
+        extern int io_stream_shard_set_checksum(io_stream_shards *shards, uint64_t conn_id, int checksum_type);
+        extern int io_stream_shard_set_compression(io_stream_shards *shards, uint64_t conn_id, int algorithm, size_t threshold,
+                                                   int level);
+        extern int io_stream_shard_set_cork(io_stream_shards *shards, uint64_t conn_id, size_t size, uint64_t delay);
+
+        // io_stream_pause_read and io_stream_resume_read run by the worker. messages already read by the worker are still received
+        extern int io_stream_shard_pause_read(io_stream_shards *shards, uint64_t conn_id);
+        extern int io_stream_shard_resume_read(io_stream_shards *shards, uint64_t conn_id);
+        extern size_t io_stream_shard_index(uint64_t conn_id);
+
+        // datagram channel(udp), every datagram carries one message with a version byte and a crc32c checksum
+        // messages longer than udp_conf::send_max_size are rejected, invalid datagrams are dropped and counted in udp_channel::stat
+        extern void udp_init_configure(udp_conf *conf);
+        extern int udp_init(udp_channel *channel, adapter::loop_t *ev_loop, const udp_conf *conf);
+
+        // it will block and wait for all sockets are closed, the queued datagrams are sent before closing
+        extern int udp_close(udp_channel *channel);
+
+        // bind a socket to addr(udp://ip:port) and receive datagrams by udp_channel::on_recv
+        extern int udp_listen(udp_channel *channel, const channel_address_t &addr, udp_socket **socket);
+        extern int udp_close_socket(udp_channel *channel, udp_socket *socket);
+
+        // addr is udp://ip:port, host names are not resolved
+        extern int udp_make_peer(const channel_address_t &addr, udp_peer_t *peer);
+
+        // send with the first socket bound to the wildcard address of the same family, or a new one bound to a random port
+        // datagrams are queued and sent by sendmmsg in the next loop or when udp_conf::send_batch datagrams are queued
+        // datagrams are dropped silently when the kernel buffer is full
+        extern int udp_send(udp_channel *channel, const udp_peer_t *peer, const void *buf, size_t len);
+
+        // send with the given socket(of the same channel and family), so the receiver sees its bound address as the source
+        extern int udp_send_from(udp_channel *channel, udp_socket *socket, const udp_peer_t *peer, const void *buf, size_t len);
+        extern int udp_flush(udp_channel *channel);
     }
 }
 
@@ -17,6 +17,7 @@
 #include <stdint.h>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "lock/seq_alloc.h"
 #include "std/smart_ptr.h"
@@ -38,6 +39,11 @@
 #include <sys/shm.h>
 
 #define ATBUS_CHANNEL_SHM 1
+
+// 匿名共享内存(memfd)，描述符可以通过unix socket传递给同机的其他进程
+#if defined(__linux__)
+#define ATBUS_CHANNEL_SHM_FD 1
+#endif
 #else
 #include <Windows.h>
 typedef long key_t;
@@ -59,6 +65,9 @@ namespace atbus {
         struct mem_channel;
         struct mem_conf;
 
+        // 指针传递模式下用于释放数据块的函数，为NULL时使用free
+        typedef void (*mem_ptr_free_fn_t)(void *buf, size_t len);
+
 #ifdef ATBUS_CHANNEL_SHM
         // shared memory channel
         struct shm_channel;
@@ -82,12 +91,80 @@ namespace atbus {
                 EN_FN_DISCONNECTED,
                 EN_FN_RECVED,
                 EN_FN_WRITEN,
+                EN_FN_WRITEN_BATCH, // 一次写请求完成后的汇总回调，额外参数为io_stream_write_stat_t
+                EN_FN_RECVED_BATCH, // 一次读取到的所有消息，额外参数为io_stream_recv_msg_t数组和数量。注册后消息不再通过EN_FN_RECVED回调
                 MAX
             };
             // 回调函数
             io_stream_callback_t callbacks[MAX];
         };
 
+        // 写完成汇总信息
+        struct io_stream_write_stat_t {
+            size_t frame_number; // 消息数量
+            size_t data_size;    // 消息数据长度(不含hash和vint)
+        };
+
+        // 批量接收的消息
+        struct io_stream_recv_msg_t {
+            int errcode; // 错误码
+            void *data;  // 消息数据(地址可能未对齐)
+            size_t size; // 消息长度
+        };
+
+        // 消息校验方式，每个连接的发送端独立设置
+        struct io_stream_checksum_t {
+            enum type {
+                EN_CS_LEGACY = 0, // 旧版本消息格式: 32位murmur hash+vint+data，切换前总是使用这种格式
+                EN_CS_NONE,       // flags+vint+data，不校验
+                EN_CS_MURMUR3,    // flags+32位murmur hash+vint+data
+                EN_CS_CRC32C,     // flags+32位crc32c+vint+data
+                EN_CS_MAX
+            };
+        };
+
+        // 消息压缩算法，按位组合时表示支持的算法集合。只有新格式的消息可以压缩，每个连接的发送端独立设置
+        struct io_stream_compress_t {
+            enum type {
+                EN_CA_NONE = 0,
+                EN_CA_ZLIB = 0x01, // vint(原始长度)+zlib数据
+            };
+        };
+
+        // 压缩统计信息
+        struct io_stream_compress_stat_t {
+            uint64_t compress_times;      // 压缩后发送的消息数量
+            uint64_t compress_skip_times; // 压缩后没有变小，发送原始数据的消息数量
+            uint64_t compress_raw_size;   // 压缩前的数据长度
+            uint64_t compress_size;       // 压缩后的数据长度
+            uint64_t compress_nsec;       // 压缩耗时(纳秒，包含压缩后没有变小的消息)
+            uint64_t decompress_times;    // 解压的消息数量
+            uint64_t decompress_raw_size; // 解压后的数据长度
+            uint64_t decompress_size;     // 解压前的数据长度
+            uint64_t decompress_nsec;     // 解压耗时(纳秒)
+        };
+
+        // 延迟直方图(HDR histogram的简化版)，单位是微秒，相对误差不超过 1/(1 << ATBUS_MACRO_IOS_LATENCY_SUB_BUCKET_BITS)
+        // 小于 1 << ATBUS_MACRO_IOS_LATENCY_SUB_BUCKET_BITS 的值每个值一个区间，之后每个2的幂区间等分成相同数量的区间
+        struct io_stream_latency_histogram_t {
+            enum {
+                SUB_BUCKET_COUNT = 1 << ATBUS_MACRO_IOS_LATENCY_SUB_BUCKET_BITS,
+                BUCKET_COUNT = (ATBUS_MACRO_IOS_LATENCY_MAX_BITS - ATBUS_MACRO_IOS_LATENCY_SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT,
+            };
+
+            uint64_t total_count; // 记录的数量
+            uint64_t total_value; // 记录的值的总和
+            uint64_t min_value;   // 最小值
+            uint64_t max_value;   // 最大值
+            uint32_t counts[BUCKET_COUNT];
+        };
+
+        // 发送延迟统计，从io_stream_send开始计时，只统计发送成功的消息
+        struct io_stream_latency_stat_t {
+            io_stream_latency_histogram_t queue;   // 在发送缓冲区中等待的时间(直到提交给uv_write或被uv_try_write直接发送)
+            io_stream_latency_histogram_t written; // 写请求完成的时间(数据已经被内核接受)
+        };
+
         // 以下不是POD类型，所以不得不暴露出来
         struct io_stream_connection {
             typedef enum {
@@ -96,6 +173,8 @@ namespace atbus {
                 EN_CF_ACCEPT,
                 EN_CF_WRITING,
                 EN_CF_CLOSING,
+                EN_CF_CORKED,      // 有延迟合并发送的数据，连接在channel的cork_fds里
+                EN_CF_READ_PAUSED, // 暂停读取，数据留在内核缓冲区里，由TCP的流量控制让对端减慢发送
                 EN_CF_MAX,
             } flag_t;
 
@@ -117,13 +196,39 @@ namespace atbus {
                                                  /**
                                                   * @brief 由于大多数数据包都比较小
                                                   *        当数据包比较小时和动态直接放在动态int的数据包一起，这样可以减少内存拷贝次数
+                                                  *        这块缓冲区只在有未处理完的数据时持有，从channel的缓存池分配，大小根据最近收到的消息调整
                                                   */
             typedef struct {
-                char buffer[ATBUS_MACRO_DATA_SMALL_SIZE]; // varint数据暂存区和小数据包存储区
-                size_t len;                               // varint数据暂存区和小数据包存储区已使用长度
+                char *buffer;           // varint数据暂存区和小数据包存储区
+                size_t len;             // varint数据暂存区和小数据包存储区已使用长度
+                size_t level;           // 缓冲区长度为ATBUS_MACRO_DATA_SMALL_SIZE << level
+                size_t expect_level;    // 期望的缓冲区等级，收到较大的消息时立即扩大，采样周期结束后才会缩小
+                size_t sample_max_size; // 本采样周期内最大的消息长度(包含消息头)
+                size_t sample_times;    // 本采样周期内的读取次数
             } read_head_t;
             read_head_t read_head;
+            uint64_t read_times;                           // 读到数据的次数(每次是一次read系统调用)
             ::atbus::detail::buffer_manager write_buffers; // 写数据缓冲区(两种Buffer管理方式，一种动态，一种静态)
+            size_t writing_req_number;                     // 正在进行的写请求数量(libuv按顺序完成写请求)
+            size_t writing_block_number;                   // write_buffers头部已经提交给写请求的数据块数量
+            size_t write_head_offset;                      // 第一个数据块中已经被uv_try_write直接发送的长度
+            size_t write_ext_size;                         // 发送缓冲区里不复制的消息数据的总长度，也计入发送缓冲区的大小限制
+            io_stream_write_stat_t try_written_stat;       // 被uv_try_write直接发送完的消息，EN_FN_WRITEN_BATCH推迟到事件循环中回调
+            ::atbus::detail::buffer_manager ctrl_write_buffers; // 控制消息的写数据缓冲区，优先于write_buffers发送
+            size_t ctrl_writing_block_number;                  // ctrl_write_buffers头部已经提交给写请求的数据块数量
+            size_t ctrl_write_barrier; // write_buffers头部必须先于控制消息发送的数据块数量(切换消息格式前的消息和切换标记)
+            bool write_head_ctrl;      // write_head_offset是否是ctrl_write_buffers的数据块
+            int send_checksum;                             // 发送消息的校验方式(io_stream_checksum_t::type)
+            bool recv_frame_flags;                         // 是否已收到切换标记，之后接收的消息头都带flags
+            int send_compress;                             // 发送消息的压缩算法(io_stream_compress_t::type)
+            size_t send_compress_threshold;                // 数据长度不小于这个值的消息才压缩
+            int send_compress_level;                       // 压缩等级，由压缩算法解释
+            io_stream_compress_stat_t compress_stat;       // 压缩统计信息
+            std::unique_ptr<io_stream_latency_stat_t> latency_stat; // 发送延迟统计，开启enable_latency_stat后第一次用到时才分配
+            size_t cork_size;                              // 延迟合并发送的数据长度上限，0则不延迟
+            uint64_t cork_delay;                           // 延迟合并发送的最长时间(微秒)
+            size_t corked_size;                            // 已延迟的数据长度
+            uint64_t cork_deadline;                        // 延迟数据的发送时间(uv_hrtime，纳秒)
 
             // 自定义数据区域
             void *data;
@@ -134,17 +239,57 @@ namespace atbus {
 
             bool is_noblock;
             bool is_nodelay;
+            bool is_reuse_port; // 监听时启用SO_REUSEPORT，多个channel可以监听同一个地址并由内核分配新连接
             size_t send_buffer_static;
             size_t recv_buffer_static;
             size_t send_buffer_max_size;
             size_t send_buffer_limit_size;
             size_t recv_buffer_max_size;
             size_t recv_buffer_limit_size;
+            size_t send_window_size;      // 每个连接同时进行的写请求数量上限
+            size_t recv_head_pool_number; // 每种长度的小数据包缓冲区最多缓存的数量
+            size_t object_pool_number;    // 每种长度的连接对象和libuv handle最多缓存的数量
+            size_t send_cork_size;        // 新连接的延迟合并发送的数据长度上限，小于这个长度的消息会延迟发送，0则不延迟
+            uint64_t send_cork_delay;     // 新连接的延迟合并发送的最长时间(微秒)，0则在下一次事件循环发送
+
+            // tcp socket的内核参数，在connect和accept的连接上都会设置，0表示使用系统默认值
+            size_t sock_send_buffer;   // SO_SNDBUF
+            size_t sock_recv_buffer;   // SO_RCVBUF，要在连接建立前设置才会影响窗口扩大因子，所以监听的socket也会设置
+            int sock_busy_poll;        // SO_BUSY_POLL(微秒)，设置的值超过net.core.busy_read需要CAP_NET_ADMIN
+            size_t sock_notsent_lowat; // TCP_NOTSENT_LOWAT
+            int sock_tos;              // IP_TOS或IPV6_TCLASS
+            bool is_quickack;          // TCP_QUICKACK，内核会自动关闭它，所以每次读取数据后会重新设置
+
+            bool enable_latency_stat; // 统计连接的发送延迟，每个消息发送时要多取一次时间
+
+            time_t dns_cache_ttl;           // 域名解析结果的缓存时间(秒)，0则不缓存
+            time_t dns_negative_cache_ttl;  // 域名解析失败的缓存时间(秒)，缓存期间connect和listen直接返回解析失败
+            uint64_t connect_attempt_delay; // 连接多个地址时依次发起连接的间隔(毫秒)，第一个成功的连接生效，0则同时连接所有地址
 
             time_t confirm_timeout;
             int backlog; // backlog indicates the number of connections the kernel might queue
         };
 
+        // 域名解析结果的缓存，status不为0时是解析失败的缓存
+        struct io_stream_dns_record_t {
+            std::string scheme; // ipv4或ipv6
+            std::string host;   // 解析出的ip
+            int status;         // libuv的错误码
+            uint64_t expire_ms; // 过期时间(uv_now)
+        };
+
+        // 连接对象(和shared_ptr的引用计数分配在一起)和libuv handle的缓存池，按长度分组
+        // 每个未释放的对象都持有一个引用，channel关闭后由最后释放的对象删除缓存池。只能在channel的线程中使用
+        struct io_stream_object_pool {
+            size_t ref_count;
+            size_t max_number; // 每种长度最多缓存的数量，channel关闭后为0
+            size_t alloc_times;
+            size_t reuse_times;
+
+            typedef std::vector<std::pair<size_t, std::vector<void *> > > free_list_t;
+            free_list_t free_blocks;
+        };
+
         struct io_stream_channel {
             typedef enum {
                 EN_CF_IS_LOOP_OWNER = 0,
@@ -166,6 +311,38 @@ namespace atbus {
             // 事件响应
             io_stream_callback_evt_t evt;
 
+            // 连接的小数据包缓冲区(read_head)缓存池，按长度等级分组
+            typedef std::vector<char *> read_head_pool_t;
+            read_head_pool_t read_head_pool[ATBUS_MACRO_IOS_READ_HEAD_LEVELS];
+
+            // 连接对象和libuv handle的缓存池(第一次使用时创建)
+            io_stream_object_pool *object_pool;
+
+            // 域名解析结果的缓存，key是域名
+            typedef ATBUS_ADVANCE_TYPE_MAP(std::string, io_stream_dns_record_t) dns_cache_t;
+            dns_cache_t dns_cache;
+
+            // 压缩和解压的临时缓冲区，解压的数据在接收回调返回前有效
+            std::vector<char> compress_buffer;
+            std::vector<char> decompress_buffer;
+
+            // 延迟合并发送的定时器(第一次使用时创建)和有延迟数据的连接
+            adapter::timer_t *cork_timer;
+            uint64_t cork_timer_deadline;
+            std::vector<adapter::fd_t> cork_fds;
+
+            // 直接发送完的消息的写完成回调推迟到下一次事件循环，避免回调在io_stream_send里重入(定时器第一次使用时创建)
+            adapter::timer_t *written_timer;
+            std::vector<adapter::fd_t> written_fds;
+
+            // 异步关闭(io_stream_close_async)的定时器和完成回调，定时器为NULL时没有进行中的异步关闭
+            adapter::timer_t *close_timer;
+            uint64_t close_deadline; // uv_now，毫秒
+            bool is_close_forced;    // 超时后强制关闭了连接
+            io_stream_callback_t close_callback;
+            void *close_priv_data;
+            size_t close_priv_size;
+
             int error_code; // 记录外部的错误码
             // 统计信息
             util::lock::seq_alloc_u32 active_reqs; // 正在进行的req数量
@@ -174,6 +351,119 @@ namespace atbus {
             void *data;
         };
 
+        // 多线程的stream channel，每个工作线程有独立的事件循环和io_stream_channel，连接固定在一个工作线程上
+        // 逻辑线程和工作线程之间通过无锁队列(指针传递模式的mem_channel)传递消息和请求，回调都在逻辑线程中执行
+        struct io_stream_shards;
+        struct io_stream_shard_worker;
+        typedef void (*io_stream_shard_callback_t)(io_stream_shards *shards, // 事件触发的shards
+                                                   uint64_t conn_id,         // 连接ID，低16位是工作线程的序号，失败时为0
+                                                   int status,               // 错误码
+                                                   void *,                   // 额外参数(不同事件不同含义)
+                                                   size_t s                  // 额外参数长度
+                                                   );
+
+        struct io_stream_shard_conf {
+            size_t shard_number;        // 工作线程数量，最多65535个
+            size_t queue_size;          // 逻辑线程和每个工作线程之间每个方向的消息队列的内存大小，未处理的数据超过时发送失败
+            uint64_t close_timeout;     // 关闭时等待连接发送剩余数据的最长时间(毫秒)
+            io_stream_conf stream_conf; // 工作线程的io_stream_channel的配置，多个工作线程时总是启用is_reuse_port
+                                        // send_buffer_max_size为0时使用queue_size
+        };
+
+        struct io_stream_shards {
+            adapter::loop_t *ev_loop; // 逻辑线程的事件循环
+            adapter::async_t *notify; // 工作线程有新事件时唤醒逻辑线程
+            io_stream_shard_conf conf;
+            std::vector<io_stream_shard_worker *> workers;
+
+            // 事件响应，只有EN_FN_ACCEPTED、EN_FN_CONNECTED、EN_FN_DISCONNECTED、EN_FN_RECVED和EN_FN_WRITEN有效
+            // EN_FN_ACCEPTED的额外参数是对端地址，EN_FN_WRITEN只在工作线程发送失败时回调，额外参数是发送失败的消息
+            io_stream_shard_callback_t callbacks[io_stream_callback_evt_t::MAX];
+
+            // 自定义数据区域
+            void *data;
+        };
+
+        // datagram channel(udp)，每个数据报是一条完整的消息，不保证送达和顺序，适合可以丢弃的实时数据
+        struct udp_socket;
+        struct udp_channel;
+        typedef void (*udp_callback_t)(udp_channel *channel,  // 事件触发的channel
+                                       udp_socket *socket,    // 收到数据的socket
+                                       const sockaddr *addr,  // 发送方地址，出错时为NULL
+                                       int status,            // 错误码，libuv的错误码在channel->error_code里
+                                       void *,                // 数据
+                                       size_t s               // 数据长度
+                                       );
+
+        // 发送目标地址，由udp_make_peer生成(只支持ip地址，不解析域名)
+        struct udp_peer_t {
+            sockaddr_storage addr;
+        };
+
+        struct udp_conf {
+            size_t send_max_size;    // 一个数据报的最大数据长度(不包含消息头)，超过的发送失败。默认不会在以太网上分片
+            size_t recv_max_size;    // 接收的最大数据长度(不包含消息头)，超过的数据报被丢弃
+            size_t send_batch;       // 合并发送(sendmmsg)的最大数据报数量，达到后立即发送，否则在下一次事件循环发送。1则不合并
+            size_t recv_batch;       // 一次读取(recvmmsg)的最大数据报数量，libuv不支持时总是1
+            size_t sock_send_buffer; // SO_SNDBUF，0表示使用系统默认值
+            size_t sock_recv_buffer; // SO_RCVBUF，0表示使用系统默认值
+        };
+
+        struct udp_stat_t {
+            size_t send_times;       // 交给内核的数据报数量
+            size_t send_size;        // 交给内核的数据长度(不包含消息头)
+            size_t send_batch_times; // 合并发送的系统调用次数
+            size_t send_drop_times;  // 因为内核缓冲区满或者其他错误被丢弃的数据报数量
+            size_t recv_times;       // 收到的有效数据报数量
+            size_t recv_size;        // 收到的有效数据长度(不包含消息头)
+            size_t recv_drop_times;  // 因为长度、消息头或校验错误被丢弃的数据报数量
+        };
+
+        // 等待合并发送的数据报，数据在udp_socket::send_buffer里
+        struct udp_send_block_t {
+            size_t offset;
+            size_t len; // 包含消息头
+            udp_peer_t peer;
+        };
+
+        struct udp_socket {
+            channel_address_t addr; // 绑定的地址，发送时自动创建的socket端口为0
+            adapter::udp_t *handle;
+            int family; // AF_INET或AF_INET6
+            udp_channel *channel;
+
+            std::vector<char> send_buffer;             // 等待合并发送的数据报(消息头+数据)
+            std::vector<udp_send_block_t> send_blocks; // 等待合并发送的数据报
+
+            // 自定义数据区域
+            void *data;
+        };
+
+        struct udp_channel {
+            adapter::loop_t *ev_loop;
+            udp_conf conf;
+
+            // 按创建顺序排列，发送时使用第一个地址族相同并且绑定到通配地址的socket
+            typedef std::vector<std::shared_ptr<udp_socket> > socket_pool_t;
+            socket_pool_t socket_pool;
+
+            // 所有socket共用的接收缓冲区，启用recvmmsg时由libuv按64KB分块
+            std::vector<char> recv_buffer;
+
+            // 合并发送的定时器(第一次使用时创建)
+            adapter::timer_t *flush_timer;
+
+            // 事件响应
+            udp_callback_t on_recv;
+
+            udp_stat_t stat;
+            int error_code; // 记录外部的错误码
+            util::lock::seq_alloc_u32 active_reqs; // 正在关闭的handle数量
+
+            // 自定义数据区域
+            void *data;
+        };
+
 #define ATBUS_CHANNEL_IOS_CHECK_FLAG(f, v) (0 != ((f) & (1 << (v))))
 #define ATBUS_CHANNEL_IOS_SET_FLAG(f, v) (f) |= (1 << (v))
 #define ATBUS_CHANNEL_IOS_UNSET_FLAG(f, v) (f) &= ~(1 << (v))
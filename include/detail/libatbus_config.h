@@ -26,6 +26,28 @@
 #define ATBUS_MACRO_DATA_SMALL_SIZE 512
 #endif
 
+#ifndef ATBUS_MACRO_IOS_READ_HEAD_LEVELS
+#define ATBUS_MACRO_IOS_READ_HEAD_LEVELS 6
+#endif
+
+#ifndef ATBUS_MACRO_IOS_WRITEV_MAX_BUFS
+#define ATBUS_MACRO_IOS_WRITEV_MAX_BUFS 64
+#endif
+
+#ifndef ATBUS_MACRO_IOS_RECV_BATCH_NUMBER
+#define ATBUS_MACRO_IOS_RECV_BATCH_NUMBER 64
+#endif
+
+// io_stream发送延迟直方图的每个2的幂区间再分成 1 << ATBUS_MACRO_IOS_LATENCY_SUB_BUCKET_BITS 份
+#ifndef ATBUS_MACRO_IOS_LATENCY_SUB_BUCKET_BITS
+#define ATBUS_MACRO_IOS_LATENCY_SUB_BUCKET_BITS 3
+#endif
+
+// io_stream发送延迟直方图记录的最大值(微秒)为 (1 << ATBUS_MACRO_IOS_LATENCY_MAX_BITS) - 1，更大的值记录在最后一个区间
+#ifndef ATBUS_MACRO_IOS_LATENCY_MAX_BITS
+#define ATBUS_MACRO_IOS_LATENCY_MAX_BITS 36
+#endif
+
 #if defined(__cplusplus) &&                                                                                         \
     (__cplusplus >= 201103L || (defined(_MSC_VER) && (_MSC_VER == 1500 && defined(_HAS_TR1)) || _MSC_VER > 1500) || \
      (defined(__GNUC__) && defined(__GXX_EXPERIMENTAL_CXX0X__)))
@@ -34,6 +34,8 @@ typedef enum {
     EN_ATBUS_ERR_CHANNEL_BUFFER_INVALID = -102, // 缓冲区错误（已被其他模块使用或检测冲突）
     EN_ATBUS_ERR_CHANNEL_ADDR_INVALID = -103,   // 地址错误
     EN_ATBUS_ERR_CHANNEL_CLOSING = -104,        // 正在关闭
+    EN_ATBUS_ERR_CHANNEL_MIGRATED = -105,       // 通道已迁移（发送端需要切换到新通道）
+    EN_ATBUS_ERR_CHANNEL_CLOSE_TIMEOUT = -106,  // 关闭超时（剩余的连接被强制关闭，未发送的数据被丢弃）
 
     EN_ATBUS_ERR_NODE_BAD_BLOCK_NODE_NUM = -202,  // 发现写坏的数据块 - 节点数量错误
     EN_ATBUS_ERR_NODE_BAD_BLOCK_BUFF_SIZE = -203, // 发现写坏的数据块 - 节点数量错误
@@ -52,6 +54,7 @@ typedef enum {
     EN_ATBUS_ERR_PIPE_BIND_FAILED = -501,    // 绑定地址或端口失败
     EN_ATBUS_ERR_PIPE_LISTEN_FAILED = -502,  // 监听失败
     EN_ATBUS_ERR_PIPE_CONNECT_FAILED = -503, // 连接失败
+    EN_ATBUS_ERR_PIPE_FD_PASS_FAILED = -504, // 传递文件描述符失败
 
     EN_ATBUS_ERR_DNS_GETADDR_FAILED = -601,   // DNS解析失败
     EN_ATBUS_ERR_CONNECTION_NOT_FOUND = -602, // 找不到连接
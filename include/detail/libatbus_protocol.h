@@ -25,12 +25,20 @@ enum ATBUS_PROTOCOL_CMD {
     ATBUS_CMD_NODE_CONN_SYN,
     ATBUS_CMD_NODE_PING,
     ATBUS_CMD_NODE_PONG,
+    ATBUS_CMD_NODE_SHM_FD_REQ, // 同机unix socket连接升级为匿名共享内存通道，消息附带接收通道的描述符
+    ATBUS_CMD_NODE_SHM_FD_RSP,
 
     ATBUS_CMD_MAX
 };
 
 MSGPACK_ADD_ENUM(ATBUS_PROTOCOL_CMD);
 
+// io_stream通道支持的消息格式版本
+enum ATBUS_PROTOCOL_IO_FRAME_VERSION {
+    ATBUS_IO_FRAME_VERSION_LEGACY = 0, // 32位murmur hash+vint+data
+    ATBUS_IO_FRAME_VERSION_FLAGS = 1,  // 支持flags+校验和格式，可以切换校验方式
+};
+
 namespace atbus {
     namespace protocol {
 #ifndef ATBUS_MACRO_BUSID_TYPE
@@ -198,11 +206,16 @@ namespace atbus {
             std::vector<channel_data> channels; // ID: 3
             uint32_t children_id_mask;          // ID: 4
             uint32_t flags;                     // ID: 5
+            uint32_t io_frame_version;          // ID: 6 (旧版本没有这个字段，解包后为0)
+            uint32_t io_compress_algorithms;    // ID: 7 (支持的压缩算法, channel::io_stream_compress_t::type的组合)
+            uint32_t shm_fd_upgrade;            // ID: 8 (非0表示支持通过ATBUS_CMD_NODE_SHM_FD_REQ升级为共享内存通道)
 
 
-            reg_data() : bus_id(0), pid(0), children_id_mask(0), flags(0){}
+            reg_data() : bus_id(0), pid(0), children_id_mask(0), flags(0), io_frame_version(ATBUS_IO_FRAME_VERSION_LEGACY),
+                          io_compress_algorithms(0), shm_fd_upgrade(0) {}
 
-            MSGPACK_DEFINE(bus_id, pid, hostname, channels, children_id_mask, flags);
+            MSGPACK_DEFINE(bus_id, pid, hostname, channels, children_id_mask, flags, io_frame_version, io_compress_algorithms,
+                           shm_fd_upgrade);
 
             template <typename CharT, typename Traits>
             friend std::basic_ostream<CharT, Traits> &operator<<(std::basic_ostream<CharT, Traits> &os, const reg_data &mbc) {
@@ -215,6 +228,9 @@ namespace atbus {
                 }
                 os << "      children_id_mask: " << mbc.children_id_mask << std::endl
                    << "      flags: " << mbc.flags << std::endl
+                   << "      io_frame_version: " << mbc.io_frame_version << std::endl
+                   << "      io_compress_algorithms: " << mbc.io_compress_algorithms << std::endl
+                   << "      shm_fd_upgrade: " << mbc.shm_fd_upgrade << std::endl
                    << "    }";
 
                 return os;
@@ -456,7 +472,9 @@ namespace msgpack {
                             break;
                         }
 
-                        case ATBUS_CMD_NODE_CONN_SYN: {
+                        case ATBUS_CMD_NODE_CONN_SYN:
+                        case ATBUS_CMD_NODE_SHM_FD_REQ:
+                        case ATBUS_CMD_NODE_SHM_FD_RSP: {
                             body_obj.convert(*v.body.make_body(v.body.conn));
                             break;
                         }
@@ -528,7 +546,9 @@ namespace msgpack {
                         break;
                     }
 
-                    case ATBUS_CMD_NODE_CONN_SYN: {
+                    case ATBUS_CMD_NODE_CONN_SYN:
+                    case ATBUS_CMD_NODE_SHM_FD_REQ:
+                    case ATBUS_CMD_NODE_SHM_FD_RSP: {
                         if (NULL == v.body.conn) {
                             o.pack_nil();
                         } else {
@@ -609,7 +629,9 @@ namespace msgpack {
                         break;
                     }
 
-                    case ATBUS_CMD_NODE_CONN_SYN: {
+                    case ATBUS_CMD_NODE_CONN_SYN:
+                    case ATBUS_CMD_NODE_SHM_FD_REQ:
+                    case ATBUS_CMD_NODE_SHM_FD_RSP: {
                         if (NULL == v.body.conn) {
                             o.via.map.ptr[1].val = msgpack::object();
                         } else {
@@ -8,6 +8,8 @@ add_compiler_define(ATBUS_MACRO_BUSID_TYPE=${ATBUS_MACRO_BUSID_TYPE})
 add_compiler_define(ATBUS_MACRO_DATA_NODE_SIZE=${ATBUS_MACRO_DATA_NODE_SIZE})
 add_compiler_define(ATBUS_MACRO_DATA_ALIGN_TYPE=${ATBUS_MACRO_DATA_ALIGN_TYPE})
 add_compiler_define(ATBUS_MACRO_DATA_SMALL_SIZE=${ATBUS_MACRO_DATA_SMALL_SIZE})
+add_compiler_define(ATBUS_MACRO_IOS_READ_HEAD_LEVELS=${ATBUS_MACRO_IOS_READ_HEAD_LEVELS})
+add_compiler_define(ATBUS_MACRO_IOS_WRITEV_MAX_BUFS=${ATBUS_MACRO_IOS_WRITEV_MAX_BUFS})
 add_compiler_define(ATBUS_MACRO_HUGETLB_SIZE=${ATBUS_MACRO_HUGETLB_SIZE})
 add_compiler_define(ATBUS_MACRO_MSG_LIMIT=${ATBUS_MACRO_MSG_LIMIT})
 add_compiler_define(ATBUS_MACRO_CONNECTION_CONFIRM_TIMEOUT=${ATBUS_MACRO_CONNECTION_CONFIRM_TIMEOUT})
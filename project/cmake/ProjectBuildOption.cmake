@@ -11,12 +11,20 @@ set(ATBUS_MACRO_DATA_ALIGN_TYPE "uint64_t" CACHE STRING "memory align type(used
 # so we use 3KB for small message buffer, and left about 500 Bytes in feture use.
 # This can be 512 or smaller (but not smaller than 32), but in most server environment, memory is cheap and there are only few connections between server and server. 
 set(ATBUS_MACRO_DATA_SMALL_SIZE 3072 CACHE STRING "small message buffer for io_stream channel(used to reduce memory copy when there are many small messages)")
+# The small message buffer is allocated only when there is unprocessed data,
+# and its size is adjusted between ATBUS_MACRO_DATA_SMALL_SIZE and ATBUS_MACRO_DATA_SMALL_SIZE << (ATBUS_MACRO_IOS_READ_HEAD_LEVELS - 1)
+set(ATBUS_MACRO_IOS_READ_HEAD_LEVELS 6 CACHE STRING "size levels of small message buffer for io_stream channel")
+
+set(ATBUS_MACRO_IOS_WRITEV_MAX_BUFS 64 CACHE STRING "max buffer number of one writev in io_stream channel")
 
 set(ATBUS_MACRO_HUGETLB_SIZE 4194304 CACHE STRING "huge page size in shared memory channel(unused now)")
 set(ATBUS_MACRO_MSG_LIMIT 65536 CACHE STRING "message size limie")
 set(ATBUS_MACRO_CONNECTION_CONFIRM_TIMEOUT 30 CACHE STRING "connection confirm timeout")
 set(ATBUS_MACRO_CONNECTION_BACKLOG 128 CACHE STRING "tcp backlog")
 
+# 可选依赖，找不到时关闭对应功能
+option(ATBUS_MACRO_ENABLE_ZLIB "Enable zlib compression of io_stream frames when zlib is found." ON)
+
 # libuv选项
 set(LIBUV_ROOT "" CACHE STRING "libuv root directory")
 
@@ -50,6 +50,94 @@ namespace atbus {
                 return *this;
             }
         };
+
+        static bool udp_compare_host(const sockaddr *l, const sockaddr *r) {
+            if (l->sa_family != r->sa_family) {
+                return false;
+            }
+
+            if (AF_INET == l->sa_family) {
+                const sockaddr_in *l_in = reinterpret_cast<const sockaddr_in *>(l);
+                const sockaddr_in *r_in = reinterpret_cast<const sockaddr_in *>(r);
+                return l_in->sin_addr.s_addr == r_in->sin_addr.s_addr;
+            }
+
+            if (AF_INET6 == l->sa_family) {
+                const sockaddr_in6 *l_in6 = reinterpret_cast<const sockaddr_in6 *>(l);
+                const sockaddr_in6 *r_in6 = reinterpret_cast<const sockaddr_in6 *>(r);
+                return 0 == memcmp(&l_in6->sin6_addr, &r_in6->sin6_addr, sizeof(in6_addr));
+            }
+
+            return false;
+        }
+
+        // 监听通配地址时来源ip必须和控制连接的对端ip一致，控制连接是unix socket(同机)时只接受本地回环地址
+        static bool udp_check_source_host(node &n, endpoint &ep, const sockaddr *addr) {
+            const endpoint *self = n.get_self_endpoint();
+            const connection *ctrl_conn = NULL == self ? NULL : self->get_ctrl_connection(&ep);
+            if (NULL == ctrl_conn) {
+                return false;
+            }
+
+            const channel::channel_address_t &ctrl_addr = ctrl_conn->get_address();
+            if (0 == UTIL_STRFUNC_STRNCASE_CMP("unix", ctrl_addr.scheme.c_str(), 4)) {
+                if (AF_INET == addr->sa_family) {
+                    return 127 == (ntohl(reinterpret_cast<const sockaddr_in *>(addr)->sin_addr.s_addr) >> 24);
+                }
+                return AF_INET6 == addr->sa_family && IN6_IS_ADDR_LOOPBACK(&reinterpret_cast<const sockaddr_in6 *>(addr)->sin6_addr);
+            }
+
+            channel::channel_address_t host_addr;
+            channel::udp_peer_t host_peer;
+            channel::make_address("udp", ctrl_addr.host.c_str(), 0, host_addr);
+            if (channel::udp_make_peer(host_addr, &host_peer) < 0) {
+                return false;
+            }
+
+            return udp_compare_host(reinterpret_cast<const sockaddr *>(&host_peer.addr), addr);
+        }
+
+        // 数据报的来源地址必须是对端注册时的udp监听地址
+        static bool udp_check_source(node &n, endpoint &ep, const sockaddr *addr) {
+            const std::list<std::string> &listen_addrs = ep.get_listen();
+            for (std::list<std::string>::const_iterator iter = listen_addrs.begin(); iter != listen_addrs.end(); ++iter) {
+                if (0 != UTIL_STRFUNC_STRNCASE_CMP("udp:", iter->c_str(), 4)) {
+                    continue;
+                }
+
+                channel::channel_address_t listen_addr;
+                channel::udp_peer_t listen_peer;
+                if (!channel::make_address(iter->c_str(), listen_addr) || channel::udp_make_peer(listen_addr, &listen_peer) < 0) {
+                    continue;
+                }
+
+                const sockaddr *expect = reinterpret_cast<const sockaddr *>(&listen_peer.addr);
+                bool is_any_host = false;
+                if (AF_INET == addr->sa_family && AF_INET == expect->sa_family) {
+                    const sockaddr_in *src_in = reinterpret_cast<const sockaddr_in *>(addr);
+                    const sockaddr_in *expect_in = reinterpret_cast<const sockaddr_in *>(expect);
+                    if (src_in->sin_port != expect_in->sin_port) {
+                        continue;
+                    }
+                    is_any_host = INADDR_ANY == expect_in->sin_addr.s_addr;
+                } else if (AF_INET6 == addr->sa_family && AF_INET6 == expect->sa_family) {
+                    const sockaddr_in6 *src_in6 = reinterpret_cast<const sockaddr_in6 *>(addr);
+                    const sockaddr_in6 *expect_in6 = reinterpret_cast<const sockaddr_in6 *>(expect);
+                    if (src_in6->sin6_port != expect_in6->sin6_port) {
+                        continue;
+                    }
+                    is_any_host = 0 != IN6_IS_ADDR_UNSPECIFIED(&expect_in6->sin6_addr);
+                } else {
+                    continue;
+                }
+
+                if (is_any_host ? udp_check_source_host(n, ep, addr) : udp_compare_host(expect, addr)) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
     }
 
     connection::connection() : state_(state_t::DISCONNECTED), owner_(NULL), binding_(NULL) {
@@ -119,6 +207,11 @@ namespace atbus {
             return 0;
         }
 
+        // 内存和共享内存通道暂停读取时数据留在通道里，通道满了以后对端发送失败
+        if (NULL != binding_ && binding_->get_flag(endpoint::flag_t::READ_PAUSED)) {
+            return 0;
+        }
+
         if (NULL != conn_data_.proc_fn) {
             return conn_data_.proc_fn(n, *this, sec, usec);
         }
@@ -194,6 +287,27 @@ namespace atbus {
             state_ = state_t::CONNECTED;
             ATBUS_FUNC_NODE_DEBUG(*owner_, get_binding(), this, NULL, "channel connected(listen)");
 
+            return res;
+        } else if (0 == UTIL_STRFUNC_STRNCASE_CMP("udp", address_.scheme.c_str(), 3)) {
+            channel::udp_channel *udp_chann = owner_->get_udp_channel();
+            if (NULL == udp_chann) {
+                return EN_ATBUS_ERR_NOT_INITED;
+            }
+
+            channel::udp_socket *socket = NULL;
+            int res = channel::udp_listen(udp_chann, address_, &socket);
+            if (res < 0) {
+                return res;
+            }
+
+            // 数据报在事件循环里回调，不需要加入轮询队列
+            conn_data_.free_fn = udp_free_fn;
+            conn_data_.shared.udp.socket = socket;
+            socket->data = this;
+            flags_.set(flag_t::UNRELIABLE, true);
+            state_ = state_t::CONNECTED;
+            ATBUS_FUNC_NODE_DEBUG(*owner_, get_binding(), this, NULL, "channel connected(listen)");
+
             return res;
         } else {
             detail::connection_async_data *async_data = new detail::connection_async_data(owner_);
@@ -204,7 +318,18 @@ namespace atbus {
             async_data->conn = self;
 
             state_ = state_t::CONNECTING;
-            int res = channel::io_stream_listen(owner_->get_iostream_channel(), address_, iostream_on_listen_cb, async_data, 0);
+            // unix socket还要在ev_loop中传递描述符，只有tcp连接放到I/O线程中收发数据
+            channel::io_stream_shards *shards = NULL;
+            if (0 != UTIL_STRFUNC_STRNCASE_CMP("unix", address_.scheme.c_str(), 4)) {
+                shards = owner_->get_iostream_shards();
+            }
+
+            int res;
+            if (NULL != shards) {
+                res = channel::io_stream_shard_listen(shards, address_, iostream_shard_on_listen_cb, async_data, 0);
+            } else {
+                res = channel::io_stream_listen(owner_->get_iostream_channel(), address_, iostream_on_listen_cb, async_data, 0);
+            }
             if (res < 0) {
                 delete async_data;
                 return res;
@@ -244,12 +369,15 @@ namespace atbus {
             conn_data_.proc_fn = mem_proc_fn;
             conn_data_.free_fn = mem_free_fn;
             conn_data_.push_fn = mem_push_fn;
+            conn_data_.push_ptr_fn = mem_push_ptr_fn;
 
             // 连接信息
             conn_data_.shared.mem.channel = mem_chann;
             conn_data_.shared.mem.buffer = reinterpret_cast<void *>(ad);
             conn_data_.shared.mem.len = conf.recv_buffer_size;
             flags_.set(flag_t::REG_PROC, true);
+            flags_.set(flag_t::ACCESS_SHARE_ADDR, true);
+            flags_.set(flag_t::ACCESS_SHARE_HOST, true);
             if (NULL == binding_) {
                 state_ = state_t::HANDSHAKING;
                 ATBUS_FUNC_NODE_DEBUG(*owner_, binding_, this, NULL, "channel handshaking(connect)");
@@ -282,6 +410,32 @@ namespace atbus {
             conn_data_.shared.shm.len = conf.recv_buffer_size;
 
             flags_.set(flag_t::REG_PROC, true);
+            flags_.set(flag_t::ACCESS_SHARE_HOST, true);
+            if (NULL == binding_) {
+                state_ = state_t::HANDSHAKING;
+                ATBUS_FUNC_NODE_DEBUG(*owner_, binding_, this, NULL, "channel handshaking(connect)");
+            } else {
+                state_ = state_t::CONNECTED;
+                ATBUS_FUNC_NODE_DEBUG(*owner_, binding_, this, NULL, "channel connected(connect)");
+            }
+
+            return res;
+        } else if (0 == UTIL_STRFUNC_STRNCASE_CMP("udp", address_.scheme.c_str(), 3)) {
+            // redirect loopback address to local address
+            if ("0.0.0.0" == address_.host) {
+                make_address("udp", "127.0.0.1", address_.port, address_);
+            } else if ("::" == address_.host) {
+                make_address("udp", "::1", address_.port, address_);
+            }
+
+            int res = channel::udp_make_peer(address_, &conn_data_.shared.udp.peer);
+            if (res < 0) {
+                return res;
+            }
+
+            // 无连接的通道，发送socket由udp通道管理
+            conn_data_.push_fn = udp_push_fn;
+            flags_.set(flag_t::UNRELIABLE, true);
             if (NULL == binding_) {
                 state_ = state_t::HANDSHAKING;
                 ATBUS_FUNC_NODE_DEBUG(*owner_, binding_, this, NULL, "channel handshaking(connect)");
@@ -307,7 +461,17 @@ namespace atbus {
             async_data->conn = self;
 
             state_ = state_t::CONNECTING;
-            int res = channel::io_stream_connect(owner_->get_iostream_channel(), address_, iostream_on_connected_cb, async_data, 0);
+            channel::io_stream_shards *shards = NULL;
+            if (0 != UTIL_STRFUNC_STRNCASE_CMP("unix", address_.scheme.c_str(), 4)) {
+                shards = owner_->get_iostream_shards();
+            }
+
+            int res;
+            if (NULL != shards) {
+                res = channel::io_stream_shard_connect(shards, address_, iostream_shard_on_connected_cb, async_data, 0);
+            } else {
+                res = channel::io_stream_connect(owner_->get_iostream_channel(), address_, iostream_on_connected_cb, async_data, 0);
+            }
             if (res < 0) {
                 delete async_data;
                 return res;
@@ -375,6 +539,275 @@ namespace atbus {
         return conn_data_.push_fn(*this, buffer, s);
     }
 
+    int connection::push_ptr(void *buffer, size_t s, channel::mem_ptr_free_fn_t free_fn) {
+        if (NULL != conn_data_.push_ptr_fn && (state_t::CONNECTED == state_ || state_t::HANDSHAKING == state_)) {
+            ++stat_.push_start_times;
+            stat_.push_start_size += s;
+
+            int ret = conn_data_.push_ptr_fn(*this, buffer, s, free_fn);
+            // 失败时所有权仍然在调用方，这里负责释放
+            if (ret < 0) {
+                channel::mem_free_ptr(buffer, s, free_fn);
+            }
+            return ret;
+        }
+
+        int ret = push(buffer, s);
+        channel::mem_free_ptr(buffer, s, free_fn);
+        return ret;
+    }
+
+    int connection::push_ctrl(void *buffer, size_t s, channel::mem_ptr_free_fn_t free_fn) {
+        bool is_shard = ios_shard_push_fn == conn_data_.push_fn;
+        if (!is_shard && (ios_push_fn != conn_data_.push_fn || NULL == conn_data_.shared.ios_fd.conn)) {
+            return push_ptr(buffer, s, free_fn);
+        }
+
+        ++stat_.push_start_times;
+        stat_.push_start_size += s;
+
+        int ret = EN_ATBUS_ERR_NOT_INITED;
+        if (state_t::CONNECTED == state_ || state_t::HANDSHAKING == state_) {
+            // I/O线程中的连接由工作线程插队发送
+            if (is_shard) {
+                ret = channel::io_stream_shard_send_ctrl(conn_data_.shared.ios_shard.shards, conn_data_.shared.ios_shard.conn_id, buffer,
+                                                         s);
+            } else {
+                ret = channel::io_stream_send_ctrl(conn_data_.shared.ios_fd.conn, buffer, s);
+            }
+        }
+
+        if (ret < 0) {
+            ++stat_.push_failed_times;
+            stat_.push_failed_size += s;
+        }
+
+        channel::mem_free_ptr(buffer, s, free_fn);
+        return ret;
+    }
+
+    int connection::migrate_shm(key_t new_key, size_t new_size) {
+        if (state_t::CONNECTED != state_) {
+            return EN_ATBUS_ERR_NOT_INITED;
+        }
+
+        // 只有监听端（接收端）可以迁移
+        if (shm_proc_fn != conn_data_.proc_fn || NULL != conn_data_.push_fn) {
+            return EN_ATBUS_ERR_ACCESS_DENY;
+        }
+
+        if (NULL != conn_data_.shared.shm.migrate_channel) {
+            return EN_ATBUS_ERR_ALREADY_INITED;
+        }
+
+        channel::shm_channel *shm_chann = NULL;
+        int res = channel::shm_migrate(conn_data_.shared.shm.channel, new_key, new_size, &shm_chann, NULL);
+        if (res < 0) {
+            return res;
+        }
+
+        conn_data_.shared.shm.migrate_channel = shm_chann;
+        conn_data_.shared.shm.migrate_shm_key = new_key;
+        conn_data_.shared.shm.migrate_len = new_size;
+
+        if (NULL != owner_) {
+            ATBUS_FUNC_NODE_DEBUG(*owner_, get_binding(), this, NULL, "shm channel migrate from %lld to %lld, new size: %llu",
+                                  static_cast<long long>(conn_data_.shared.shm.shm_key), static_cast<long long>(new_key),
+                                  static_cast<unsigned long long>(new_size));
+        }
+        return res;
+    }
+
+    int connection::set_iostream_checksum(int checksum_type) {
+        if (ios_shard_push_fn == conn_data_.push_fn) {
+            return channel::io_stream_shard_set_checksum(conn_data_.shared.ios_shard.shards, conn_data_.shared.ios_shard.conn_id,
+                                                         checksum_type);
+        }
+
+        if (ios_push_fn != conn_data_.push_fn || NULL == conn_data_.shared.ios_fd.conn) {
+            return EN_ATBUS_ERR_ACCESS_DENY;
+        }
+
+        return channel::io_stream_set_checksum(conn_data_.shared.ios_fd.conn, checksum_type);
+    }
+
+    int connection::set_iostream_compression(int algorithm, size_t threshold, int level) {
+        if (ios_shard_push_fn == conn_data_.push_fn) {
+            return channel::io_stream_shard_set_compression(conn_data_.shared.ios_shard.shards, conn_data_.shared.ios_shard.conn_id,
+                                                            algorithm, threshold, level);
+        }
+
+        if (ios_push_fn != conn_data_.push_fn || NULL == conn_data_.shared.ios_fd.conn) {
+            return EN_ATBUS_ERR_ACCESS_DENY;
+        }
+
+        return channel::io_stream_set_compression(conn_data_.shared.ios_fd.conn, algorithm, threshold, level);
+    }
+
+    const channel::io_stream_compress_stat_t *connection::get_iostream_compress_stat() const {
+        if (ios_push_fn != conn_data_.push_fn || NULL == conn_data_.shared.ios_fd.conn) {
+            return NULL;
+        }
+
+        return &conn_data_.shared.ios_fd.conn->compress_stat;
+    }
+
+    const channel::io_stream_latency_stat_t *connection::get_iostream_latency_stat() const {
+        if (ios_push_fn != conn_data_.push_fn || NULL == conn_data_.shared.ios_fd.conn) {
+            return NULL;
+        }
+
+        return conn_data_.shared.ios_fd.conn->latency_stat.get();
+    }
+
+    int connection::set_iostream_cork(size_t size, uint64_t delay) {
+        if (ios_shard_push_fn == conn_data_.push_fn) {
+            return channel::io_stream_shard_set_cork(conn_data_.shared.ios_shard.shards, conn_data_.shared.ios_shard.conn_id, size,
+                                                     delay);
+        }
+
+        if (ios_push_fn != conn_data_.push_fn || NULL == conn_data_.shared.ios_fd.conn) {
+            return EN_ATBUS_ERR_ACCESS_DENY;
+        }
+
+        return channel::io_stream_set_cork(conn_data_.shared.ios_fd.conn, size, delay);
+    }
+
+    int connection::pause_iostream_read() {
+        if (ios_shard_push_fn == conn_data_.push_fn) {
+            return channel::io_stream_shard_pause_read(conn_data_.shared.ios_shard.shards, conn_data_.shared.ios_shard.conn_id);
+        }
+
+        if (ios_push_fn != conn_data_.push_fn || NULL == conn_data_.shared.ios_fd.conn) {
+            return EN_ATBUS_ERR_ACCESS_DENY;
+        }
+
+        return channel::io_stream_pause_read(conn_data_.shared.ios_fd.conn);
+    }
+
+    int connection::resume_iostream_read() {
+        if (ios_shard_push_fn == conn_data_.push_fn) {
+            return channel::io_stream_shard_resume_read(conn_data_.shared.ios_shard.shards, conn_data_.shared.ios_shard.conn_id);
+        }
+
+        if (ios_push_fn != conn_data_.push_fn || NULL == conn_data_.shared.ios_fd.conn) {
+            return EN_ATBUS_ERR_ACCESS_DENY;
+        }
+
+        return channel::io_stream_resume_read(conn_data_.shared.ios_fd.conn);
+    }
+
+    int connection::init_shm_fd(const char *addr_str, size_t len, int *fd) {
+#ifdef ATBUS_CHANNEL_SHM_FD
+        if (state_t::DISCONNECTED != state_) {
+            return EN_ATBUS_ERR_ALREADY_INITED;
+        }
+
+        if (NULL == owner_) {
+            return EN_ATBUS_ERR_NOT_INITED;
+        }
+
+        if (NULL == fd) {
+            return EN_ATBUS_ERR_PARAMS;
+        }
+
+        if (false == channel::make_address(addr_str, address_)) {
+            return EN_ATBUS_ERR_CHANNEL_ADDR_INVALID;
+        }
+
+        if (owner_->get_proc_connection(address_.address)) {
+            return EN_ATBUS_ERR_ALREADY_INITED;
+        }
+
+        channel::shm_channel *shm_chann = NULL;
+        int res = channel::shm_init_fd(len, fd, &shm_chann, NULL);
+        if (res < 0) {
+            return res;
+        }
+
+        conn_data_.proc_fn = shm_fd_proc_fn;
+        conn_data_.free_fn = shm_fd_free_fn;
+        conn_data_.push_fn = shm_fd_push_fn;
+
+        // 加入轮询队列，对端的通道关联之前不能发送
+        conn_data_.shared.shm_fd.recv_channel = shm_chann;
+        conn_data_.shared.shm_fd.send_channel = NULL;
+        owner_->add_proc_connection(watcher_.lock());
+        flags_.set(flag_t::REG_PROC, true);
+        flags_.set(flag_t::ACCESS_SHARE_HOST, true);
+        state_ = state_t::CONNECTING;
+        ATBUS_FUNC_NODE_DEBUG(*owner_, binding_, this, NULL, "shm fd channel created, size: %llu", static_cast<unsigned long long>(len));
+
+        return res;
+#else
+        return EN_ATBUS_ERR_ACCESS_DENY;
+#endif
+    }
+
+    int connection::attach_shm_fd(int fd) {
+#ifdef ATBUS_CHANNEL_SHM_FD
+        if (shm_fd_proc_fn != conn_data_.proc_fn || state_t::CONNECTING != state_) {
+            return EN_ATBUS_ERR_ACCESS_DENY;
+        }
+
+        if (NULL != conn_data_.shared.shm_fd.send_channel) {
+            return EN_ATBUS_ERR_ALREADY_INITED;
+        }
+
+        channel::shm_channel *shm_chann = NULL;
+        int res = channel::shm_attach_fd(fd, &shm_chann, NULL);
+        if (res < 0) {
+            return res;
+        }
+
+        conn_data_.shared.shm_fd.send_channel = shm_chann;
+        state_ = state_t::CONNECTED;
+        if (NULL != owner_) {
+            ATBUS_FUNC_NODE_DEBUG(*owner_, binding_, this, NULL, "channel connected(shm fd)");
+        }
+
+        return res;
+#else
+        return EN_ATBUS_ERR_ACCESS_DENY;
+#endif
+    }
+
+    int connection::push_fd(int fd, const void *buffer, size_t s) {
+        if (ios_push_fn != conn_data_.push_fn || NULL == conn_data_.shared.ios_fd.conn) {
+            return EN_ATBUS_ERR_ACCESS_DENY;
+        }
+
+#ifdef _WIN32
+        return EN_ATBUS_ERR_ACCESS_DENY;
+#else
+        ++stat_.push_start_times;
+        stat_.push_start_size += s;
+
+        int ret = EN_ATBUS_ERR_NOT_INITED;
+        if (state_t::CONNECTED == state_ || state_t::HANDSHAKING == state_) {
+            ret = channel::io_stream_send_fd(conn_data_.shared.ios_fd.conn, fd, buffer, s);
+        }
+
+        if (ret < 0) {
+            ++stat_.push_failed_times;
+            stat_.push_failed_size += s;
+        }
+        return ret;
+#endif
+    }
+
+    int connection::pop_fd(int *fd) {
+        if (ios_push_fn != conn_data_.push_fn || NULL == conn_data_.shared.ios_fd.conn) {
+            return EN_ATBUS_ERR_ACCESS_DENY;
+        }
+
+#ifdef _WIN32
+        return EN_ATBUS_ERR_ACCESS_DENY;
+#else
+        return channel::io_stream_recv_fd(conn_data_.shared.ios_fd.conn, fd);
+#endif
+    }
+
     bool connection::is_connected() const { return state_t::CONNECTED == state_; }
 
     endpoint *connection::get_binding() { return binding_; }
@@ -493,6 +926,43 @@ namespace atbus {
         _this->on_recv(conn, &m, status, channel->error_code);
     }
 
+    void connection::iostream_on_recv_batch_cb(channel::io_stream_channel *channel, channel::io_stream_connection *conn_ios, int status,
+                                               void *buffer, size_t s) {
+        assert(channel && channel->data);
+        node *_this = reinterpret_cast<node *>(channel->data);
+        channel::io_stream_recv_msg_t *msgs = reinterpret_cast<channel::io_stream_recv_msg_t *>(buffer);
+        if (NULL == msgs) {
+            return;
+        }
+
+        // 同一批消息复用unpack的缓存
+        msgpack::unpacked result;
+        for (size_t i = 0; i < s; ++i) {
+            // 消息回调过程中连接可能被释放，所以每次都要重新获取
+            connection *conn = reinterpret_cast<connection *>(conn_ios->data);
+            if (msgs[i].errcode < 0 || NULL == msgs[i].data || 0 == msgs[i].size) {
+                _this->on_recv(conn, NULL, msgs[i].errcode, channel->error_code);
+                continue;
+            }
+
+            // connection 已经释放并解除绑定，这时候会先把剩下未处理的消息处理完再关闭
+            if (NULL == conn) {
+                return;
+            }
+
+            // statistic
+            ++conn->stat_.pull_times;
+            conn->stat_.pull_size += msgs[i].size;
+
+            // unpack
+            protocol::msg m;
+            if (false == unpack(&result, *conn, m, msgs[i].data, msgs[i].size)) {
+                continue;
+            }
+            _this->on_recv(conn, &m, msgs[i].errcode, channel->error_code);
+        }
+    }
+
     void connection::iostream_on_accepted(channel::io_stream_channel *channel, channel::io_stream_connection *conn_ios, int status,
                                           void *buffer, size_t s) {
         // 连接成功加入点对点传输池
@@ -545,10 +1015,14 @@ namespace atbus {
         assert(NULL != n);
         connection *conn = reinterpret_cast<connection *>(conn_ios->data);
 
+        // 一次写请求只回调一次，额外参数是汇总信息
+        assert(NULL != buffer && sizeof(channel::io_stream_write_stat_t) == s);
+        const channel::io_stream_write_stat_t *written_stat = reinterpret_cast<const channel::io_stream_write_stat_t *>(buffer);
+
         if (EN_ATBUS_ERR_SUCCESS != status) {
             if (NULL != conn) {
-                ++conn->stat_.push_failed_times;
-                conn->stat_.push_failed_size += s;
+                conn->stat_.push_failed_times += written_stat->frame_number;
+                conn->stat_.push_failed_size += written_stat->data_size;
 
                 ATBUS_FUNC_NODE_DEBUG(*n, conn->get_binding(), conn, NULL, "write data to %p failed, err=%d, status=%d", conn_ios,
                                       channel->error_code, status);
@@ -560,8 +1034,8 @@ namespace atbus {
             ATBUS_FUNC_NODE_ERROR(*n, NULL, conn, status, channel->error_code);
         } else {
             if (NULL != conn) {
-                ++conn->stat_.push_success_times;
-                conn->stat_.push_success_size += s;
+                conn->stat_.push_success_times += written_stat->frame_number;
+                conn->stat_.push_success_size += written_stat->data_size;
 
                 ATBUS_FUNC_NODE_DEBUG(*n, conn->get_binding(), conn, NULL, "write data to %p success", conn_ios);
             } else {
@@ -583,6 +1057,16 @@ namespace atbus {
             int res = channel::shm_recv(conn.conn_data_.shared.shm.channel, static_buffer->data(), static_buffer->size(), &recv_len);
 
             if (EN_ATBUS_ERR_NO_DATA == res) {
+                // 旧通道已经读完，切换到新通道。切换前不能读新通道，否则同一个发送端的消息可能乱序
+                if (NULL != conn.conn_data_.shared.shm.migrate_channel &&
+                    channel::shm_migrate_drained(conn.conn_data_.shared.shm.channel)) {
+                    channel::shm_close(conn.conn_data_.shared.shm.shm_key);
+                    conn.conn_data_.shared.shm.channel = conn.conn_data_.shared.shm.migrate_channel;
+                    conn.conn_data_.shared.shm.shm_key = conn.conn_data_.shared.shm.migrate_shm_key;
+                    conn.conn_data_.shared.shm.len = conn.conn_data_.shared.shm.migrate_len;
+                    conn.conn_data_.shared.shm.migrate_channel = NULL;
+                    continue;
+                }
                 break;
             }
 
@@ -611,10 +1095,46 @@ namespace atbus {
         return ret;
     }
 
-    int connection::shm_free_fn(node &n, connection &conn) { return channel::shm_close(conn.conn_data_.shared.shm.shm_key); }
+    int connection::shm_free_fn(node &n, connection &conn) {
+        if (NULL != conn.conn_data_.shared.shm.migrate_channel) {
+            channel::shm_close(conn.conn_data_.shared.shm.migrate_shm_key);
+            conn.conn_data_.shared.shm.migrate_channel = NULL;
+        }
+
+        return channel::shm_close(conn.conn_data_.shared.shm.shm_key);
+    }
 
     int connection::shm_push_fn(connection &conn, const void *buffer, size_t s) {
         int ret = channel::shm_send(conn.conn_data_.shared.shm.channel, buffer, s);
+
+        // 接收端已经扩容，在这条消息开始前切换到新通道(可能连续迁移多次)
+        while (EN_ATBUS_ERR_CHANNEL_MIGRATED == ret) {
+            key_t new_key;
+            size_t new_len;
+            if (!channel::shm_get_migrate(conn.conn_data_.shared.shm.channel, &new_key, &new_len)) {
+                break;
+            }
+
+            channel::shm_channel *shm_chann = NULL;
+            int res = channel::shm_attach(new_key, new_len, &shm_chann, NULL);
+            if (res < 0) {
+                ret = res;
+                break;
+            }
+
+            channel::shm_close(conn.conn_data_.shared.shm.shm_key);
+            conn.conn_data_.shared.shm.channel = shm_chann;
+            conn.conn_data_.shared.shm.shm_key = new_key;
+            conn.conn_data_.shared.shm.len = new_len;
+
+            if (NULL != conn.owner_) {
+                ATBUS_FUNC_NODE_DEBUG(*conn.owner_, conn.get_binding(), &conn, NULL, "shm channel switch to %lld",
+                                      static_cast<long long>(new_key));
+            }
+
+            ret = channel::shm_send(shm_chann, buffer, s);
+        }
+
         if (ret >= 0) {
             ++conn.stat_.push_success_times;
             conn.stat_.push_success_size += s;
@@ -635,6 +1155,33 @@ namespace atbus {
         }
 
         while (left_times-- > 0) {
+            // 进程内的指针传递队列，直接使用发送方的数据块，不需要拷贝
+            // 环形缓冲区里有更早的数据时返回没有数据，由下面的mem_recv先读取
+            {
+                void *recv_ptr = NULL;
+                size_t recv_len = 0;
+                channel::mem_ptr_free_fn_t recv_free_fn = NULL;
+                int res = channel::mem_recv_ptr(conn.conn_data_.shared.mem.channel, &recv_ptr, &recv_len, &recv_free_fn);
+                if (EN_ATBUS_ERR_SUCCESS == res) {
+                    // statistic
+                    ++conn.stat_.pull_times;
+                    conn.stat_.pull_size += recv_len;
+
+                    // unpack
+                    {
+                        msgpack::unpacked result;
+                        protocol::msg m;
+                        if (unpack(&result, conn, m, recv_ptr, recv_len)) {
+                            n.on_recv(&conn, &m, res, res);
+                            ++ret;
+                        }
+                    }
+
+                    channel::mem_free_ptr(recv_ptr, recv_len, recv_free_fn);
+                    continue;
+                }
+            }
+
             size_t recv_len;
             int res = channel::mem_recv(conn.conn_data_.shared.mem.channel, static_buffer->data(), static_buffer->size(), &recv_len);
 
@@ -667,9 +1214,16 @@ namespace atbus {
         return ret;
     }
 
-    int connection::mem_free_fn(node &n, connection &conn) { return 0; }
+    int connection::mem_free_fn(node &n, connection &conn) {
+        // 只有接收端（监听端没有push_fn）可以清理指针传递队列中未处理的数据块
+        if (NULL == conn.conn_data_.push_fn && NULL != conn.conn_data_.shared.mem.channel) {
+            channel::mem_clear_ptr(conn.conn_data_.shared.mem.channel);
+        }
+        return 0;
+    }
 
     int connection::mem_push_fn(connection &conn, const void *buffer, size_t s) {
+        // 接收端按入队时的写游标保证和mem_push_ptr_fn之间的消息顺序
         int ret = channel::mem_send(conn.conn_data_.shared.mem.channel, buffer, s);
         if (ret >= 0) {
             ++conn.stat_.push_success_times;
@@ -681,6 +1235,18 @@ namespace atbus {
         return ret;
     }
 
+    int connection::mem_push_ptr_fn(connection &conn, void *buffer, size_t s, channel::mem_ptr_free_fn_t free_fn) {
+        int ret = channel::mem_send_ptr(conn.conn_data_.shared.mem.channel, buffer, s, free_fn);
+        if (ret >= 0) {
+            ++conn.stat_.push_success_times;
+            conn.stat_.push_success_size += s;
+        } else {
+            ++conn.stat_.push_failed_times;
+            conn.stat_.push_failed_size += s;
+        }
+        return ret;
+    }
+
     int connection::ios_free_fn(node &n, connection &conn) {
         int ret = channel::io_stream_disconnect(conn.conn_data_.shared.ios_fd.channel, conn.conn_data_.shared.ios_fd.conn, NULL);
         // 释放后移除关联关系
@@ -698,6 +1264,356 @@ namespace atbus {
         return ret;
     }
 
+    void connection::iostream_shard_on_listen_cb(channel::io_stream_shards *shards, uint64_t conn_id, int status, void *buffer,
+                                                 size_t s) {
+        detail::connection_async_data *async_data = reinterpret_cast<detail::connection_async_data *>(buffer);
+        assert(NULL != async_data);
+        if (NULL == async_data) {
+            return;
+        }
+
+        if (status < 0) {
+            ATBUS_FUNC_NODE_ERROR(*async_data->owner_node, async_data->conn->binding_, async_data->conn.get(), status, 0);
+            async_data->conn->state_ = state_t::DISCONNECTED;
+            ATBUS_FUNC_NODE_DEBUG(*async_data->conn->owner_, async_data->conn->binding_, async_data->conn.get(), NULL,
+                                  "channel disconnected(listen callback)");
+
+        } else {
+            // 每个I/O线程都有自己的监听socket，关闭时通知所有I/O线程
+            async_data->conn->conn_data_.shared.ios_shard.shards = shards;
+            async_data->conn->conn_data_.shared.ios_shard.conn_id = 0;
+            async_data->conn->conn_data_.free_fn = ios_shard_listen_free_fn;
+            async_data->conn->flags_.set(flag_t::REG_FD, true);
+            async_data->conn->state_ = state_t::CONNECTED;
+            ATBUS_FUNC_NODE_DEBUG(*async_data->conn->owner_, async_data->conn->binding_, async_data->conn.get(), NULL,
+                                  "channel connected(listen callback)");
+        }
+
+        delete async_data;
+    }
+
+    void connection::iostream_shard_on_connected_cb(channel::io_stream_shards *shards, uint64_t conn_id, int status, void *buffer,
+                                                    size_t s) {
+        detail::connection_async_data *async_data = reinterpret_cast<detail::connection_async_data *>(buffer);
+        assert(NULL != async_data);
+        if (NULL == async_data) {
+            return;
+        }
+
+        if (status < 0) {
+            ATBUS_FUNC_NODE_ERROR(*async_data->owner_node, async_data->conn->binding_, async_data->conn.get(), status, 0);
+            // 连接失败，重置连接
+            async_data->conn->reset();
+
+        } else {
+            async_data->conn->flags_.set(flag_t::REG_FD, true);
+            if (NULL == async_data->conn->binding_) {
+                async_data->conn->state_ = state_t::HANDSHAKING;
+                ATBUS_FUNC_NODE_DEBUG(*async_data->conn->owner_, async_data->conn->binding_, async_data->conn.get(), NULL,
+                                      "channel handshaking(connect callback)");
+            } else {
+                async_data->conn->state_ = state_t::CONNECTED;
+                ATBUS_FUNC_NODE_DEBUG(*async_data->conn->owner_, async_data->conn->binding_, async_data->conn.get(), NULL,
+                                      "channel connected(connect callback)");
+            }
+
+            async_data->conn->conn_data_.shared.ios_shard.shards = shards;
+            async_data->conn->conn_data_.shared.ios_shard.conn_id = conn_id;
+
+            async_data->conn->conn_data_.free_fn = ios_shard_free_fn;
+            async_data->conn->conn_data_.push_fn = ios_shard_push_fn;
+            async_data->owner_node->add_iostream_shard_connection(conn_id, async_data->conn.get());
+
+            async_data->owner_node->on_new_connection(async_data->conn.get());
+        }
+
+        delete async_data;
+    }
+
+    void connection::iostream_shard_on_accepted(channel::io_stream_shards *shards, uint64_t conn_id, int status, void *buffer,
+                                                size_t s) {
+        node *n = reinterpret_cast<node *>(shards->data);
+        assert(NULL != n);
+        if (NULL == n) {
+            channel::io_stream_shard_disconnect(shards, conn_id);
+            return;
+        }
+
+        ptr_t conn = create(n);
+        conn->state_ = state_t::HANDSHAKING;
+        conn->flags_.set(flag_t::REG_FD, true);
+
+        conn->conn_data_.free_fn = ios_shard_free_fn;
+        conn->conn_data_.push_fn = ios_shard_push_fn;
+
+        conn->conn_data_.shared.ios_shard.shards = shards;
+        conn->conn_data_.shared.ios_shard.conn_id = conn_id;
+        n->add_iostream_shard_connection(conn_id, conn.get());
+
+        // copy address
+        if (NULL != buffer && s > 0) {
+            make_address(std::string(reinterpret_cast<const char *>(buffer), s).c_str(), conn->address_);
+        }
+
+        ATBUS_FUNC_NODE_DEBUG(*n, NULL, conn.get(), NULL, "connection accepted");
+        n->on_new_connection(conn.get());
+    }
+
+    void connection::iostream_shard_on_disconnected(channel::io_stream_shards *shards, uint64_t conn_id, int status, void *buffer,
+                                                    size_t s) {
+        node *n = reinterpret_cast<node *>(shards->data);
+        assert(NULL != n);
+        if (NULL == n) {
+            return;
+        }
+
+        // 主动关闭时会先移除connection，这时候不需要再重置
+        connection *conn = n->get_iostream_shard_connection(conn_id);
+        if (NULL == conn) {
+            return;
+        }
+        n->remove_iostream_shard_connection(conn_id);
+
+        ATBUS_FUNC_NODE_DEBUG(*n, conn->get_binding(), conn, NULL, "connection reset by peer");
+        conn->reset();
+    }
+
+    void connection::iostream_shard_on_recv_cb(channel::io_stream_shards *shards, uint64_t conn_id, int status, void *buffer,
+                                               size_t s) {
+        node *n = reinterpret_cast<node *>(shards->data);
+        assert(NULL != n);
+        if (NULL == n) {
+            return;
+        }
+
+        connection *conn = n->get_iostream_shard_connection(conn_id);
+        if (status < 0 || NULL == buffer || s <= 0) {
+            n->on_recv(conn, NULL, status, 0);
+            return;
+        }
+
+        // connection 已经释放并解除绑定，I/O线程中剩下的消息直接丢弃
+        if (NULL == conn) {
+            return;
+        }
+
+        // statistic
+        ++conn->stat_.pull_times;
+        conn->stat_.pull_size += s;
+
+        // unpack
+        msgpack::unpacked result;
+        protocol::msg m;
+        if (false == unpack(&result, *conn, m, buffer, s)) {
+            return;
+        }
+        n->on_recv(conn, &m, status, 0);
+    }
+
+    void connection::iostream_shard_on_send_failed(channel::io_stream_shards *shards, uint64_t conn_id, int status, void *buffer,
+                                                   size_t s) {
+        node *n = reinterpret_cast<node *>(shards->data);
+        assert(NULL != n);
+        if (NULL == n) {
+            return;
+        }
+
+        // push时已经计入成功，I/O线程中发送失败后再修正统计
+        connection *conn = n->get_iostream_shard_connection(conn_id);
+        if (NULL != conn) {
+            if (conn->stat_.push_success_times > 0) {
+                --conn->stat_.push_success_times;
+            }
+            if (conn->stat_.push_success_size >= s) {
+                conn->stat_.push_success_size -= s;
+            }
+            ++conn->stat_.push_failed_times;
+            conn->stat_.push_failed_size += s;
+        }
+
+        ATBUS_FUNC_NODE_DEBUG(*n, NULL == conn ? NULL : conn->get_binding(), conn, NULL, "write data to shard connection %llu failed",
+                              static_cast<unsigned long long>(conn_id));
+        ATBUS_FUNC_NODE_ERROR(*n, NULL == conn ? NULL : conn->get_binding(), conn, status, 0);
+    }
+
+    int connection::ios_shard_free_fn(node &n, connection &conn) {
+        // 先解除关联关系，之后I/O线程回调的事件都会被忽略
+        n.remove_iostream_shard_connection(conn.conn_data_.shared.ios_shard.conn_id);
+        return channel::io_stream_shard_disconnect(conn.conn_data_.shared.ios_shard.shards, conn.conn_data_.shared.ios_shard.conn_id);
+    }
+
+    int connection::ios_shard_listen_free_fn(node &, connection &conn) {
+        return channel::io_stream_shard_close_listen(conn.conn_data_.shared.ios_shard.shards, conn.address_);
+    }
+
+    int connection::ios_shard_push_fn(connection &conn, const void *buffer, size_t s) {
+        int ret =
+            channel::io_stream_shard_send(conn.conn_data_.shared.ios_shard.shards, conn.conn_data_.shared.ios_shard.conn_id, buffer, s);
+        if (ret >= 0) {
+            ++conn.stat_.push_success_times;
+            conn.stat_.push_success_size += s;
+        } else {
+            ++conn.stat_.push_failed_times;
+            conn.stat_.push_failed_size += s;
+        }
+
+        return ret;
+    }
+
+    void connection::udp_on_recv_cb(channel::udp_channel *channel, channel::udp_socket *socket, const sockaddr *addr, int status,
+                                    void *buffer, size_t s) {
+        assert(channel && channel->data);
+        node *_this = reinterpret_cast<node *>(channel->data);
+        connection *conn = reinterpret_cast<connection *>(socket->data);
+
+        // 只有监听的socket关联了connection，发送用的socket收到的数据直接丢弃
+        if (NULL == conn) {
+            return;
+        }
+
+        if (status < 0 || NULL == buffer || s <= 0) {
+            ATBUS_FUNC_NODE_ERROR(*_this, conn->get_binding(), conn, status, channel->error_code);
+            return;
+        }
+
+        // statistic
+        ++conn->stat_.pull_times;
+        conn->stat_.pull_size += s;
+
+        // unpack
+        msgpack::unpacked result;
+        protocol::msg m;
+        if (false == unpack(&result, *conn, m, buffer, s)) {
+            return;
+        }
+
+        // 数据报可以伪造源地址，只接受直连端点发给自己的数据转发消息，注册和控制消息必须走可靠的通道
+        if (ATBUS_CMD_DATA_TRANSFORM_REQ != m.head.cmd || NULL == m.body.forward || m.body.forward->to != _this->get_id() ||
+            m.body.forward->from != m.head.src_bus_id) {
+            ATBUS_FUNC_NODE_ERROR(*_this, conn->get_binding(), conn, EN_ATBUS_ERR_ACCESS_DENY, 0);
+            return;
+        }
+
+        // 来源地址必须是已注册端点的udp监听地址
+        endpoint *ep = _this->get_endpoint(m.head.src_bus_id);
+        if (NULL == ep || NULL == addr || false == detail::udp_check_source(*_this, *ep, addr)) {
+            ATBUS_FUNC_NODE_ERROR(*_this, conn->get_binding(), conn, EN_ATBUS_ERR_ACCESS_DENY, 0);
+            return;
+        }
+
+        _this->on_recv(conn, &m, status, channel->error_code);
+    }
+
+    int connection::udp_free_fn(node &n, connection &conn) {
+        // 发送端没有关联socket
+        if (NULL == conn.conn_data_.shared.udp.socket) {
+            return 0;
+        }
+
+        channel::udp_socket *socket = conn.conn_data_.shared.udp.socket;
+        socket->data = NULL;
+        return channel::udp_close_socket(socket->channel, socket);
+    }
+
+    int connection::udp_push_fn(connection &conn, const void *buffer, size_t s) {
+        int ret = EN_ATBUS_ERR_NOT_INITED;
+        if (NULL != conn.owner_) {
+            // 从自己监听的地址发出，对端按注册时的udp地址校验来源。只有监听的socket关联了connection
+            channel::udp_channel *udp_chann = conn.owner_->get_udp_channel();
+            channel::udp_socket *listen_sock = NULL;
+            for (size_t i = 0; NULL != udp_chann && i < udp_chann->socket_pool.size(); ++i) {
+                channel::udp_socket *sock = udp_chann->socket_pool[i].get();
+                if (NULL != sock->data && sock->family == conn.conn_data_.shared.udp.peer.addr.ss_family) {
+                    listen_sock = sock;
+                    break;
+                }
+            }
+
+            ret = channel::udp_send_from(udp_chann, listen_sock, &conn.conn_data_.shared.udp.peer, buffer, s);
+        }
+
+        // 交给内核后仍然可能丢失，这里只统计进入发送队列的结果
+        if (ret >= 0) {
+            ++conn.stat_.push_success_times;
+            conn.stat_.push_success_size += s;
+        } else {
+            ++conn.stat_.push_failed_times;
+            conn.stat_.push_failed_size += s;
+        }
+
+        return ret;
+    }
+
+#ifdef ATBUS_CHANNEL_SHM_FD
+    int connection::shm_fd_proc_fn(node &n, connection &conn, time_t sec, time_t usec) {
+        int ret = 0;
+        size_t left_times = n.get_conf().loop_times;
+        detail::buffer_block *static_buffer = n.get_temp_static_buffer();
+        if (NULL == static_buffer) {
+            return ATBUS_FUNC_NODE_ERROR(n, NULL, &conn, EN_ATBUS_ERR_NOT_INITED, 0);
+        }
+
+        while (left_times-- > 0) {
+            size_t recv_len;
+            int res =
+                channel::shm_recv(conn.conn_data_.shared.shm_fd.recv_channel, static_buffer->data(), static_buffer->size(), &recv_len);
+
+            if (EN_ATBUS_ERR_NO_DATA == res) {
+                break;
+            }
+
+            // 回调收到数据事件
+            if (res < 0) {
+                ret = res;
+                n.on_recv(&conn, NULL, res, res);
+                break;
+            } else {
+                // statistic
+                ++conn.stat_.pull_times;
+                conn.stat_.pull_size += recv_len;
+
+                // unpack
+                msgpack::unpacked result;
+                protocol::msg m;
+                if (false == unpack(&result, conn, m, static_buffer->data(), recv_len)) {
+                    continue;
+                }
+
+                n.on_recv(&conn, &m, res, res);
+                ++ret;
+            }
+        }
+
+        return ret;
+    }
+
+    int connection::shm_fd_free_fn(node &n, connection &conn) {
+        if (NULL != conn.conn_data_.shared.shm_fd.send_channel) {
+            channel::shm_close_fd(conn.conn_data_.shared.shm_fd.send_channel);
+            conn.conn_data_.shared.shm_fd.send_channel = NULL;
+        }
+
+        return channel::shm_close_fd(conn.conn_data_.shared.shm_fd.recv_channel);
+    }
+
+    int connection::shm_fd_push_fn(connection &conn, const void *buffer, size_t s) {
+        int ret = EN_ATBUS_ERR_NOT_INITED;
+        if (NULL != conn.conn_data_.shared.shm_fd.send_channel) {
+            ret = channel::shm_send(conn.conn_data_.shared.shm_fd.send_channel, buffer, s);
+        }
+
+        if (ret >= 0) {
+            ++conn.stat_.push_success_times;
+            conn.stat_.push_success_size += s;
+        } else {
+            ++conn.stat_.push_failed_times;
+            conn.stat_.push_failed_size += s;
+        }
+
+        return ret;
+    }
+#endif
+
     bool connection::unpack(void *res, connection &conn, atbus::protocol::msg &m, void *buffer, size_t s) {
         msgpack::unpacked *result = reinterpret_cast<msgpack::unpacked *>(res);
         msgpack::unpack(*result, reinterpret_cast<const char *>(buffer), s);
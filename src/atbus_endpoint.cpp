@@ -145,6 +145,11 @@ namespace atbus {
         if (connection::state_t::HANDSHAKING == conn->get_status()) {
             conn->state_ = connection::state_t::CONNECTED;
         }
+
+        // 控制连接一直读取，否则暂停期间收不到ping的回包
+        if (flags_.test(flag_t::READ_PAUSED) && conn != ctrl_conn_.get()) {
+            conn->pause_iostream_read();
+        }
         return true;
     }
 
@@ -153,8 +158,9 @@ namespace atbus {
             return false;
         }
 
+        // udp通道不可靠，不能作为普通的数据通道
         for (std::list<connection::ptr_t>::const_iterator iter = data_conn_.begin(); iter != data_conn_.end(); ++iter) {
-            if ((*iter) && (*iter)->is_running()) {
+            if ((*iter) && (*iter)->is_running() && !(*iter)->check_flag(connection::flag_t::UNRELIABLE)) {
                 return true;
             }
         }
@@ -211,7 +217,7 @@ namespace atbus {
     }
 
     int endpoint::set_flag(flag_t::type f, bool v) {
-        if (f >= flag_t::MAX || f < flag_t::MUTABLE_FLAGS) {
+        if (f >= flag_t::MAX || f < flag_t::MUTABLE_FLAGS || flag_t::READ_PAUSED == f) {
             return EN_ATBUS_ERR_PARAMS;
         }
 
@@ -222,6 +228,37 @@ namespace atbus {
 
     uint32_t endpoint::get_flags() const { return static_cast<uint32_t>(flags_.to_ulong()); }
 
+    // 在node轮询队列里的内存和共享内存通道由proc检查READ_PAUSED，暂停和恢复读取都不需要操作连接
+    static bool is_proc_data_connection(const node *n, const connection::ptr_t &conn) {
+        return NULL != n && conn->check_flag(connection::flag_t::REG_PROC) && n->get_proc_connection(conn->get_address().address) == conn;
+    }
+
+    size_t endpoint::pause_read() {
+        flags_.set(flag_t::READ_PAUSED, true);
+
+        size_t ret = 0;
+        for (std::list<connection::ptr_t>::iterator iter = data_conn_.begin(); iter != data_conn_.end(); ++iter) {
+            if ((*iter) && (is_proc_data_connection(owner_, *iter) || EN_ATBUS_ERR_SUCCESS == (*iter)->pause_iostream_read())) {
+                ++ret;
+            }
+        }
+
+        return ret;
+    }
+
+    size_t endpoint::resume_read() {
+        flags_.set(flag_t::READ_PAUSED, false);
+
+        size_t ret = 0;
+        for (std::list<connection::ptr_t>::iterator iter = data_conn_.begin(); iter != data_conn_.end(); ++iter) {
+            if ((*iter) && (is_proc_data_connection(owner_, *iter) || EN_ATBUS_ERR_SUCCESS == (*iter)->resume_iostream_read())) {
+                ++ret;
+            }
+        }
+
+        return ret;
+    }
+
     endpoint::ptr_t endpoint::watch() const {
         if (flags_.test(flag_t::DESTRUCTING) || watcher_.expired()) {
             return endpoint::ptr_t();
@@ -286,7 +323,7 @@ namespace atbus {
         }
 
         for (std::list<connection::ptr_t>::iterator iter = ep->data_conn_.begin(); iter != ep->data_conn_.end(); ++iter) {
-            if (connection::state_t::CONNECTED != (*iter)->get_status()) {
+            if (connection::state_t::CONNECTED != (*iter)->get_status() || (*iter)->check_flag(connection::flag_t::UNRELIABLE)) {
                 continue;
             }
 
@@ -310,6 +347,25 @@ namespace atbus {
         }
     }
 
+    connection *endpoint::get_unreliable_connection(endpoint *ep) const {
+        if (NULL == ep) {
+            return NULL;
+        }
+
+        if (this == ep) {
+            return NULL;
+        }
+
+        for (std::list<connection::ptr_t>::iterator iter = ep->data_conn_.begin(); iter != ep->data_conn_.end(); ++iter) {
+            if (connection::state_t::CONNECTED == (*iter)->get_status() && (*iter)->check_flag(connection::flag_t::UNRELIABLE)) {
+                return (*iter).get();
+            }
+        }
+
+        // 没有udp连接时使用可靠的数据连接
+        return get_data_connection(ep, true);
+    }
+
     endpoint::stat_t::stat_t() : fault_count(0), unfinished_ping(0), ping_delay(0), last_pong_time(0) {}
 
     /** 增加错误计数 **/
@@ -450,4 +506,28 @@ namespace atbus {
 
         return ret;
     }
+
+    size_t endpoint::get_stat_iostream_latency(channel::io_stream_latency_stat_t &out) const {
+        channel::io_stream_latency_reset(&out.queue);
+        channel::io_stream_latency_reset(&out.written);
+
+        size_t ret = 0;
+        for (std::list<connection::ptr_t>::const_iterator iter = data_conn_.begin(); iter != data_conn_.end(); ++iter) {
+            const channel::io_stream_latency_stat_t *stat = (*iter) ? (*iter)->get_iostream_latency_stat() : NULL;
+            if (NULL != stat) {
+                channel::io_stream_latency_merge(&out.queue, &stat->queue);
+                channel::io_stream_latency_merge(&out.written, &stat->written);
+                ++ret;
+            }
+        }
+
+        const channel::io_stream_latency_stat_t *stat = ctrl_conn_ ? ctrl_conn_->get_iostream_latency_stat() : NULL;
+        if (NULL != stat) {
+            channel::io_stream_latency_merge(&out.queue, &stat->queue);
+            channel::io_stream_latency_merge(&out.written, &stat->written);
+            ++ret;
+        }
+
+        return ret;
+    }
 }
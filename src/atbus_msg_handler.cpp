@@ -1,5 +1,9 @@
 ﻿#include <sstream>
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 #include "common/string_oprs.h"
 
 #include "detail/buffer.h"
@@ -30,6 +34,8 @@ namespace atbus {
                 ATBUS_CMD_REG_NAME(ATBUS_CMD_NODE_CONN_SYN);
                 ATBUS_CMD_REG_NAME(ATBUS_CMD_NODE_PING);
                 ATBUS_CMD_REG_NAME(ATBUS_CMD_NODE_PONG);
+                ATBUS_CMD_REG_NAME(ATBUS_CMD_NODE_SHM_FD_REQ);
+                ATBUS_CMD_REG_NAME(ATBUS_CMD_NODE_SHM_FD_RSP);
 
                 for (int i = 0; i < ATBUS_CMD_MAX; ++i) {
                     if (fn_names[i].empty()) {
@@ -50,6 +56,85 @@ namespace atbus {
 
             return fn_names[cmd].c_str();
         }
+
+        // 对端支持新的消息格式时，切换本端发送消息的校验方式，两端都支持压缩时再开启压缩。只有io_stream连接有效
+        static void set_io_frame_checksum(node &n, connection &conn, const protocol::reg_data &reg) {
+            if (reg.io_frame_version < ATBUS_IO_FRAME_VERSION_FLAGS ||
+                channel::io_stream_checksum_t::EN_CS_LEGACY == n.get_conf().frame_checksum) {
+                return;
+            }
+
+            int res = conn.set_iostream_checksum(n.get_conf().frame_checksum);
+            if (res < 0) {
+                if (EN_ATBUS_ERR_ACCESS_DENY != res) {
+                    ATBUS_FUNC_NODE_ERROR(n, conn.get_binding(), &conn, res, 0);
+                }
+                return;
+            }
+
+            int algorithms = static_cast<int>(reg.io_compress_algorithms) & channel::io_stream_compress_algorithms();
+            if (0 == n.get_conf().compress_threshold || 0 == (algorithms & channel::io_stream_compress_t::EN_CA_ZLIB)) {
+                return;
+            }
+
+            res = conn.set_iostream_compression(channel::io_stream_compress_t::EN_CA_ZLIB, n.get_conf().compress_threshold,
+                                                n.get_conf().compress_level);
+            if (res < 0 && EN_ATBUS_ERR_ACCESS_DENY != res) {
+                ATBUS_FUNC_NODE_ERROR(n, conn.get_binding(), &conn, res, 0);
+            }
+        }
+
+        static void close_fd(int fd) {
+#ifndef _WIN32
+            if (fd >= 0) {
+                close(fd);
+            }
+#endif
+        }
+
+        // 同机的unix socket连接升级为匿名共享内存通道，发起连接的一端先创建自己的接收通道并发给对端
+        // 新连接在对端回包并关联对端的接收通道后才加入端点，失败或超时都会直接释放，不影响原来的连接
+        static void upgrade_shm_fd(node &n, connection &conn, endpoint &ep, const protocol::reg_data &reg) {
+#ifdef ATBUS_CHANNEL_SHM_FD
+            if (0 == reg.shm_fd_upgrade || 0 == n.get_conf().shm_upgrade_size) {
+                return;
+            }
+
+            if (0 != UTIL_STRFUNC_STRNCASE_CMP("unix", conn.get_address().scheme.c_str(), 4) || ep.get_hostname() != n.get_hostname()) {
+                return;
+            }
+
+            // 已经有同机的数据通道(内存或共享内存通道)则不需要升级
+            connection *data_conn = n.get_self_endpoint()->get_data_connection(&ep, false);
+            if (NULL != data_conn && data_conn->check_flag(connection::flag_t::ACCESS_SHARE_HOST)) {
+                return;
+            }
+
+            char addr[128] = {0};
+            UTIL_STRFUNC_SNPRINTF(addr, sizeof(addr), "memfd://%llx-%llx-%u", static_cast<unsigned long long>(n.get_id()),
+                                  static_cast<unsigned long long>(ep.get_id()), n.alloc_msg_seq());
+
+            connection::ptr_t shm_conn = connection::create(&n);
+            if (!shm_conn) {
+                ATBUS_FUNC_NODE_ERROR(n, &ep, &conn, EN_ATBUS_ERR_MALLOC, 0);
+                return;
+            }
+
+            int fd = -1;
+            int res = shm_conn->init_shm_fd(addr, n.get_conf().shm_upgrade_size, &fd);
+            if (res >= 0) {
+                res = msg_handler::send_shm_fd(ATBUS_CMD_NODE_SHM_FD_REQ, n, conn, 0, 0, addr, fd);
+            }
+
+            // 描述符已经复制到发送队列里
+            close_fd(fd);
+
+            if (res < 0) {
+                ATBUS_FUNC_NODE_ERROR(n, &ep, &conn, res, 0);
+                shm_conn->reset();
+            }
+#endif
+        }
     }
 
     int msg_handler::dispatch_msg(node &n, connection *conn, protocol::msg *m, int status, int errcode) {
@@ -67,6 +152,8 @@ namespace atbus {
             fns[ATBUS_CMD_NODE_CONN_SYN] = msg_handler::on_recv_node_conn_syn;
             fns[ATBUS_CMD_NODE_PING] = msg_handler::on_recv_node_ping;
             fns[ATBUS_CMD_NODE_PONG] = msg_handler::on_recv_node_pong;
+            fns[ATBUS_CMD_NODE_SHM_FD_REQ] = msg_handler::on_recv_node_shm_fd_req;
+            fns[ATBUS_CMD_NODE_SHM_FD_RSP] = msg_handler::on_recv_node_shm_fd_rsp;
         }
 
         if (NULL == m) {
@@ -126,6 +213,11 @@ namespace atbus {
 
         reg->children_id_mask = n.get_self_endpoint()->get_children_mask();
         reg->flags = n.get_self_endpoint()->get_flags();
+        reg->io_frame_version = ATBUS_IO_FRAME_VERSION_FLAGS;
+        reg->io_compress_algorithms = static_cast<uint32_t>(channel::io_stream_compress_algorithms());
+#ifdef ATBUS_CHANNEL_SHM_FD
+        reg->shm_fd_upgrade = n.get_conf().shm_upgrade_size > 0 ? 1 : 0;
+#endif
 
         return send_msg(n, conn, m);
     }
@@ -138,21 +230,59 @@ namespace atbus {
         return n.send_ctrl_msg(m.body.forward->to, m);
     }
 
+    int msg_handler::send_shm_fd(int32_t msg_id, node &n, connection &conn, int32_t ret_code, uint32_t seq, const char *addr, int fd) {
+        if (msg_id != ATBUS_CMD_NODE_SHM_FD_REQ && msg_id != ATBUS_CMD_NODE_SHM_FD_RSP) {
+            return EN_ATBUS_ERR_PARAMS;
+        }
+
+        protocol::msg m;
+        m.init(n.get_id(), static_cast<ATBUS_PROTOCOL_CMD>(msg_id), 0, ret_code, 0 == seq ? n.alloc_msg_seq() : seq);
+
+        protocol::conn_data *conn_body = m.body.make_body(m.body.conn);
+        if (NULL == conn_body) {
+            return EN_ATBUS_ERR_MALLOC;
+        }
+        conn_body->address.address = addr;
+
+        if (fd < 0) {
+            return send_msg(n, conn, m);
+        }
+
+        // 描述符和消息一起发送，对端收到这条消息时取出
+        msgpack::sbuffer packed_buffer;
+        msgpack::pack(packed_buffer, m);
+
+        size_t packed_size = packed_buffer.size();
+        if (packed_size >= n.get_conf().msg_size) {
+            return EN_ATBUS_ERR_BUFF_LIMIT;
+        }
+
+        ATBUS_FUNC_NODE_DEBUG(n, conn.get_binding(), &conn, &m, "node send msg(cmd=%s, type=%d, sequence=%u, ret=%d, length=%llu, fd=%d)",
+                              detail::get_cmd_name(m.head.cmd), m.head.type, m.head.sequence, m.head.ret,
+                              static_cast<unsigned long long>(packed_size), fd);
+
+        return conn.push_fd(fd, packed_buffer.data(), packed_size);
+    }
+
     int msg_handler::send_msg(node &n, connection &conn, const protocol::msg &m) {
-        std::stringstream ss;
-        msgpack::pack(ss, m);
-        std::string packed_buffer = ss.str();
+        // sbuffer 使用malloc分配内存，打包完成后可以直接把所有权交给connection，进程内通道不需要再拷贝
+        msgpack::sbuffer packed_buffer;
+        msgpack::pack(packed_buffer, m);
 
-        if (packed_buffer.size() >= n.get_conf().msg_size) {
+        size_t packed_size = packed_buffer.size();
+        if (packed_size >= n.get_conf().msg_size) {
             return EN_ATBUS_ERR_BUFF_LIMIT;
         }
 
         ATBUS_FUNC_NODE_DEBUG(n, conn.get_binding(), &conn, &m, "node send msg(cmd=%s, type=%d, sequence=%u, ret=%d, length=%llu)",
                               detail::get_cmd_name(m.head.cmd), m.head.type, m.head.sequence, m.head.ret,
-                              static_cast<unsigned long long>(packed_buffer.size()));
+                              static_cast<unsigned long long>(packed_size));
 
-        return conn.push(packed_buffer.data(), packed_buffer.size());
-        ;
+        // 节点控制协议(注册、ping/pong等)不能排在大量数据消息后面，否则可能被判定为超时
+        if (m.head.cmd >= ATBUS_CMD_NODE_SYNC_REQ) {
+            return conn.push_ctrl(packed_buffer.release(), packed_size, NULL);
+        }
+        return conn.push_ptr(packed_buffer.release(), packed_size, NULL);
     }
 
     int msg_handler::on_recv_data_transfer_req(node &n, connection *conn, protocol::msg &m, int status, int errcode) {
@@ -166,7 +296,9 @@ namespace atbus {
                                   static_cast<unsigned long long>(m.body.forward->content.size));
             n.on_recv_data(conn->get_binding(), conn, m, m.body.forward->content.ptr, m.body.forward->content.size);
 
-            if (m.body.forward->check_flag(atbus::protocol::forward_data::FLAG_REQUIRE_RSP)) {
+            // udp的来源地址可以伪造，不回包，避免被用来放大流量
+            if (m.body.forward->check_flag(atbus::protocol::forward_data::FLAG_REQUIRE_RSP) &&
+                false == conn->check_flag(connection::flag_t::UNRELIABLE)) {
                 return send_transfer_rsp(n, m, EN_ATBUS_ERR_SUCCESS);
             }
             return EN_ATBUS_ERR_SUCCESS;
@@ -197,9 +329,10 @@ namespace atbus {
 
                 const std::list<std::string> &listen_addrs = to_ep->get_listen();
                 for (std::list<std::string>::const_iterator iter = listen_addrs.begin(); iter != listen_addrs.end(); ++iter) {
-                    // 通知连接控制通道，控制通道不能是（共享）内存通道
+                    // 通知连接控制通道，控制通道不能是（共享）内存通道或udp通道
                     if (0 != UTIL_STRFUNC_STRNCASE_CMP("mem:", iter->c_str(), 4) &&
-                        0 != UTIL_STRFUNC_STRNCASE_CMP("shm:", iter->c_str(), 4)) {
+                        0 != UTIL_STRFUNC_STRNCASE_CMP("shm:", iter->c_str(), 4) &&
+                        0 != UTIL_STRFUNC_STRNCASE_CMP("udp:", iter->c_str(), 4)) {
                         new_conn->address.address = *iter;
                         break;
                     }
@@ -358,9 +491,12 @@ namespace atbus {
             // 如果双方一边有IOS通道，另一边没有，则没有的连接有的
             // 如果双方都有IOS通道，则ID小的连接ID大的
             bool has_ios_listen = false;
-            for (std::list<std::string>::const_iterator iter = n.get_listen_list().begin();
-                 !has_ios_listen && iter != n.get_listen_list().end(); ++iter) {
-                if (0 != UTIL_STRFUNC_STRNCASE_CMP("mem:", iter->c_str(), 4) && 0 != UTIL_STRFUNC_STRNCASE_CMP("shm:", iter->c_str(), 4)) {
+            bool has_udp_listen = false;
+            for (std::list<std::string>::const_iterator iter = n.get_listen_list().begin(); iter != n.get_listen_list().end(); ++iter) {
+                if (0 == UTIL_STRFUNC_STRNCASE_CMP("udp:", iter->c_str(), 4)) {
+                    has_udp_listen = true;
+                } else if (0 != UTIL_STRFUNC_STRNCASE_CMP("mem:", iter->c_str(), 4) &&
+                           0 != UTIL_STRFUNC_STRNCASE_CMP("shm:", iter->c_str(), 4)) {
                     has_ios_listen = true;
                 }
             }
@@ -373,8 +509,10 @@ namespace atbus {
                 if (has_ios_listen && n.get_id() > ep->get_id()) {
                     // wait peer to connect n, do not check and close endpoint
                     has_data_conn = true;
+                    // 单工的通道(内存、共享内存和udp)总是由收到注册消息的一方连接
                     if (0 != UTIL_STRFUNC_STRNCASE_CMP("mem:", chan.address.c_str(), 4) &&
-                        0 != UTIL_STRFUNC_STRNCASE_CMP("shm:", chan.address.c_str(), 4)) {
+                        0 != UTIL_STRFUNC_STRNCASE_CMP("shm:", chan.address.c_str(), 4) &&
+                        0 != UTIL_STRFUNC_STRNCASE_CMP("udp:", chan.address.c_str(), 4)) {
                         continue;
                     }
                 }
@@ -384,6 +522,11 @@ namespace atbus {
                     continue;
                 }
 
+                // 对端只接受从注册的udp地址发出的数据报，自己没有监听udp地址时使用可靠的数据连接
+                if (0 == UTIL_STRFUNC_STRNCASE_CMP("udp:", chan.address.c_str(), 4) && !has_udp_listen) {
+                    continue;
+                }
+
                 // if n is not a temporary node, connect to other nodes
                 if (0 != n.get_id() && 0 != ep->get_id()) {
                     res = n.connect(chan.address.c_str(), ep);
@@ -412,6 +555,9 @@ namespace atbus {
             if (rsp_code < 0) {
                 ATBUS_FUNC_NODE_ERROR(n, ep, conn, ret, errcode);
                 conn->disconnect();
+            } else if (ret >= 0) {
+                // 回包仍然是旧格式，对端收到回包后才可能切换
+                detail::set_io_frame_checksum(n, *conn, *m.body.reg);
             }
 
             return ret;
@@ -449,7 +595,17 @@ namespace atbus {
 
             conn->disconnect();
             return m.head.ret;
-        } else if (node::state_t::CONNECTING_PARENT == n.get_state()) {
+        }
+
+        if (NULL != m.body.reg) {
+            detail::set_io_frame_checksum(n, *conn, *m.body.reg);
+
+            if (NULL != ep) {
+                detail::upgrade_shm_fd(n, *conn, *ep, *m.body.reg);
+            }
+        }
+
+        if (node::state_t::CONNECTING_PARENT == n.get_state()) {
             // 父节点返回的rsp成功则可以上线
             // 这时候父节点的endpoint不一定初始化完毕
             if (n.is_parent_node(m.body.reg->bus_id)) {
@@ -518,4 +674,134 @@ namespace atbus {
 
         return EN_ATBUS_ERR_SUCCESS;
     }
+
+    int msg_handler::on_recv_node_shm_fd_req(node &n, connection *conn, protocol::msg &m, int status, int errcode) {
+        if (NULL == m.body.conn || NULL == conn) {
+            ATBUS_FUNC_NODE_ERROR(n, NULL == conn ? NULL : conn->get_binding(), conn, EN_ATBUS_ERR_BAD_DATA, 0);
+            return EN_ATBUS_ERR_BAD_DATA;
+        }
+
+        // 描述符和消息一起到达，不接受升级也要取出并关闭
+        int peer_fd = -1;
+        int32_t rsp_code = conn->pop_fd(&peer_fd);
+        int fd = -1;
+        endpoint *ep = conn->get_binding();
+        connection::ptr_t shm_conn;
+        const char *addr = m.body.conn->address.address.c_str();
+
+        do {
+            if (rsp_code < 0) {
+                break;
+            }
+
+            if (NULL == ep || 0 == n.get_conf().shm_upgrade_size || 0 != UTIL_STRFUNC_STRNCASE_CMP("memfd:", addr, 6)) {
+                rsp_code = EN_ATBUS_ERR_ACCESS_DENY;
+                break;
+            }
+
+            connection *data_conn = n.get_self_endpoint()->get_data_connection(ep, false);
+            if (NULL != data_conn && data_conn->check_flag(connection::flag_t::ACCESS_SHARE_HOST)) {
+                rsp_code = EN_ATBUS_ERR_ACCESS_DENY;
+                break;
+            }
+
+            shm_conn = connection::create(&n);
+            if (!shm_conn) {
+                rsp_code = EN_ATBUS_ERR_MALLOC;
+                break;
+            }
+
+            rsp_code = shm_conn->init_shm_fd(addr, n.get_conf().shm_upgrade_size, &fd);
+            if (rsp_code < 0) {
+                break;
+            }
+
+            rsp_code = shm_conn->attach_shm_fd(peer_fd);
+            if (rsp_code < 0) {
+                break;
+            }
+
+            if (false == ep->add_connection(shm_conn.get(), true)) {
+                rsp_code = EN_ATBUS_ERR_ATNODE_NO_CONNECTION;
+            }
+        } while (false);
+
+        detail::close_fd(peer_fd);
+
+        if (rsp_code < 0) {
+            ATBUS_FUNC_NODE_ERROR(n, ep, conn, rsp_code, 0);
+            if (shm_conn) {
+                shm_conn->reset();
+            }
+
+            detail::close_fd(fd);
+            fd = -1;
+        }
+
+        int ret = send_shm_fd(ATBUS_CMD_NODE_SHM_FD_RSP, n, *conn, rsp_code, m.head.sequence, addr, fd);
+        detail::close_fd(fd);
+
+        // 对端收不到本端的接收通道，这个连接也不能再使用
+        if (ret < 0 && rsp_code >= 0) {
+            ATBUS_FUNC_NODE_ERROR(n, ep, conn, ret, 0);
+            shm_conn->reset();
+        }
+
+        return ret;
+    }
+
+    int msg_handler::on_recv_node_shm_fd_rsp(node &n, connection *conn, protocol::msg &m, int status, int errcode) {
+        if (NULL == m.body.conn || NULL == conn) {
+            ATBUS_FUNC_NODE_ERROR(n, NULL == conn ? NULL : conn->get_binding(), conn, EN_ATBUS_ERR_BAD_DATA, 0);
+            return EN_ATBUS_ERR_BAD_DATA;
+        }
+
+        int fd = -1;
+        int res = conn->pop_fd(&fd);
+        endpoint *ep = conn->get_binding();
+        const std::string &addr = m.body.conn->address.address;
+
+        connection::ptr_t shm_conn;
+        if (0 == UTIL_STRFUNC_STRNCASE_CMP("memfd:", addr.c_str(), 6)) {
+            shm_conn = n.get_proc_connection(addr);
+        }
+
+        if (!shm_conn || NULL == ep || (NULL != shm_conn->get_binding() && ep != shm_conn->get_binding())) {
+            detail::close_fd(fd);
+
+            ATBUS_FUNC_NODE_DEBUG(n, ep, conn, &m, "shm fd connection %s not found", addr.c_str());
+            return EN_ATBUS_ERR_CONNECTION_NOT_FOUND;
+        }
+
+        // 任意一端失败，两端都放弃这个通道，原来的连接不受影响
+        if (m.head.ret < 0 || shm_conn->is_connected()) {
+            detail::close_fd(fd);
+
+            if (m.head.ret < 0) {
+                ATBUS_FUNC_NODE_ERROR(n, ep, conn, m.head.ret, errcode);
+                shm_conn->reset();
+            }
+            return m.head.ret;
+        }
+
+        if (res >= 0) {
+            res = shm_conn->attach_shm_fd(fd);
+            detail::close_fd(fd);
+        }
+
+        if (res >= 0 && false == ep->add_connection(shm_conn.get(), true)) {
+            res = EN_ATBUS_ERR_ATNODE_NO_CONNECTION;
+        }
+
+        if (res < 0) {
+            ATBUS_FUNC_NODE_ERROR(n, ep, conn, res, 0);
+            shm_conn->reset();
+
+            // 通知对端释放已经建立的通道
+            return send_shm_fd(ATBUS_CMD_NODE_SHM_FD_RSP, n, *conn, res, m.head.sequence, addr.c_str(), -1);
+        }
+
+        ATBUS_FUNC_NODE_DEBUG(n, ep, conn, &m, "connection upgraded to %s", addr.c_str());
+        return res;
+    }
 }
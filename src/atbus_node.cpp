@@ -48,6 +48,16 @@ namespace atbus {
         delete p;
     }
 
+    void node::udp_channel_del::operator()(channel::udp_channel *p) const {
+        channel::udp_close(p);
+        delete p;
+    }
+
+    void node::io_stream_shards_del::operator()(channel::io_stream_shards *p) const {
+        channel::io_stream_shard_close(p);
+        delete p;
+    }
+
     node::~node() {
         if (state_t::CREATED != state_) {
             reset();
@@ -66,12 +76,30 @@ namespace atbus {
         conf->ping_interval = 60;
         conf->retry_interval = 3;
         conf->fault_tolerant = 3;
+        conf->dns_cache_ttl = 60;
+        conf->dns_negative_cache_ttl = 5;
+        conf->connect_attempt_delay = 250;
+        conf->close_timeout = 3000;
+        conf->io_loop_number = 0;
         conf->backlog = ATBUS_MACRO_CONNECTION_BACKLOG;
 
         conf->msg_size = ATBUS_MACRO_MSG_LIMIT;
         conf->recv_buffer_size = ATBUS_MACRO_MSG_LIMIT * 32; // default for 3 times of ATBUS_MACRO_MSG_LIMIT = 2MB
         conf->send_buffer_size = ATBUS_MACRO_MSG_LIMIT;
         conf->send_buffer_number = 0;
+        conf->send_window_size = 4;
+        conf->frame_checksum = channel::io_stream_checksum_t::EN_CS_CRC32C;
+        conf->compress_threshold = 0;
+        conf->compress_level = 1;
+        conf->send_cork_size = 0;
+        conf->send_cork_delay = 0;
+        conf->shm_upgrade_size = 0;
+        conf->udp_msg_size = 1400; // 以太网MTU减去IP头和UDP头
+        conf->sock_send_buffer = 0;
+        conf->sock_recv_buffer = 0;
+        conf->sock_busy_poll = 0;
+        conf->sock_notsent_lowat = 0;
+        conf->sock_tos = 0;
 
         conf->flags.reset();
     }
@@ -97,6 +125,11 @@ namespace atbus {
             conf_ = *conf;
         }
 
+        // 发送延迟统计在I/O线程中更新，逻辑线程不能读取
+        if (conf_.io_loop_number > 0 && conf_.flags.test(conf_flag_t::EN_CONF_LATENCY_STAT)) {
+            return EN_ATBUS_ERR_PARAMS;
+        }
+
         ev_loop_ = conf_.ev_loop;
         self_ = endpoint::create(this, id, conf_.children_mask, get_pid(), get_hostname());
         if (!self_) {
@@ -193,6 +226,11 @@ namespace atbus {
             self_->reset();
         }
 
+        // 发送完剩余数据后关闭所有连接，对端卡住时超时强制关闭，保证下面的等待有上限
+        if (iostream_channel_) {
+            channel::io_stream_close_async(iostream_channel_.get(), conf_.close_timeout, NULL, NULL, 0);
+        }
+
         // 引用的数据(正在进行的连接)也必须全部释放完成
         // 保证延迟释放的连接也释放完成
         while (!ref_objs_.empty()) {
@@ -201,7 +239,10 @@ namespace atbus {
 
         // 基础数据
         iostream_channel_.reset(); // 这里结束后就不会再触发回调了
+        iostream_shards_.reset();  // I/O线程发送完剩余数据(最多等待close_timeout)后退出，之后也不会再触发回调了
+        iostream_shard_connections_.clear();
         iostream_conf_.reset();
+        udp_channel_.reset(); // 监听的socket已经在self_->reset()里关闭，这里发送剩余的数据报后关闭
 
         if (NULL != ev_loop_) {
             ev_loop_ = NULL;
@@ -340,6 +381,16 @@ namespace atbus {
             event_timer_.pending_check_list_.clear();
         }
 
+        // 本轮的消息处理完了，不再等待延迟合并发送的定时器
+        if (iostream_channel_) {
+            channel::io_stream_flush_all(iostream_channel_.get());
+        }
+
+        // 合并发送的数据报也不再等到下一次事件循环
+        if (udp_channel_) {
+            channel::udp_flush(udp_channel_.get());
+        }
+
         return ret;
     }
 
@@ -390,6 +441,9 @@ namespace atbus {
             return EN_ATBUS_ERR_ACCESS_DENY;
         } else if (0 == UTIL_STRFUNC_STRNCASE_CMP("shm", addr_str, 3)) {
             return EN_ATBUS_ERR_ACCESS_DENY;
+        } else if (0 == UTIL_STRFUNC_STRNCASE_CMP("udp", addr_str, 3)) {
+            // udp通道是无连接的，也不能握手
+            return EN_ATBUS_ERR_ACCESS_DENY;
         }
 
         int ret = conn->connect(addr_str);
@@ -419,7 +473,8 @@ namespace atbus {
 
         ATBUS_FUNC_NODE_DEBUG(*this, ep, conn.get(), NULL, "connect to %s and bind to a endpoint, res: %d", addr_str, ret);
 
-        if (0 == UTIL_STRFUNC_STRNCASE_CMP("mem:", addr_str, 4) || 0 == UTIL_STRFUNC_STRNCASE_CMP("shm:", addr_str, 4)) {
+        if (0 == UTIL_STRFUNC_STRNCASE_CMP("mem:", addr_str, 4) || 0 == UTIL_STRFUNC_STRNCASE_CMP("shm:", addr_str, 4) ||
+            0 == UTIL_STRFUNC_STRNCASE_CMP("udp:", addr_str, 4)) {
             if (ep->add_connection(conn.get(), true)) {
                 return EN_ATBUS_ERR_SUCCESS;
             }
@@ -462,6 +517,23 @@ namespace atbus {
         return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
     }
 
+    int node::migrate_shm_channel(const char *addr_str, key_t new_key, size_t new_size) {
+        channel::channel_address_t addr;
+        if (false == channel::make_address(addr_str, addr)) {
+            return EN_ATBUS_ERR_CHANNEL_ADDR_INVALID;
+        }
+
+        detail::auto_select_map<std::string, connection::ptr_t>::type::iterator iter = proc_connections_.find(addr.address);
+        if (iter == proc_connections_.end() || !iter->second) {
+            return EN_ATBUS_ERR_CONNECTION_NOT_FOUND;
+        }
+
+        int ret = iter->second->migrate_shm(new_key, new_size);
+        ATBUS_FUNC_NODE_DEBUG(*this, self_.get(), iter->second.get(), NULL, "migrate %s to shm key %lld, res: %d", addr_str,
+                              static_cast<long long>(new_key), ret);
+        return ret;
+    }
+
     int node::send_data(bus_id_t tid, int type, const void *buffer, size_t s, bool require_rsp) {
         if (s >= conf_.msg_size) {
             return EN_ATBUS_ERR_BUFF_LIMIT;
@@ -513,6 +585,31 @@ namespace atbus {
         return send_data_msg(tid, m);
     }
 
+    int node::send_data_unreliable(bus_id_t tid, int type, const void *buffer, size_t s) {
+        // 收到udp消息的节点不会转发，所以只有直连的端点才使用udp通道
+        if (tid == get_id() || NULL == get_endpoint(tid)) {
+            return send_data(tid, type, buffer, s, false);
+        }
+
+        if (s >= conf_.msg_size) {
+            return EN_ATBUS_ERR_BUFF_LIMIT;
+        }
+
+        atbus::protocol::msg m;
+        m.init(get_id(), ATBUS_CMD_DATA_TRANSFORM_REQ, type, 0, alloc_msg_seq());
+
+        if (NULL == m.body.make_body(m.body.forward)) {
+            return EN_ATBUS_ERR_MALLOC;
+        }
+
+        m.body.forward->from = get_id();
+        m.body.forward->to = tid;
+        m.body.forward->content.ptr = buffer;
+        m.body.forward->content.size = s;
+
+        return send_msg(tid, m, &endpoint::get_unreliable_connection, NULL, NULL);
+    }
+
     int node::send_data_msg(bus_id_t tid, atbus::protocol::msg &mb) { return send_data_msg(tid, mb, NULL, NULL); }
 
     int node::send_data_msg(bus_id_t tid, atbus::protocol::msg &mb, endpoint **ep_out, connection **conn_out) {
@@ -803,6 +900,34 @@ namespace atbus {
         return NULL != self_->get_data_connection(ep, false);
     }
 
+    int node::pause_read(bus_id_t tid) {
+        endpoint *ep = get_endpoint(tid);
+        if (NULL == ep) {
+            return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+        }
+
+        size_t paused = ep->pause_read();
+        ATBUS_FUNC_NODE_DEBUG(*this, ep, NULL, NULL, "pause reading %llu connection(s)", static_cast<unsigned long long>(paused));
+
+        // 只有控制连接(或者数据连接都不支持暂停)时没有暂停任何连接，恢复原来的状态
+        if (0 == paused) {
+            ep->resume_read();
+            return EN_ATBUS_ERR_ATNODE_NO_CONNECTION;
+        }
+        return EN_ATBUS_ERR_SUCCESS;
+    }
+
+    int node::resume_read(bus_id_t tid) {
+        endpoint *ep = get_endpoint(tid);
+        if (NULL == ep) {
+            return EN_ATBUS_ERR_ATNODE_NOT_FOUND;
+        }
+
+        size_t resumed = ep->resume_read();
+        ATBUS_FUNC_NODE_DEBUG(*this, ep, NULL, NULL, "resume reading %llu connection(s)", static_cast<unsigned long long>(resumed));
+        return EN_ATBUS_ERR_SUCCESS;
+    }
+
     adapter::loop_t *node::get_evloop() {
         assert(state_t::CREATED != state_);
         if (NULL != ev_loop_) {
@@ -904,6 +1029,43 @@ namespace atbus {
         return true;
     }
 
+    connection::ptr_t node::get_proc_connection(const std::string &conn_key) const {
+        detail::auto_select_map<std::string, connection::ptr_t>::type::const_iterator iter = proc_connections_.find(conn_key);
+        if (iter == proc_connections_.end()) {
+            return connection::ptr_t();
+        }
+
+        return iter->second;
+    }
+
+    bool node::add_iostream_shard_connection(uint64_t conn_id, connection *conn) {
+        if (NULL == conn || 0 == conn_id || iostream_shard_connections_.end() != iostream_shard_connections_.find(conn_id)) {
+            return false;
+        }
+
+        iostream_shard_connections_[conn_id] = conn;
+        return true;
+    }
+
+    bool node::remove_iostream_shard_connection(uint64_t conn_id) {
+        detail::auto_select_map<uint64_t, connection *>::type::iterator iter = iostream_shard_connections_.find(conn_id);
+        if (iter == iostream_shard_connections_.end()) {
+            return false;
+        }
+
+        iostream_shard_connections_.erase(iter);
+        return true;
+    }
+
+    connection *node::get_iostream_shard_connection(uint64_t conn_id) const {
+        detail::auto_select_map<uint64_t, connection *>::type::const_iterator iter = iostream_shard_connections_.find(conn_id);
+        if (iter == iostream_shard_connections_.end()) {
+            return NULL;
+        }
+
+        return iter->second;
+    }
+
     bool node::add_connection_timer(connection::ptr_t conn) {
         if (!conn) {
             return false;
@@ -1346,11 +1508,66 @@ namespace atbus {
         iostream_channel_->evt.callbacks[channel::io_stream_callback_evt_t::EN_FN_CONNECTED] = connection::iostream_on_connected;
         iostream_channel_->evt.callbacks[channel::io_stream_callback_evt_t::EN_FN_DISCONNECTED] = connection::iostream_on_disconnected;
         iostream_channel_->evt.callbacks[channel::io_stream_callback_evt_t::EN_FN_RECVED] = connection::iostream_on_recv_cb;
-        iostream_channel_->evt.callbacks[channel::io_stream_callback_evt_t::EN_FN_WRITEN] = connection::iostream_on_written;
+        iostream_channel_->evt.callbacks[channel::io_stream_callback_evt_t::EN_FN_RECVED_BATCH] = connection::iostream_on_recv_batch_cb;
+        iostream_channel_->evt.callbacks[channel::io_stream_callback_evt_t::EN_FN_WRITEN_BATCH] = connection::iostream_on_written;
 
         return iostream_channel_.get();
     }
 
+    channel::udp_channel *node::get_udp_channel() {
+        if (udp_channel_) {
+            return udp_channel_.get();
+        }
+
+        channel::udp_conf conf;
+        channel::udp_init_configure(&conf);
+        conf.send_max_size = conf_.udp_msg_size;
+        conf.sock_send_buffer = conf_.sock_send_buffer;
+        conf.sock_recv_buffer = conf_.sock_recv_buffer;
+
+        udp_channel_.reset(new channel::udp_channel());
+        channel::udp_init(udp_channel_.get(), get_evloop(), &conf);
+        udp_channel_->data = this;
+        udp_channel_->on_recv = connection::udp_on_recv_cb;
+
+        return udp_channel_.get();
+    }
+
+    channel::io_stream_shards *node::get_iostream_shards() {
+        if (iostream_shards_) {
+            return iostream_shards_.get();
+        }
+
+        if (0 == conf_.io_loop_number) {
+            return NULL;
+        }
+
+        // 和ev_loop中的连接使用相同的配置，消息队列和接收缓冲区一样大
+        channel::io_stream_shard_conf conf;
+        channel::io_stream_shard_init_configure(&conf);
+        conf.shard_number = conf_.io_loop_number;
+        conf.queue_size = conf_.recv_buffer_size;
+        conf.close_timeout = conf_.close_timeout;
+        conf.stream_conf = *get_iostream_conf();
+
+        iostream_shards_.reset(new channel::io_stream_shards());
+        int res = channel::io_stream_shard_init(iostream_shards_.get(), get_evloop(), &conf);
+        if (res < 0) {
+            ATBUS_FUNC_NODE_ERROR(*this, NULL, NULL, res, 0);
+            iostream_shards_.reset();
+            return NULL;
+        }
+        iostream_shards_->data = this;
+
+        // callbacks
+        iostream_shards_->callbacks[channel::io_stream_callback_evt_t::EN_FN_ACCEPTED] = connection::iostream_shard_on_accepted;
+        iostream_shards_->callbacks[channel::io_stream_callback_evt_t::EN_FN_DISCONNECTED] = connection::iostream_shard_on_disconnected;
+        iostream_shards_->callbacks[channel::io_stream_callback_evt_t::EN_FN_RECVED] = connection::iostream_shard_on_recv_cb;
+        iostream_shards_->callbacks[channel::io_stream_callback_evt_t::EN_FN_WRITEN] = connection::iostream_shard_on_send_failed;
+
+        return iostream_shards_.get();
+    }
+
     node::ptr_t node::get_watcher() { return watcher_.lock(); }
 
     channel::io_stream_conf *node::get_iostream_conf() {
@@ -1368,8 +1585,22 @@ namespace atbus {
         iostream_conf_->send_buffer_static = conf_.send_buffer_number;
         iostream_conf_->send_buffer_max_size = conf_.send_buffer_size;
         iostream_conf_->send_buffer_limit_size = conf_.msg_size;
+        iostream_conf_->send_window_size = conf_.send_window_size;
         iostream_conf_->confirm_timeout = conf_.first_idle_timeout;
         iostream_conf_->backlog = conf_.backlog;
+        iostream_conf_->is_reuse_port = conf_.flags.test(conf_flag_t::EN_CONF_REUSE_PORT);
+        iostream_conf_->send_cork_size = conf_.send_cork_size;
+        iostream_conf_->send_cork_delay = conf_.send_cork_delay;
+        iostream_conf_->sock_send_buffer = conf_.sock_send_buffer;
+        iostream_conf_->sock_recv_buffer = conf_.sock_recv_buffer;
+        iostream_conf_->sock_busy_poll = conf_.sock_busy_poll;
+        iostream_conf_->sock_notsent_lowat = conf_.sock_notsent_lowat;
+        iostream_conf_->sock_tos = conf_.sock_tos;
+        iostream_conf_->is_quickack = conf_.flags.test(conf_flag_t::EN_CONF_TCP_QUICKACK);
+        iostream_conf_->enable_latency_stat = conf_.flags.test(conf_flag_t::EN_CONF_LATENCY_STAT);
+        iostream_conf_->dns_cache_ttl = conf_.dns_cache_ttl;
+        iostream_conf_->dns_negative_cache_ttl = conf_.dns_negative_cache_ttl;
+        iostream_conf_->connect_attempt_delay = conf_.connect_attempt_delay;
 
         return iostream_conf_.get();
     }
@@ -4,7 +4,10 @@
  *        附带c++的部分是为了避免命名空间污染并且c++的跨平台适配更加简单
  */
 
+#include <algorithm>
 #include <assert.h>
+#include <cerrno>
+#include <cmath>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
@@ -14,11 +17,19 @@
 #include <vector>
 
 #ifndef _MSC_VER
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #endif
 
+#ifdef ATBUS_MACRO_WITH_ZLIB
+#include <zlib.h>
+#endif
+
 #include "common/string_oprs.h"
 #include "config/compiler_features.h"
 #include "std/smart_ptr.h"
@@ -27,6 +38,7 @@
 #include "algorithm/murmur_hash.h"
 
 #include "detail/buffer.h"
+#include "detail/crc32.h"
 #include "detail/libatbus_channel_export.h"
 #include "detail/libatbus_error.h"
 
@@ -49,54 +61,20 @@
 #endif
 #endif
 
-#define ATBUS_MACRO_TLS_MERGE_BUFFER_LEN (ATBUS_MACRO_MSG_LIMIT - sizeof(ATBUS_MACRO_DATA_ALIGN_TYPE) - sizeof(uv_write_t))
+// 新版本消息头的第一个字节为flags，低4位为校验方式(io_stream_checksum_t::type)，第4位为zlib压缩，其他位保留
+#define ATBUS_CHANNEL_IOS_FRAME_CHECKSUM_MASK 0x0F
+#define ATBUS_CHANNEL_IOS_FRAME_FLAG_ZLIB 0x10
 
-#if defined(UTIL_CONFIG_THREAD_LOCAL)
-namespace atbus {
-    namespace channel {
-        namespace detail {
-            static char *io_stream_get_msg_buffer() {
-                static UTIL_CONFIG_THREAD_LOCAL char ret[ATBUS_MACRO_TLS_MERGE_BUFFER_LEN];
-                return ret;
-            }
-        }
-    }
-}
+// 本端能解析的flags，收到其他flags的消息时后续数据都无法解析
+#ifdef ATBUS_MACRO_WITH_ZLIB
+#define ATBUS_CHANNEL_IOS_FRAME_KNOWN_FLAGS (ATBUS_CHANNEL_IOS_FRAME_CHECKSUM_MASK | ATBUS_CHANNEL_IOS_FRAME_FLAG_ZLIB)
 #else
-
-#include <pthread.h>
-namespace atbus {
-    namespace channel {
-        namespace detail {
-            static pthread_once_t gt_io_stream_get_msg_buffer_tls_once = PTHREAD_ONCE_INIT;
-            static pthread_key_t gt_io_stream_get_msg_buffer_tls_key;
-
-            static void dtor_pthread_io_stream_get_msg_buffer_tls(void *p) {
-                char *res = reinterpret_cast<char *>(p);
-                if (NULL != res) {
-                    delete[] res;
-                }
-            }
-
-            static void init_pthread_io_stream_get_msg_buffer_tls() {
-                (void)pthread_key_create(&gt_io_stream_get_msg_buffer_tls_key, dtor_pthread_io_stream_get_msg_buffer_tls);
-            }
-
-            static char *io_stream_get_msg_buffer() {
-                (void)pthread_once(&gt_io_stream_get_msg_buffer_tls_once, init_pthread_io_stream_get_msg_buffer_tls);
-                char *ret = reinterpret_cast<char *>(pthread_getspecific(gt_io_stream_get_msg_buffer_tls_key));
-                if (NULL == ret) {
-                    ret = new char[ATBUS_MACRO_TLS_MERGE_BUFFER_LEN];
-                    pthread_setspecific(gt_io_stream_get_msg_buffer_tls_key, ret);
-                }
-                return ret;
-            }
-        }
-    }
-}
-
+#define ATBUS_CHANNEL_IOS_FRAME_KNOWN_FLAGS ATBUS_CHANNEL_IOS_FRAME_CHECKSUM_MASK
 #endif
 
+// 小数据包缓冲区每隔多少次读取重新计算一次期望的长度
+#define ATBUS_CHANNEL_IOS_READ_HEAD_SAMPLE_TIMES 64
+
 namespace atbus {
     namespace channel {
 
@@ -173,6 +151,7 @@ namespace atbus {
             conf->keepalive = 60;
             conf->is_noblock = true;
             conf->is_nodelay = true;
+            conf->is_reuse_port = false;
             conf->send_buffer_static = 0;
             conf->recv_buffer_static = 2; // 接收一般就一个正在处理的包，所以预留2个index足够了
 
@@ -181,6 +160,21 @@ namespace atbus {
 
             conf->recv_buffer_max_size = ATBUS_MACRO_MSG_LIMIT * conf->recv_buffer_static;
             conf->recv_buffer_limit_size = ATBUS_MACRO_MSG_LIMIT;
+            conf->send_window_size = 4;
+            conf->recv_head_pool_number = 64;
+            conf->object_pool_number = 256;
+            conf->send_cork_size = 0;
+            conf->send_cork_delay = 0;
+            conf->sock_send_buffer = 0;
+            conf->sock_recv_buffer = 0;
+            conf->sock_busy_poll = 0;
+            conf->sock_notsent_lowat = 0;
+            conf->sock_tos = 0;
+            conf->is_quickack = false;
+            conf->enable_latency_stat = false;
+            conf->dns_cache_ttl = 60;
+            conf->dns_negative_cache_ttl = 5;
+            conf->connect_attempt_delay = 250; // RFC 8305推荐的间隔
 
             conf->backlog = ATBUS_MACRO_CONNECTION_BACKLOG;
         }
@@ -201,6 +195,121 @@ namespace atbus {
             return channel->ev_loop;
         }
 
+        // ============ 连接对象和libuv handle的缓存池 ============
+        static io_stream_object_pool *io_stream_get_object_pool(io_stream_channel *channel) {
+            if (NULL == channel->object_pool && channel->conf.object_pool_number > 0) {
+                channel->object_pool = new io_stream_object_pool();
+                channel->object_pool->ref_count = 1; // channel持有的引用
+                channel->object_pool->max_number = channel->conf.object_pool_number;
+                channel->object_pool->alloc_times = 0;
+                channel->object_pool->reuse_times = 0;
+            }
+
+            return channel->object_pool;
+        }
+
+        static void io_stream_object_pool_clear(io_stream_object_pool *pool) {
+            for (size_t i = 0; i < pool->free_blocks.size(); ++i) {
+                for (size_t j = 0; j < pool->free_blocks[i].second.size(); ++j) {
+                    ::operator delete(pool->free_blocks[i].second[j]);
+                }
+            }
+            pool->free_blocks.clear();
+        }
+
+        static void io_stream_object_pool_release(io_stream_object_pool *pool) {
+            assert(pool->ref_count > 0);
+            if (0 == --pool->ref_count) {
+                io_stream_object_pool_clear(pool);
+                delete pool;
+            }
+        }
+
+        static void *io_stream_object_pool_malloc(io_stream_object_pool *pool, size_t size) {
+            if (NULL == pool) {
+                return ::operator new(size);
+            }
+
+            ++pool->alloc_times;
+            void *ret = NULL;
+            for (size_t i = 0; i < pool->free_blocks.size(); ++i) {
+                if (pool->free_blocks[i].first == size) {
+                    if (!pool->free_blocks[i].second.empty()) {
+                        ret = pool->free_blocks[i].second.back();
+                        pool->free_blocks[i].second.pop_back();
+                        ++pool->reuse_times;
+                    }
+                    break;
+                }
+            }
+
+            if (NULL == ret) {
+                ret = ::operator new(size);
+            }
+
+            ++pool->ref_count;
+            return ret;
+        }
+
+        static void io_stream_object_pool_free(io_stream_object_pool *pool, void *ptr, size_t size) {
+            if (NULL == pool) {
+                ::operator delete(ptr);
+                return;
+            }
+
+            std::vector<void *> *free_list = NULL;
+            for (size_t i = 0; i < pool->free_blocks.size(); ++i) {
+                if (pool->free_blocks[i].first == size) {
+                    free_list = &pool->free_blocks[i].second;
+                    break;
+                }
+            }
+
+            if (NULL == free_list && pool->max_number > 0) {
+                pool->free_blocks.push_back(std::make_pair(size, std::vector<void *>()));
+                free_list = &pool->free_blocks.back().second;
+            }
+
+            if (NULL != free_list && free_list->size() < pool->max_number) {
+                free_list->push_back(ptr);
+            } else {
+                ::operator delete(ptr);
+            }
+
+            io_stream_object_pool_release(pool);
+        }
+
+        // 用于std::allocate_shared，对象和引用计数在同一块内存里，并且内存从缓存池里分配
+        template <typename T>
+        struct io_stream_object_allocator {
+            typedef T value_type;
+
+            template <typename U>
+            struct rebind {
+                typedef io_stream_object_allocator<U> other;
+            };
+
+            explicit io_stream_object_allocator(io_stream_object_pool *p) : pool(p) {}
+
+            template <typename U>
+            io_stream_object_allocator(const io_stream_object_allocator<U> &other) : pool(other.pool) {}
+
+            T *allocate(size_t n) { return reinterpret_cast<T *>(io_stream_object_pool_malloc(pool, n * sizeof(T))); }
+            void deallocate(T *p, size_t n) { io_stream_object_pool_free(pool, p, n * sizeof(T)); }
+
+            template <typename U>
+            bool operator==(const io_stream_object_allocator<U> &other) const {
+                return pool == other.pool;
+            }
+
+            template <typename U>
+            bool operator!=(const io_stream_object_allocator<U> &other) const {
+                return pool != other.pool;
+            }
+
+            io_stream_object_pool *pool;
+        };
+
         int io_stream_init(io_stream_channel *channel, adapter::loop_t *ev_loop, const io_stream_conf *conf) {
             if (NULL == channel) {
                 return EN_ATBUS_ERR_PARAMS;
@@ -217,24 +326,48 @@ namespace atbus {
             channel->ev_loop = ev_loop;
             ATBUS_CHANNEL_IOS_CLEAR_FLAG(channel->flags);
 
+#ifndef _WIN32
+            // 写入已经被对端关闭的连接会产生SIGPIPE，默认会结束进程，libuv不会屏蔽它
+            // 没有设置过处理函数时忽略它，写失败的错误由写回调返回
+            struct sigaction sigpipe_act;
+            if (0 == sigaction(SIGPIPE, NULL, &sigpipe_act) && SIG_DFL == sigpipe_act.sa_handler) {
+                signal(SIGPIPE, SIG_IGN);
+            }
+#endif
+
             memset(channel->evt.callbacks, 0, sizeof(channel->evt.callbacks));
 
+            channel->cork_timer = NULL;
+            channel->cork_timer_deadline = 0;
+            channel->cork_fds.clear();
+            channel->written_timer = NULL;
+            channel->written_fds.clear();
+            channel->close_timer = NULL;
+            channel->close_deadline = 0;
+            channel->is_close_forced = false;
+            channel->close_callback = NULL;
+            channel->close_priv_data = NULL;
+            channel->close_priv_size = 0;
+            channel->object_pool = NULL;
+            channel->dns_cache.clear();
+
             channel->error_code = 0;
             return EN_ATBUS_ERR_SUCCESS;
         }
 
-        int io_stream_close(io_stream_channel *channel) {
-            if (NULL == channel) {
-                return EN_ATBUS_ERR_PARAMS;
-            }
+        static void io_stream_channel_timer_on_close(uv_handle_t *handle) {
+            io_stream_channel *channel = reinterpret_cast<io_stream_channel *>(handle->data);
+            assert(channel);
 
-            io_stream_flag_guard flag_guard(channel->flags, io_stream_channel::EN_CF_CLOSING);
+            free(handle);
+            ATBUS_CHANNEL_REQ_END(channel);
+        }
 
-            // 不允许在回调中关闭
-            if (ATBUS_CHANNEL_IOS_CHECK_FLAG(channel->flags, io_stream_channel::EN_CF_IN_CALLBACK)) {
-                abort();
-            }
+        static int io_stream_disconnect_run(io_stream_connection *connection);
+        static void io_stream_close_async_check(io_stream_channel *channel);
 
+        // 断开所有连接，并关闭延迟合并发送和延迟写完成回调的定时器
+        static void io_stream_disconnect_all(io_stream_channel *channel) {
             // 释放所有连接
             {
                 std::vector<io_stream_connection *> pending_release;
@@ -248,6 +381,131 @@ namespace atbus {
                 }
             }
 
+            // 断开连接时已经发送了所有延迟的数据，定时器不再需要了
+            if (NULL != channel->cork_timer) {
+                uv_timer_stop(channel->cork_timer);
+                uv_close(reinterpret_cast<uv_handle_t *>(channel->cork_timer), io_stream_channel_timer_on_close);
+                channel->cork_timer = NULL;
+            }
+            channel->cork_fds.clear();
+
+            // 还没回调的直接发送完的消息在连接关闭时回调
+            if (NULL != channel->written_timer) {
+                uv_timer_stop(channel->written_timer);
+                uv_close(reinterpret_cast<uv_handle_t *>(channel->written_timer), io_stream_channel_timer_on_close);
+                channel->written_timer = NULL;
+            }
+            channel->written_fds.clear();
+        }
+
+        static void io_stream_close_timer_cb(uv_timer_t *handle) {
+            io_stream_channel *channel = reinterpret_cast<io_stream_channel *>(handle->data);
+            assert(channel);
+
+            io_stream_flag_guard flag_guard(channel->flags, io_stream_channel::EN_CF_IN_CALLBACK);
+
+            // 超时后强制关闭剩下的连接，正在进行的写请求会被取消，未发送的数据被丢弃
+            if (!channel->is_close_forced && !channel->conn_pool.empty() && uv_now(channel->ev_loop) >= channel->close_deadline) {
+                channel->is_close_forced = true;
+
+                std::vector<io_stream_connection *> pending_release;
+                pending_release.reserve(channel->conn_pool.size());
+                for (io_stream_channel::conn_pool_t::iterator iter = channel->conn_pool.begin(); iter != channel->conn_pool.end(); ++iter) {
+                    pending_release.push_back(iter->second.get());
+                }
+
+                for (size_t i = 0; i < pending_release.size(); ++i) {
+                    io_stream_disconnect_run(pending_release[i]);
+                }
+            }
+
+            io_stream_close_async_check(channel);
+        }
+
+        static void io_stream_close_async_check(io_stream_channel *channel) {
+            if (NULL == channel->close_timer || !channel->conn_pool.empty() || !channel->conn_gc_pool.empty()) {
+                return;
+            }
+
+            // 除了关闭定时器自己，还有域名解析这类没有关闭事件的请求，轮询等待它们完成
+            if (channel->active_reqs.get() > 1) {
+                if (0 == uv_timer_get_repeat(channel->close_timer)) {
+                    uv_timer_start(channel->close_timer, io_stream_close_timer_cb, 1, 1);
+                }
+                return;
+            }
+
+            uv_timer_stop(channel->close_timer);
+            uv_close(reinterpret_cast<uv_handle_t *>(channel->close_timer), io_stream_channel_timer_on_close);
+            channel->close_timer = NULL;
+
+            io_stream_callback_t callback = channel->close_callback;
+            channel->close_callback = NULL;
+            if (NULL != callback) {
+                callback(channel, NULL, channel->is_close_forced ? EN_ATBUS_ERR_CHANNEL_CLOSE_TIMEOUT : EN_ATBUS_ERR_SUCCESS,
+                         channel->close_priv_data, channel->close_priv_size);
+            }
+        }
+
+        int io_stream_close_async(io_stream_channel *channel, uint64_t timeout, io_stream_callback_t callback, void *priv_data,
+                                  size_t priv_size) {
+            if (NULL == channel) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (NULL != channel->close_timer) {
+                return EN_ATBUS_ERR_CHANNEL_CLOSING;
+            }
+
+            adapter::loop_t *ev_loop = io_stream_get_loop(channel);
+            if (NULL == ev_loop) {
+                return EN_ATBUS_ERR_MALLOC;
+            }
+
+            channel->close_timer = reinterpret_cast<adapter::timer_t *>(malloc(sizeof(adapter::timer_t)));
+            if (NULL == channel->close_timer) {
+                return EN_ATBUS_ERR_MALLOC;
+            }
+
+            uv_timer_init(ev_loop, channel->close_timer);
+            channel->close_timer->data = channel;
+            ATBUS_CHANNEL_REQ_START(channel);
+
+            channel->close_deadline = uv_now(ev_loop) + timeout;
+            channel->is_close_forced = false;
+            channel->close_callback = callback;
+            channel->close_priv_data = priv_data;
+            channel->close_priv_size = priv_size;
+
+            // 不再接受新连接
+            ATBUS_CHANNEL_IOS_SET_FLAG(channel->flags, io_stream_channel::EN_CF_CLOSING);
+            io_stream_disconnect_all(channel);
+
+            // 完成的回调总是在事件循环里触发
+            uv_timer_start(channel->close_timer, io_stream_close_timer_cb, channel->conn_pool.empty() ? 0 : timeout, 0);
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        int io_stream_close(io_stream_channel *channel) {
+            if (NULL == channel) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            io_stream_flag_guard flag_guard(channel->flags, io_stream_channel::EN_CF_CLOSING);
+
+            // 不允许在回调中关闭
+            if (ATBUS_CHANNEL_IOS_CHECK_FLAG(channel->flags, io_stream_channel::EN_CF_IN_CALLBACK)) {
+                abort();
+            }
+
+            io_stream_disconnect_all(channel);
+
+            // 未完成的异步关闭不再回调，但是保留它的定时器，超时后仍然强制关闭剩下的连接
+            // 否则对端一直不读取数据时下面的等待永远不会结束
+            if (NULL != channel->close_timer) {
+                channel->close_callback = NULL;
+            }
+
             // 必须保证这个接口过后channel内的数据可以正常释放
             // 所以必须等待相关的回调全部完成
             // 当然也可以用另一种方法强行结束掉所有req，但是这样会造成丢失回调
@@ -280,6 +538,28 @@ namespace atbus {
 
             channel->ev_loop = NULL;
 
+            // 释放小数据包缓冲区的缓存池
+            for (size_t i = 0; i < ATBUS_MACRO_IOS_READ_HEAD_LEVELS; ++i) {
+                for (size_t j = 0; j < channel->read_head_pool[i].size(); ++j) {
+                    free(channel->read_head_pool[i][j]);
+                }
+                channel->read_head_pool[i].clear();
+            }
+
+            // 释放缓存的连接对象和handle，还在使用中的对象释放时直接归还给系统
+            if (NULL != channel->object_pool) {
+                channel->object_pool->max_number = 0;
+                io_stream_object_pool_clear(channel->object_pool);
+                io_stream_object_pool_release(channel->object_pool);
+                channel->object_pool = NULL;
+            }
+
+            channel->dns_cache.clear();
+
+            // 释放压缩缓冲区
+            std::vector<char>().swap(channel->compress_buffer);
+            std::vector<char>().swap(channel->decompress_buffer);
+
             return EN_ATBUS_ERR_SUCCESS;
         }
 
@@ -297,6 +577,65 @@ namespace atbus {
         }
 
 
+        static inline size_t io_stream_read_head_size(size_t level) { return static_cast<size_t>(ATBUS_MACRO_DATA_SMALL_SIZE) << level; }
+
+        static char *io_stream_alloc_read_head(io_stream_channel *channel, size_t level) {
+            io_stream_channel::read_head_pool_t &pool = channel->read_head_pool[level];
+            if (!pool.empty()) {
+                char *ret = pool.back();
+                pool.pop_back();
+                return ret;
+            }
+
+            return reinterpret_cast<char *>(malloc(io_stream_read_head_size(level)));
+        }
+
+        static void io_stream_free_read_head(io_stream_channel *channel, char *buffer, size_t level) {
+            if (NULL == buffer) {
+                return;
+            }
+
+            io_stream_channel::read_head_pool_t &pool = channel->read_head_pool[level];
+            if (pool.size() < channel->conf.recv_head_pool_number) {
+                pool.push_back(buffer);
+            } else {
+                free(buffer);
+            }
+        }
+
+        // 记录收到的消息长度(包含消息头)，缓冲区至少要能放下两个这样的消息，不够时立即扩大期望的等级
+        // 返回期望的缓冲区长度
+        static size_t io_stream_sample_read_head(io_stream_connection *conn, size_t frame_size) {
+            io_stream_connection::read_head_t &read_head = conn->read_head;
+            if (frame_size > read_head.sample_max_size) {
+                read_head.sample_max_size = frame_size;
+            }
+
+            while (read_head.expect_level + 1 < ATBUS_MACRO_IOS_READ_HEAD_LEVELS &&
+                   io_stream_read_head_size(read_head.expect_level) < frame_size * 2) {
+                ++read_head.expect_level;
+            }
+
+            return io_stream_read_head_size(read_head.expect_level);
+        }
+
+        // 采样周期结束后按周期内最大的消息重新计算期望的等级，最近都是小消息时缩小
+        static void io_stream_update_read_head_level(io_stream_connection *conn) {
+            io_stream_connection::read_head_t &read_head = conn->read_head;
+            if (++read_head.sample_times < ATBUS_CHANNEL_IOS_READ_HEAD_SAMPLE_TIMES) {
+                return;
+            }
+
+            size_t level = 0;
+            while (level + 1 < ATBUS_MACRO_IOS_READ_HEAD_LEVELS && io_stream_read_head_size(level) < read_head.sample_max_size * 2) {
+                ++level;
+            }
+
+            read_head.expect_level = level;
+            read_head.sample_max_size = 0;
+            read_head.sample_times = 0;
+        }
+
         static void io_stream_on_recv_alloc_fn(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf) {
             io_stream_connection *conn_raw_ptr = reinterpret_cast<io_stream_connection *>(handle->data);
             assert(conn_raw_ptr);
@@ -317,7 +656,30 @@ namespace atbus {
 
             // 正在读取vint时，指定缓冲区为head内存块
             if (NULL == data || 0 == swrite) {
-                buf->len = sizeof(conn_raw_ptr->read_head.buffer) - conn_raw_ptr->read_head.len;
+                io_stream_connection::read_head_t &read_head = conn_raw_ptr->read_head;
+
+                // 按需分配，或者扩大到期望的长度(保留未处理完的数据)
+                if (NULL == read_head.buffer || read_head.level < read_head.expect_level) {
+                    char *new_buffer = io_stream_alloc_read_head(conn_raw_ptr->channel, read_head.expect_level);
+                    if (NULL != new_buffer) {
+                        if (NULL != read_head.buffer) {
+                            memcpy(new_buffer, read_head.buffer, read_head.len);
+                            io_stream_free_read_head(conn_raw_ptr->channel, read_head.buffer, read_head.level);
+                        }
+
+                        read_head.buffer = new_buffer;
+                        read_head.level = read_head.expect_level;
+                    }
+                }
+
+                // 内存不足，libuv会以UV_ENOBUFS回调
+                if (NULL == read_head.buffer) {
+                    buf->base = NULL;
+                    buf->len = 0;
+                    return;
+                }
+
+                buf->len = io_stream_read_head_size(read_head.level) - read_head.len;
 
                 if (0 == buf->len) {
                     // 理论上这里不会走到，因为如果必然会先收取一次header的大小，这时候已经可以解出msg的大小
@@ -336,92 +698,371 @@ namespace atbus {
             buf->len = swrite;
         }
 
-        static void io_stream_on_recv_read_fn(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
-            io_stream_connection *conn_raw_ptr = reinterpret_cast<io_stream_connection *>(stream->data);
-            assert(conn_raw_ptr);
-            io_stream_channel *channel = conn_raw_ptr->channel;
-            assert(channel);
+        static inline uint32_t io_stream_make_checksum(int checksum_type, const void *buf, size_t len) {
+            switch (checksum_type) {
+            case io_stream_checksum_t::EN_CS_NONE:
+                return 0;
+            case io_stream_checksum_t::EN_CS_CRC32C:
+                return ::atbus::detail::crc32c(0, reinterpret_cast<const unsigned char *>(buf), len);
+            default: // EN_CS_LEGACY and EN_CS_MURMUR3
+                return util::hash::murmur_hash3_x86_32(reinterpret_cast<const char *>(buf), static_cast<int>(len), 0);
+            }
+        }
 
-            io_stream_flag_guard flag_guard(channel->flags, io_stream_channel::EN_CF_IN_CALLBACK);
+        static inline bool io_stream_check_checksum(int checksum_type, uint32_t checksum, const void *buf, size_t len) {
+            return io_stream_checksum_t::EN_CS_NONE == checksum_type || checksum == io_stream_make_checksum(checksum_type, buf, len);
+        }
 
-            // 如果正处于关闭阶段，忽略所有数据
-            if (io_stream_connection::EN_ST_CONNECTED != conn_raw_ptr->status) {
-                return;
+        // 写入消息头，旧格式为32位hash+vint，新格式为flags+32位校验和(不校验时没有)+vint。返回消息头长度
+        // frame_flags的低4位为校验方式，旧格式只能是0(EN_CS_LEGACY)
+        static size_t io_stream_write_frame_head(int frame_flags, const void *buf, size_t len, char *head, size_t head_size) {
+            size_t head_len = 0;
+            int checksum_type = frame_flags & ATBUS_CHANNEL_IOS_FRAME_CHECKSUM_MASK;
+            if (io_stream_checksum_t::EN_CS_LEGACY != checksum_type) {
+                head[head_len++] = static_cast<char>(frame_flags);
             }
 
-            // 读取完或EAGAIN或signal中断，直接忽略即可
-            if (0 == nread || UV_EAGAIN == nread || UV_EAI_AGAIN == nread || UV_EINTR == nread) {
-                return;
+            if (io_stream_checksum_t::EN_CS_NONE != checksum_type) {
+                uint32_t checksum = io_stream_make_checksum(checksum_type, buf, len);
+                memcpy(head + head_len, &checksum, sizeof(uint32_t));
+                head_len += sizeof(uint32_t);
             }
 
-            // 网络错误
-            if (nread < 0) {
-                io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_RECVED, channel, conn_raw_ptr, static_cast<int>(nread),
-                                           EN_ATBUS_ERR_READ_FAILED, NULL, 0);
+            return head_len + ::atbus::detail::fn::write_vint(len, head + head_len, head_size - head_len);
+        }
 
-                // 任何非重试的错误则关闭
-                // 注意libuv有个特殊的错误码 UV_ENOBUFS 表示缓冲区不足
-                // 理论上除非配置错误，否则不应该会出现，并且可能会导致header数据无法缩减。所以也直接关闭连接
-                io_stream_disconnect(channel, conn_raw_ptr, NULL);
-                return;
+        struct io_stream_frame_head_t {
+            int flags; // 旧格式为0
+            int checksum_type;
+            uint32_t checksum;
+            uint64_t msg_len;
+        };
+
+        // 解析消息头，返回消息头长度，数据不足时返回0，flags错误时返回-1
+        static int io_stream_read_frame_head(bool has_flags, const char *buf, size_t len, io_stream_frame_head_t &head) {
+            size_t head_len = 0;
+            head.flags = 0;
+            head.checksum_type = io_stream_checksum_t::EN_CS_LEGACY;
+            head.checksum = 0;
+            head.msg_len = 0;
+
+            if (has_flags) {
+                if (len < 1) {
+                    return 0;
+                }
+
+                head.flags = static_cast<unsigned char>(buf[0]);
+                head.checksum_type = head.flags & ATBUS_CHANNEL_IOS_FRAME_CHECKSUM_MASK;
+                if (0 != (head.flags & ~ATBUS_CHANNEL_IOS_FRAME_KNOWN_FLAGS) || io_stream_checksum_t::EN_CS_LEGACY == head.checksum_type ||
+                    head.checksum_type >= io_stream_checksum_t::EN_CS_MAX) {
+                    return -1;
+                }
+                ++head_len;
             }
 
-            void *data = NULL;
-            size_t sread = 0, swrite = 0;
-            conn_raw_ptr->read_buffers.back(data, sread, swrite);
-            bool is_free = false;
+            if (io_stream_checksum_t::EN_CS_NONE != head.checksum_type) {
+                if (len < head_len + sizeof(uint32_t)) {
+                    return 0;
+                }
 
-            // head 阶段
-            if (NULL == data || 0 == swrite) {
-                assert(static_cast<size_t>(nread) <= sizeof(conn_raw_ptr->read_head.buffer) - conn_raw_ptr->read_head.len);
-                conn_raw_ptr->read_head.len += static_cast<size_t>(nread); // 写数据计数
+                memcpy(&head.checksum, buf + head_len, sizeof(uint32_t));
+                head_len += sizeof(uint32_t);
+            }
 
-                // 尝试解出所有的head数据
-                char *buff_start = conn_raw_ptr->read_head.buffer;
-                size_t buff_left_len = conn_raw_ptr->read_head.len;
+            size_t vint_len = ::atbus::detail::fn::read_vint(head.msg_len, buf + head_len, len - head_len);
+            if (0 == vint_len) {
+                return 0;
+            }
 
-                // 可能包含多条消息
-                while (buff_left_len > sizeof(uint32_t)) {
-                    uint64_t msg_len = 0;
-                    // 前4 字节为32位hash
-                    size_t vint_len =
-                        ::atbus::detail::fn::read_vint(msg_len, buff_start + sizeof(uint32_t), buff_left_len - sizeof(uint32_t));
-
-                    // 剩余数据不足以解动态长度整数，直接中断退出
-                    if (0 == vint_len) {
-                        break;
-                    }
+            return static_cast<int>(head_len + vint_len);
+        }
 
-                    // 如果读取vint成功，判定是否有小数据包。并对小数据包直接回调
-                    if (buff_left_len >= sizeof(uint32_t) + vint_len + msg_len) {
-                        channel->error_code = 0;
-                        uint32_t check_hash =
-                            util::hash::murmur_hash3_x86_32(buff_start + sizeof(uint32_t) + vint_len, static_cast<int>(msg_len), 0);
-                        uint32_t expect_hash;
-                        memcpy(&expect_hash, buff_start, sizeof(uint32_t));
-                        int errcode = EN_ATBUS_ERR_SUCCESS;
-                        if (check_hash != expect_hash) {
-                            errcode = EN_ATBUS_ERR_BAD_DATA;
-                        } else if (channel->conf.recv_buffer_limit_size > 0 && msg_len > channel->conf.recv_buffer_limit_size) {
-                            errcode = EN_ATBUS_ERR_INVALID_SIZE;
-                        }
+        // 大数据包缓冲区的头部，后面是消息数据
+        struct io_stream_recv_checksum_t {
+            uint32_t checksum;
+            uint32_t frame_flags;
+        };
 
-                        io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_RECVED, channel, conn_raw_ptr, 0, errcode,
-                                                   buff_start + sizeof(uint32_t) + vint_len,
-                                                   // 这里的地址未对齐，所以buffer不能直接保存内存数据
-                                                   msg_len);
+        // 批量接收回调的缓存，只在一次读回调内有效
+        struct io_stream_recv_batch_t {
+            io_stream_channel *channel;
+            io_stream_connection *connection;
+            bool is_enabled;
+            size_t number;
+            io_stream_recv_msg_t msgs[ATBUS_MACRO_IOS_RECV_BATCH_NUMBER];
+        };
 
-                        // 32bits hash+vint+buffer
-                        buff_start += sizeof(uint32_t) + vint_len + msg_len;
-                        buff_left_len -= sizeof(uint32_t) + vint_len + msg_len;
-                    } else {
-                        // 大数据包，使用缓冲区，并且剩余数据一定是在一个包内
-                        // 32位hash 也暂存在这里
-                        if (EN_ATBUS_ERR_SUCCESS == conn_raw_ptr->read_buffers.push_back(data, sizeof(uint32_t) + msg_len)) {
-                            memcpy(data, buff_start, sizeof(uint32_t)); // 32位hash
-                            memcpy(reinterpret_cast<char *>(data) + sizeof(uint32_t), buff_start + sizeof(uint32_t) + vint_len,
-                                   buff_left_len - sizeof(uint32_t) - vint_len);
-                            conn_raw_ptr->read_buffers.pop_back(buff_left_len - vint_len, false); // vint_len不用保存
+        static void io_stream_flush_recv_batch(io_stream_recv_batch_t &batch) {
+            if (0 == batch.number) {
+                return;
+            }
+
+            size_t number = batch.number;
+            batch.number = 0;
+            io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_RECVED_BATCH, batch.channel, batch.connection, 0,
+                                       EN_ATBUS_ERR_SUCCESS, batch.msgs, number);
+        }
+
+        static void io_stream_on_recv_msg(io_stream_recv_batch_t &batch, int errcode, void *data, size_t s) {
+            if (!batch.is_enabled) {
+                io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_RECVED, batch.channel, batch.connection, 0, errcode, data, s);
+                return;
+            }
+
+            if (batch.number >= ATBUS_MACRO_IOS_RECV_BATCH_NUMBER) {
+                io_stream_flush_recv_batch(batch);
+            }
+
+            batch.msgs[batch.number].errcode = errcode;
+            batch.msgs[batch.number].data = data;
+            batch.msgs[batch.number].size = s;
+            ++batch.number;
+        }
+
+        // 按连接的设置压缩消息，压缩后的数据在channel的压缩缓冲区里。返回压缩方式对应的flags，不压缩时返回0
+        static int io_stream_compress_frame(io_stream_connection *connection, const void *buf, size_t len, const void *&out,
+                                            size_t &out_len) {
+            if (io_stream_compress_t::EN_CA_NONE == connection->send_compress || len < connection->send_compress_threshold) {
+                return 0;
+            }
+
+#ifdef ATBUS_MACRO_WITH_ZLIB
+            if (io_stream_compress_t::EN_CA_ZLIB == connection->send_compress) {
+                uint64_t begin_time = uv_hrtime();
+
+                // vint(原始长度)+zlib数据
+                std::vector<char> &buffer = connection->channel->compress_buffer;
+                uLong bound = compressBound(static_cast<uLong>(len));
+                if (buffer.size() < 16 + bound) {
+                    buffer.resize(16 + bound);
+                }
+                size_t vint_len = ::atbus::detail::fn::write_vint(len, &buffer[0], 16);
+                uLongf compress_len = static_cast<uLongf>(buffer.size() - vint_len);
+                int res = compress2(reinterpret_cast<Bytef *>(&buffer[vint_len]), &compress_len, reinterpret_cast<const Bytef *>(buf),
+                                    static_cast<uLong>(len), connection->send_compress_level);
+
+                connection->compress_stat.compress_nsec += uv_hrtime() - begin_time;
+
+                // 压缩后没有变小的消息直接发送原始数据
+                if (Z_OK != res || vint_len + compress_len >= len) {
+                    ++connection->compress_stat.compress_skip_times;
+                    return 0;
+                }
+
+                ++connection->compress_stat.compress_times;
+                connection->compress_stat.compress_raw_size += len;
+                connection->compress_stat.compress_size += vint_len + compress_len;
+
+                out = &buffer[0];
+                out_len = vint_len + compress_len;
+                return ATBUS_CHANNEL_IOS_FRAME_FLAG_ZLIB;
+            }
+#else
+            (void)buf;
+            (void)out;
+            (void)out_len;
+#endif
+
+            return 0;
+        }
+
+        // 解压消息，成功后data指向channel的解压缓冲区，在下一次解压前有效
+        static int io_stream_decompress_frame(io_stream_connection *connection, char *&data, size_t &len) {
+#ifdef ATBUS_MACRO_WITH_ZLIB
+            uint64_t begin_time = uv_hrtime();
+            io_stream_channel *channel = connection->channel;
+
+            uint64_t raw_len = 0;
+            size_t vint_len = ::atbus::detail::fn::read_vint(raw_len, data, len);
+            if (0 == vint_len) {
+                return EN_ATBUS_ERR_BAD_DATA;
+            }
+
+            // 解压后的数据一样要受消息长度限制
+            if (channel->conf.recv_buffer_limit_size > 0 && raw_len > channel->conf.recv_buffer_limit_size) {
+                return EN_ATBUS_ERR_INVALID_SIZE;
+            }
+
+            std::vector<char> &buffer = channel->decompress_buffer;
+            if (buffer.size() <= raw_len) {
+                buffer.resize(static_cast<size_t>(raw_len) + 1);
+            }
+
+            uLongf decompress_len = static_cast<uLongf>(raw_len);
+            int res = uncompress(reinterpret_cast<Bytef *>(&buffer[0]), &decompress_len, reinterpret_cast<const Bytef *>(data + vint_len),
+                                 static_cast<uLong>(len - vint_len));
+            if (Z_OK != res || decompress_len != raw_len) {
+                return EN_ATBUS_ERR_BAD_DATA;
+            }
+
+            ++connection->compress_stat.decompress_times;
+            connection->compress_stat.decompress_raw_size += raw_len;
+            connection->compress_stat.decompress_size += len;
+            connection->compress_stat.decompress_nsec += uv_hrtime() - begin_time;
+
+            data = &buffer[0];
+            len = static_cast<size_t>(raw_len);
+            return EN_ATBUS_ERR_SUCCESS;
+#else
+            (void)connection;
+            (void)data;
+            (void)len;
+            return EN_ATBUS_ERR_BAD_DATA;
+#endif
+        }
+
+        // 校验并回调一个完整的消息，data可能未对齐
+        static void io_stream_on_recv_frame(io_stream_recv_batch_t &batch, int frame_flags, uint32_t checksum, char *data, size_t len) {
+            io_stream_channel *channel = batch.channel;
+            int errcode = EN_ATBUS_ERR_SUCCESS;
+            if (!io_stream_check_checksum(frame_flags & ATBUS_CHANNEL_IOS_FRAME_CHECKSUM_MASK, checksum, data, len)) {
+                errcode = EN_ATBUS_ERR_BAD_DATA;
+            } else if (channel->conf.recv_buffer_limit_size > 0 && len > channel->conf.recv_buffer_limit_size) {
+                errcode = EN_ATBUS_ERR_INVALID_SIZE;
+            } else if (0 != (frame_flags & ATBUS_CHANNEL_IOS_FRAME_FLAG_ZLIB)) {
+                errcode = io_stream_decompress_frame(batch.connection, data, len);
+
+                // 解压缓冲区会被下一个压缩的消息覆盖，所以要立即回调
+                if (EN_ATBUS_ERR_SUCCESS == errcode) {
+                    io_stream_on_recv_msg(batch, errcode, data, len);
+                    io_stream_flush_recv_batch(batch);
+                    return;
+                }
+            }
+
+            io_stream_on_recv_msg(batch, errcode, data, len);
+        }
+
+        static void io_stream_tcp_quickack(adapter::tcp_t *handle) {
+#if defined(TCP_QUICKACK) && !defined(_MSC_VER)
+            uv_os_fd_t fd;
+            if (0 != uv_fileno(reinterpret_cast<uv_handle_t *>(handle), &fd)) {
+                return;
+            }
+
+            int opt = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &opt, sizeof(opt));
+#endif
+        }
+
+        static void io_stream_on_recv_read_fn(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
+            io_stream_connection *conn_raw_ptr = reinterpret_cast<io_stream_connection *>(stream->data);
+            assert(conn_raw_ptr);
+            io_stream_channel *channel = conn_raw_ptr->channel;
+            assert(channel);
+
+            io_stream_flag_guard flag_guard(channel->flags, io_stream_channel::EN_CF_IN_CALLBACK);
+
+            // 如果正处于关闭阶段，忽略所有数据
+            if (io_stream_connection::EN_ST_CONNECTED != conn_raw_ptr->status) {
+                return;
+            }
+
+            // 读取完或EAGAIN或signal中断，直接忽略即可
+            if (0 == nread || UV_EAGAIN == nread || UV_EAI_AGAIN == nread || UV_EINTR == nread) {
+                return;
+            }
+
+            // 网络错误
+            if (nread < 0) {
+                io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_RECVED, channel, conn_raw_ptr, static_cast<int>(nread),
+                                           EN_ATBUS_ERR_READ_FAILED, NULL, 0);
+
+                // 任何非重试的错误则关闭
+                // 注意libuv有个特殊的错误码 UV_ENOBUFS 表示缓冲区不足
+                // 理论上除非配置错误，否则不应该会出现，并且可能会导致header数据无法缩减。所以也直接关闭连接
+                io_stream_disconnect(channel, conn_raw_ptr, NULL);
+                return;
+            }
+            ++conn_raw_ptr->read_times;
+
+            // TCP_QUICKACK不是永久的，内核进入延迟确认模式后会自动关闭，所以每次读取后重新设置
+            if (channel->conf.is_quickack && UV_TCP == stream->type) {
+                io_stream_tcp_quickack(reinterpret_cast<adapter::tcp_t *>(stream));
+            }
+
+            void *data = NULL;
+            size_t sread = 0, swrite = 0;
+            conn_raw_ptr->read_buffers.back(data, sread, swrite);
+            bool is_free = false;
+            int free_errcode = EN_ATBUS_ERR_INVALID_SIZE;
+
+            io_stream_recv_batch_t batch;
+            batch.channel = channel;
+            batch.connection = conn_raw_ptr;
+            batch.is_enabled = NULL != channel->evt.callbacks[io_stream_callback_evt_t::EN_FN_RECVED_BATCH] ||
+                               NULL != conn_raw_ptr->evt.callbacks[io_stream_callback_evt_t::EN_FN_RECVED_BATCH];
+            batch.number = 0;
+
+            // head 阶段
+            if (NULL == data || 0 == swrite) {
+                assert(static_cast<size_t>(nread) <= io_stream_read_head_size(conn_raw_ptr->read_head.level) - conn_raw_ptr->read_head.len);
+                conn_raw_ptr->read_head.len += static_cast<size_t>(nread); // 写数据计数
+
+                // 读满了缓冲区说明socket里还有更多数据，当作一个占满缓冲区的消息记录，下次使用更大的缓冲区以减少read的次数
+                size_t read_head_size = io_stream_read_head_size(conn_raw_ptr->read_head.level);
+                if (conn_raw_ptr->read_head.len >= read_head_size) {
+                    io_stream_sample_read_head(conn_raw_ptr, read_head_size);
+                }
+
+                // 尝试解出所有的head数据
+                char *buff_start = conn_raw_ptr->read_head.buffer;
+                size_t buff_left_len = conn_raw_ptr->read_head.len;
+
+                // 可能包含多条消息
+                while (buff_left_len > 0) {
+                    io_stream_frame_head_t frame_head;
+                    int head_res = io_stream_read_frame_head(conn_raw_ptr->recv_frame_flags, buff_start, buff_left_len, frame_head);
+
+                    // 剩余数据不足以解消息头，直接中断退出
+                    if (0 == head_res) {
+                        break;
+                    }
+
+                    // 不支持的消息头，后续数据都无法解析
+                    if (head_res < 0) {
+                        is_free = true;
+                        free_errcode = EN_ATBUS_ERR_BAD_DATA;
+                        break;
+                    }
+
+                    size_t head_len = static_cast<size_t>(head_res);
+                    uint64_t msg_len = frame_head.msg_len;
+                    size_t expect_head_size = io_stream_sample_read_head(conn_raw_ptr, head_len + static_cast<size_t>(msg_len));
+
+                    // 旧格式的空消息是切换标记(旧版本不会发送空消息)，之后的消息头都带flags
+                    if (!conn_raw_ptr->recv_frame_flags && 0 == msg_len) {
+                        conn_raw_ptr->recv_frame_flags = true;
+                        buff_start += head_len;
+                        buff_left_len -= head_len;
+                        continue;
+                    }
+
+                    // 如果读取消息头成功，判定是否有小数据包。并对小数据包直接回调
+                    if (buff_left_len >= head_len + msg_len) {
+                        channel->error_code = 0;
+                        io_stream_on_recv_frame(batch, frame_head.flags, frame_head.checksum, buff_start + head_len,
+                                                // 这里的地址未对齐，所以buffer不能直接保存内存数据
+                                                static_cast<size_t>(msg_len));
+
+                        // frame head+buffer
+                        buff_start += head_len + msg_len;
+                        buff_left_len -= head_len + msg_len;
+                    } else if (head_len + msg_len <= expect_head_size) {
+                        // 能放进小数据包缓冲区的消息，等待后续数据即可，不需要使用大数据包缓冲区
+                        break;
+                    } else {
+                        // 大数据包，使用缓冲区，并且剩余数据一定是在一个包内
+                        // 校验和和校验方式也暂存在这里
+                        if (EN_ATBUS_ERR_SUCCESS ==
+                            conn_raw_ptr->read_buffers.push_back(data, sizeof(io_stream_recv_checksum_t) + msg_len)) {
+                            io_stream_recv_checksum_t check_head;
+                            check_head.checksum = frame_head.checksum;
+                            check_head.frame_flags = static_cast<uint32_t>(frame_head.flags);
+                            memcpy(data, &check_head, sizeof(check_head));
+                            memcpy(reinterpret_cast<char *>(data) + sizeof(check_head), buff_start + head_len, buff_left_len - head_len);
+                            // 消息头不用保存
+                            conn_raw_ptr->read_buffers.pop_back(sizeof(check_head) + buff_left_len - head_len, false);
 
                             buff_start += buff_left_len;
                             buff_left_len = 0; // 循环退出
@@ -429,18 +1070,28 @@ namespace atbus {
                             // 追加大缓冲区失败，可能是到达缓冲区限制
                             // 读缓冲区一般只有一个正在处理的数据包，如果发生创建失败则是数据错误或者这个包就是超出大小限制的
                             is_free = true;
-                            buff_start += sizeof(uint32_t) + vint_len;
-                            buff_left_len -= sizeof(uint32_t) + vint_len;
+                            buff_start += head_len;
+                            buff_left_len -= head_len;
                             break;
                         }
                     }
                 }
 
+                // 消息数据都在head内存块里，必须在后续数据前移之前回调
+                io_stream_flush_recv_batch(batch);
+
                 // 后续数据前移
                 if (buff_start != conn_raw_ptr->read_head.buffer && buff_left_len > 0) {
                     memmove(conn_raw_ptr->read_head.buffer, buff_start, buff_left_len);
                 }
                 conn_raw_ptr->read_head.len = buff_left_len;
+                io_stream_update_read_head_level(conn_raw_ptr);
+
+                // 没有未处理的数据时归还缓冲区，空闲的连接不占用小数据包缓冲区
+                if (0 == buff_left_len) {
+                    io_stream_free_read_head(channel, conn_raw_ptr->read_head.buffer, conn_raw_ptr->read_head.level);
+                    conn_raw_ptr->read_head.buffer = NULL;
+                }
             } else {
                 size_t nread_s = static_cast<size_t>(nread);
                 assert(nread_s <= swrite);
@@ -455,24 +1106,16 @@ namespace atbus {
                 channel->error_code = 0;
                 data = ::atbus::detail::fn::buffer_prev(data, sread);
 
-                // 32位Hash校验和
-                uint32_t check_hash = util::hash::murmur_hash3_x86_32(reinterpret_cast<char *>(data) + sizeof(uint32_t),
-                                                                      static_cast<int>(sread - sizeof(uint32_t)), 0);
-                uint32_t expect_hash;
-                memcpy(&expect_hash, data, sizeof(uint32_t));
-                size_t msg_len = sread - sizeof(uint32_t); // - hash32 header
+                // 校验和
+                io_stream_recv_checksum_t check_head;
+                memcpy(&check_head, data, sizeof(check_head));
+                char *msg_start = reinterpret_cast<char *>(data) + sizeof(check_head);
+                size_t msg_len = sread - sizeof(check_head);
 
-                int errcode = EN_ATBUS_ERR_SUCCESS;
-                if (check_hash != expect_hash) {
-                    errcode = EN_ATBUS_ERR_BAD_DATA;
-                } else if (channel->conf.recv_buffer_limit_size > 0 && msg_len > channel->conf.recv_buffer_limit_size) {
-                    errcode = EN_ATBUS_ERR_INVALID_SIZE;
-                }
-
-                io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_RECVED, channel, conn_raw_ptr, 0, errcode,
-                                           reinterpret_cast<char *>(data) + sizeof(uint32_t), // + hash32 header
-                                           // 由于buffer_block内取出的数据已经保证了字节对齐，所以这里一定是4字节对齐
-                                           msg_len);
+                io_stream_on_recv_frame(batch, static_cast<int>(check_head.frame_flags), check_head.checksum, msg_start,
+                                        // 由于buffer_block内取出的数据已经保证了字节对齐，所以这里一定是4字节对齐
+                                        msg_len);
+                io_stream_flush_recv_batch(batch);
 
                 // 回调并释放缓冲区
                 conn_raw_ptr->read_buffers.pop_front(0, true);
@@ -480,10 +1123,10 @@ namespace atbus {
 
             if (is_free) {
                 if (conn_raw_ptr->read_head.len > 0) {
-                    io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_RECVED, channel, conn_raw_ptr, 0, EN_ATBUS_ERR_INVALID_SIZE,
-                                               conn_raw_ptr->read_head.buffer,
-                                               // 由于buffer_block内取出的数据已经保证了字节对齐，所以这里一定是4字节对齐
-                                               conn_raw_ptr->read_head.len);
+                    io_stream_on_recv_msg(batch, free_errcode, conn_raw_ptr->read_head.buffer,
+                                          // 由于buffer_block内取出的数据已经保证了字节对齐，所以这里一定是4字节对齐
+                                          conn_raw_ptr->read_head.len);
+                    io_stream_flush_recv_batch(batch);
                 }
 
                 // 强制中断
@@ -524,6 +1167,57 @@ namespace atbus {
             uv_stream_set_blocking(handle, channel->conf.is_noblock ? 0 : 1);
         }
 
+        // 设置io_stream_conf里的socket内核参数，socket还没创建时(比如Windows上connect之前)忽略
+        // 和keepalive、nodelay一样，设置失败不影响连接，内核会使用默认值
+        static void io_stream_tcp_sockopt(io_stream_channel *channel, adapter::tcp_t *handle) {
+#ifndef _MSC_VER
+            uv_os_fd_t fd;
+            if (0 != uv_fileno(reinterpret_cast<uv_handle_t *>(handle), &fd)) {
+                return;
+            }
+
+            int opt;
+            if (channel->conf.sock_send_buffer > 0) {
+                opt = static_cast<int>(channel->conf.sock_send_buffer);
+                setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &opt, sizeof(opt));
+            }
+
+            if (channel->conf.sock_recv_buffer > 0) {
+                opt = static_cast<int>(channel->conf.sock_recv_buffer);
+                setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt));
+            }
+
+#ifdef SO_BUSY_POLL
+            if (channel->conf.sock_busy_poll > 0) {
+                opt = channel->conf.sock_busy_poll;
+                setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &opt, sizeof(opt));
+            }
+#endif
+
+#ifdef TCP_NOTSENT_LOWAT
+            if (channel->conf.sock_notsent_lowat > 0) {
+                opt = static_cast<int>(channel->conf.sock_notsent_lowat);
+                setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &opt, sizeof(opt));
+            }
+#endif
+
+            if (channel->conf.sock_tos > 0) {
+                sockaddr_storage sock_addr;
+                socklen_t sock_addr_len = sizeof(sock_addr);
+                opt = channel->conf.sock_tos;
+                if (0 == getsockname(fd, reinterpret_cast<sockaddr *>(&sock_addr), &sock_addr_len) && AF_INET6 == sock_addr.ss_family) {
+                    setsockopt(fd, IPPROTO_IPV6, IPV6_TCLASS, &opt, sizeof(opt));
+                } else {
+                    setsockopt(fd, IPPROTO_IP, IP_TOS, &opt, sizeof(opt));
+                }
+            }
+
+            if (channel->conf.is_quickack) {
+                io_stream_tcp_quickack(handle);
+            }
+#endif
+        }
+
         static void io_stream_tcp_setup(io_stream_channel *channel, adapter::tcp_t *handle) {
             if (NULL == channel || NULL == handle) {
                 return;
@@ -536,9 +1230,44 @@ namespace atbus {
             }
 
             uv_tcp_nodelay(handle, channel->conf.is_nodelay ? 1 : 0);
+            io_stream_tcp_sockopt(channel, handle);
             io_stream_stream_setup(channel, reinterpret_cast<adapter::stream_t *>(handle));
         }
 
+        // 创建socket并关联到handle，必须在bind或connect之前调用。这样在这之前就可以设置socket选项
+        // 不支持的平台上reuse_port为false时什么也不做，由libuv在bind或connect时创建socket
+        static int io_stream_tcp_open(adapter::tcp_t *handle, int family, bool reuse_port) {
+#ifndef _MSC_VER
+            // libuv的错误码在unix下就是-errno
+            int sock = socket(family, SOCK_STREAM, 0);
+            if (sock < 0) {
+                return -errno;
+            }
+
+            if (reuse_port) {
+#ifdef SO_REUSEPORT
+                int opt = 1;
+                if (0 != setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+                    int res = -errno;
+                    close(sock);
+                    return res;
+                }
+#else
+                close(sock);
+                return UV_ENOTSUP;
+#endif
+            }
+
+            int res = uv_tcp_open(handle, sock);
+            if (0 != res) {
+                close(sock);
+            }
+            return res;
+#else
+            return reuse_port ? UV_ENOTSUP : 0;
+#endif
+        }
+
         static void io_stream_pipe_setup(io_stream_channel *channel, adapter::pipe_t *handle) {
             if (NULL == channel || NULL == handle) {
                 return;
@@ -547,6 +1276,8 @@ namespace atbus {
             io_stream_stream_setup(channel, reinterpret_cast<adapter::stream_t *>(handle));
         }
 
+        struct io_stream_connect_race_data;
+
         struct io_stream_connect_async_data {
             uv_connect_t req;
             channel_address_t addr;
@@ -556,8 +1287,12 @@ namespace atbus {
             bool pipe;
             void *priv_data;
             size_t priv_size;
+            io_stream_connect_race_data *race; // 并行连接多个地址时的共享数据，否则为NULL
         };
 
+        static void io_stream_release_write_blocks(io_stream_connection *connection);
+        static void io_stream_written_callback(io_stream_connection *connection);
+
         static void io_stream_connection_on_close(uv_handle_t *handle) {
             io_stream_connection *conn_raw_ptr = reinterpret_cast<io_stream_connection *>(handle->data);
             // connect not completed, directly exit
@@ -574,6 +1309,9 @@ namespace atbus {
             io_stream_channel::conn_gc_pool_t::iterator iter = channel->conn_gc_pool.find(reinterpret_cast<uintptr_t>(conn_raw_ptr));
             assert(iter != channel->conn_gc_pool.end());
 
+            // 直接发送完的消息先于断开事件回调
+            io_stream_written_callback(conn_raw_ptr);
+
             iter->second->status = io_stream_connection::EN_ST_DISCONNECTIED;
             io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_DISCONNECTED, channel, iter->second.get(), 0, EN_ATBUS_ERR_SUCCESS,
                                        NULL, 0);
@@ -582,7 +1320,14 @@ namespace atbus {
                 conn_raw_ptr->act_disc_cbk(channel, conn_raw_ptr, EN_ATBUS_ERR_SUCCESS, NULL, 0);
             }
 
+            io_stream_free_read_head(channel, conn_raw_ptr->read_head.buffer, conn_raw_ptr->read_head.level);
+            conn_raw_ptr->read_head.buffer = NULL;
+            conn_raw_ptr->read_head.len = 0;
+            io_stream_release_write_blocks(conn_raw_ptr);
+
             channel->conn_gc_pool.erase(iter);
+
+            io_stream_close_async_check(channel);
         }
 
         static void io_stream_async_data_on_close(uv_handle_t *handle) {
@@ -653,7 +1398,8 @@ namespace atbus {
                 return ret;
             }
 
-            ret = std::make_shared<io_stream_connection>();
+            ret = std::allocate_shared<io_stream_connection>(
+                io_stream_object_allocator<io_stream_connection>(io_stream_get_object_pool(channel)));
             if (!ret) {
                 return ret;
             }
@@ -677,12 +1423,40 @@ namespace atbus {
             if (channel->conf.recv_buffer_max_size > 0 && channel->conf.recv_buffer_static > 0) {
                 ret->read_buffers.set_mode(channel->conf.recv_buffer_max_size, channel->conf.recv_buffer_static);
             }
+            ret->read_head.buffer = NULL;
             ret->read_head.len = 0;
+            ret->read_head.level = 0;
+            ret->read_head.expect_level = 0;
+            ret->read_head.sample_max_size = 0;
+            ret->read_head.sample_times = 0;
+            ret->read_times = 0;
 
             ret->write_buffers.set_limit(channel->conf.send_buffer_max_size, 0);
             if (channel->conf.send_buffer_max_size > 0 && channel->conf.send_buffer_static > 0) {
                 ret->write_buffers.set_mode(channel->conf.send_buffer_max_size, channel->conf.send_buffer_static);
             }
+            ret->writing_req_number = 0;
+            ret->writing_block_number = 0;
+            ret->write_head_offset = 0;
+            ret->write_ext_size = 0;
+            ret->try_written_stat.frame_number = 0;
+            ret->try_written_stat.data_size = 0;
+            // 控制消息一般很小，只需要限制总长度
+            ret->ctrl_write_buffers.set_limit(channel->conf.send_buffer_max_size, 0);
+            ret->ctrl_writing_block_number = 0;
+            ret->ctrl_write_barrier = 0;
+            ret->write_head_ctrl = false;
+            ret->send_checksum = io_stream_checksum_t::EN_CS_LEGACY;
+            ret->recv_frame_flags = false;
+            ret->send_compress = io_stream_compress_t::EN_CA_NONE;
+            ret->send_compress_threshold = 0;
+            ret->send_compress_level = 0;
+            memset(&ret->compress_stat, 0, sizeof(ret->compress_stat));
+            ret->latency_stat.reset();
+            ret->cork_size = channel->conf.send_cork_size;
+            ret->cork_delay = channel->conf.send_cork_delay;
+            ret->corked_size = 0;
+            ret->cork_deadline = 0;
 
             channel->conn_pool[ret->fd] = ret;
             ret->channel = channel;
@@ -698,19 +1472,24 @@ namespace atbus {
 
         // ============ C Style转C++ Style内存管理 ============
         template <typename T>
-        static void io_stream_delete_stream_fn(adapter::stream_t *handle) {
-            T *real_conn = reinterpret_cast<T *>(handle);
+        struct io_stream_stream_holder {
+            T handle;
 
             // 到这里必须已经释放handle了，否则删除hanlde会导致数据异常。
-            assert(uv_is_closing(reinterpret_cast<adapter::handle_t *>(handle)));
-            delete real_conn;
-        }
+            ~io_stream_stream_holder() { assert(uv_is_closing(reinterpret_cast<adapter::handle_t *>(&handle))); }
+        };
 
         template <typename T>
-        static T *io_stream_make_stream_ptr(std::shared_ptr<adapter::stream_t> &res) {
-            T *real_conn = new T();
+        static T *io_stream_make_stream_ptr(io_stream_channel *channel, std::shared_ptr<adapter::stream_t> &res) {
+            std::shared_ptr<io_stream_stream_holder<T> > holder = std::allocate_shared<io_stream_stream_holder<T> >(
+                io_stream_object_allocator<io_stream_stream_holder<T> >(io_stream_get_object_pool(channel)));
+            if (!holder) {
+                return NULL;
+            }
+
+            T *real_conn = &holder->handle;
             adapter::stream_t *stream_conn = reinterpret_cast<adapter::stream_t *>(real_conn);
-            res = std::shared_ptr<adapter::stream_t>(stream_conn, io_stream_delete_stream_fn<T>);
+            res = std::shared_ptr<adapter::stream_t>(holder, stream_conn);
             stream_conn->data = NULL;
             return real_conn;
         }
@@ -728,7 +1507,7 @@ namespace atbus {
                 return NULL;
             }
 
-            adapter::tcp_t *tcp_conn = io_stream_make_stream_ptr<adapter::tcp_t>(recv_conn);
+            adapter::tcp_t *tcp_conn = io_stream_make_stream_ptr<adapter::tcp_t>(channel, recv_conn);
             if (NULL == tcp_conn) {
                 return NULL;
             }
@@ -829,7 +1608,7 @@ namespace atbus {
                     break;
                 }
 
-                adapter::pipe_t *pipe_conn = io_stream_make_stream_ptr<adapter::pipe_t>(recv_conn);
+                adapter::pipe_t *pipe_conn = io_stream_make_stream_ptr<adapter::pipe_t>(channel, recv_conn);
                 if (NULL == pipe_conn) {
                     res = EN_ATBUS_ERR_PIPE_CONNECT_FAILED;
                     break;
@@ -878,6 +1657,123 @@ namespace atbus {
             }
         }
 
+        // 把域名解析的结果转换为ipv4或ipv6地址，并记录到缓存里
+        static int io_stream_dns_make_record(io_stream_channel *channel, const std::string &name, int status, const struct addrinfo *res,
+                                             io_stream_dns_record_t &record) {
+            record.status = status;
+            if (0 == status) {
+                if (NULL != res && AF_INET == res->ai_family) {
+                    char ip[17] = {0};
+                    uv_ip4_name(reinterpret_cast<const sockaddr_in *>(res->ai_addr), ip, sizeof(ip));
+                    record.scheme = "ipv4";
+                    record.host = ip;
+                } else if (NULL != res && AF_INET6 == res->ai_family) {
+                    char ip[40] = {0};
+                    uv_ip6_name(reinterpret_cast<const sockaddr_in6 *>(res->ai_addr), ip, sizeof(ip));
+                    record.scheme = "ipv6";
+                    record.host = ip;
+                } else {
+                    record.status = -1;
+                }
+            }
+
+            // 取消的请求(比如关闭channel时)不缓存
+            time_t ttl = 0 == record.status ? channel->conf.dns_cache_ttl : channel->conf.dns_negative_cache_ttl;
+            if (ttl > 0 && UV_ECANCELED != status && UV_EAI_CANCELED != status && NULL != channel->ev_loop) {
+                record.expire_ms = uv_now(channel->ev_loop) + static_cast<uint64_t>(ttl) * 1000;
+                channel->dns_cache[name] = record;
+            }
+
+            return record.status;
+        }
+
+        // 取出解析到的所有ipv4和ipv6地址，去重后两种地址交替排列，从第一个结果的类型开始
+        static void io_stream_dns_collect_addresses(const struct addrinfo *res, int port, std::vector<channel_address_t> &addrs) {
+            std::vector<channel_address_t> family_addrs[2];
+            int first_family = 0;
+            for (const struct addrinfo *iter = res; NULL != iter; iter = iter->ai_next) {
+                channel_address_t addr;
+                if (AF_INET == iter->ai_family) {
+                    char ip[17] = {0};
+                    uv_ip4_name(reinterpret_cast<const sockaddr_in *>(iter->ai_addr), ip, sizeof(ip));
+                    make_address("ipv4", ip, port, addr);
+                } else if (AF_INET6 == iter->ai_family) {
+                    char ip[40] = {0};
+                    uv_ip6_name(reinterpret_cast<const sockaddr_in6 *>(iter->ai_addr), ip, sizeof(ip));
+                    make_address("ipv6", ip, port, addr);
+                } else {
+                    continue;
+                }
+
+                if (0 == first_family) {
+                    first_family = iter->ai_family;
+                }
+
+                std::vector<channel_address_t> &target = family_addrs[first_family == iter->ai_family ? 0 : 1];
+                bool is_duplicated = false;
+                for (size_t i = 0; i < target.size() && !is_duplicated; ++i) {
+                    is_duplicated = target[i].address == addr.address;
+                }
+
+                if (!is_duplicated) {
+                    target.push_back(addr);
+                }
+            }
+
+            addrs.reserve(family_addrs[0].size() + family_addrs[1].size());
+            for (size_t i = 0; i < family_addrs[0].size() || i < family_addrs[1].size(); ++i) {
+                if (i < family_addrs[0].size()) {
+                    addrs.push_back(family_addrs[0][i]);
+                }
+                if (i < family_addrs[1].size()) {
+                    addrs.push_back(family_addrs[1][i]);
+                }
+            }
+        }
+
+        // 查找未过期的域名解析缓存，过期的缓存会被删除
+        static bool io_stream_dns_find_record(io_stream_channel *channel, const std::string &name, io_stream_dns_record_t &record) {
+            io_stream_channel::dns_cache_t::iterator iter = channel->dns_cache.find(name);
+            if (iter == channel->dns_cache.end()) {
+                return false;
+            }
+
+            if (NULL == channel->ev_loop || iter->second.expire_ms <= uv_now(channel->ev_loop)) {
+                channel->dns_cache.erase(iter);
+                return false;
+            }
+
+            record = iter->second;
+            return true;
+        }
+
+        // 连接失败时可能是域名对应的地址变化了，删除解析到这个地址的缓存，下次重新解析
+        static void io_stream_dns_remove_address(io_stream_channel *channel, const channel_address_t &addr) {
+            io_stream_channel::dns_cache_t::iterator iter = channel->dns_cache.begin();
+            while (iter != channel->dns_cache.end()) {
+                if (0 == iter->second.status && iter->second.host == addr.host &&
+                    0 == UTIL_STRFUNC_STRNCASE_CMP(iter->second.scheme.c_str(), addr.scheme.c_str(), 4)) {
+                    channel->dns_cache.erase(iter++);
+                } else {
+                    ++iter;
+                }
+            }
+        }
+
+        int io_stream_flush_dns_cache(io_stream_channel *channel, const char *host) {
+            if (NULL == channel) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (NULL == host) {
+                channel->dns_cache.clear();
+            } else {
+                channel->dns_cache.erase(host);
+            }
+
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
         // listen 接口传入域名时的回调异步数据
         struct io_stream_dns_async_data {
             io_stream_channel *channel;
@@ -898,42 +1794,15 @@ namespace atbus {
 
             io_stream_flag_guard flag_guard(async_data->channel->flags, io_stream_channel::EN_CF_IN_CALLBACK);
 
-            int listen_res = status;
-            do {
-                async_data->channel->error_code = status;
-
-                if (0 != status) {
-                    break;
-                }
-
-                if (NULL == async_data) {
-                    listen_res = -1;
-                    break;
-                }
-
-                if (NULL == res) {
-                    listen_res = -1;
-                    break;
-                }
+            async_data->channel->error_code = status;
 
-                if (AF_INET == res->ai_family) {
-                    sockaddr_in *res_c = reinterpret_cast<sockaddr_in *>(res->ai_addr);
-                    char ip[17] = {0};
-                    uv_ip4_name(res_c, ip, sizeof(ip));
-                    make_address("ipv4", ip, async_data->addr.port, async_data->addr);
-                    listen_res = io_stream_listen(async_data->channel, async_data->addr, async_data->callback, async_data->priv_data,
-                                                  async_data->priv_size);
-                } else if (AF_INET6 == res->ai_family) {
-                    sockaddr_in6 *res_c = reinterpret_cast<sockaddr_in6 *>(res->ai_addr);
-                    char ip[40] = {0};
-                    uv_ip6_name(res_c, ip, sizeof(ip));
-                    make_address("ipv6", ip, async_data->addr.port, async_data->addr);
-                    listen_res = io_stream_listen(async_data->channel, async_data->addr, async_data->callback, async_data->priv_data,
-                                                  async_data->priv_size);
-                } else {
-                    listen_res = -1;
-                }
-            } while (false);
+            io_stream_dns_record_t record;
+            int listen_res = io_stream_dns_make_record(async_data->channel, async_data->addr.host, status, res, record);
+            if (0 == listen_res) {
+                make_address(record.scheme.c_str(), record.host.c_str(), async_data->addr.port, async_data->addr);
+                listen_res = io_stream_listen(async_data->channel, async_data->addr, async_data->callback, async_data->priv_data,
+                                              async_data->priv_size);
+            }
 
             // 接口调用不成功则要调用回调函数
             if (0 != listen_res) {
@@ -971,7 +1840,7 @@ namespace atbus {
                 0 == UTIL_STRFUNC_STRNCASE_CMP("ipv6", addr.scheme.c_str(), 4)) {
                 std::shared_ptr<adapter::stream_t> listen_conn;
                 std::shared_ptr<io_stream_connection> conn;
-                adapter::tcp_t *handle = io_stream_make_stream_ptr<adapter::tcp_t>(listen_conn);
+                adapter::tcp_t *handle = io_stream_make_stream_ptr<adapter::tcp_t>(channel, listen_conn);
                 if (NULL == handle) {
                     return EN_ATBUS_ERR_MALLOC;
                 }
@@ -979,6 +1848,14 @@ namespace atbus {
                 uv_tcp_init(ev_loop, handle);
                 int ret = EN_ATBUS_ERR_SUCCESS;
                 do {
+                    // 多个channel监听同一个地址，由内核把新连接分配给不同的channel(可以在不同的线程)
+                    // 提前创建socket，接收缓冲区这类需要在bind前设置的socket选项才能生效
+                    if (0 != (channel->error_code = io_stream_tcp_open(handle, '4' == addr.scheme[3] ? AF_INET : AF_INET6,
+                                                                       channel->conf.is_reuse_port))) {
+                        ret = EN_ATBUS_ERR_SOCK_BIND_FAILED;
+                        break;
+                    }
+
                     io_stream_tcp_setup(channel, handle);
 
                     if ('4' == addr.scheme[3]) {
@@ -1034,8 +1911,8 @@ namespace atbus {
             } else if (0 == UTIL_STRFUNC_STRNCASE_CMP("unix", addr.scheme.c_str(), 4)) {
                 std::shared_ptr<adapter::stream_t> listen_conn;
                 std::shared_ptr<io_stream_connection> conn;
-                adapter::pipe_t *handle = io_stream_make_stream_ptr<adapter::pipe_t>(listen_conn);
-                uv_pipe_init(ev_loop, handle, 1);
+                adapter::pipe_t *handle = io_stream_make_stream_ptr<adapter::pipe_t>(channel, listen_conn);
+                uv_pipe_init(ev_loop, handle, 0);
                 int ret = EN_ATBUS_ERR_SUCCESS;
                 do {
                     if (0 != (channel->error_code = uv_pipe_bind(handle, addr.host.c_str()))) {
@@ -1073,6 +1950,18 @@ namespace atbus {
                 }
                 return ret;
             } else if (0 == UTIL_STRFUNC_STRNCASE_CMP("dns", addr.scheme.c_str(), 3)) {
+                io_stream_dns_record_t record;
+                if (io_stream_dns_find_record(channel, addr.host, record)) {
+                    if (0 != record.status) {
+                        channel->error_code = record.status;
+                        return EN_ATBUS_ERR_DNS_GETADDR_FAILED;
+                    }
+
+                    channel_address_t resolved_addr;
+                    make_address(record.scheme.c_str(), record.host.c_str(), addr.port, resolved_addr);
+                    return io_stream_listen(channel, resolved_addr, callback, priv_data, priv_size);
+                }
+
                 io_stream_dns_async_data *async_data = new io_stream_dns_async_data();
                 if (NULL == async_data) {
                     return EN_ATBUS_ERR_MALLOC;
@@ -1097,28 +1986,270 @@ namespace atbus {
             return EN_ATBUS_ERR_SCHEME;
         }
 
-        static void io_stream_all_connected_cb(uv_connect_t *req, int status) {
-            io_stream_connect_async_data *async_data = reinterpret_cast<io_stream_connect_async_data *>(req->data);
-            assert(async_data);
-            assert(async_data->channel);
-            ATBUS_CHANNEL_REQ_END(async_data->channel);
+        // ============ 并行连接多个地址(Happy Eyeballs, RFC 8305) ============
+        // 依次间隔connect_attempt_delay发起连接，一个地址失败时立即尝试下一个，第一个成功的连接通知回调，其他的关闭
+        struct io_stream_connect_race_data {
+            adapter::timer_t timer; // 下一次尝试的定时器，关闭回调里删除race
+            io_stream_channel *channel;
+            io_stream_callback_t callback;
+            void *priv_data;
+            size_t priv_size;
+            std::string name; // 解析的域名，成功后更新域名解析的缓存
+
+            std::vector<channel_address_t> addrs;
+            size_t next_index;
+            std::vector<io_stream_connect_async_data *> attempts; // 正在进行的连接，包括已取消还没回调的
+            bool done;                                            // 已经通知过回调了
+            int last_status;
+            int last_errcode;
+        };
 
-            io_stream_flag_guard flag_guard(async_data->channel->flags, io_stream_channel::EN_CF_IN_CALLBACK);
+        static void io_stream_all_connected_cb(uv_connect_t *req, int status);
 
-            int errcode = EN_ATBUS_ERR_SUCCESS;
-            async_data->channel->error_code = status;
-            std::shared_ptr<io_stream_connection> conn;
+        static int io_stream_tcp_connect(io_stream_channel *channel, const channel_address_t &addr, io_stream_callback_t callback,
+                                         void *priv_data, size_t priv_size, io_stream_connect_race_data *race) {
+            adapter::loop_t *ev_loop = io_stream_get_loop(channel);
+            if (NULL == ev_loop) {
+                return EN_ATBUS_ERR_MALLOC;
+            }
+
+            std::shared_ptr<adapter::stream_t> sock_conn;
+            adapter::tcp_t *handle = io_stream_make_stream_ptr<adapter::tcp_t>(channel, sock_conn);
+            if (NULL == handle) {
+                return EN_ATBUS_ERR_MALLOC;
+            }
+
+            uv_tcp_init(ev_loop, handle);
+
+            int ret = EN_ATBUS_ERR_SUCCESS;
+            io_stream_connect_async_data *async_data = NULL;
+            do {
+                async_data = new io_stream_connect_async_data();
+                if (NULL == async_data) {
+                    ret = EN_ATBUS_ERR_MALLOC;
+                    break;
+                }
+
+                async_data->pipe = false;
+                async_data->addr = addr;
+                async_data->channel = channel;
+                async_data->callback = callback;
+                async_data->req.data = async_data;
+                async_data->stream = sock_conn;
+                async_data->priv_data = priv_data;
+                async_data->priv_size = priv_size;
+                async_data->race = race;
+
+                io_stream_sockaddr_switcher sock_addr;
+                const sockaddr *sock_addr_ptr = NULL;
+
+                if ('4' == addr.scheme[3]) {
+                    uv_ip4_addr(addr.host.c_str(), addr.port, &sock_addr.ipv4);
+                    sock_addr_ptr = &sock_addr.base;
+                } else {
+                    uv_ip6_addr(addr.host.c_str(), addr.port, &sock_addr.ipv6);
+                    sock_addr_ptr = &sock_addr.base;
+                }
+
+                // 提前创建socket，connect之前设置的接收缓冲区才会影响窗口扩大因子
+                if (0 != (channel->error_code = io_stream_tcp_open(handle, '4' == addr.scheme[3] ? AF_INET : AF_INET6, false))) {
+                    ret = EN_ATBUS_ERR_SOCK_CONNECT_FAILED;
+                    break;
+                }
+
+                io_stream_tcp_setup(channel, handle);
+                ATBUS_CHANNEL_REQ_START(async_data->channel);
+                if (0 != (channel->error_code = uv_tcp_connect(&async_data->req, handle, sock_addr_ptr, io_stream_all_connected_cb))) {
+                    ATBUS_CHANNEL_REQ_END(async_data->channel);
+
+                    ret = EN_ATBUS_ERR_SOCK_CONNECT_FAILED;
+                    break;
+                }
+
+                if (NULL != race) {
+                    race->attempts.push_back(async_data);
+                }
+
+                // conn_req = NULL; // 防止异常情况会调用回调时，任然释放对象
+                return ret;
+            } while (false);
+
+            // 回收关闭
+            io_stream_shutdown_ev_handle(async_data);
+            return ret;
+        }
+
+        static void io_stream_connect_race_timer_on_close(uv_handle_t *handle) {
+            io_stream_connect_race_data *race = reinterpret_cast<io_stream_connect_race_data *>(handle->data);
+            assert(race);
+
+            ATBUS_CHANNEL_REQ_END(race->channel);
+            delete race;
+        }
+
+        // 发起下一个地址的连接，发起失败的地址直接跳过
+        static bool io_stream_connect_race_start_next(io_stream_connect_race_data *race) {
+            while (race->next_index < race->addrs.size()) {
+                if (ATBUS_CHANNEL_IOS_CHECK_FLAG(race->channel->flags, io_stream_channel::EN_CF_CLOSING)) {
+                    race->next_index = race->addrs.size();
+                    race->last_status = 0;
+                    race->last_errcode = EN_ATBUS_ERR_CHANNEL_CLOSING;
+                    break;
+                }
+
+                const channel_address_t &addr = race->addrs[race->next_index++];
+                int res = io_stream_tcp_connect(race->channel, addr, race->callback, race->priv_data, race->priv_size, race);
+                if (0 == res) {
+                    return true;
+                }
+
+                race->last_status = race->channel->error_code;
+                race->last_errcode = res;
+            }
+
+            return false;
+        }
+
+        // 所有地址都失败时通知回调，没有正在进行的连接后释放race
+        static void io_stream_connect_race_check_finish(io_stream_connect_race_data *race) {
+            if (!race->attempts.empty() || (!race->done && race->next_index < race->addrs.size())) {
+                return;
+            }
+
+            if (!race->done) {
+                race->done = true;
+                io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_CONNECTED, race->channel, race->callback, NULL,
+                                           race->last_status, race->last_errcode, race->priv_data, race->priv_size);
+            }
+
+            uv_timer_stop(&race->timer);
+            uv_close(reinterpret_cast<uv_handle_t *>(&race->timer), io_stream_connect_race_timer_on_close);
+        }
+
+        static void io_stream_connect_race_timer_cb(uv_timer_t *handle) {
+            io_stream_connect_race_data *race = reinterpret_cast<io_stream_connect_race_data *>(handle->data);
+            assert(race);
+
+            io_stream_flag_guard flag_guard(race->channel->flags, io_stream_channel::EN_CF_IN_CALLBACK);
+            if (!io_stream_connect_race_start_next(race) || race->next_index >= race->addrs.size()) {
+                uv_timer_stop(&race->timer);
+            }
+
+            io_stream_connect_race_check_finish(race);
+        }
+
+        // 间隔connect_attempt_delay后发起下一个连接，间隔为0时同时连接所有地址
+        static void io_stream_connect_race_schedule(io_stream_connect_race_data *race) {
+            uint64_t delay = race->channel->conf.connect_attempt_delay;
+            if (0 == delay) {
+                while (io_stream_connect_race_start_next(race)) {
+                }
+            } else if (race->next_index < race->addrs.size()) {
+                uv_timer_start(&race->timer, io_stream_connect_race_timer_cb, delay, delay);
+            }
+        }
+
+        static int io_stream_connect_race(io_stream_channel *channel, const std::string &name, const std::vector<channel_address_t> &addrs,
+                                          io_stream_callback_t callback, void *priv_data, size_t priv_size) {
+            adapter::loop_t *ev_loop = io_stream_get_loop(channel);
+            if (NULL == ev_loop) {
+                return EN_ATBUS_ERR_MALLOC;
+            }
+
+            io_stream_connect_race_data *race = new io_stream_connect_race_data();
+            if (NULL == race) {
+                return EN_ATBUS_ERR_MALLOC;
+            }
+
+            race->channel = channel;
+            race->callback = callback;
+            race->priv_data = priv_data;
+            race->priv_size = priv_size;
+            race->name = name;
+            race->addrs = addrs;
+            race->next_index = 0;
+            race->done = false;
+            race->last_status = 0;
+            race->last_errcode = EN_ATBUS_ERR_SOCK_CONNECT_FAILED;
+
+            uv_timer_init(ev_loop, &race->timer);
+            race->timer.data = race;
+            ATBUS_CHANNEL_REQ_START(channel);
+
+            if (!io_stream_connect_race_start_next(race)) {
+                // 一个也没有发起成功，和单个地址时一样直接返回错误
+                int ret = race->last_errcode;
+                race->done = true;
+                io_stream_connect_race_check_finish(race);
+                return ret;
+            }
+
+            io_stream_connect_race_schedule(race);
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        // 某一个连接成功后关闭其他正在进行的连接，它们的回调里status为UV_ECANCELED
+        static void io_stream_connect_race_win(io_stream_connect_race_data *race, const channel_address_t &addr) {
+            race->done = true;
+            uv_timer_stop(&race->timer);
+
+            for (size_t i = 0; i < race->attempts.size(); ++i) {
+                if (!uv_is_closing(reinterpret_cast<uv_handle_t *>(race->attempts[i]->stream.get()))) {
+                    io_stream_shutdown_ev_handle(race->attempts[i]);
+                }
+            }
+
+            // 域名解析的缓存改为连接成功的地址，下次直接使用
+            io_stream_channel::dns_cache_t::iterator iter = race->channel->dns_cache.find(race->name);
+            if (iter != race->channel->dns_cache.end() && 0 == iter->second.status) {
+                iter->second.scheme = addr.scheme;
+                iter->second.host = addr.host;
+            }
+        }
+
+        static void io_stream_all_connected_cb(uv_connect_t *req, int status) {
+            io_stream_connect_async_data *async_data = reinterpret_cast<io_stream_connect_async_data *>(req->data);
+            assert(async_data);
+            assert(async_data->channel);
+            ATBUS_CHANNEL_REQ_END(async_data->channel);
+
+            io_stream_flag_guard flag_guard(async_data->channel->flags, io_stream_channel::EN_CF_IN_CALLBACK);
+
+            io_stream_connect_race_data *race = async_data->race;
+            if (NULL != race) {
+                std::vector<io_stream_connect_async_data *>::iterator iter =
+                    std::find(race->attempts.begin(), race->attempts.end(), async_data);
+                assert(iter != race->attempts.end());
+                race->attempts.erase(iter);
+
+                // 被取消的连接已经在关闭流程中了，async_data会在关闭回调里释放
+                if (uv_is_closing(reinterpret_cast<uv_handle_t *>(async_data->stream.get()))) {
+                    io_stream_connect_race_check_finish(race);
+                    return;
+                }
+            }
+
+            int errcode = EN_ATBUS_ERR_SUCCESS;
+            async_data->channel->error_code = status;
+            std::shared_ptr<io_stream_connection> conn;
             do {
                 if (0 != status) {
                     if (async_data->pipe) {
                         errcode = EN_ATBUS_ERR_PIPE_CONNECT_FAILED;
                     } else {
                         errcode = EN_ATBUS_ERR_SOCK_CONNECT_FAILED;
+                        io_stream_dns_remove_address(async_data->channel, async_data->addr);
                     }
 
                     break;
                 }
 
+                // 已经有其他地址连接成功了
+                if (NULL != race && race->done) {
+                    errcode = EN_ATBUS_ERR_SOCK_CONNECT_FAILED;
+                    break;
+                }
+
                 // 正在关闭，新连接直接断开
                 if (ATBUS_CHANNEL_IOS_CHECK_FLAG(async_data->channel->flags, io_stream_channel::EN_CF_CLOSING)) {
                     errcode = EN_ATBUS_ERR_CHANNEL_CLOSING;
@@ -1142,8 +2273,21 @@ namespace atbus {
                 ATBUS_CHANNEL_IOS_SET_FLAG(conn->flags, io_stream_connection::EN_CF_CONNECT);
             } while (false);
 
-            io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_CONNECTED, async_data->channel, async_data->callback, conn.get(),
-                                       status, errcode, async_data->priv_data, async_data->priv_size);
+            if (NULL == race) {
+                io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_CONNECTED, async_data->channel, async_data->callback, conn.get(),
+                                           status, errcode, async_data->priv_data, async_data->priv_size);
+            } else if (conn) {
+                io_stream_connect_race_win(race, async_data->addr);
+                io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_CONNECTED, async_data->channel, async_data->callback, conn.get(),
+                                           status, errcode, async_data->priv_data, async_data->priv_size);
+            } else if (!race->done) {
+                // 失败时立即尝试下一个地址
+                race->last_status = status;
+                race->last_errcode = errcode;
+                if (io_stream_connect_race_start_next(race)) {
+                    io_stream_connect_race_schedule(race);
+                }
+            }
 
             // 如果连接成功，async_data->stream的生命周期由conn接管
             // 如果失败，需要关闭handle并在回调之后删除async_data。所以这时候不能直接
@@ -1156,6 +2300,10 @@ namespace atbus {
             } else {
                 delete async_data;
             }
+
+            if (NULL != race) {
+                io_stream_connect_race_check_finish(race);
+            }
         }
 
         // listen 接口传入域名时的回调
@@ -1168,42 +2316,22 @@ namespace atbus {
 
             io_stream_flag_guard flag_guard(async_data->channel->flags, io_stream_channel::EN_CF_IN_CALLBACK);
 
-            int listen_res = status;
-            do {
-                async_data->channel->error_code = status;
-
-                if (0 != status) {
-                    break;
-                }
-
-                if (NULL == async_data) {
-                    listen_res = -1;
-                    break;
-                }
-
-                if (NULL == res) {
-                    listen_res = -1;
-                    break;
-                }
+            async_data->channel->error_code = status;
 
-                if (AF_INET == res->ai_family) {
-                    sockaddr_in *res_c = reinterpret_cast<sockaddr_in *>(res->ai_addr);
-                    char ip[17] = {0};
-                    uv_ip4_name(res_c, ip, sizeof(ip));
-                    make_address("ipv4", ip, async_data->addr.port, async_data->addr);
-                    listen_res = io_stream_connect(async_data->channel, async_data->addr, async_data->callback, async_data->priv_data,
-                                                   async_data->priv_size);
-                } else if (AF_INET6 == res->ai_family) {
-                    sockaddr_in6 *res_c = reinterpret_cast<sockaddr_in6 *>(res->ai_addr);
-                    char ip[40] = {0};
-                    uv_ip6_name(res_c, ip, sizeof(ip));
-                    make_address("ipv6", ip, async_data->addr.port, async_data->addr);
+            io_stream_dns_record_t record;
+            int listen_res = io_stream_dns_make_record(async_data->channel, async_data->addr.host, status, res, record);
+            if (0 == listen_res) {
+                std::vector<channel_address_t> addrs;
+                io_stream_dns_collect_addresses(res, async_data->addr.port, addrs);
+                if (addrs.size() > 1) {
+                    listen_res = io_stream_connect_race(async_data->channel, async_data->addr.host, addrs, async_data->callback,
+                                                        async_data->priv_data, async_data->priv_size);
+                } else {
+                    make_address(record.scheme.c_str(), record.host.c_str(), async_data->addr.port, async_data->addr);
                     listen_res = io_stream_connect(async_data->channel, async_data->addr, async_data->callback, async_data->priv_data,
                                                    async_data->priv_size);
-                } else {
-                    listen_res = -1;
                 }
-            } while (false);
+            }
 
             // 接口调用不成功则要调用回调函数
             if (0 != listen_res) {
@@ -1239,62 +2367,10 @@ namespace atbus {
             // socket
             if (0 == UTIL_STRFUNC_STRNCASE_CMP("ipv4", addr.scheme.c_str(), 4) ||
                 0 == UTIL_STRFUNC_STRNCASE_CMP("ipv6", addr.scheme.c_str(), 4)) {
-                std::shared_ptr<adapter::stream_t> sock_conn;
-                adapter::tcp_t *handle = io_stream_make_stream_ptr<adapter::tcp_t>(sock_conn);
-                if (NULL == handle) {
-                    return EN_ATBUS_ERR_MALLOC;
-                }
-
-                uv_tcp_init(ev_loop, handle);
-
-                int ret = EN_ATBUS_ERR_SUCCESS;
-                io_stream_connect_async_data *async_data = NULL;
-                do {
-                    async_data = new io_stream_connect_async_data();
-                    if (NULL == async_data) {
-                        ret = EN_ATBUS_ERR_MALLOC;
-                        break;
-                    }
-
-                    async_data->pipe = false;
-                    async_data->addr = addr;
-                    async_data->channel = channel;
-                    async_data->callback = callback;
-                    async_data->req.data = async_data;
-                    async_data->stream = sock_conn;
-                    async_data->priv_data = priv_data;
-                    async_data->priv_size = priv_size;
-
-                    io_stream_sockaddr_switcher sock_addr;
-                    const sockaddr *sock_addr_ptr = NULL;
-
-                    if ('4' == addr.scheme[3]) {
-                        uv_ip4_addr(addr.host.c_str(), addr.port, &sock_addr.ipv4);
-                        sock_addr_ptr = &sock_addr.base;
-                    } else {
-                        uv_ip6_addr(addr.host.c_str(), addr.port, &sock_addr.ipv6);
-                        sock_addr_ptr = &sock_addr.base;
-                    }
-
-                    io_stream_tcp_setup(channel, handle);
-                    ATBUS_CHANNEL_REQ_START(async_data->channel);
-                    if (0 != uv_tcp_connect(&async_data->req, handle, sock_addr_ptr, io_stream_all_connected_cb)) {
-                        ATBUS_CHANNEL_REQ_END(async_data->channel);
-
-                        ret = EN_ATBUS_ERR_SOCK_CONNECT_FAILED;
-                        break;
-                    }
-
-                    // conn_req = NULL; // 防止异常情况会调用回调时，任然释放对象
-                    return ret;
-                } while (false);
-
-                // 回收关闭
-                io_stream_shutdown_ev_handle(async_data);
-                return ret;
+                return io_stream_tcp_connect(channel, addr, callback, priv_data, priv_size, NULL);
             } else if (0 == UTIL_STRFUNC_STRNCASE_CMP("unix", addr.scheme.c_str(), 4)) {
                 std::shared_ptr<adapter::stream_t> pipe_conn;
-                adapter::pipe_t *handle = io_stream_make_stream_ptr<adapter::pipe_t>(pipe_conn);
+                adapter::pipe_t *handle = io_stream_make_stream_ptr<adapter::pipe_t>(channel, pipe_conn);
                 if (NULL == handle) {
                     return EN_ATBUS_ERR_MALLOC;
                 }
@@ -1317,6 +2393,7 @@ namespace atbus {
                     async_data->stream = pipe_conn;
                     async_data->priv_data = priv_data;
                     async_data->priv_size = priv_size;
+                    async_data->race = NULL;
 
                     // 不会失败
                     io_stream_pipe_setup(channel, handle);
@@ -1332,6 +2409,19 @@ namespace atbus {
                 return ret;
 
             } else if (0 == UTIL_STRFUNC_STRNCASE_CMP("dns", addr.scheme.c_str(), 3)) {
+                // 重连时直接使用缓存的解析结果
+                io_stream_dns_record_t record;
+                if (io_stream_dns_find_record(channel, addr.host, record)) {
+                    if (0 != record.status) {
+                        channel->error_code = record.status;
+                        return EN_ATBUS_ERR_DNS_GETADDR_FAILED;
+                    }
+
+                    channel_address_t resolved_addr;
+                    make_address(record.scheme.c_str(), record.host.c_str(), addr.port, resolved_addr);
+                    return io_stream_connect(channel, resolved_addr, callback, priv_data, priv_size);
+                }
+
                 io_stream_dns_async_data *async_data = new io_stream_dns_async_data();
                 if (NULL == async_data) {
                     return EN_ATBUS_ERR_MALLOC;
@@ -1355,6 +2445,31 @@ namespace atbus {
             return EN_ATBUS_ERR_SUCCESS;
         }
 
+        int io_stream_connect_any(io_stream_channel *channel, const std::vector<channel_address_t> &addrs, io_stream_callback_t callback,
+                                  void *priv_data, size_t priv_size) {
+            if (NULL == channel || addrs.empty()) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (1 == addrs.size()) {
+                return io_stream_connect(channel, addrs[0], callback, priv_data, priv_size);
+            }
+
+            // 正在关闭，不允许启动新连接
+            if (ATBUS_CHANNEL_IOS_CHECK_FLAG(channel->flags, io_stream_channel::EN_CF_CLOSING)) {
+                return EN_ATBUS_ERR_CHANNEL_CLOSING;
+            }
+
+            for (size_t i = 0; i < addrs.size(); ++i) {
+                if (0 != UTIL_STRFUNC_STRNCASE_CMP("ipv4", addrs[i].scheme.c_str(), 4) &&
+                    0 != UTIL_STRFUNC_STRNCASE_CMP("ipv6", addrs[i].scheme.c_str(), 4)) {
+                    return EN_ATBUS_ERR_SCHEME;
+                }
+            }
+
+            return io_stream_connect_race(channel, std::string(), addrs, callback, priv_data, priv_size);
+        }
+
         static int io_stream_disconnect_run(io_stream_connection *connection) {
             if (NULL == connection) {
                 return EN_ATBUS_ERR_PARAMS;
@@ -1385,6 +2500,9 @@ namespace atbus {
 
             connection->status = io_stream_connection::EN_ST_DISCONNECTING;
 
+            // delayed data should be written before closing
+            io_stream_flush(connection);
+
             // if there is any writing data, closing this connection later
             if (ATBUS_CHANNEL_IOS_CHECK_FLAG(connection->flags, io_stream_connection::EN_CF_WRITING)) {
                 return EN_ATBUS_ERR_SUCCESS;
@@ -1406,222 +2524,604 @@ namespace atbus {
             return io_stream_disconnect(channel, iter->second.get(), callback);
         }
 
-        static void io_stream_on_written_fn(uv_write_t *req, int status) {
-            // req is at the begin of the data block, and will not be used any more, we can delete it here
-            // if uv_write2 return 0, this will always be called, so free all data here
+        static size_t io_stream_latency_bucket_index(uint64_t usec) {
+            if (usec < io_stream_latency_histogram_t::SUB_BUCKET_COUNT) {
+                return static_cast<size_t>(usec);
+            }
 
-            io_stream_connection *connection = reinterpret_cast<io_stream_connection *>(req->data);
-            assert(connection);
-            assert(connection->channel);
+            size_t msb = 0;
+            for (uint64_t v = usec >> 1; v > 0; v >>= 1) {
+                ++msb;
+            }
+            if (msb >= ATBUS_MACRO_IOS_LATENCY_MAX_BITS) {
+                return io_stream_latency_histogram_t::BUCKET_COUNT - 1;
+            }
 
-            ATBUS_CHANNEL_REQ_END(connection->channel);
+            size_t shift = msb - ATBUS_MACRO_IOS_LATENCY_SUB_BUCKET_BITS;
+            return (shift + 1) * io_stream_latency_histogram_t::SUB_BUCKET_COUNT +
+                   static_cast<size_t>((usec >> shift) - io_stream_latency_histogram_t::SUB_BUCKET_COUNT);
+        }
 
-            io_stream_flag_guard flag_guard(connection->channel->flags, io_stream_channel::EN_CF_IN_CALLBACK);
+        // 区间内的最大值
+        static uint64_t io_stream_latency_bucket_value(size_t index) {
+            if (index < io_stream_latency_histogram_t::SUB_BUCKET_COUNT) {
+                return index;
+            }
 
-            void *data = NULL;
-            size_t nread, nwrite;
+            size_t shift = index / io_stream_latency_histogram_t::SUB_BUCKET_COUNT - 1;
+            uint64_t sub = index % io_stream_latency_histogram_t::SUB_BUCKET_COUNT + io_stream_latency_histogram_t::SUB_BUCKET_COUNT;
+            return ((sub + 1) << shift) - 1;
+        }
 
-            // popup the lost callback
-            while (true) {
-                connection->write_buffers.front(data, nread, nwrite);
-                if (NULL == data) {
-                    break;
-                }
+        void io_stream_latency_record(io_stream_latency_histogram_t *histogram, uint64_t usec) {
+            if (NULL == histogram) {
+                return;
+            }
 
-                assert(0 == nread);
-                assert(req == data);
+            if (0 == histogram->total_count || usec < histogram->min_value) {
+                histogram->min_value = usec;
+            }
+            if (usec > histogram->max_value) {
+                histogram->max_value = usec;
+            }
+            ++histogram->total_count;
+            histogram->total_value += usec;
+            ++histogram->counts[io_stream_latency_bucket_index(usec)];
+        }
 
-                if (0 == nwrite) {
-                    connection->write_buffers.pop_front(0, true);
-                    break;
-                }
+        void io_stream_latency_merge(io_stream_latency_histogram_t *dst, const io_stream_latency_histogram_t *src) {
+            if (NULL == dst || NULL == src || 0 == src->total_count) {
+                return;
+            }
 
-                // nwrite = sizeof(uv_write_t) + [data block...]
-                // data block = 32bits hash+vint+data length
-                char *buff_start = reinterpret_cast<char *>(data) + sizeof(uv_write_t);
-                size_t left_length = nwrite - sizeof(uv_write_t);
-                while (left_length > 0) {
-                    // skip 32bits hash
-                    buff_start += sizeof(uint32_t);
-                    uint64_t out;
-                    size_t vint_len = ::atbus::detail::fn::read_vint(out, buff_start, left_length - sizeof(uint32_t));
-                    // skip varint
-                    buff_start += vint_len;
-
-                    // data length should be enough to hold all data
-                    if (left_length < sizeof(uint32_t) + vint_len + static_cast<size_t>(out)) {
-                        assert(false);
-                        left_length = 0;
-                    }
+            if (0 == dst->total_count || src->min_value < dst->min_value) {
+                dst->min_value = src->min_value;
+            }
+            if (src->max_value > dst->max_value) {
+                dst->max_value = src->max_value;
+            }
+            dst->total_count += src->total_count;
+            dst->total_value += src->total_value;
+            for (size_t i = 0; i < io_stream_latency_histogram_t::BUCKET_COUNT; ++i) {
+                dst->counts[i] += src->counts[i];
+            }
+        }
 
-                    io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_WRITEN, connection->channel, connection, status,
-                                               req == data ? EN_ATBUS_ERR_SUCCESS : EN_ATBUS_ERR_NODE_TIMEOUT, buff_start, out);
+        uint64_t io_stream_latency_percentile(const io_stream_latency_histogram_t *histogram, double percentile) {
+            if (NULL == histogram || 0 == histogram->total_count) {
+                return 0;
+            }
 
-                    buff_start += static_cast<size_t>(out);
+            if (percentile <= 0.0) {
+                return histogram->min_value;
+            }
 
-                    // 32bits hash+vint+data length
-                    left_length -= sizeof(uint32_t) + vint_len + static_cast<size_t>(out);
+            // 至少要包含这么多个记录
+            uint64_t expect_count = static_cast<uint64_t>(std::ceil(percentile * static_cast<double>(histogram->total_count) / 100.0));
+            uint64_t count = 0;
+            for (size_t i = 0; i < io_stream_latency_histogram_t::BUCKET_COUNT; ++i) {
+                count += histogram->counts[i];
+                if (count >= expect_count) {
+                    uint64_t ret = io_stream_latency_bucket_value(i);
+                    return ret < histogram->max_value ? ret : histogram->max_value;
                 }
+            }
 
-                // remove all cache buffer
-                connection->write_buffers.pop_front(nwrite, true);
+            return histogram->max_value;
+        }
 
-                // the end
-                if (req == data) {
-                    break;
-                }
+        void io_stream_latency_reset(io_stream_latency_histogram_t *histogram) {
+            if (NULL != histogram) {
+                memset(histogram, 0, sizeof(io_stream_latency_histogram_t));
             }
+        }
 
-            // unset writing mode
-            ATBUS_CHANNEL_IOS_UNSET_FLAG(connection->flags, io_stream_connection::EN_CF_WRITING);
+        // 没有开启enable_latency_stat时返回NULL，统计数据比较大，第一次用到时才分配
+        static io_stream_latency_stat_t *io_stream_get_latency_stat(io_stream_connection *connection) {
+            if (!connection->channel->conf.enable_latency_stat) {
+                return NULL;
+            }
 
-            // write left data
-            io_stream_try_write(connection);
+            if (!connection->latency_stat) {
+                connection->latency_stat.reset(new io_stream_latency_stat_t());
+                io_stream_latency_reset(&connection->latency_stat->queue);
+                io_stream_latency_reset(&connection->latency_stat->written);
+            }
+            return connection->latency_stat.get();
+        }
 
-            // if in disconnecting status and there is no more data to write, close it
-            if (io_stream_connection::EN_ST_DISCONNECTING == connection->status &&
-                !ATBUS_CHANNEL_IOS_CHECK_FLAG(connection->flags, io_stream_connection::EN_CF_WRITING)) {
+        // 发送缓冲区数据块的头部，后面是[消息头+data]
+        struct io_stream_write_block_head_t {
+            uv_write_t req;                  // 写请求，必须放在最前面
+            io_stream_write_stat_t stat;     // 本数据块包含的消息信息，入队时记录
+            size_t payload_size;             // 消息头后面的数据长度，压缩后和stat.data_size不同
+            size_t req_block_number;         // 仅写请求所在的数据块有效，本次写请求包含的数据块数量
+            bool req_is_ctrl;                // 仅写请求所在的数据块有效，本次写请求的数据块是否在ctrl_write_buffers里
+            io_stream_write_stat_t req_stat; // 仅写请求所在的数据块有效，本次写请求包含的消息信息
+            const void *ext_data;            // 不复制的消息数据，长度是payload_size，为NULL时数据在消息头后面
+            mem_ptr_free_fn_t ext_free_fn;   // 发送完成或取消后释放ext_data
+            uint64_t send_time;              // 调用io_stream_send的时间(uv_hrtime，纳秒)，用于统计发送延迟
+            adapter::pipe_t *send_handle;    // 和消息一起发送的文件描述符(仅unix socket)，发送完成或取消后关闭
+        };
 
-                io_stream_disconnect_run(connection);
-            }
+        static inline io_stream_write_block_head_t *io_stream_get_write_block_head(::atbus::detail::buffer_block *bb) {
+            return reinterpret_cast<io_stream_write_block_head_t *>(bb->raw_data());
         }
 
-        int io_stream_try_write(io_stream_connection *connection) {
-            if (NULL == connection) {
-                return EN_ATBUS_ERR_PARAMS;
-            }
+        static void io_stream_fd_handle_on_close(uv_handle_t *handle) {
+            io_stream_channel *channel = reinterpret_cast<io_stream_channel *>(handle->data);
+            assert(channel);
 
-            int ret = EN_ATBUS_ERR_SUCCESS;
-            if (ATBUS_CHANNEL_IOS_CHECK_FLAG(connection->flags, io_stream_connection::EN_CF_WRITING)) {
-                return ret;
+            free(handle);
+            ATBUS_CHANNEL_REQ_END(channel);
+        }
+
+        static inline void io_stream_free_write_block_ext(io_stream_connection *connection, io_stream_write_block_head_t *head) {
+            if (NULL != head->ext_data && NULL != head->ext_free_fn) {
+                assert(connection->write_ext_size >= head->payload_size);
+                connection->write_ext_size -= head->payload_size;
+                head->ext_free_fn(const_cast<void *>(head->ext_data), head->payload_size);
             }
+            head->ext_data = NULL;
+            head->ext_free_fn = NULL;
 
-            // empty then skip write data
-            if (connection->write_buffers.empty()) {
-                return ret;
+            // 文件描述符已经发送给对端或者不再发送了，关闭本地复制的描述符
+            if (NULL != head->send_handle) {
+                uv_close(reinterpret_cast<uv_handle_t *>(head->send_handle), io_stream_fd_handle_on_close);
+                head->send_handle = NULL;
             }
+        }
 
-            // closing or closed, cancle writing
-            if (ATBUS_CHANNEL_IOS_CHECK_FLAG(connection->flags, io_stream_connection::EN_CF_CLOSING)) {
-                while (!connection->write_buffers.empty()) {
-                    ::atbus::detail::buffer_block *bb = connection->write_buffers.front();
-                    size_t nwrite = bb->raw_size();
-                    // nwrite = sizeof(uv_write_t) + [data block...]
-                    // data block = 32bits hash+vint+data length
-                    char *buff_start = reinterpret_cast<char *>(bb->raw_data()) + sizeof(uv_write_t);
-                    size_t left_length = nwrite - sizeof(uv_write_t);
-                    while (left_length > 0) {
-                        // skip 32bits hash
-                        buff_start += sizeof(uint32_t);
-                        uint64_t out;
-                        size_t vint_len = ::atbus::detail::fn::read_vint(out, buff_start, left_length - sizeof(uint32_t));
-                        // skip varint
-                        buff_start += vint_len;
-
-                        // data length should be enough to hold all data
-                        if (left_length < sizeof(uint32_t) + vint_len + static_cast<size_t>(out)) {
-                            assert(false);
-                            left_length = 0;
-                        }
-                        io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_WRITEN, connection->channel, connection, UV_ECANCELED,
-                                                   EN_ATBUS_ERR_CLOSING, buff_start, out);
-
-                        buff_start += static_cast<size_t>(out);
+        // 连接关闭时没有发送的数据直接丢弃，只需要释放不复制的消息数据
+        static void io_stream_release_write_blocks(io_stream_connection *connection) {
+            ::atbus::detail::buffer_manager *write_buffers[2] = {&connection->ctrl_write_buffers, &connection->write_buffers};
+            for (int i = 0; i < 2; ++i) {
+                while (!write_buffers[i]->empty()) {
+                    ::atbus::detail::buffer_block *bb = write_buffers[i]->front();
+                    if (NULL == bb) {
+                        break;
+                    }
 
-                        // 32bits hash+vint+data length
-                        left_length -= sizeof(uint32_t) + vint_len + static_cast<size_t>(out);
+                    if (bb->raw_size() >= sizeof(io_stream_write_block_head_t)) {
+                        io_stream_free_write_block_ext(connection, io_stream_get_write_block_head(bb));
                     }
+                    write_buffers[i]->pop_front(bb->raw_size(), true);
+                }
+            }
+        }
 
-                    // remove all cache buffer
-                    connection->write_buffers.pop_front(nwrite, true);
+        // 移除头部的block_number个数据块并触发回调，只有注册了EN_FN_WRITEN时才需要逐个消息回调
+        static void io_stream_pop_write_blocks(io_stream_connection *connection, bool is_ctrl, size_t block_number, int status,
+                                               int errcode) {
+            ::atbus::detail::buffer_manager &write_buffers = is_ctrl ? connection->ctrl_write_buffers : connection->write_buffers;
+            bool need_frame_callback = NULL != connection->channel->evt.callbacks[io_stream_callback_evt_t::EN_FN_WRITEN] ||
+                                       NULL != connection->evt.callbacks[io_stream_callback_evt_t::EN_FN_WRITEN];
+
+            io_stream_write_stat_t stat;
+            stat.frame_number = 0;
+            stat.data_size = 0;
+            io_stream_latency_stat_t *latency_stat = 0 == status ? io_stream_get_latency_stat(connection) : NULL;
+            uint64_t now = NULL != latency_stat ? uv_hrtime() : 0;
+            for (size_t i = 0; i < block_number; ++i) {
+                ::atbus::detail::buffer_block *bb = write_buffers.front();
+                if (NULL == bb) {
+                    break;
                 }
 
-                return ret;
-            }
+                if (!is_ctrl && connection->ctrl_write_barrier > 0) {
+                    --connection->ctrl_write_barrier;
+                }
 
-            // if not in writing mode, try to merge and write data
-            // merge only if message is smaller than read buffer
-            if (connection->write_buffers.limit().cost_number_ > 1 &&
-                connection->write_buffers.front()->raw_size() <= ATBUS_MACRO_DATA_SMALL_SIZE) {
-                size_t available_bytes = ATBUS_MACRO_TLS_MERGE_BUFFER_LEN;
-                char *buffer_start = ::atbus::channel::detail::io_stream_get_msg_buffer();
-                char *free_buffer = buffer_start;
+                size_t nwrite = bb->raw_size();
+                if (nwrite < sizeof(io_stream_write_block_head_t)) {
+                    write_buffers.pop_front(nwrite, true);
+                    continue;
+                }
 
-                ::atbus::detail::buffer_block *preview_bb = NULL;
-                while (!connection->write_buffers.empty() && available_bytes > 0) {
-                    ::atbus::detail::buffer_block *bb = connection->write_buffers.front();
-                    if (NULL == bb || bb->raw_size() > available_bytes) {
-                        break;
-                    }
+                io_stream_write_block_head_t *head = io_stream_get_write_block_head(bb);
+                stat.frame_number += head->stat.frame_number;
+                stat.data_size += head->stat.data_size;
+                if (NULL != latency_stat && head->stat.frame_number > 0) {
+                    io_stream_latency_record(&latency_stat->written, (now - head->send_time) / 1000);
+                }
 
-                    // if connection->write_buffers is a static circle buffer, can not merge the bound blocks
-                    if (connection->write_buffers.is_static_mode() && NULL != preview_bb && preview_bb > bb) {
-                        break;
+                // nwrite = sizeof(io_stream_write_block_head_t) + frame head + payload
+                // the frame head has different length in different checksum type, but payload is always at the end of block
+                // payload is not in the block if it's sent by io_stream_send_ptr
+                if (need_frame_callback && head->stat.frame_number > 0) {
+                    const void *payload = head->ext_data;
+                    if (NULL == payload) {
+                        assert(nwrite >= sizeof(io_stream_write_block_head_t) + head->payload_size);
+                        payload = reinterpret_cast<char *>(bb->raw_data()) + nwrite - head->payload_size;
                     }
-                    preview_bb = bb;
+                    io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_WRITEN, connection->channel, connection, status, errcode,
+                                               const_cast<void *>(payload), head->payload_size);
+                }
+
+                // remove all cache buffer
+                io_stream_free_write_block_ext(connection, head);
+                write_buffers.pop_front(nwrite, true);
+            }
 
-                    // first sizeof(uv_write_t) is req, the rest is 32bits hash+varint+len
-                    size_t bb_size = bb->raw_size() - sizeof(uv_write_t);
-                    memcpy(free_buffer, ::atbus::detail::fn::buffer_next(bb->raw_data(), sizeof(uv_write_t)), bb_size);
-                    free_buffer += bb_size;
-                    available_bytes -= bb_size;
+            if (stat.frame_number > 0) {
+                io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_WRITEN_BATCH, connection->channel, connection, status, errcode,
+                                           &stat, sizeof(stat));
+            }
+        }
 
-                    connection->write_buffers.pop_front(bb->raw_size(), true);
-                }
+        static void io_stream_on_written_fn(uv_write_t *req, int status) {
+            // req is at the begin of the last data block, and will not be used any more, we can delete it here
+            // if uv_write2 return 0, this will always be called, so free all data here
 
-                void *data = NULL;
-                connection->write_buffers.push_front(data, sizeof(uv_write_t) + (free_buffer - buffer_start));
+            io_stream_connection *connection = reinterpret_cast<io_stream_connection *>(req->data);
+            assert(connection);
+            assert(connection->channel);
 
-                // already pop more data than sizeof(uv_write_t) + (free_buffer - buffer_start)
-                // so this push_front should always success
-                assert(data);
-                // at least merge one block
-                assert(free_buffer > buffer_start);
-                assert(static_cast<size_t>(free_buffer - buffer_start) <= ATBUS_MACRO_TLS_MERGE_BUFFER_LEN);
+            ATBUS_CHANNEL_REQ_END(connection->channel);
+
+            io_stream_flag_guard flag_guard(connection->channel->flags, io_stream_channel::EN_CF_IN_CALLBACK);
 
-                data = ::atbus::detail::fn::buffer_next(data, sizeof(uv_write_t));
-                // copy back merged data
-                memcpy(data, buffer_start, free_buffer - buffer_start);
+            // popup all blocks written by this req, the number of blocks is recorded when writing
+            // libuv finish write requests in order, so they are always the first blocks of write_buffers or ctrl_write_buffers
+            size_t block_number = reinterpret_cast<io_stream_write_block_head_t *>(req)->req_block_number;
+            bool is_ctrl = reinterpret_cast<io_stream_write_block_head_t *>(req)->req_is_ctrl;
+            size_t &writing_block_number = is_ctrl ? connection->ctrl_writing_block_number : connection->writing_block_number;
+            assert(writing_block_number >= block_number);
+            if (writing_block_number >= block_number) {
+                writing_block_number -= block_number;
+            } else {
+                writing_block_number = 0;
             }
+            io_stream_pop_write_blocks(connection, is_ctrl, block_number, status, EN_ATBUS_ERR_SUCCESS);
 
+            // unset writing mode when all write requests finished
+            assert(connection->writing_req_number > 0);
+            if (connection->writing_req_number > 0) {
+                --connection->writing_req_number;
+            }
+            if (0 == connection->writing_req_number) {
+                ATBUS_CHANNEL_IOS_UNSET_FLAG(connection->flags, io_stream_connection::EN_CF_WRITING);
+                connection->writing_block_number = 0;
+                connection->ctrl_writing_block_number = 0;
+            }
 
-            ::atbus::detail::buffer_block *writing_block = connection->write_buffers.front();
+            // write left data
+            io_stream_try_write(connection);
 
-            // should always exist, empty will cause return before
-            if (NULL == writing_block) {
-                assert(writing_block);
-                return EN_ATBUS_ERR_NO_DATA;
+            // if in disconnecting status and there is no more data to write, close it
+            if (io_stream_connection::EN_ST_DISCONNECTING == connection->status &&
+                !ATBUS_CHANNEL_IOS_CHECK_FLAG(connection->flags, io_stream_connection::EN_CF_WRITING)) {
+
+                io_stream_disconnect_run(connection);
             }
+        }
 
-            if (writing_block->raw_size() <= sizeof(uv_write_t)) {
-                connection->write_buffers.pop_front(writing_block->raw_size(), true);
-                return io_stream_try_write(connection);
+        int io_stream_try_write(io_stream_connection *connection) {
+            if (NULL == connection) {
+                return EN_ATBUS_ERR_PARAMS;
             }
 
-            // 初始化req，填充vint，复制数据区
-            uv_write_t *req = reinterpret_cast<uv_write_t *>(writing_block->raw_data());
-            req->data = connection;
+            int ret = EN_ATBUS_ERR_SUCCESS;
+            // closing connection will cancel all left data after all write requests finished
+            if (ATBUS_CHANNEL_IOS_CHECK_FLAG(connection->flags, io_stream_connection::EN_CF_WRITING)) {
+                if (ATBUS_CHANNEL_IOS_CHECK_FLAG(connection->flags, io_stream_connection::EN_CF_CLOSING)) {
+                    return ret;
+                }
 
-            char *buff_start = reinterpret_cast<char *>(writing_block->raw_data());
-            // req
-            buff_start += sizeof(uv_write_t);
+                size_t window_size = connection->channel->conf.send_window_size > 0 ? connection->channel->conf.send_window_size : 1;
+                if (connection->writing_req_number >= window_size) {
+                    return ret;
+                }
+            }
 
+            // empty then skip write data
+            if (connection->write_buffers.empty() && connection->ctrl_write_buffers.empty()) {
+                return ret;
+            }
+
+            // closing or closed, cancle writing
+            if (ATBUS_CHANNEL_IOS_CHECK_FLAG(connection->flags, io_stream_connection::EN_CF_CLOSING)) {
+                io_stream_pop_write_blocks(connection, true, connection->ctrl_write_buffers.limit().cost_number_, UV_ECANCELED,
+                                           EN_ATBUS_ERR_CLOSING);
+                io_stream_pop_write_blocks(connection, false, connection->write_buffers.limit().cost_number_, UV_ECANCELED,
+                                           EN_ATBUS_ERR_CLOSING);
+                return ret;
+            }
+
+            // write as many queued blocks as possible with one uv_write(writev), skip blocks already in writing
+            // buffer blocks need not to be continuous, so there is no memory copy and no limit of static circle buffer here
+            // control messages are written at first, but the block partly written by uv_try_write must be finished before them
+            ::atbus::detail::buffer_block *writing_blocks[ATBUS_MACRO_IOS_WRITEV_MAX_BUFS];
+            size_t writing_number = 0;
+            bool is_ctrl = false;
+            if (0 == connection->write_head_offset || connection->write_head_ctrl) {
+                writing_number = connection->ctrl_write_buffers.front_blocks(writing_blocks, ATBUS_MACRO_IOS_WRITEV_MAX_BUFS,
+                                                                             connection->ctrl_writing_block_number);
+                is_ctrl = writing_number > 0;
+            }
+            if (!is_ctrl) {
+                writing_number = connection->write_buffers.front_blocks(writing_blocks, ATBUS_MACRO_IOS_WRITEV_MAX_BUFS,
+                                                                        connection->writing_block_number);
+            }
+            ::atbus::detail::buffer_manager &write_buffers = is_ctrl ? connection->ctrl_write_buffers : connection->write_buffers;
+            size_t &writing_block_number = is_ctrl ? connection->ctrl_writing_block_number : connection->writing_block_number;
+
+            // all blocks are already in writing
+            if (0 == writing_number) {
+                return ret;
+            }
+
+            if (0 == writing_block_number && writing_blocks[0]->raw_size() <= sizeof(io_stream_write_block_head_t)) {
+                if (!is_ctrl && connection->ctrl_write_barrier > 0) {
+                    --connection->ctrl_write_barrier;
+                }
+                write_buffers.pop_front(writing_blocks[0]->raw_size(), true);
+                return io_stream_try_write(connection);
+            }
+
+            // first sizeof(io_stream_write_block_head_t) of each block is head, the rest is frame head+data
+            // the data of blocks sent by io_stream_send_ptr is not in the block, and will be written as another buffer
             // call write ，bufs[] will be copied in libuv, but the real data will not
-            uv_buf_t bufs[1] = {uv_buf_init(buff_start, static_cast<unsigned int>(writing_block->raw_size() - sizeof(uv_write_t)))};
+            uv_buf_t bufs[ATBUS_MACRO_IOS_WRITEV_MAX_BUFS];
+            size_t nbufs = 0;
+            size_t nblocks = 0;
+            size_t total_bytes = 0;
+            io_stream_write_stat_t req_stat;
+            req_stat.frame_number = 0;
+            req_stat.data_size = 0;
+            for (size_t i = 0; i < writing_number; ++i) {
+                io_stream_write_block_head_t *bb_head = io_stream_get_write_block_head(writing_blocks[i]);
+                char *bb_data = reinterpret_cast<char *>(writing_blocks[i]->raw_data()) + sizeof(io_stream_write_block_head_t);
+                size_t bb_size = writing_blocks[i]->raw_size() - sizeof(io_stream_write_block_head_t);
+                char *ext_data = reinterpret_cast<char *>(const_cast<void *>(bb_head->ext_data));
+                size_t ext_size = NULL == ext_data ? 0 : bb_head->payload_size;
+                // the head of first block may be already sent by uv_try_write in io_stream_send
+                if (0 == i && 0 == writing_block_number && connection->write_head_offset < bb_size + ext_size) {
+                    if (connection->write_head_offset < bb_size) {
+                        bb_data += connection->write_head_offset;
+                        bb_size -= connection->write_head_offset;
+                    } else {
+                        ext_data += connection->write_head_offset - bb_size;
+                        ext_size -= connection->write_head_offset - bb_size;
+                        bb_size = 0;
+                    }
+                }
 
-            ATBUS_CHANNEL_IOS_SET_FLAG(connection->flags, io_stream_connection::EN_CF_WRITING);
-            int res = uv_write(req, connection->handle.get(), bufs, 1, io_stream_on_written_fn);
+                // merge no more than ATBUS_MACRO_MSG_LIMIT except the first one, so big messages can be written in parallel
+                if (i > 0 && total_bytes + bb_size + ext_size > ATBUS_MACRO_MSG_LIMIT) {
+                    break;
+                }
+
+                // only one file descriptor can be sent by a write request, and it's sent with the first buffer
+                if (i > 0 && NULL != bb_head->send_handle) {
+                    break;
+                }
+
+                if (nbufs + (bb_size > 0 ? 1 : 0) + (ext_size > 0 ? 1 : 0) > ATBUS_MACRO_IOS_WRITEV_MAX_BUFS) {
+                    break;
+                }
+
+                if (bb_size > 0) {
+                    bufs[nbufs] = uv_buf_init(bb_data, static_cast<unsigned int>(bb_size));
+                    ++nbufs;
+                }
+                if (ext_size > 0) {
+                    bufs[nbufs] = uv_buf_init(ext_data, static_cast<unsigned int>(ext_size));
+                    ++nbufs;
+                }
+                ++nblocks;
+                total_bytes += bb_size + ext_size;
+                req_stat.frame_number += bb_head->stat.frame_number;
+                req_stat.data_size += bb_head->stat.data_size;
+            }
+
+            // use req in the last block, and record the blocks and messages of this req in it
+            io_stream_write_block_head_t *req_head = io_stream_get_write_block_head(writing_blocks[nblocks - 1]);
+            req_head->req_block_number = nblocks;
+            req_head->req_is_ctrl = is_ctrl;
+            req_head->req_stat = req_stat;
+            uv_write_t *req = &req_head->req;
+            req->data = connection;
+
+            int res;
+            io_stream_write_block_head_t *first_head = io_stream_get_write_block_head(writing_blocks[0]);
+            if (NULL != first_head->send_handle) {
+                res = uv_write2(req, connection->handle.get(), bufs, static_cast<unsigned int>(nbufs),
+                                reinterpret_cast<uv_stream_t *>(first_head->send_handle), io_stream_on_written_fn);
+            } else {
+                res = uv_write(req, connection->handle.get(), bufs, static_cast<unsigned int>(nbufs), io_stream_on_written_fn);
+            }
             if (0 != res) {
                 connection->channel->error_code = res;
-                ATBUS_CHANNEL_IOS_UNSET_FLAG(connection->flags, io_stream_connection::EN_CF_WRITING);
                 return EN_ATBUS_ERR_WRITE_FAILED;
             }
             ATBUS_CHANNEL_REQ_START(connection->channel);
+            ATBUS_CHANNEL_IOS_SET_FLAG(connection->flags, io_stream_connection::EN_CF_WRITING);
+            ++connection->writing_req_number;
+            writing_block_number += nblocks;
+
+            io_stream_latency_stat_t *latency_stat = io_stream_get_latency_stat(connection);
+            if (NULL != latency_stat) {
+                uint64_t now = uv_hrtime();
+                for (size_t i = 0; i < nblocks; ++i) {
+                    io_stream_write_block_head_t *bb_head = io_stream_get_write_block_head(writing_blocks[i]);
+                    if (bb_head->stat.frame_number > 0) {
+                        io_stream_latency_record(&latency_stat->queue, (now - bb_head->send_time) / 1000);
+                    }
+                }
+            }
+            connection->write_head_offset = 0;
+            connection->write_head_ctrl = false;
 
-            return ret;
+            // fill the write window
+            return io_stream_try_write(connection);
         }
 
-        int io_stream_send(io_stream_connection *connection, const void *buf, size_t len) {
+        // 回调被uv_try_write直接发送完的消息的EN_FN_WRITEN_BATCH
+        static void io_stream_written_callback(io_stream_connection *connection) {
+            if (0 == connection->try_written_stat.frame_number) {
+                return;
+            }
+
+            io_stream_write_stat_t stat = connection->try_written_stat;
+            connection->try_written_stat.frame_number = 0;
+            connection->try_written_stat.data_size = 0;
+            io_stream_channel_callback(io_stream_callback_evt_t::EN_FN_WRITEN_BATCH, connection->channel, connection, 0,
+                                       EN_ATBUS_ERR_SUCCESS, &stat, sizeof(stat));
+        }
+
+        static void io_stream_written_timer_on_timeout(uv_timer_t *handle) {
+            io_stream_channel *channel = reinterpret_cast<io_stream_channel *>(handle->data);
+            assert(channel);
+
+            io_stream_flag_guard flag_guard(channel->flags, io_stream_channel::EN_CF_IN_CALLBACK);
+
+            // 回调里可能会有新的直接发送完的消息，它们在下一次事件循环回调
+            std::vector<adapter::fd_t> written_fds;
+            written_fds.swap(channel->written_fds);
+            for (size_t i = 0; i < written_fds.size(); ++i) {
+                io_stream_channel::conn_pool_t::iterator iter = channel->conn_pool.find(written_fds[i]);
+                if (iter != channel->conn_pool.end()) {
+                    io_stream_written_callback(iter->second.get());
+                }
+            }
+        }
+
+        // 记录直接发送完的消息，写完成回调在下一次事件循环里触发
+        static int io_stream_written_defer(io_stream_connection *connection, size_t data_size) {
+            io_stream_channel *channel = connection->channel;
+            if (NULL == channel->written_timer) {
+                adapter::timer_t *timer = reinterpret_cast<adapter::timer_t *>(malloc(sizeof(adapter::timer_t)));
+                if (NULL == timer) {
+                    return EN_ATBUS_ERR_MALLOC;
+                }
+
+                if (0 != uv_timer_init(io_stream_get_loop(channel), timer)) {
+                    free(timer);
+                    return EN_ATBUS_ERR_EV_RUN;
+                }
+
+                timer->data = channel;
+                channel->written_timer = timer;
+                ATBUS_CHANNEL_REQ_START(channel);
+            }
+
+            if (0 == connection->try_written_stat.frame_number) {
+                channel->written_fds.push_back(connection->fd);
+            }
+            ++connection->try_written_stat.frame_number;
+            connection->try_written_stat.data_size += data_size;
+
+            if (!uv_is_active(reinterpret_cast<uv_handle_t *>(channel->written_timer)) &&
+                0 != uv_timer_start(channel->written_timer, io_stream_written_timer_on_timeout, 0, 0)) {
+                return EN_ATBUS_ERR_EV_RUN;
+            }
+
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        static void io_stream_cork_timer_on_timeout(uv_timer_t *handle);
+
+        // 定时器在所有连接中最早的发送时间触发
+        static int io_stream_cork_timer_start(io_stream_channel *channel, uint64_t deadline) {
+            if (NULL == channel->cork_timer) {
+                adapter::timer_t *timer = reinterpret_cast<adapter::timer_t *>(malloc(sizeof(adapter::timer_t)));
+                if (NULL == timer) {
+                    return EN_ATBUS_ERR_MALLOC;
+                }
+
+                if (0 != uv_timer_init(io_stream_get_loop(channel), timer)) {
+                    free(timer);
+                    return EN_ATBUS_ERR_EV_RUN;
+                }
+
+                timer->data = channel;
+                channel->cork_timer = timer;
+                // 关闭定时器时计数结束，保证io_stream_close返回前定时器已经释放
+                ATBUS_CHANNEL_REQ_START(channel);
+            }
+
+            if (uv_is_active(reinterpret_cast<uv_handle_t *>(channel->cork_timer)) && channel->cork_timer_deadline <= deadline) {
+                return EN_ATBUS_ERR_SUCCESS;
+            }
+
+            // libuv的定时器精度是毫秒，向上取整
+            uint64_t now = uv_hrtime();
+            uint64_t timeout_ms = deadline > now ? (deadline - now + 999999) / 1000000 : 0;
+            if (0 != uv_timer_start(channel->cork_timer, io_stream_cork_timer_on_timeout, timeout_ms, 0)) {
+                return EN_ATBUS_ERR_EV_RUN;
+            }
+
+            channel->cork_timer_deadline = deadline;
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        // 发送所有到期的延迟数据，没到期的重新计时
+        static void io_stream_cork_timer_on_timeout(uv_timer_t *handle) {
+            io_stream_channel *channel = reinterpret_cast<io_stream_channel *>(handle->data);
+            assert(channel);
+
+            io_stream_flag_guard flag_guard(channel->flags, io_stream_channel::EN_CF_IN_CALLBACK);
+
+            // 发送时的回调里可能会有新的延迟数据，所以先取出所有连接
+            std::vector<adapter::fd_t> cork_fds;
+            cork_fds.swap(channel->cork_fds);
+
+            uint64_t now = uv_hrtime();
+            for (size_t i = 0; i < cork_fds.size(); ++i) {
+                // 已经关闭或已经发送的连接直接跳过
+                io_stream_channel::conn_pool_t::iterator iter = channel->conn_pool.find(cork_fds[i]);
+                if (iter == channel->conn_pool.end() ||
+                    !ATBUS_CHANNEL_IOS_CHECK_FLAG(iter->second->flags, io_stream_connection::EN_CF_CORKED)) {
+                    continue;
+                }
+
+                if (iter->second->cork_deadline <= now) {
+                    io_stream_flush(iter->second.get());
+                } else if (channel->cork_fds.end() == std::find(channel->cork_fds.begin(), channel->cork_fds.end(), cork_fds[i])) {
+                    channel->cork_fds.push_back(cork_fds[i]);
+                }
+            }
+
+            uint64_t deadline = 0;
+            for (size_t i = 0; i < channel->cork_fds.size(); ++i) {
+                io_stream_channel::conn_pool_t::iterator iter = channel->conn_pool.find(channel->cork_fds[i]);
+                if (iter != channel->conn_pool.end() && (0 == deadline || iter->second->cork_deadline < deadline)) {
+                    deadline = iter->second->cork_deadline;
+                }
+            }
+
+            if (0 != deadline) {
+                io_stream_cork_timer_start(channel, deadline);
+            }
+        }
+
+        // 记录延迟发送的数据，达到长度上限时立即发送，否则等待定时器
+        static int io_stream_cork(io_stream_connection *connection, size_t frame_size) {
+            connection->corked_size += frame_size;
+            if (connection->corked_size >= connection->cork_size) {
+                return io_stream_flush(connection);
+            }
+
+            if (ATBUS_CHANNEL_IOS_CHECK_FLAG(connection->flags, io_stream_connection::EN_CF_CORKED)) {
+                return EN_ATBUS_ERR_SUCCESS;
+            }
+
+            connection->cork_deadline = uv_hrtime() + connection->cork_delay * 1000;
+            // 定时器不可用时不再延迟
+            if (io_stream_cork_timer_start(connection->channel, connection->cork_deadline) < 0) {
+                return io_stream_flush(connection);
+            }
+
+            ATBUS_CHANNEL_IOS_SET_FLAG(connection->flags, io_stream_connection::EN_CF_CORKED);
+            connection->channel->cork_fds.push_back(connection->fd);
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        // free_fn不为NULL时不复制buf，消息数据作为单独的缓冲区发送，完成或取消后调用free_fn释放
+        // send_handle不为NULL时和消息一起发送文件描述符，所有权转移到数据块，只有返回0时才会由数据块关闭
+        static int io_stream_send_frame(io_stream_connection *connection, const void *buf, size_t len, bool is_ctrl,
+                                        mem_ptr_free_fn_t free_fn, adapter::pipe_t *send_handle) {
             if (NULL == connection) {
                 return EN_ATBUS_ERR_PARAMS;
             }
@@ -1634,40 +3134,468 @@ namespace atbus {
                 return EN_ATBUS_ERR_CLOSING;
             }
 
+            // 切换标记发送前控制消息也按顺序排队，否则新格式的控制消息会先于切换标记发送
+            if (io_stream_checksum_t::EN_CS_LEGACY == connection->send_checksum || connection->ctrl_write_barrier > 0 ||
+                NULL != send_handle) {
+                is_ctrl = false;
+            }
+            ::atbus::detail::buffer_manager &write_buffers = is_ctrl ? connection->ctrl_write_buffers : connection->write_buffers;
+
             // push back message
             if (NULL != buf && len > 0) {
-                char vint[16];
-                size_t vint_len = ::atbus::detail::fn::write_vint(len, vint, sizeof(vint));
-                // 计算需要的内存块大小（uv_write_t的大小+32bits hash+vint的大小+len）
-                size_t total_buffer_size = sizeof(uv_write_t) + sizeof(uint32_t) + vint_len + len;
+                uint64_t send_time = connection->channel->conf.enable_latency_stat ? uv_hrtime() : 0;
+                // 压缩后发送的是压缩数据，只有新格式的消息可以压缩
+                const void *payload = buf;
+                size_t payload_size = len;
+                int frame_flags = connection->send_checksum;
+                // 压缩会产生新的数据，不复制的消息不压缩
+                if (io_stream_checksum_t::EN_CS_LEGACY != connection->send_checksum && NULL == free_fn) {
+                    frame_flags |= io_stream_compress_frame(connection, buf, len, payload, payload_size);
+                }
+
+                // flags+32bits checksum+vint
+                char head[1 + sizeof(uint32_t) + 16];
+                size_t head_len = io_stream_write_frame_head(frame_flags, payload, payload_size, head, sizeof(head));
+                // 计算需要的内存块大小（数据块头部的大小+消息头的大小+payload_size）
+                size_t total_buffer_size = sizeof(io_stream_write_block_head_t) + head_len;
+                if (NULL == free_fn) {
+                    total_buffer_size += payload_size;
+                }
+                // 延迟合并发送的小消息只放进发送缓冲区，不直接发送，不复制的消息总是立即发送
+                bool is_corked = !is_ctrl && NULL == free_fn && NULL == send_handle && connection->cork_size > 0 &&
+                                 head_len + payload_size < connection->cork_size;
+
+                // 连接空闲时先尝试直接发送，只有没发送完的部分才需要进入发送缓冲区
+                // 发送缓冲区为空时push_back只会因为超出大小限制或内存不足而失败，超出大小限制的包直接走排队流程并返回错误
+                // 写完成回调不能在这里触发，不复制的消息和需要逐个消息回调的消息在返回后还要用到数据，所以不直接发送
+                size_t try_written = 0;
+                size_t write_limit_size = write_buffers.limit().limit_size_;
+                bool need_frame_callback = NULL != connection->channel->evt.callbacks[io_stream_callback_evt_t::EN_FN_WRITEN] ||
+                                           NULL != connection->evt.callbacks[io_stream_callback_evt_t::EN_FN_WRITEN];
+                // 带文件描述符的消息只能通过uv_write2发送
+                if (!is_corked && NULL == send_handle && NULL == free_fn && !need_frame_callback &&
+                    !ATBUS_CHANNEL_IOS_CHECK_FLAG(connection->flags, io_stream_connection::EN_CF_WRITING) &&
+                    connection->write_buffers.empty() && connection->ctrl_write_buffers.empty() &&
+                    (0 == write_limit_size || total_buffer_size <= write_limit_size)) {
+                    uv_buf_t bufs[2] = {uv_buf_init(head, static_cast<unsigned int>(head_len)),
+                                        uv_buf_init(reinterpret_cast<char *>(const_cast<void *>(payload)),
+                                                    static_cast<unsigned int>(payload_size))};
+                    int res = uv_try_write(connection->handle.get(), bufs, 2);
+                    // UV_EAGAIN or other errors, just push it into write_buffers and the errors will be reported by uv_write
+                    if (res > 0) {
+                        try_written = static_cast<size_t>(res);
+                    }
+
+                    if (try_written >= head_len + payload_size) {
+                        // 直接发送完的消息没有排队，写完成的时间就是被内核接受的时间
+                        io_stream_latency_stat_t *latency_stat = io_stream_get_latency_stat(connection);
+                        if (NULL != latency_stat) {
+                            uint64_t latency = (uv_hrtime() - send_time) / 1000;
+                            io_stream_latency_record(&latency_stat->queue, latency);
+                            io_stream_latency_record(&latency_stat->written, latency);
+                        }
+
+                        // 数据已经发送了，定时器不可用时只会丢失回调
+                        io_stream_written_defer(connection, len);
+                        return EN_ATBUS_ERR_SUCCESS;
+                    }
+                }
+
+                // 判定内存限制，不复制的消息数据不在发送缓冲区里，但是也要计入大小限制，否则对端不读取时会无限堆积
+                if (NULL != free_fn && write_limit_size > 0 &&
+                    write_buffers.limit().cost_size_ + connection->write_ext_size + total_buffer_size + payload_size > write_limit_size) {
+                    return EN_ATBUS_ERR_BUFF_LIMIT;
+                }
 
-                // 判定内存限制
                 void *data;
-                int res = connection->write_buffers.push_back(data, total_buffer_size);
+                int res = write_buffers.push_back(data, total_buffer_size);
                 if (res < 0) {
+                    // part of this message is already sent, the stream can not be recovered
+                    if (try_written > 0) {
+                        io_stream_disconnect(connection->channel, connection, NULL);
+                    }
                     return res;
                 }
-
-                // 初始化req，填充vint，复制数据区
-                uv_write_t *req = reinterpret_cast<uv_write_t *>(data);
-                req->data = connection;
+                connection->write_head_offset = try_written;
+                connection->write_head_ctrl = is_ctrl;
+
+                // 初始化数据块头部，填充vint，复制数据区
+                io_stream_write_block_head_t *block_head = reinterpret_cast<io_stream_write_block_head_t *>(data);
+                block_head->req.data = connection;
+                block_head->stat.frame_number = 1;
+                block_head->stat.data_size = len;
+                block_head->payload_size = payload_size;
+                block_head->req_block_number = 0;
+                block_head->req_is_ctrl = false;
+                block_head->req_stat.frame_number = 0;
+                block_head->req_stat.data_size = 0;
+                block_head->ext_data = NULL == free_fn ? NULL : payload;
+                block_head->ext_free_fn = free_fn;
+                if (NULL != free_fn) {
+                    connection->write_ext_size += payload_size;
+                }
+                block_head->send_time = send_time;
+                block_head->send_handle = send_handle;
                 char *buff_start = reinterpret_cast<char *>(data);
-                // req
-                buff_start += sizeof(uv_write_t);
+                // head
+                buff_start += sizeof(io_stream_write_block_head_t);
 
-                // 32bits hash
-                uint32_t hash32 = util::hash::murmur_hash3_x86_32(reinterpret_cast<const char *>(buf), static_cast<int>(len), 0);
-                memcpy(buff_start, &hash32, sizeof(uint32_t));
-
-                // vint
-                memcpy(buff_start + sizeof(uint32_t), vint, vint_len);
+                // frame head
+                memcpy(buff_start, head, head_len);
                 // buffer
-                memcpy(buff_start + sizeof(uint32_t) + vint_len, buf, len);
+                if (NULL == free_fn) {
+                    memcpy(buff_start + head_len, payload, payload_size);
+                }
+
+                if (is_corked) {
+                    return io_stream_cork(connection, head_len + payload_size);
+                }
             }
 
+            // buf is owned by the write block now, and will be released when the connection is closed even if writing failed
+            if (NULL != free_fn || NULL != send_handle) {
+                if (is_ctrl) {
+                    io_stream_try_write(connection);
+                } else {
+                    io_stream_flush(connection);
+                }
+                return EN_ATBUS_ERR_SUCCESS;
+            }
+
+            if (is_ctrl) {
+                return io_stream_try_write(connection);
+            }
+
+            // the delayed frames are written together with this one
+            return io_stream_flush(connection);
+        }
+
+        int io_stream_send(io_stream_connection *connection, const void *buf, size_t len) {
+            return io_stream_send_frame(connection, buf, len, false, NULL, NULL);
+        }
+
+        int io_stream_send_ptr(io_stream_connection *connection, void *buf, size_t len, mem_ptr_free_fn_t free_fn) {
+            if (NULL == buf || 0 == len || NULL == free_fn) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            return io_stream_send_frame(connection, buf, len, false, free_fn, NULL);
+        }
+
+        int io_stream_send_ctrl(io_stream_connection *connection, const void *buf, size_t len) {
+            return io_stream_send_frame(connection, buf, len, true, NULL, NULL);
+        }
+
+        // 文件描述符通过unix socket的SCM_RIGHTS发送，只有ipc模式的pipe才能收发
+        static bool io_stream_fd_passing_available(io_stream_connection *connection) {
+            if (NULL == connection || !connection->handle || UV_NAMED_PIPE != connection->handle->type) {
+                return false;
+            }
+
+            return 0 != reinterpret_cast<adapter::pipe_t *>(connection->handle.get())->ipc;
+        }
+
+        int io_stream_send_fd(io_stream_connection *connection, adapter::fd_t fd, const void *buf, size_t len) {
+            if (NULL == connection || NULL == buf || 0 == len || fd < 0) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+#ifdef _WIN32
+            return EN_ATBUS_ERR_ACCESS_DENY;
+#else
+            if (!io_stream_fd_passing_available(connection)) {
+                return EN_ATBUS_ERR_ACCESS_DENY;
+            }
+
+            if (io_stream_connection::EN_ST_CONNECTED != connection->status) {
+                return EN_ATBUS_ERR_CLOSING;
+            }
+
+            // 复制一份描述符，调用者可以在返回后直接关闭fd
+            int dup_fd = dup(fd);
+            if (dup_fd < 0) {
+                connection->channel->error_code = -errno;
+                return EN_ATBUS_ERR_PIPE_FD_PASS_FAILED;
+            }
+
+            adapter::pipe_t *send_handle = reinterpret_cast<adapter::pipe_t *>(malloc(sizeof(adapter::pipe_t)));
+            if (NULL == send_handle) {
+                close(dup_fd);
+                return EN_ATBUS_ERR_MALLOC;
+            }
+
+            int res = uv_pipe_init(io_stream_get_loop(connection->channel), send_handle, 0);
+            if (0 != res) {
+                close(dup_fd);
+                free(send_handle);
+                connection->channel->error_code = res;
+                return EN_ATBUS_ERR_PIPE_FD_PASS_FAILED;
+            }
+            send_handle->data = connection->channel;
+            ATBUS_CHANNEL_REQ_START(connection->channel);
+
+            res = uv_pipe_open(send_handle, dup_fd);
+            if (0 != res) {
+                close(dup_fd);
+                uv_close(reinterpret_cast<uv_handle_t *>(send_handle), io_stream_fd_handle_on_close);
+                connection->channel->error_code = res;
+                return EN_ATBUS_ERR_PIPE_FD_PASS_FAILED;
+            }
+
+            res = io_stream_send_frame(connection, buf, len, false, NULL, send_handle);
+            if (res < 0) {
+                uv_close(reinterpret_cast<uv_handle_t *>(send_handle), io_stream_fd_handle_on_close);
+            }
+            return res;
+#endif
+        }
+
+        static void io_stream_recv_fd_on_close(uv_handle_t *handle) { free(handle); }
+
+        int io_stream_recv_fd(io_stream_connection *connection, adapter::fd_t *fd) {
+            if (NULL == connection || NULL == fd) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+#ifdef _WIN32
+            return EN_ATBUS_ERR_ACCESS_DENY;
+#else
+            if (!io_stream_fd_passing_available(connection)) {
+                return EN_ATBUS_ERR_ACCESS_DENY;
+            }
+
+            adapter::pipe_t *pipe = reinterpret_cast<adapter::pipe_t *>(connection->handle.get());
+            if (uv_pipe_pending_count(pipe) <= 0) {
+                return EN_ATBUS_ERR_NO_DATA;
+            }
+
+            // libuv收到的描述符只能通过uv_accept取出，先放进临时的pipe，再复制给调用者
+            adapter::pipe_t *recv_handle = reinterpret_cast<adapter::pipe_t *>(malloc(sizeof(adapter::pipe_t)));
+            if (NULL == recv_handle) {
+                return EN_ATBUS_ERR_MALLOC;
+            }
+
+            int res = uv_pipe_init(io_stream_get_loop(connection->channel), recv_handle, 0);
+            if (0 != res) {
+                free(recv_handle);
+                connection->channel->error_code = res;
+                return EN_ATBUS_ERR_PIPE_FD_PASS_FAILED;
+            }
+
+            int ret = EN_ATBUS_ERR_SUCCESS;
+            uv_os_fd_t recv_fd;
+            res = uv_accept(connection->handle.get(), reinterpret_cast<uv_stream_t *>(recv_handle));
+            if (0 == res) {
+                res = uv_fileno(reinterpret_cast<uv_handle_t *>(recv_handle), &recv_fd);
+            }
+            if (0 == res) {
+                *fd = dup(recv_fd);
+                if (*fd < 0) {
+                    res = -errno;
+                }
+            }
+
+            if (0 != res) {
+                connection->channel->error_code = res;
+                ret = EN_ATBUS_ERR_PIPE_FD_PASS_FAILED;
+            }
+
+            uv_close(reinterpret_cast<uv_handle_t *>(recv_handle), io_stream_recv_fd_on_close);
+            return ret;
+#endif
+        }
+
+        int io_stream_set_checksum(io_stream_connection *connection, int checksum_type) {
+            if (NULL == connection || checksum_type < 0 || checksum_type >= io_stream_checksum_t::EN_CS_MAX) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (checksum_type == connection->send_checksum) {
+                return EN_ATBUS_ERR_SUCCESS;
+            }
+
+            // 对端收到切换标记后只接受新格式，所以不能切换回旧格式
+            if (io_stream_checksum_t::EN_CS_LEGACY == checksum_type) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (io_stream_connection::EN_ST_CONNECTED != connection->status) {
+                return EN_ATBUS_ERR_CLOSING;
+            }
+
+            if (io_stream_checksum_t::EN_CS_LEGACY == connection->send_checksum) {
+                // 切换标记是旧格式的空消息，和普通消息一样排队发送，保证前后的消息格式不会错乱
+                char head[sizeof(uint32_t) + 16];
+                size_t head_len = io_stream_write_frame_head(io_stream_checksum_t::EN_CS_LEGACY, NULL, 0, head, sizeof(head));
+
+                void *data;
+                int res = connection->write_buffers.push_back(data, sizeof(io_stream_write_block_head_t) + head_len);
+                if (res < 0) {
+                    return res;
+                }
+
+                io_stream_write_block_head_t *block_head = reinterpret_cast<io_stream_write_block_head_t *>(data);
+                block_head->req.data = connection;
+                block_head->stat.frame_number = 0;
+                block_head->stat.data_size = 0;
+                block_head->payload_size = 0;
+                block_head->req_block_number = 0;
+                block_head->req_is_ctrl = false;
+                block_head->req_stat.frame_number = 0;
+                block_head->req_stat.data_size = 0;
+                block_head->ext_data = NULL;
+                block_head->ext_free_fn = NULL;
+                block_head->send_time = connection->channel->conf.enable_latency_stat ? uv_hrtime() : 0;
+                block_head->send_handle = NULL;
+                memcpy(reinterpret_cast<char *>(data) + sizeof(io_stream_write_block_head_t), head, head_len);
+
+                // 之前排队的消息和切换标记都要先于新格式的控制消息发送
+                connection->ctrl_write_barrier = connection->write_buffers.limit().cost_number_;
+            }
+
+            connection->send_checksum = checksum_type;
             return io_stream_try_write(connection);
         }
 
+        int io_stream_compress_algorithms() {
+            int ret = io_stream_compress_t::EN_CA_NONE;
+#ifdef ATBUS_MACRO_WITH_ZLIB
+            ret |= io_stream_compress_t::EN_CA_ZLIB;
+#endif
+            return ret;
+        }
+
+        int io_stream_set_compression(io_stream_connection *connection, int algorithm, size_t threshold, int level) {
+            if (NULL == connection) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (io_stream_compress_t::EN_CA_NONE != algorithm) {
+                // 一次只能使用一种压缩算法
+                if (0 != (algorithm & (algorithm - 1))) {
+                    return EN_ATBUS_ERR_PARAMS;
+                }
+
+                // 旧格式的消息头没有flags，不能标记压缩
+                if (0 == (io_stream_compress_algorithms() & algorithm) ||
+                    io_stream_checksum_t::EN_CS_LEGACY == connection->send_checksum) {
+                    return EN_ATBUS_ERR_ACCESS_DENY;
+                }
+            }
+
+            connection->send_compress = algorithm;
+            connection->send_compress_threshold = threshold;
+            connection->send_compress_level = level;
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        int io_stream_set_cork(io_stream_connection *connection, size_t size, uint64_t delay) {
+            if (NULL == connection) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            connection->cork_size = size;
+            connection->cork_delay = delay;
+
+            // 关闭时立即发送已经延迟的数据，否则新的设置从下一次延迟开始生效
+            if (0 == size) {
+                return io_stream_flush(connection);
+            }
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        int io_stream_pause_read(io_stream_connection *connection) {
+            if (NULL == connection) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (io_stream_connection::EN_ST_CONNECTED != connection->status) {
+                return EN_ATBUS_ERR_CLOSING;
+            }
+
+            if (ATBUS_CHANNEL_IOS_CHECK_FLAG(connection->flags, io_stream_connection::EN_CF_READ_PAUSED)) {
+                return EN_ATBUS_ERR_SUCCESS;
+            }
+
+            // 在读回调里调用时libuv会在回调返回后停止读取，本次读到的数据仍然会处理完
+            int res = uv_read_stop(connection->handle.get());
+            if (0 != res) {
+                connection->channel->error_code = res;
+                return EN_ATBUS_ERR_READ_FAILED;
+            }
+
+            ATBUS_CHANNEL_IOS_SET_FLAG(connection->flags, io_stream_connection::EN_CF_READ_PAUSED);
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        int io_stream_resume_read(io_stream_connection *connection) {
+            if (NULL == connection) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (!ATBUS_CHANNEL_IOS_CHECK_FLAG(connection->flags, io_stream_connection::EN_CF_READ_PAUSED)) {
+                return EN_ATBUS_ERR_SUCCESS;
+            }
+
+            ATBUS_CHANNEL_IOS_UNSET_FLAG(connection->flags, io_stream_connection::EN_CF_READ_PAUSED);
+
+            // 正在关闭的连接不再读取
+            if (io_stream_connection::EN_ST_CONNECTED != connection->status) {
+                return EN_ATBUS_ERR_CLOSING;
+            }
+
+            int res = uv_read_start(connection->handle.get(), io_stream_on_recv_alloc_fn, io_stream_on_recv_read_fn);
+            if (0 != res) {
+                connection->channel->error_code = res;
+                return EN_ATBUS_ERR_READ_FAILED;
+            }
+
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        int io_stream_flush(io_stream_connection *connection) {
+            if (NULL == connection) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (ATBUS_CHANNEL_IOS_CHECK_FLAG(connection->flags, io_stream_connection::EN_CF_CORKED)) {
+                ATBUS_CHANNEL_IOS_UNSET_FLAG(connection->flags, io_stream_connection::EN_CF_CORKED);
+
+                std::vector<adapter::fd_t> &cork_fds = connection->channel->cork_fds;
+                std::vector<adapter::fd_t>::iterator iter = std::find(cork_fds.begin(), cork_fds.end(), connection->fd);
+                if (iter != cork_fds.end()) {
+                    cork_fds.erase(iter);
+                }
+            }
+            connection->corked_size = 0;
+
+            return io_stream_try_write(connection);
+        }
+
+        int io_stream_flush_all(io_stream_channel *channel) {
+            if (NULL == channel) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            std::vector<adapter::fd_t> cork_fds;
+            cork_fds.swap(channel->cork_fds);
+
+            int ret = EN_ATBUS_ERR_SUCCESS;
+            for (size_t i = 0; i < cork_fds.size(); ++i) {
+                io_stream_channel::conn_pool_t::iterator iter = channel->conn_pool.find(cork_fds[i]);
+                if (iter == channel->conn_pool.end()) {
+                    continue;
+                }
+
+                int res = io_stream_flush(iter->second.get());
+                if (res < 0) {
+                    ret = res;
+                }
+            }
+
+            return ret;
+        }
+
         void io_stream_show_channel(io_stream_channel *channel, std::ostream &out) {
             if (NULL == channel) {
                 return;
@@ -1678,6 +3606,7 @@ namespace atbus {
             out << "configure:" << std::endl
                 << "is_noblock: " << channel->conf.is_noblock << std::endl
                 << "is_nodelay: " << channel->conf.is_nodelay << std::endl
+                << "is_reuse_port: " << channel->conf.is_reuse_port << std::endl
                 << "backlog: " << channel->conf.backlog << std::endl
                 << "keepalive: " << channel->conf.keepalive << std::endl
                 << "recv_buffer_limit_size(Bytes): " << channel->conf.recv_buffer_limit_size << std::endl
@@ -1686,21 +3615,104 @@ namespace atbus {
                 << "send_buffer_limit_size(Bytes): " << channel->conf.send_buffer_limit_size << std::endl
                 << "send_buffer_max_size(Bytes): " << channel->conf.send_buffer_max_size << std::endl
                 << "send_buffer_static_max_number: " << channel->conf.send_buffer_static << std::endl
+                << "send_window_size: " << channel->conf.send_window_size << std::endl
+                << "recv_head_pool_number: " << channel->conf.recv_head_pool_number << std::endl
+                << "object_pool_number: " << channel->conf.object_pool_number << std::endl
+                << "send_cork_size: " << channel->conf.send_cork_size << std::endl
+                << "send_cork_delay(us): " << channel->conf.send_cork_delay << std::endl
+                << "sock_send_buffer(Bytes): " << channel->conf.sock_send_buffer << std::endl
+                << "sock_recv_buffer(Bytes): " << channel->conf.sock_recv_buffer << std::endl
+                << "sock_busy_poll(us): " << channel->conf.sock_busy_poll << std::endl
+                << "sock_notsent_lowat(Bytes): " << channel->conf.sock_notsent_lowat << std::endl
+                << "sock_tos: " << channel->conf.sock_tos << std::endl
+                << "is_quickack: " << channel->conf.is_quickack << std::endl
+                << "enable_latency_stat: " << channel->conf.enable_latency_stat << std::endl
+                << "dns_cache_ttl(s): " << channel->conf.dns_cache_ttl << std::endl
+                << "dns_negative_cache_ttl(s): " << channel->conf.dns_negative_cache_ttl << std::endl
+                << "connect_attempt_delay(ms): " << channel->conf.connect_attempt_delay << std::endl
                 << std::endl;
 
+            out << "read head pool:" << std::endl;
+            for (size_t i = 0; i < ATBUS_MACRO_IOS_READ_HEAD_LEVELS; ++i) {
+                out << "\t" << io_stream_read_head_size(i) << " Bytes: " << channel->read_head_pool[i].size() << std::endl;
+            }
+            out << std::endl;
+
+            if (NULL != channel->object_pool) {
+                out << "object pool:" << std::endl;
+                out << "\talloc_times: " << channel->object_pool->alloc_times << std::endl;
+                out << "\treuse_times: " << channel->object_pool->reuse_times << std::endl;
+                for (size_t i = 0; i < channel->object_pool->free_blocks.size(); ++i) {
+                    out << "\t" << channel->object_pool->free_blocks[i].first
+                        << " Bytes: " << channel->object_pool->free_blocks[i].second.size() << std::endl;
+                }
+                out << std::endl;
+            }
+
+            out << "dns cache:" << std::endl;
+            for (io_stream_channel::dns_cache_t::iterator iter = channel->dns_cache.begin(); iter != channel->dns_cache.end(); ++iter) {
+                out << "\t" << iter->first << ": " << iter->second.scheme << "://" << iter->second.host
+                    << "(status = " << iter->second.status << ", expire_ms = " << iter->second.expire_ms << ")" << std::endl;
+            }
+            out << std::endl;
+
             out << "all connections:" << std::endl;
             for (io_stream_channel::conn_pool_t::iterator iter = channel->conn_pool.begin(); iter != channel->conn_pool.end(); ++iter) {
                 out << "\t" << iter->second->addr.address << ":(status = " << iter->second->status << ")" << std::endl;
 
+                out << "\t\tread_times: " << iter->second->read_times << std::endl;
+
                 out << "\t\twrite_buffers.cost_number: " << iter->second->write_buffers.limit().cost_number_ << std::endl;
                 out << "\t\twrite_buffers.cost_size: " << iter->second->write_buffers.limit().cost_size_ << std::endl;
                 out << "\t\twrite_buffers.limit_number: " << iter->second->write_buffers.limit().limit_number_ << std::endl;
                 out << "\t\twrite_buffers.limit_size: " << iter->second->write_buffers.limit().limit_size_ << std::endl;
+                out << "\t\twriting_req_number: " << iter->second->writing_req_number << std::endl;
+                out << "\t\twriting_block_number: " << iter->second->writing_block_number << std::endl;
+                out << "\t\tctrl_write_buffers.cost_number: " << iter->second->ctrl_write_buffers.limit().cost_number_ << std::endl;
+                out << "\t\tctrl_write_buffers.cost_size: " << iter->second->ctrl_write_buffers.limit().cost_size_ << std::endl;
+                out << "\t\tctrl_writing_block_number: " << iter->second->ctrl_writing_block_number << std::endl;
+                out << "\t\tctrl_write_barrier: " << iter->second->ctrl_write_barrier << std::endl;
+                out << "\t\tsend_checksum: " << iter->second->send_checksum << std::endl;
+                out << "\t\trecv_frame_flags: " << iter->second->recv_frame_flags << std::endl;
+                out << "\t\tcork_size: " << iter->second->cork_size << std::endl;
+                out << "\t\tcork_delay(us): " << iter->second->cork_delay << std::endl;
+                out << "\t\tcorked_size: " << iter->second->corked_size << std::endl;
+                out << "\t\tsend_compress: " << iter->second->send_compress << std::endl;
+                out << "\t\tsend_compress_threshold: " << iter->second->send_compress_threshold << std::endl;
+                out << "\t\tsend_compress_level: " << iter->second->send_compress_level << std::endl;
+
+                const io_stream_compress_stat_t &compress_stat = iter->second->compress_stat;
+                out << "\t\tcompress_stat.compress_times: " << compress_stat.compress_times << std::endl;
+                out << "\t\tcompress_stat.compress_skip_times: " << compress_stat.compress_skip_times << std::endl;
+                out << "\t\tcompress_stat.compress_raw_size: " << compress_stat.compress_raw_size << std::endl;
+                out << "\t\tcompress_stat.compress_size: " << compress_stat.compress_size << std::endl;
+                out << "\t\tcompress_stat.compress_nsec: " << compress_stat.compress_nsec << std::endl;
+                out << "\t\tcompress_stat.decompress_times: " << compress_stat.decompress_times << std::endl;
+                out << "\t\tcompress_stat.decompress_raw_size: " << compress_stat.decompress_raw_size << std::endl;
+                out << "\t\tcompress_stat.decompress_size: " << compress_stat.decompress_size << std::endl;
+                out << "\t\tcompress_stat.decompress_nsec: " << compress_stat.decompress_nsec << std::endl;
+
+                if (iter->second->latency_stat) {
+                    const io_stream_latency_histogram_t *latency[2] = {&iter->second->latency_stat->queue,
+                                                                       &iter->second->latency_stat->written};
+                    const char *latency_name[2] = {"queue", "written"};
+                    for (int i = 0; i < 2; ++i) {
+                        out << "\t\tlatency_stat." << latency_name[i] << "(us): count = " << latency[i]->total_count
+                            << ", min = " << latency[i]->min_value << ", p50 = " << io_stream_latency_percentile(latency[i], 50.0)
+                            << ", p99 = " << io_stream_latency_percentile(latency[i], 99.0)
+                            << ", p999 = " << io_stream_latency_percentile(latency[i], 99.9) << ", max = " << latency[i]->max_value
+                            << std::endl;
+                    }
+                }
 
                 out << "\t\tread_buffers.cost_number: " << iter->second->read_buffers.limit().cost_number_ << std::endl;
                 out << "\t\tread_buffers.cost_size: " << iter->second->read_buffers.limit().cost_size_ << std::endl;
                 out << "\t\tread_buffers.limit_number: " << iter->second->read_buffers.limit().limit_number_ << std::endl;
                 out << "\t\tread_buffers.limit_size: " << iter->second->read_buffers.limit().limit_size_ << std::endl;
+                out << "\t\tread_head.len: " << iter->second->read_head.len << std::endl;
+                size_t read_head_size = NULL == iter->second->read_head.buffer ? 0 : io_stream_read_head_size(iter->second->read_head.level);
+                out << "\t\tread_head.size: " << read_head_size << std::endl;
+                out << "\t\tread_head.expect_size: " << io_stream_read_head_size(iter->second->read_head.expect_level) << std::endl;
             }
         }
     }
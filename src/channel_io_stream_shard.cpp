@@ -0,0 +1,842 @@
+﻿/**
+ * @brief 所有channel文件的模式均为 c + channel<br />
+ *        使用c的模式是为了简单、结构清晰并且避免异常<br />
+ *        附带c++的部分是为了避免命名空间污染并且c++的跨平台适配更加简单
+ */
+
+#include <assert.h>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "algorithm/murmur_hash.h"
+#include "common/string_oprs.h"
+#include "lock/atomic_int_type.h"
+
+#include "detail/libatbus_channel_export.h"
+#include "detail/libatbus_error.h"
+
+namespace atbus {
+    namespace channel {
+        // 逻辑线程和工作线程之间传递的消息，后面是size长度的数据
+        struct io_stream_shard_msg {
+            enum type {
+                // 逻辑线程 -> 工作线程
+                EN_SM_LISTEN = 0, // 数据是地址
+                EN_SM_CONNECT,    // 数据是地址
+                EN_SM_SEND,       // 数据是消息内容
+                EN_SM_DISCONNECT,
+                EN_SM_SEND_CTRL,       // 数据是消息内容
+                EN_SM_SET_CHECKSUM,    // status是校验方式
+                EN_SM_SET_COMPRESSION, // 数据是io_stream_shard_compression
+                EN_SM_SET_CORK,        // 数据是io_stream_shard_cork
+                EN_SM_CLOSE_LISTEN,    // 数据是监听地址
+                EN_SM_PAUSE_READ,
+                EN_SM_RESUME_READ,
+
+                // 工作线程 -> 逻辑线程
+                EN_SM_LISTENED,
+                EN_SM_CONNECTED,
+                EN_SM_ACCEPTED, // 数据是对端地址
+                EN_SM_DISCONNECTED,
+                EN_SM_RECVED,      // 数据是消息内容
+                EN_SM_SEND_FAILED, // 发送失败的EN_SM_SEND和EN_SM_SEND_CTRL消息原样返回，status是错误码
+            };
+
+            int type;
+            int status;
+            uint64_t conn_id;
+            void *req; // listen和connect请求，工作线程原样返回，只在逻辑线程中使用
+            size_t size;
+        };
+
+        struct io_stream_shard_compression {
+            int algorithm;
+            size_t threshold;
+            int level;
+        };
+
+        struct io_stream_shard_cork {
+            size_t size;
+            uint64_t delay;
+        };
+
+        // listen和connect请求，listen在多个工作线程中进行，全部完成后才回调
+        struct io_stream_shard_req {
+            io_stream_shard_callback_t callback;
+            void *priv_data;
+            size_t priv_size;
+            size_t left_number;
+            int status;
+        };
+
+        struct io_stream_shard_worker {
+            io_stream_shards *owner;
+            size_t index;
+            adapter::thread_t thread;
+            adapter::loop_t loop;
+            adapter::async_t notify; // 逻辑线程有新请求或需要停止时唤醒工作线程
+            io_stream_channel channel;
+
+            void *in_buffer;
+            mem_channel *in_queue; // 逻辑线程 -> 工作线程
+            void *out_buffer;
+            mem_channel *out_queue; // 工作线程 -> 逻辑线程
+
+            util::lock::atomic_int_type<int> is_stopping;
+            util::lock::atomic_int_type<int> is_event_blocked; // out_queue满了，逻辑线程取出事件后要唤醒工作线程
+
+            // 以下只在工作线程中使用，线程退出后由逻辑线程清理
+            typedef ATBUS_ADVANCE_TYPE_MAP(uint64_t, io_stream_connection *) conn_map_t;
+            conn_map_t conns;
+            typedef ATBUS_ADVANCE_TYPE_MAP(uintptr_t, uint64_t) conn_id_map_t;
+            conn_id_map_t conn_ids;
+            uint64_t conn_seq;
+            std::list<io_stream_shard_msg *> pending_events; // out_queue满时暂存的事件，保持顺序
+        };
+
+        static inline char *io_stream_shard_msg_data(io_stream_shard_msg *msg) {
+            return reinterpret_cast<char *>(msg) + sizeof(io_stream_shard_msg);
+        }
+
+        static io_stream_shard_msg *io_stream_shard_make_msg(int type, uint64_t conn_id, int status, void *req, const void *buf,
+                                                             size_t len) {
+            io_stream_shard_msg *msg = reinterpret_cast<io_stream_shard_msg *>(malloc(sizeof(io_stream_shard_msg) + len));
+            if (NULL == msg) {
+                return NULL;
+            }
+
+            msg->type = type;
+            msg->status = status;
+            msg->conn_id = conn_id;
+            msg->req = req;
+            msg->size = len;
+            if (NULL != buf && len > 0) {
+                memcpy(io_stream_shard_msg_data(msg), buf, len);
+            }
+            return msg;
+        }
+
+        // 发送完成后释放EN_SM_SEND消息，buf是消息的数据区
+        static void io_stream_shard_free_send_msg(void *buf, size_t) { free(reinterpret_cast<char *>(buf) - sizeof(io_stream_shard_msg)); }
+
+        // 请求的所有消息都处理完后才释放，is_callback为false时是关闭时丢弃的请求
+        static void io_stream_shard_finish_req(io_stream_shards *shards, io_stream_shard_req *req, uint64_t conn_id, int status,
+                                               bool is_callback) {
+            if (NULL == req) {
+                return;
+            }
+
+            if (status < 0 && 0 == req->status) {
+                req->status = status;
+            }
+
+            if (req->left_number > 1) {
+                --req->left_number;
+                return;
+            }
+
+            if (is_callback) {
+                if (NULL != shards->callbacks[io_stream_callback_evt_t::EN_FN_CONNECTED]) {
+                    shards->callbacks[io_stream_callback_evt_t::EN_FN_CONNECTED](shards, conn_id, req->status, req->priv_data,
+                                                                                req->priv_size);
+                }
+
+                if (NULL != req->callback) {
+                    req->callback(shards, conn_id, req->status, req->priv_data, req->priv_size);
+                }
+            }
+
+            delete req;
+        }
+
+        // 释放没有处理的消息，关闭时使用
+        static void io_stream_shard_drop_msg(io_stream_shards *shards, io_stream_shard_msg *msg) {
+            if (NULL != msg->req) {
+                io_stream_shard_finish_req(shards, reinterpret_cast<io_stream_shard_req *>(msg->req), 0, EN_ATBUS_ERR_CLOSING, false);
+            }
+            free(msg);
+        }
+
+        // ============ 工作线程 ============
+        static int io_stream_shard_post_event(io_stream_shard_worker *worker, io_stream_shard_msg *msg) {
+            if (NULL == msg) {
+                return EN_ATBUS_ERR_MALLOC;
+            }
+
+            if (worker->pending_events.empty() &&
+                EN_ATBUS_ERR_SUCCESS == mem_send_ptr(worker->out_queue, msg, sizeof(io_stream_shard_msg) + msg->size, NULL)) {
+                uv_async_send(worker->owner->notify);
+                return EN_ATBUS_ERR_SUCCESS;
+            }
+
+            // 逻辑线程处理不过来时先暂存，逻辑线程取出事件后会唤醒工作线程重新发送
+            worker->pending_events.push_back(msg);
+            worker->is_event_blocked.store(1);
+            uv_async_send(worker->owner->notify);
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        static void io_stream_shard_flush_events(io_stream_shard_worker *worker) {
+            while (!worker->pending_events.empty()) {
+                io_stream_shard_msg *msg = worker->pending_events.front();
+                if (EN_ATBUS_ERR_SUCCESS != mem_send_ptr(worker->out_queue, msg, sizeof(io_stream_shard_msg) + msg->size, NULL)) {
+                    worker->is_event_blocked.store(1);
+                    break;
+                }
+                worker->pending_events.pop_front();
+            }
+
+            uv_async_send(worker->owner->notify);
+        }
+
+        static uint64_t io_stream_shard_add_connection(io_stream_shard_worker *worker, io_stream_connection *connection) {
+            uint64_t conn_id = ((++worker->conn_seq) << 16) | static_cast<uint64_t>(worker->index);
+            worker->conns[conn_id] = connection;
+            worker->conn_ids[reinterpret_cast<uintptr_t>(connection)] = conn_id;
+            return conn_id;
+        }
+
+        static void io_stream_shard_on_listened(io_stream_channel *channel, io_stream_connection *, int status, void *priv_data, size_t) {
+            io_stream_shard_worker *worker = reinterpret_cast<io_stream_shard_worker *>(channel->data);
+            io_stream_shard_post_event(worker,
+                                       io_stream_shard_make_msg(io_stream_shard_msg::EN_SM_LISTENED, 0, status, priv_data, NULL, 0));
+        }
+
+        static void io_stream_shard_on_connected(io_stream_channel *channel, io_stream_connection *connection, int status,
+                                                 void *priv_data, size_t) {
+            io_stream_shard_worker *worker = reinterpret_cast<io_stream_shard_worker *>(channel->data);
+            uint64_t conn_id = 0;
+            if (0 == status && NULL != connection) {
+                conn_id = io_stream_shard_add_connection(worker, connection);
+            } else if (0 == status) {
+                status = EN_ATBUS_ERR_SOCK_CONNECT_FAILED;
+            }
+
+            io_stream_shard_post_event(worker,
+                                       io_stream_shard_make_msg(io_stream_shard_msg::EN_SM_CONNECTED, conn_id, status, priv_data, NULL, 0));
+        }
+
+        static void io_stream_shard_on_accepted(io_stream_channel *channel, io_stream_connection *connection, int status, void *, size_t) {
+            if (0 != status || NULL == connection) {
+                return;
+            }
+
+            io_stream_shard_worker *worker = reinterpret_cast<io_stream_shard_worker *>(channel->data);
+            uint64_t conn_id = io_stream_shard_add_connection(worker, connection);
+            io_stream_shard_post_event(worker, io_stream_shard_make_msg(io_stream_shard_msg::EN_SM_ACCEPTED, conn_id, 0, NULL,
+                                                                        connection->addr.address.c_str(), connection->addr.address.size()));
+        }
+
+        static void io_stream_shard_on_disconnected(io_stream_channel *channel, io_stream_connection *connection, int, void *, size_t) {
+            io_stream_shard_worker *worker = reinterpret_cast<io_stream_shard_worker *>(channel->data);
+            io_stream_shard_worker::conn_id_map_t::iterator iter = worker->conn_ids.find(reinterpret_cast<uintptr_t>(connection));
+            // 监听的连接没有ID
+            if (iter == worker->conn_ids.end()) {
+                return;
+            }
+
+            uint64_t conn_id = iter->second;
+            worker->conn_ids.erase(iter);
+            worker->conns.erase(conn_id);
+            io_stream_shard_post_event(worker,
+                                       io_stream_shard_make_msg(io_stream_shard_msg::EN_SM_DISCONNECTED, conn_id, 0, NULL, NULL, 0));
+        }
+
+        static void io_stream_shard_on_recv(io_stream_channel *channel, io_stream_connection *connection, int status, void *buffer,
+                                            size_t s) {
+            if (0 != status || NULL == buffer) {
+                return;
+            }
+
+            io_stream_shard_worker *worker = reinterpret_cast<io_stream_shard_worker *>(channel->data);
+            io_stream_shard_worker::conn_id_map_t::iterator iter = worker->conn_ids.find(reinterpret_cast<uintptr_t>(connection));
+            if (iter == worker->conn_ids.end()) {
+                return;
+            }
+
+            io_stream_shard_post_event(worker,
+                                       io_stream_shard_make_msg(io_stream_shard_msg::EN_SM_RECVED, iter->second, 0, NULL, buffer, s));
+        }
+
+        static void io_stream_shard_worker_run_cmd(io_stream_shard_worker *worker, io_stream_shard_msg *msg) {
+            switch (msg->type) {
+            case io_stream_shard_msg::EN_SM_LISTEN:
+            case io_stream_shard_msg::EN_SM_CONNECT: {
+                channel_address_t addr;
+                make_address(std::string(io_stream_shard_msg_data(msg), msg->size).c_str(), addr);
+
+                int res;
+                if (io_stream_shard_msg::EN_SM_LISTEN == msg->type) {
+                    res = io_stream_listen(&worker->channel, addr, io_stream_shard_on_listened, msg->req, 0);
+                } else {
+                    res = io_stream_connect(&worker->channel, addr, io_stream_shard_on_connected, msg->req, 0);
+                }
+
+                // 失败时不会回调
+                if (res < 0) {
+                    int type = io_stream_shard_msg::EN_SM_LISTEN == msg->type ? io_stream_shard_msg::EN_SM_LISTENED
+                                                                              : io_stream_shard_msg::EN_SM_CONNECTED;
+                    io_stream_shard_post_event(worker, io_stream_shard_make_msg(type, 0, res, msg->req, NULL, 0));
+                }
+                free(msg);
+                break;
+            }
+            case io_stream_shard_msg::EN_SM_SEND: {
+                io_stream_shard_worker::conn_map_t::iterator iter = worker->conns.find(msg->conn_id);
+                // 直接发送消息里的数据，发送完成后释放消息
+                int res = EN_ATBUS_ERR_CONNECTION_NOT_FOUND;
+                if (iter != worker->conns.end()) {
+                    res = io_stream_send_ptr(iter->second, io_stream_shard_msg_data(msg), msg->size, io_stream_shard_free_send_msg);
+                }
+
+                // 发送失败(比如超过发送缓冲区的限制)时把消息还给逻辑线程，由EN_FN_WRITEN通知
+                if (res < 0) {
+                    msg->type = io_stream_shard_msg::EN_SM_SEND_FAILED;
+                    msg->status = res;
+                    io_stream_shard_post_event(worker, msg);
+                }
+                break;
+            }
+            case io_stream_shard_msg::EN_SM_DISCONNECT: {
+                io_stream_shard_worker::conn_map_t::iterator iter = worker->conns.find(msg->conn_id);
+                if (iter != worker->conns.end()) {
+                    io_stream_disconnect(&worker->channel, iter->second, NULL);
+                }
+                free(msg);
+                break;
+            }
+            case io_stream_shard_msg::EN_SM_SEND_CTRL: {
+                io_stream_shard_worker::conn_map_t::iterator iter = worker->conns.find(msg->conn_id);
+                // 控制消息会复制数据，插队到连接的发送缓冲区前面
+                int res = EN_ATBUS_ERR_CONNECTION_NOT_FOUND;
+                if (iter != worker->conns.end()) {
+                    res = io_stream_send_ctrl(iter->second, io_stream_shard_msg_data(msg), msg->size);
+                }
+
+                if (res < 0) {
+                    msg->type = io_stream_shard_msg::EN_SM_SEND_FAILED;
+                    msg->status = res;
+                    io_stream_shard_post_event(worker, msg);
+                } else {
+                    free(msg);
+                }
+                break;
+            }
+            case io_stream_shard_msg::EN_SM_CLOSE_LISTEN: {
+                // 监听的连接没有ID，按地址查找。先取出来再关闭，避免关闭时修改conn_pool
+                std::string address(io_stream_shard_msg_data(msg), msg->size);
+                std::vector<io_stream_connection *> listen_conns;
+                for (io_stream_channel::conn_pool_t::iterator iter = worker->channel.conn_pool.begin();
+                     iter != worker->channel.conn_pool.end(); ++iter) {
+                    if (ATBUS_CHANNEL_IOS_CHECK_FLAG(iter->second->flags, io_stream_connection::EN_CF_LISTEN) &&
+                        iter->second->addr.address == address) {
+                        listen_conns.push_back(iter->second.get());
+                    }
+                }
+
+                for (size_t i = 0; i < listen_conns.size(); ++i) {
+                    io_stream_disconnect(&worker->channel, listen_conns[i], NULL);
+                }
+                free(msg);
+                break;
+            }
+            case io_stream_shard_msg::EN_SM_SET_CHECKSUM:
+            case io_stream_shard_msg::EN_SM_SET_COMPRESSION:
+            case io_stream_shard_msg::EN_SM_SET_CORK:
+            case io_stream_shard_msg::EN_SM_PAUSE_READ:
+            case io_stream_shard_msg::EN_SM_RESUME_READ: {
+                // 参数已经在逻辑线程检查过，连接已经关闭时忽略
+                io_stream_shard_worker::conn_map_t::iterator iter = worker->conns.find(msg->conn_id);
+                if (iter != worker->conns.end()) {
+                    if (io_stream_shard_msg::EN_SM_PAUSE_READ == msg->type) {
+                        io_stream_pause_read(iter->second);
+                    } else if (io_stream_shard_msg::EN_SM_RESUME_READ == msg->type) {
+                        io_stream_resume_read(iter->second);
+                    } else if (io_stream_shard_msg::EN_SM_SET_CHECKSUM == msg->type) {
+                        io_stream_set_checksum(iter->second, msg->status);
+                    } else if (io_stream_shard_msg::EN_SM_SET_COMPRESSION == msg->type) {
+                        io_stream_shard_compression *opt = reinterpret_cast<io_stream_shard_compression *>(io_stream_shard_msg_data(msg));
+                        io_stream_set_compression(iter->second, opt->algorithm, opt->threshold, opt->level);
+                    } else {
+                        io_stream_shard_cork *opt = reinterpret_cast<io_stream_shard_cork *>(io_stream_shard_msg_data(msg));
+                        io_stream_set_cork(iter->second, opt->size, opt->delay);
+                    }
+                }
+                free(msg);
+                break;
+            }
+            default:
+                assert(false);
+                free(msg);
+                break;
+            }
+        }
+
+        static void io_stream_shard_worker_notify_cb(uv_async_t *handle) {
+            io_stream_shard_worker *worker = reinterpret_cast<io_stream_shard_worker *>(handle->data);
+            assert(worker);
+
+            if (0 != worker->is_event_blocked.exchange(0)) {
+                io_stream_shard_flush_events(worker);
+            }
+
+            void *buf = NULL;
+            while (EN_ATBUS_ERR_SUCCESS == mem_recv_ptr(worker->in_queue, &buf, NULL, NULL)) {
+                io_stream_shard_worker_run_cmd(worker, reinterpret_cast<io_stream_shard_msg *>(buf));
+            }
+
+            if (0 != worker->is_stopping.load()) {
+                uv_stop(&worker->loop);
+            }
+        }
+
+        static void io_stream_shard_worker_main(void *arg) {
+            io_stream_shard_worker *worker = reinterpret_cast<io_stream_shard_worker *>(arg);
+
+            while (0 == worker->is_stopping.load()) {
+                uv_run(&worker->loop, UV_RUN_DEFAULT);
+            }
+
+            // 关闭所有连接，对端不读取时超时后强制关闭，然后释放事件循环
+            io_stream_close_async(&worker->channel, worker->owner->conf.close_timeout, NULL, NULL, 0);
+            io_stream_close(&worker->channel);
+            uv_close(reinterpret_cast<uv_handle_t *>(&worker->notify), NULL);
+            while (UV_EBUSY == uv_loop_close(&worker->loop)) {
+                uv_run(&worker->loop, UV_RUN_ONCE);
+            }
+        }
+
+        // ============ 逻辑线程 ============
+        static void io_stream_shard_dispatch(io_stream_shards *shards, io_stream_shard_msg *msg) {
+            switch (msg->type) {
+            case io_stream_shard_msg::EN_SM_LISTENED:
+            case io_stream_shard_msg::EN_SM_CONNECTED:
+                io_stream_shard_finish_req(shards, reinterpret_cast<io_stream_shard_req *>(msg->req), msg->conn_id, msg->status, true);
+                break;
+            case io_stream_shard_msg::EN_SM_ACCEPTED:
+                if (NULL != shards->callbacks[io_stream_callback_evt_t::EN_FN_ACCEPTED]) {
+                    shards->callbacks[io_stream_callback_evt_t::EN_FN_ACCEPTED](shards, msg->conn_id, msg->status,
+                                                                               io_stream_shard_msg_data(msg), msg->size);
+                }
+                break;
+            case io_stream_shard_msg::EN_SM_DISCONNECTED:
+                if (NULL != shards->callbacks[io_stream_callback_evt_t::EN_FN_DISCONNECTED]) {
+                    shards->callbacks[io_stream_callback_evt_t::EN_FN_DISCONNECTED](shards, msg->conn_id, msg->status, NULL, 0);
+                }
+                break;
+            case io_stream_shard_msg::EN_SM_RECVED:
+                if (NULL != shards->callbacks[io_stream_callback_evt_t::EN_FN_RECVED]) {
+                    shards->callbacks[io_stream_callback_evt_t::EN_FN_RECVED](shards, msg->conn_id, msg->status,
+                                                                             io_stream_shard_msg_data(msg), msg->size);
+                }
+                break;
+            case io_stream_shard_msg::EN_SM_SEND_FAILED:
+                if (NULL != shards->callbacks[io_stream_callback_evt_t::EN_FN_WRITEN]) {
+                    shards->callbacks[io_stream_callback_evt_t::EN_FN_WRITEN](shards, msg->conn_id, msg->status,
+                                                                             io_stream_shard_msg_data(msg), msg->size);
+                }
+                break;
+            default:
+                assert(false);
+                break;
+            }
+
+            free(msg);
+        }
+
+        static void io_stream_shard_notify_cb(uv_async_t *handle) {
+            io_stream_shards *shards = reinterpret_cast<io_stream_shards *>(handle->data);
+            assert(shards);
+
+            for (size_t i = 0; i < shards->workers.size(); ++i) {
+                io_stream_shard_worker *worker = shards->workers[i];
+                void *buf = NULL;
+                while (EN_ATBUS_ERR_SUCCESS == mem_recv_ptr(worker->out_queue, &buf, NULL, NULL)) {
+                    io_stream_shard_dispatch(shards, reinterpret_cast<io_stream_shard_msg *>(buf));
+                }
+
+                // 工作线程有暂存的事件，唤醒它重新发送
+                if (0 != worker->is_event_blocked.load()) {
+                    uv_async_send(&worker->notify);
+                }
+            }
+        }
+
+        static void io_stream_shard_notify_on_close(uv_handle_t *handle) { free(handle); }
+
+        static int io_stream_shard_post_cmd(io_stream_shard_worker *worker, io_stream_shard_msg *msg) {
+            if (NULL == msg) {
+                return EN_ATBUS_ERR_MALLOC;
+            }
+
+            int res = mem_send_ptr(worker->in_queue, msg, sizeof(io_stream_shard_msg) + msg->size, NULL);
+            if (res < 0) {
+                free(msg);
+                return res;
+            }
+
+            uv_async_send(&worker->notify);
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        static io_stream_shard_worker *io_stream_shard_get_worker(io_stream_shards *shards, uint64_t conn_id) {
+            if (NULL == shards) {
+                return NULL;
+            }
+
+            size_t index = io_stream_shard_index(conn_id);
+            if (0 == conn_id || index >= shards->workers.size()) {
+                return NULL;
+            }
+
+            return shards->workers[index];
+        }
+
+        void io_stream_shard_init_configure(io_stream_shard_conf *conf) {
+            if (NULL == conf) {
+                return;
+            }
+
+            conf->shard_number = 1;
+            conf->queue_size = ATBUS_MACRO_MSG_LIMIT * 32;
+            conf->close_timeout = 3000;
+            io_stream_init_configure(&conf->stream_conf);
+        }
+
+        int io_stream_shard_init(io_stream_shards *shards, adapter::loop_t *ev_loop, const io_stream_shard_conf *conf) {
+            if (NULL == shards || NULL == ev_loop) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (NULL == conf) {
+                io_stream_shard_init_configure(&shards->conf);
+            } else {
+                shards->conf = *conf;
+            }
+
+            if (0 == shards->conf.shard_number || shards->conf.shard_number > 0xFFFF) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            // 所有工作线程监听同一个地址
+            if (shards->conf.shard_number > 1) {
+                shards->conf.stream_conf.is_reuse_port = true;
+            }
+
+            // 逻辑线程发送时不知道连接的发送缓冲区的状态，对端不读取时工作线程里的数据不能无限堆积
+            if (0 == shards->conf.stream_conf.send_buffer_max_size) {
+                shards->conf.stream_conf.send_buffer_max_size = shards->conf.queue_size;
+            }
+
+            shards->ev_loop = ev_loop;
+            shards->workers.clear();
+            memset(shards->callbacks, 0, sizeof(shards->callbacks));
+
+            shards->notify = reinterpret_cast<adapter::async_t *>(malloc(sizeof(adapter::async_t)));
+            if (NULL == shards->notify) {
+                return EN_ATBUS_ERR_MALLOC;
+            }
+            if (0 != uv_async_init(ev_loop, shards->notify, io_stream_shard_notify_cb)) {
+                free(shards->notify);
+                shards->notify = NULL;
+                return EN_ATBUS_ERR_EV_RUN;
+            }
+            shards->notify->data = shards;
+
+            int ret = EN_ATBUS_ERR_SUCCESS;
+            for (size_t i = 0; i < shards->conf.shard_number; ++i) {
+                io_stream_shard_worker *worker = new io_stream_shard_worker();
+                worker->owner = shards;
+                worker->index = i;
+                worker->in_buffer = malloc(shards->conf.queue_size);
+                worker->out_buffer = malloc(shards->conf.queue_size);
+                worker->in_queue = NULL;
+                worker->out_queue = NULL;
+                worker->is_stopping.store(0);
+                worker->is_event_blocked.store(0);
+                worker->conn_seq = 0;
+                if (NULL == worker->in_buffer || NULL == worker->out_buffer) {
+                    free(worker->in_buffer);
+                    free(worker->out_buffer);
+                    delete worker;
+                    ret = EN_ATBUS_ERR_MALLOC;
+                    break;
+                }
+
+                if ((ret = mem_init(worker->in_buffer, shards->conf.queue_size, &worker->in_queue, NULL)) < 0 ||
+                    (ret = mem_init(worker->out_buffer, shards->conf.queue_size, &worker->out_queue, NULL)) < 0) {
+                    free(worker->in_buffer);
+                    free(worker->out_buffer);
+                    delete worker;
+                    break;
+                }
+
+                uv_loop_init(&worker->loop);
+                uv_async_init(&worker->loop, &worker->notify, io_stream_shard_worker_notify_cb);
+                worker->notify.data = worker;
+
+                io_stream_init(&worker->channel, &worker->loop, &shards->conf.stream_conf);
+                worker->channel.data = worker;
+                worker->channel.evt.callbacks[io_stream_callback_evt_t::EN_FN_ACCEPTED] = io_stream_shard_on_accepted;
+                worker->channel.evt.callbacks[io_stream_callback_evt_t::EN_FN_DISCONNECTED] = io_stream_shard_on_disconnected;
+                worker->channel.evt.callbacks[io_stream_callback_evt_t::EN_FN_RECVED] = io_stream_shard_on_recv;
+
+                if (0 != uv_thread_create(&worker->thread, io_stream_shard_worker_main, worker)) {
+                    io_stream_close(&worker->channel);
+                    uv_close(reinterpret_cast<uv_handle_t *>(&worker->notify), NULL);
+                    while (UV_EBUSY == uv_loop_close(&worker->loop)) {
+                        uv_run(&worker->loop, UV_RUN_ONCE);
+                    }
+                    free(worker->in_buffer);
+                    free(worker->out_buffer);
+                    delete worker;
+                    ret = EN_ATBUS_ERR_EV_RUN;
+                    break;
+                }
+
+                shards->workers.push_back(worker);
+            }
+
+            if (ret < 0) {
+                io_stream_shard_close(shards);
+            }
+            return ret;
+        }
+
+        int io_stream_shard_close(io_stream_shards *shards) {
+            if (NULL == shards) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            for (size_t i = 0; i < shards->workers.size(); ++i) {
+                shards->workers[i]->is_stopping.store(1);
+                uv_async_send(&shards->workers[i]->notify);
+            }
+
+            for (size_t i = 0; i < shards->workers.size(); ++i) {
+                io_stream_shard_worker *worker = shards->workers[i];
+                uv_thread_join(&worker->thread);
+
+                // 工作线程已经退出，丢弃所有没处理的请求和事件
+                void *buf = NULL;
+                while (EN_ATBUS_ERR_SUCCESS == mem_recv_ptr(worker->in_queue, &buf, NULL, NULL)) {
+                    io_stream_shard_drop_msg(shards, reinterpret_cast<io_stream_shard_msg *>(buf));
+                }
+                while (EN_ATBUS_ERR_SUCCESS == mem_recv_ptr(worker->out_queue, &buf, NULL, NULL)) {
+                    io_stream_shard_drop_msg(shards, reinterpret_cast<io_stream_shard_msg *>(buf));
+                }
+                // 释放队列缓存的节点
+                mem_clear_ptr(worker->in_queue);
+                mem_clear_ptr(worker->out_queue);
+                for (std::list<io_stream_shard_msg *>::iterator iter = worker->pending_events.begin();
+                     iter != worker->pending_events.end(); ++iter) {
+                    io_stream_shard_drop_msg(shards, *iter);
+                }
+
+                free(worker->in_buffer);
+                free(worker->out_buffer);
+                delete worker;
+            }
+            shards->workers.clear();
+
+            if (NULL != shards->notify) {
+                uv_close(reinterpret_cast<uv_handle_t *>(shards->notify), io_stream_shard_notify_on_close);
+                shards->notify = NULL;
+            }
+
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        static int io_stream_shard_post_req(io_stream_shards *shards, int type, const channel_address_t &addr,
+                                            io_stream_shard_callback_t callback, void *priv_data, size_t priv_size) {
+            if (NULL == shards || shards->workers.empty()) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            // tcp在所有工作线程上监听，unix socket不能重复监听，只在第一个工作线程上监听
+            // 连接按地址的hash选择工作线程
+            size_t begin_index = 0;
+            size_t end_index = 1;
+            if (io_stream_shard_msg::EN_SM_LISTEN == type) {
+                if (0 != UTIL_STRFUNC_STRNCASE_CMP("unix", addr.scheme.c_str(), 4)) {
+                    end_index = shards->workers.size();
+                }
+            } else {
+                begin_index = util::hash::murmur_hash3_x86_32(addr.address.c_str(), static_cast<int>(addr.address.size()), 0) %
+                              shards->workers.size();
+                end_index = begin_index + 1;
+            }
+
+            io_stream_shard_req *req = new io_stream_shard_req();
+            req->callback = callback;
+            req->priv_data = priv_data;
+            req->priv_size = priv_size;
+            req->left_number = end_index - begin_index;
+            req->status = EN_ATBUS_ERR_SUCCESS;
+
+            int ret = EN_ATBUS_ERR_SUCCESS;
+            for (size_t i = begin_index; i < end_index; ++i) {
+                int res = io_stream_shard_post_cmd(
+                    shards->workers[i], io_stream_shard_make_msg(type, 0, 0, req, addr.address.c_str(), addr.address.size()));
+                if (res < 0) {
+                    ret = res;
+                    --req->left_number;
+                }
+            }
+
+            // 全部失败时直接返回错误，部分失败时在回调中返回错误
+            if (0 == req->left_number) {
+                delete req;
+                return ret;
+            }
+
+            if (ret < 0) {
+                req->status = ret;
+            }
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        int io_stream_shard_listen(io_stream_shards *shards, const channel_address_t &addr, io_stream_shard_callback_t callback,
+                                   void *priv_data, size_t priv_size) {
+            return io_stream_shard_post_req(shards, io_stream_shard_msg::EN_SM_LISTEN, addr, callback, priv_data, priv_size);
+        }
+
+        int io_stream_shard_connect(io_stream_shards *shards, const channel_address_t &addr, io_stream_shard_callback_t callback,
+                                    void *priv_data, size_t priv_size) {
+            return io_stream_shard_post_req(shards, io_stream_shard_msg::EN_SM_CONNECT, addr, callback, priv_data, priv_size);
+        }
+
+        int io_stream_shard_close_listen(io_stream_shards *shards, const channel_address_t &addr) {
+            if (NULL == shards || shards->workers.empty()) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            // 和listen一样发给所有工作线程，没有监听这个地址的工作线程会忽略
+            int ret = EN_ATBUS_ERR_SUCCESS;
+            for (size_t i = 0; i < shards->workers.size(); ++i) {
+                io_stream_shard_msg *msg = io_stream_shard_make_msg(io_stream_shard_msg::EN_SM_CLOSE_LISTEN, 0, 0, NULL,
+                                                                    addr.address.c_str(), addr.address.size());
+                int res = io_stream_shard_post_cmd(shards->workers[i], msg);
+                if (res < 0) {
+                    ret = res;
+                }
+            }
+
+            return ret;
+        }
+
+        int io_stream_shard_send(io_stream_shards *shards, uint64_t conn_id, const void *buf, size_t len) {
+            io_stream_shard_worker *worker = io_stream_shard_get_worker(shards, conn_id);
+            if (NULL == worker || NULL == buf || 0 == len) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (shards->conf.stream_conf.send_buffer_limit_size > 0 && len > shards->conf.stream_conf.send_buffer_limit_size) {
+                return EN_ATBUS_ERR_INVALID_SIZE;
+            }
+
+            return io_stream_shard_post_cmd(worker, io_stream_shard_make_msg(io_stream_shard_msg::EN_SM_SEND, conn_id, 0, NULL, buf, len));
+        }
+
+        int io_stream_shard_disconnect(io_stream_shards *shards, uint64_t conn_id) {
+            io_stream_shard_worker *worker = io_stream_shard_get_worker(shards, conn_id);
+            if (NULL == worker) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            return io_stream_shard_post_cmd(worker,
+                                            io_stream_shard_make_msg(io_stream_shard_msg::EN_SM_DISCONNECT, conn_id, 0, NULL, NULL, 0));
+        }
+
+        int io_stream_shard_send_ctrl(io_stream_shards *shards, uint64_t conn_id, const void *buf, size_t len) {
+            io_stream_shard_worker *worker = io_stream_shard_get_worker(shards, conn_id);
+            if (NULL == worker || NULL == buf || 0 == len) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (shards->conf.stream_conf.send_buffer_limit_size > 0 && len > shards->conf.stream_conf.send_buffer_limit_size) {
+                return EN_ATBUS_ERR_INVALID_SIZE;
+            }
+
+            return io_stream_shard_post_cmd(worker,
+                                            io_stream_shard_make_msg(io_stream_shard_msg::EN_SM_SEND_CTRL, conn_id, 0, NULL, buf, len));
+        }
+
+        int io_stream_shard_set_checksum(io_stream_shards *shards, uint64_t conn_id, int checksum_type) {
+            io_stream_shard_worker *worker = io_stream_shard_get_worker(shards, conn_id);
+            // 和io_stream_set_checksum一样，不能切换回旧格式
+            if (NULL == worker || checksum_type <= io_stream_checksum_t::EN_CS_LEGACY ||
+                checksum_type >= io_stream_checksum_t::EN_CS_MAX) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            return io_stream_shard_post_cmd(
+                worker, io_stream_shard_make_msg(io_stream_shard_msg::EN_SM_SET_CHECKSUM, conn_id, checksum_type, NULL, NULL, 0));
+        }
+
+        int io_stream_shard_set_compression(io_stream_shards *shards, uint64_t conn_id, int algorithm, size_t threshold, int level) {
+            io_stream_shard_worker *worker = io_stream_shard_get_worker(shards, conn_id);
+            if (NULL == worker) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (io_stream_compress_t::EN_CA_NONE != algorithm) {
+                if (0 != (algorithm & (algorithm - 1))) {
+                    return EN_ATBUS_ERR_PARAMS;
+                }
+
+                if (0 == (io_stream_compress_algorithms() & algorithm)) {
+                    return EN_ATBUS_ERR_ACCESS_DENY;
+                }
+            }
+
+            io_stream_shard_compression opt;
+            opt.algorithm = algorithm;
+            opt.threshold = threshold;
+            opt.level = level;
+            return io_stream_shard_post_cmd(
+                worker, io_stream_shard_make_msg(io_stream_shard_msg::EN_SM_SET_COMPRESSION, conn_id, 0, NULL, &opt, sizeof(opt)));
+        }
+
+        int io_stream_shard_set_cork(io_stream_shards *shards, uint64_t conn_id, size_t size, uint64_t delay) {
+            io_stream_shard_worker *worker = io_stream_shard_get_worker(shards, conn_id);
+            if (NULL == worker) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            io_stream_shard_cork opt;
+            opt.size = size;
+            opt.delay = delay;
+            return io_stream_shard_post_cmd(
+                worker, io_stream_shard_make_msg(io_stream_shard_msg::EN_SM_SET_CORK, conn_id, 0, NULL, &opt, sizeof(opt)));
+        }
+
+        int io_stream_shard_pause_read(io_stream_shards *shards, uint64_t conn_id) {
+            io_stream_shard_worker *worker = io_stream_shard_get_worker(shards, conn_id);
+            if (NULL == worker) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            return io_stream_shard_post_cmd(worker,
+                                            io_stream_shard_make_msg(io_stream_shard_msg::EN_SM_PAUSE_READ, conn_id, 0, NULL, NULL, 0));
+        }
+
+        int io_stream_shard_resume_read(io_stream_shards *shards, uint64_t conn_id) {
+            io_stream_shard_worker *worker = io_stream_shard_get_worker(shards, conn_id);
+            if (NULL == worker) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            return io_stream_shard_post_cmd(worker,
+                                            io_stream_shard_make_msg(io_stream_shard_msg::EN_SM_RESUME_READ, conn_id, 0, NULL, NULL, 0));
+        }
+
+        size_t io_stream_shard_index(uint64_t conn_id) { return static_cast<size_t>(conn_id & 0xFFFF); }
+    }
+}
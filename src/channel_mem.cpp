@@ -18,6 +18,7 @@
 #include <utility>
 
 #if (defined(__cplusplus) && __cplusplus >= 201103L) || (defined(_MSC_VER) && _MSC_VER >= 1800)
+#include <thread>
 #include <type_traits>
 #endif
 
@@ -41,6 +42,16 @@
 
 #define MEM_CHANNEL_NAME "ATBUSMEM"
 
+// 迁移后旧通道已经读空，但还有登记为正在写入的发送者时，最多等待的时间(秒)
+#ifndef ATBUS_MACRO_MEM_MIGRATE_DRAIN_TIMEOUT
+#define ATBUS_MACRO_MEM_MIGRATE_DRAIN_TIMEOUT 3
+#endif
+
+// 指针传递队列最多缓存的空闲节点数量，超出后直接释放
+#ifndef ATBUS_MACRO_MEM_PTR_NODE_CACHE_SIZE
+#define ATBUS_MACRO_MEM_PTR_NODE_CACHE_SIZE 1024
+#endif
+
 namespace atbus {
     namespace channel {
 
@@ -73,6 +84,9 @@ namespace atbus {
 
         typedef ATBUS_MACRO_DATA_ALIGN_TYPE data_align_type;
 
+        // 和 libatbus_channel_types.h 中的声明保持一致
+        typedef void (*mem_ptr_free_fn_t)(void *buf, size_t len);
+
         // 配置数据结构
         typedef struct {
             size_t protect_node_count;
@@ -84,6 +98,15 @@ namespace atbus {
             volatile util::lock::atomic_int_type<size_t> atomic_recver_identify;
         } mem_conf;
 
+        // 指针传递模式的队列节点，只传递数据块的所有权，不拷贝数据
+        typedef struct {
+            volatile util::lock::atomic_int_type<uintptr_t> atomic_next;
+            void *buffer;
+            size_t buffer_size;
+            mem_ptr_free_fn_t free_fn;
+            size_t ring_mark; // 入队时环形缓冲区的写游标，接收端读完这之前写入的数据才能取出这个节点
+        } mem_ptr_node;
+
         // 通道头
         typedef struct {
             char node_magic[8]; // 魔术串，用于标识数据类型
@@ -115,6 +138,27 @@ namespace atbus {
             size_t block_bad_count;     // 读取到坏块次数
             size_t block_timeout_count; // 读取到写入超时块次数
             size_t node_bad_count;      // 读取到坏node次数
+
+            // 指针传递队列(MPSC，仅同一进程内可用，共享内存通道不能使用)
+            // [ptr_head, atomic_ptr_tail] 为侵入式链表，ptr_stub 为哨兵节点
+            volatile util::lock::atomic_int_type<uintptr_t> atomic_ptr_tail; // 写端，多个写者通过原子交换追加节点
+            uintptr_t ptr_head;                                              // 读端，只能有一个读者
+            volatile util::lock::atomic_int_type<size_t> atomic_ptr_pending_size; // 已写入未读取的数据长度
+            mem_ptr_node ptr_stub;
+            // 发送端从读取写游标到节点入队完成期间加锁，这样队列中节点的标记是有序的，接收端也不会在节点入队前读过它的标记
+            volatile util::lock::atomic_int_type<uint32_t> atomic_ptr_send_lock;
+            // 空闲节点缓存(接收端放入，发送端取出)，避免每条消息都分配一次节点
+            volatile util::lock::atomic_int_type<uintptr_t> atomic_ptr_free_head;
+            volatile util::lock::atomic_int_type<size_t> atomic_ptr_free_count;
+            volatile util::lock::atomic_int_type<uint32_t> atomic_ptr_free_lock; // 取出节点时加锁，同时只有一个取出者，避免ABA问题
+
+            // 在线迁移(用于共享内存通道扩容)
+            // 接收端创建新通道后写入迁移目标，发送端在下一条记录开始前切换到新通道
+            volatile util::lock::atomic_int_type<uint32_t> atomic_migrate_flag;  // 非0表示已迁移
+            volatile util::lock::atomic_int_type<uint32_t> atomic_writing_count; // 正在写入的发送者数量
+            int64_t migrate_key;
+            size_t migrate_size;
+            time_t migrate_drain_time; // 接收端第一次读空旧通道但还有发送者正在写入的时间
         } mem_channel;
 
 #if (defined(__cplusplus) && __cplusplus >= 201103L) || (defined(_MSC_VER) && _MSC_VER >= 1800)
@@ -370,6 +414,10 @@ namespace atbus {
             head->channel.area_data_offset = head->channel.area_head_offset + head->channel.node_count * mem_block::node_head_size;
             head->channel.area_end_offset = head->channel.area_data_offset + head->channel.node_count * head->channel.node_size;
 
+            // 指针传递队列初始化
+            head->channel.ptr_head = reinterpret_cast<uintptr_t>(&head->channel.ptr_stub);
+            head->channel.atomic_ptr_tail.store(head->channel.ptr_head);
+
             // 配置初始化
             if (NULL != conf)
                 memcpy(&head->channel.conf, &conf, sizeof(conf));
@@ -495,20 +543,108 @@ namespace atbus {
         int mem_send(mem_channel *channel, const void *buf, size_t len) {
             if (NULL == channel) return EN_ATBUS_ERR_PARAMS;
 
+            // 先登记写入者再检查迁移标记，和接收端 mem_migrate_drained 的检查顺序相反
+            // 这样要么发送端能看到迁移标记，要么接收端能看到正在写入的发送者，不会漏掉数据
+            channel->atomic_writing_count.fetch_add(1);
+            if (0 != channel->atomic_migrate_flag.load()) {
+                channel->atomic_writing_count.fetch_sub(1);
+                return EN_ATBUS_ERR_CHANNEL_MIGRATED;
+            }
+
             int ret = 0;
             size_t left_try_times = channel->conf.write_retry_times;
             while (left_try_times-- > 0) {
-                int ret = mem_send_real(channel, buf, len);
+                ret = mem_send_real(channel, buf, len);
 
                 // 原子操作序列冲突，重试
                 if (EN_ATBUS_ERR_NODE_BAD_BLOCK_CSEQ_ID == ret || EN_ATBUS_ERR_NODE_BAD_BLOCK_WSEQ_ID == ret) continue;
 
-                return ret;
+                break;
             }
 
+            channel->atomic_writing_count.fetch_sub(1);
             return ret;
         }
 
+        int mem_migrate(mem_channel *channel, int64_t key, size_t size) {
+            if (NULL == channel) return EN_ATBUS_ERR_PARAMS;
+
+            if (0 != channel->atomic_migrate_flag.load()) {
+                return EN_ATBUS_ERR_ALREADY_INITED;
+            }
+
+            // 先写入迁移目标，再发布标记
+            channel->migrate_key = key;
+            channel->migrate_size = size;
+            channel->atomic_migrate_flag.store(1);
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        bool mem_get_migrate(mem_channel *channel, int64_t *key, size_t *size) {
+            if (NULL == channel || 0 == channel->atomic_migrate_flag.load()) {
+                return false;
+            }
+
+            if (key) *key = channel->migrate_key;
+            if (size) *size = channel->migrate_size;
+            return true;
+        }
+
+        bool mem_migrate_drained(mem_channel *channel) {
+            if (NULL == channel || 0 == channel->atomic_migrate_flag.load()) {
+                return false;
+            }
+
+            // 迁移标记发布后，已经开始的写入必须全部完成并且被读取完
+            // 必须先读写入者计数再比较读写游标，和 mem_send 的顺序相反。计数为0时之后登记的发送者一定能看到迁移标记，
+            // 否则发送者可能在比较游标后写入并注销，这条消息就留在了旧通道里
+            uint32_t writing_count = channel->atomic_writing_count.load();
+            if (channel->atomic_read_cur.load() != channel->atomic_write_cur.load()) {
+                channel->migrate_drain_time = 0;
+                return false;
+            }
+
+            if (0 == writing_count) {
+                channel->migrate_drain_time = 0;
+                return true;
+            }
+
+            // 发送者在登记后崩溃的话计数永远不会归零，和写入超时的数据块一样，超时后不再等待它
+            // 写了一半的数据块会让读写游标不一致，由mem_recv的写入超时跳过，所以这里只在计数不为0并且通道读空时计时
+            time_t now = time(NULL);
+            if (0 == channel->migrate_drain_time) {
+                channel->migrate_drain_time = now;
+                return false;
+            }
+
+            return now - channel->migrate_drain_time >= ATBUS_MACRO_MEM_MIGRATE_DRAIN_TIMEOUT;
+        }
+
+        /**
+         * @brief 查看指针传递队列的第一个节点，不取出
+         * @note 只能由接收端调用。没有待处理的数据块时不访问链表，共享内存通道里的链表指针在其他进程中是无效的
+         */
+        static mem_ptr_node *mem_ptr_peek_node(mem_channel *channel) {
+            if (0 == channel->atomic_ptr_pending_size.load()) {
+                return NULL;
+            }
+
+            mem_ptr_node *head = reinterpret_cast<mem_ptr_node *>(channel->ptr_head);
+            if (&channel->ptr_stub == head) {
+                return reinterpret_cast<mem_ptr_node *>(head->atomic_next.load());
+            }
+
+            return head;
+        }
+
+        /**
+         * @brief 读游标到节点标记的距离，为0时表示节点入队前写入环形缓冲区的数据都已读取
+         * @note 接收端读环形缓冲区时不会越过队列中和正在入队的节点的标记，所以这个距离不会有回绕的歧义
+         */
+        static inline size_t mem_ptr_node_distance(mem_channel *channel, const mem_ptr_node *node, size_t read_cur) {
+            return (node->ring_mark + channel->node_count - read_cur) % channel->node_count;
+        }
+
         int mem_recv(mem_channel *channel, void *buf, size_t len, size_t *recv_size) {
             // 用于调试的节点编号信息
             detail::last_action_channel_begin_node_index = std::numeric_limits<size_t>::max();
@@ -527,6 +663,28 @@ namespace atbus {
             size_t write_cur = channel->atomic_write_cur.load();
             // std::atomic_thread_fence(std::memory_order_seq_cst);
 
+            // 指针传递队列里有先发送的数据块时只读取它入队前写入的数据，保证和mem_send_ptr之间的消息顺序
+            // 必须先读写游标再检查队列，这样同一个发送者在数据块之后写入的数据一定会被限制住
+            // 有发送端正在入队时，它的标记可能在已写入的范围内，等入队完成后再读
+            if (0 != channel->atomic_ptr_send_lock.load()) {
+                return EN_ATBUS_ERR_NO_DATA;
+            }
+
+            {
+                mem_ptr_node *ptr_node = mem_ptr_peek_node(channel);
+                if (NULL != ptr_node) {
+                    size_t mark_distance = mem_ptr_node_distance(channel, ptr_node, read_begin_cur);
+                    if (0 == mark_distance) {
+                        return EN_ATBUS_ERR_NO_DATA;
+                    }
+
+                    // 标记在读取写游标之后才设置时会超出已写入的范围，这时不需要限制
+                    if (mark_distance < (write_cur + channel->node_count - read_begin_cur) % channel->node_count) {
+                        write_cur = ptr_node->ring_mark;
+                    }
+                }
+            }
+
             while (true) {
                 read_end_cur = read_begin_cur;
 
@@ -673,6 +831,192 @@ namespace atbus {
             return ret;
         }
 
+        static void mem_ptr_push_node(mem_channel *channel, mem_ptr_node *node) {
+            node->atomic_next.store(0);
+            // 先抢占尾部，再链接前驱节点。链接完成前读端会认为队列暂时为空
+            uintptr_t prev = channel->atomic_ptr_tail.exchange(reinterpret_cast<uintptr_t>(node));
+            reinterpret_cast<mem_ptr_node *>(prev)->atomic_next.store(reinterpret_cast<uintptr_t>(node));
+        }
+
+        static mem_ptr_node *mem_ptr_pop_node(mem_channel *channel) {
+            mem_ptr_node *stub = &channel->ptr_stub;
+            mem_ptr_node *head = reinterpret_cast<mem_ptr_node *>(channel->ptr_head);
+            mem_ptr_node *next = reinterpret_cast<mem_ptr_node *>(head->atomic_next.load());
+
+            // 跳过哨兵节点
+            if (stub == head) {
+                if (NULL == next) {
+                    return NULL;
+                }
+
+                channel->ptr_head = reinterpret_cast<uintptr_t>(next);
+                head = next;
+                next = reinterpret_cast<mem_ptr_node *>(head->atomic_next.load());
+            }
+
+            if (NULL != next) {
+                channel->ptr_head = reinterpret_cast<uintptr_t>(next);
+                return head;
+            }
+
+            // 写端正在追加节点，下次再读
+            if (channel->atomic_ptr_tail.load() != reinterpret_cast<uintptr_t>(head)) {
+                return NULL;
+            }
+
+            // 最后一个节点，重新放入哨兵节点后才能取出
+            mem_ptr_push_node(channel, stub);
+            next = reinterpret_cast<mem_ptr_node *>(head->atomic_next.load());
+            if (NULL != next) {
+                channel->ptr_head = reinterpret_cast<uintptr_t>(next);
+                return head;
+            }
+
+            return NULL;
+        }
+
+        static void mem_ptr_lock(volatile util::lock::atomic_int_type<uint32_t> &lock) {
+            uint32_t unlocked = 0;
+            while (false == lock.compare_exchange_weak(unlocked, 1)) {
+                unlocked = 0;
+#if (defined(__cplusplus) && __cplusplus >= 201103L) || (defined(_MSC_VER) && _MSC_VER >= 1800)
+                std::this_thread::yield();
+#endif
+            }
+        }
+
+        static mem_ptr_node *mem_ptr_alloc_node(mem_channel *channel) {
+            // 只有接收端放回节点，取出时加锁保证同时只有一个取出者，这样不会有ABA问题
+            // 其他发送端正在取节点时直接分配新节点，不等待
+            uint32_t unlocked = 0;
+            if (channel->atomic_ptr_free_lock.compare_exchange_strong(unlocked, 1)) {
+                uintptr_t head = channel->atomic_ptr_free_head.load();
+                while (0 != head) {
+                    uintptr_t next = reinterpret_cast<mem_ptr_node *>(head)->atomic_next.load();
+                    if (channel->atomic_ptr_free_head.compare_exchange_weak(head, next)) {
+                        break;
+                    }
+                }
+                channel->atomic_ptr_free_lock.store(0);
+
+                if (0 != head) {
+                    channel->atomic_ptr_free_count.fetch_sub(1);
+                    return reinterpret_cast<mem_ptr_node *>(head);
+                }
+            }
+
+            return reinterpret_cast<mem_ptr_node *>(malloc(sizeof(mem_ptr_node)));
+        }
+
+        static void mem_ptr_release_node(mem_channel *channel, mem_ptr_node *node) {
+            if (channel->atomic_ptr_free_count.load() >= ATBUS_MACRO_MEM_PTR_NODE_CACHE_SIZE) {
+                free(node);
+                return;
+            }
+
+            channel->atomic_ptr_free_count.fetch_add(1);
+            uintptr_t head = channel->atomic_ptr_free_head.load();
+            do {
+                node->atomic_next.store(head);
+            } while (false == channel->atomic_ptr_free_head.compare_exchange_weak(head, reinterpret_cast<uintptr_t>(node)));
+        }
+
+        int mem_send_ptr(mem_channel *channel, void *buf, size_t len, mem_ptr_free_fn_t free_fn) {
+            if (NULL == channel || NULL == buf || 0 == len) return EN_ATBUS_ERR_PARAMS;
+
+            // 和环形缓冲区保持一样的容量限制，防止读端处理不过来时无限堆积
+            size_t limit_size = channel->area_end_offset - channel->area_data_offset - channel->conf.protect_memory_size;
+            size_t pending_size = channel->atomic_ptr_pending_size.load();
+            do {
+                if (pending_size + len > limit_size) return EN_ATBUS_ERR_BUFF_LIMIT;
+            } while (false == channel->atomic_ptr_pending_size.compare_exchange_weak(pending_size, pending_size + len));
+
+            mem_ptr_node *node = mem_ptr_alloc_node(channel);
+            if (NULL == node) {
+                channel->atomic_ptr_pending_size.fetch_sub(len);
+                return EN_ATBUS_ERR_MALLOC;
+            }
+
+            node->buffer = buf;
+            node->buffer_size = len;
+            node->free_fn = free_fn;
+            // 这之前写入环形缓冲区的数据要先于这个数据块被读取
+            mem_ptr_lock(channel->atomic_ptr_send_lock);
+            node->ring_mark = channel->atomic_write_cur.load();
+            mem_ptr_push_node(channel, node);
+            channel->atomic_ptr_send_lock.store(0);
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        int mem_recv_ptr(mem_channel *channel, void **buf, size_t *len, mem_ptr_free_fn_t *free_fn) {
+            if (NULL == channel || NULL == buf) return EN_ATBUS_ERR_PARAMS;
+
+            mem_ptr_node *node = mem_ptr_peek_node(channel);
+            if (NULL == node) {
+                return EN_ATBUS_ERR_NO_DATA;
+            }
+
+            // 环形缓冲区里还有先发送的数据，要先通过mem_recv读取
+            if (0 != mem_ptr_node_distance(channel, node, channel->atomic_read_cur.load())) {
+                return EN_ATBUS_ERR_NO_DATA;
+            }
+
+            node = mem_ptr_pop_node(channel);
+            if (NULL == node) {
+                return EN_ATBUS_ERR_NO_DATA;
+            }
+
+            *buf = node->buffer;
+            if (len) *len = node->buffer_size;
+            if (free_fn) {
+                *free_fn = node->free_fn;
+            }
+
+            channel->atomic_ptr_pending_size.fetch_sub(node->buffer_size);
+            mem_ptr_release_node(channel, node);
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        void mem_free_ptr(void *buf, size_t len, mem_ptr_free_fn_t free_fn) {
+            if (NULL == buf) {
+                return;
+            }
+
+            if (NULL != free_fn) {
+                free_fn(buf, len);
+            } else {
+                free(buf);
+            }
+        }
+
+        size_t mem_clear_ptr(mem_channel *channel) {
+            if (NULL == channel) return 0;
+
+            // 丢弃所有未处理的数据块，不再和环形缓冲区保持顺序
+            size_t ret = 0;
+            mem_ptr_node *node = NULL;
+            while (0 != channel->atomic_ptr_pending_size.load() && NULL != (node = mem_ptr_pop_node(channel))) {
+                channel->atomic_ptr_pending_size.fetch_sub(node->buffer_size);
+                mem_free_ptr(node->buffer, node->buffer_size, node->free_fn);
+                free(node);
+                ++ret;
+            }
+
+            // 释放缓存的空闲节点，等待正在取节点的发送端完成
+            mem_ptr_lock(channel->atomic_ptr_free_lock);
+            uintptr_t head = channel->atomic_ptr_free_head.exchange(0);
+            channel->atomic_ptr_free_lock.store(0);
+
+            while (0 != head) {
+                node = reinterpret_cast<mem_ptr_node *>(head);
+                head = node->atomic_next.load();
+                channel->atomic_ptr_free_count.fetch_sub(1);
+                free(node);
+            }
+
+            return ret;
+        }
+
         std::pair<size_t, size_t> mem_last_action() {
             return std::make_pair(detail::last_action_channel_begin_node_index, detail::last_action_channel_end_node_index);
         }
@@ -705,6 +1049,9 @@ namespace atbus {
                 << "read index: " << read_cur << std::endl
                 << "write index: " << write_cur << std::endl
                 << "operation sequence: " << channel->atomic_operation_seq << std::endl
+                << "pointer passing pending size: " << channel->atomic_ptr_pending_size.load() << std::endl
+                << "writing count: " << channel->atomic_writing_count.load() << std::endl
+                << "migrated: " << (channel->atomic_migrate_flag.load() ? "yes" : "no") << std::endl
                 << std::endl;
 
             out << "stat:" << std::endl
@@ -745,6 +1092,9 @@ namespace atbus {
                 << "read index: " << channel->atomic_read_cur << std::endl
                 << "write index: " << channel->atomic_write_cur << std::endl
                 << "operation sequence: " << channel->atomic_operation_seq << std::endl
+                << "pointer passing pending size: " << channel->atomic_ptr_pending_size.load() << std::endl
+                << "writing count: " << channel->atomic_writing_count.load() << std::endl
+                << "migrated: " << (channel->atomic_migrate_flag.load() ? "yes" : "no") << std::endl
                 << std::endl;
         }
     }
@@ -38,6 +38,34 @@
 #include <unistd.h>
 #endif
 
+#ifdef ATBUS_CHANNEL_SHM_FD
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+// 老版本的头文件没有file seal的定义
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+
+// 映射后长度不能再改变，否则对端截断文件后访问映射区域会触发SIGBUS
+#define ATBUS_CHANNEL_SHM_FD_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+#endif
+
 #ifdef ATBUS_CHANNEL_SHM
 
 namespace atbus {
@@ -62,12 +90,14 @@ namespace atbus {
             HANDLE handle;
             LPCTSTR buffer;
             size_t size;
+            size_t ref_count; // 同一进程内可能多次attach同一块共享内存(比如迁移时的收发双方)
         } shm_mapped_record_type;
 #else
         typedef struct {
             int shm_id;
             void *buffer;
             size_t size;
+            size_t ref_count; // 同一进程内可能多次attach同一块共享内存(比如迁移时的收发双方)
         } shm_mapped_record_type;
 #endif
 
@@ -77,6 +107,11 @@ namespace atbus {
             std::map<key_t, shm_mapped_record_type>::iterator iter = shm_mapped_records.find(shm_key);
             if (shm_mapped_records.end() == iter) return EN_ATBUS_ERR_SHM_NOT_FOUND;
 
+            if (iter->second.ref_count > 1) {
+                --iter->second.ref_count;
+                return EN_ATBUS_ERR_SUCCESS;
+            }
+
             shm_mapped_record_type record = iter->second;
             shm_mapped_records.erase(iter);
 
@@ -98,6 +133,7 @@ namespace atbus {
             {
                 std::map<key_t, shm_mapped_record_type>::iterator iter = shm_mapped_records.find(shm_key);
                 if (shm_mapped_records.end() != iter) {
+                    ++iter->second.ref_count;
                     if (data) *data = (void *)iter->second.buffer;
                     if (real_size) *real_size = iter->second.size;
                     return EN_ATBUS_ERR_SUCCESS;
@@ -136,6 +172,7 @@ namespace atbus {
                 if (real_size) *real_size = len;
 
                 shm_record.size = len;
+                shm_record.ref_count = 1;
                 shm_mapped_records[shm_key] = shm_record;
                 return EN_ATBUS_ERR_SUCCESS;
             }
@@ -160,6 +197,7 @@ namespace atbus {
             if (NULL == shm_record.buffer) return EN_ATBUS_ERR_SHM_GET_FAILED;
 
             shm_record.size = len;
+            shm_record.ref_count = 1;
             shm_mapped_records[shm_key] = shm_record;
 
             if (data) *data = (void *)shm_record.buffer;
@@ -205,6 +243,7 @@ namespace atbus {
 
             // 获取地址
             shm_record.buffer = shmat(shm_record.shm_id, NULL, 0);
+            shm_record.ref_count = 1;
             shm_mapped_records[shm_key] = shm_record;
 
             if (data) *data = shm_record.buffer;
@@ -273,6 +312,49 @@ namespace atbus {
             return mem_recv(switcher.mem, buf, len, recv_size);
         }
 
+        int shm_migrate(shm_channel *channel, key_t new_key, size_t new_len, shm_channel **new_channel, const shm_conf *conf) {
+            if (NULL == channel) return EN_ATBUS_ERR_PARAMS;
+
+            shm_channel_switcher switcher;
+            switcher.shm = channel;
+            if (mem_get_migrate(switcher.mem, NULL, NULL)) {
+                return EN_ATBUS_ERR_ALREADY_INITED;
+            }
+
+            shm_channel *res_channel = NULL;
+            int ret = shm_init(new_key, new_len, &res_channel, conf);
+            if (ret < 0) return ret;
+
+            // 新通道准备好以后再发布，发送端看到标记时一定可以attach成功
+            ret = mem_migrate(switcher.mem, static_cast<int64_t>(new_key), new_len);
+            if (ret < 0) {
+                shm_close(new_key);
+                return ret;
+            }
+
+            if (new_channel) *new_channel = res_channel;
+            return ret;
+        }
+
+        bool shm_get_migrate(shm_channel *channel, key_t *new_key, size_t *new_len) {
+            shm_channel_switcher switcher;
+            switcher.shm = channel;
+
+            int64_t key = 0;
+            if (!mem_get_migrate(switcher.mem, &key, new_len)) {
+                return false;
+            }
+
+            if (new_key) *new_key = static_cast<key_t>(key);
+            return true;
+        }
+
+        bool shm_migrate_drained(shm_channel *channel) {
+            shm_channel_switcher switcher;
+            switcher.shm = channel;
+            return mem_migrate_drained(switcher.mem);
+        }
+
         std::pair<size_t, size_t> shm_last_action() { return mem_last_action(); }
 
         void shm_show_channel(shm_channel *channel, std::ostream &out, bool need_node_status, size_t need_node_data) {
@@ -280,6 +362,95 @@ namespace atbus {
             switcher.shm = channel;
             mem_show_channel(switcher.mem, out, need_node_status, need_node_data);
         }
+
+#ifdef ATBUS_CHANNEL_SHM_FD
+        typedef struct {
+            void *buffer;
+            size_t size;
+        } shm_fd_mapped_record_type;
+
+        // 匿名共享内存没有key，按通道地址记录映射区域
+        static std::map<shm_channel *, shm_fd_mapped_record_type> shm_fd_mapped_records;
+
+        static int shm_fd_map_buffer(int fd, size_t len, shm_channel **channel, const shm_conf *conf, bool create) {
+            void *buffer = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (MAP_FAILED == buffer) return EN_ATBUS_ERR_SHM_GET_FAILED;
+
+            shm_channel_switcher channel_s;
+            shm_conf_cswitcher conf_s;
+            conf_s.shm = conf;
+
+            int ret;
+            if (create) {
+                ret = mem_init(buffer, len, &channel_s.mem, conf_s.mem);
+            } else {
+                ret = mem_attach(buffer, len, &channel_s.mem, conf_s.mem);
+            }
+            if (ret < 0) {
+                munmap(buffer, len);
+                return ret;
+            }
+
+            shm_fd_mapped_record_type record;
+            record.buffer = buffer;
+            record.size = len;
+            shm_fd_mapped_records[channel_s.shm] = record;
+
+            if (channel) *channel = channel_s.shm;
+            return ret;
+        }
+
+        int shm_init_fd(size_t len, int *fd, shm_channel **channel, const shm_conf *conf) {
+            if (NULL == fd || 0 == len) return EN_ATBUS_ERR_PARAMS;
+
+            // len 长度对齐到分页大小
+            size_t page_size = ::sysconf(_SC_PAGESIZE);
+            len = (len + page_size - 1) & (~(page_size - 1));
+
+            // 老版本glibc没有memfd_create的包装函数，直接使用系统调用
+            int res_fd = static_cast<int>(syscall(SYS_memfd_create, "libatbus_shm", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+            if (res_fd < 0) return EN_ATBUS_ERR_SHM_GET_FAILED;
+
+            if (0 != ftruncate(res_fd, static_cast<off_t>(len)) || 0 != fcntl(res_fd, F_ADD_SEALS, ATBUS_CHANNEL_SHM_FD_SEALS)) {
+                close(res_fd);
+                return EN_ATBUS_ERR_SHM_GET_FAILED;
+            }
+
+            int ret = shm_fd_map_buffer(res_fd, len, channel, conf, true);
+            if (ret < 0) {
+                close(res_fd);
+                return ret;
+            }
+
+            *fd = res_fd;
+            return ret;
+        }
+
+        int shm_attach_fd(int fd, shm_channel **channel, const shm_conf *conf) {
+            if (fd < 0) return EN_ATBUS_ERR_PARAMS;
+
+            // 只接受创建者已经固定了长度的描述符
+            int seals = fcntl(fd, F_GET_SEALS);
+            if (seals < 0 || ATBUS_CHANNEL_SHM_FD_SEALS != (seals & ATBUS_CHANNEL_SHM_FD_SEALS)) return EN_ATBUS_ERR_SHM_GET_FAILED;
+
+            // 长度由创建者决定
+            struct stat fd_stat;
+            if (0 != fstat(fd, &fd_stat) || fd_stat.st_size <= 0) return EN_ATBUS_ERR_SHM_GET_FAILED;
+
+            return shm_fd_map_buffer(fd, static_cast<size_t>(fd_stat.st_size), channel, conf, false);
+        }
+
+        int shm_close_fd(shm_channel *channel) {
+            std::map<shm_channel *, shm_fd_mapped_record_type>::iterator iter = shm_fd_mapped_records.find(channel);
+            if (shm_fd_mapped_records.end() == iter) return EN_ATBUS_ERR_SHM_NOT_FOUND;
+
+            shm_fd_mapped_record_type record = iter->second;
+            shm_fd_mapped_records.erase(iter);
+
+            if (0 != munmap(record.buffer, record.size)) return EN_ATBUS_ERR_SHM_GET_FAILED;
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+#endif
     }
 }
 
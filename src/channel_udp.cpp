@@ -0,0 +1,539 @@
+﻿/**
+ * @brief 所有channel文件的模式均为 c + channel<br />
+ *        使用c的模式是为了简单、结构清晰并且避免异常<br />
+ *        附带c++的部分是为了避免命名空间污染并且c++的跨平台适配更加简单
+ */
+
+#include <algorithm>
+#include <assert.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <sys/types.h>
+#endif
+
+#include "common/string_oprs.h"
+#include "std/smart_ptr.h"
+
+#include "detail/crc32.h"
+#include "detail/libatbus_channel_export.h"
+#include "detail/libatbus_error.h"
+
+// 数据报的消息头：1字节版本号+32位crc32c校验和
+#define ATBUS_CHANNEL_UDP_FRAME_VERSION 1
+#define ATBUS_CHANNEL_UDP_FRAME_HEAD_SIZE 5
+
+// libuv按这个长度把接收缓冲区分块给recvmmsg
+#define ATBUS_CHANNEL_UDP_DGRAM_MAXSIZE 65536
+
+// 一次sendmmsg最多发送的数据报数量
+#define ATBUS_CHANNEL_UDP_SENDMMSG_MAX 64
+
+// libuv 1.40以后UV_UDP_RECVMMSG的缓冲区由使用者管理(UV_UDP_MMSG_FREE)
+#if UV_VERSION_HEX >= 0x012800
+#define ATBUS_CHANNEL_UDP_RECVMMSG 1
+#endif
+
+namespace atbus {
+    namespace channel {
+        void udp_init_configure(udp_conf *conf) {
+            if (NULL == conf) {
+                return;
+            }
+
+            // 以太网MTU(1500)减去IPv6头(40)、UDP头(8)和消息头
+            conf->send_max_size = 1400;
+            conf->recv_max_size = ATBUS_CHANNEL_UDP_DGRAM_MAXSIZE - ATBUS_CHANNEL_UDP_FRAME_HEAD_SIZE - 1;
+            conf->send_batch = 32;
+            conf->recv_batch = 16;
+            conf->sock_send_buffer = 0;
+            conf->sock_recv_buffer = 0;
+        }
+
+        int udp_init(udp_channel *channel, adapter::loop_t *ev_loop, const udp_conf *conf) {
+            if (NULL == channel || NULL == ev_loop) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (NULL == conf) {
+                udp_conf default_conf;
+                udp_init_configure(&default_conf);
+
+                return udp_init(channel, ev_loop, &default_conf);
+            }
+
+            channel->ev_loop = ev_loop;
+            channel->conf = *conf;
+            if (channel->conf.send_batch < 1) {
+                channel->conf.send_batch = 1;
+            }
+            if (channel->conf.recv_batch < 1) {
+                channel->conf.recv_batch = 1;
+            }
+
+            channel->socket_pool.clear();
+#ifdef ATBUS_CHANNEL_UDP_RECVMMSG
+            if (channel->conf.recv_batch > 1) {
+                channel->recv_buffer.resize(channel->conf.recv_batch * ATBUS_CHANNEL_UDP_DGRAM_MAXSIZE);
+            } else {
+                channel->recv_buffer.resize(channel->conf.recv_max_size + ATBUS_CHANNEL_UDP_FRAME_HEAD_SIZE + 1);
+            }
+#else
+            // 多读一个字节，用于发现超长的数据报
+            channel->recv_buffer.resize(channel->conf.recv_max_size + ATBUS_CHANNEL_UDP_FRAME_HEAD_SIZE + 1);
+#endif
+            channel->flush_timer = NULL;
+            channel->on_recv = NULL;
+            memset(&channel->stat, 0, sizeof(channel->stat));
+            channel->error_code = 0;
+            channel->data = NULL;
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        static void udp_socket_on_close(uv_handle_t *handle) {
+            udp_channel *channel = reinterpret_cast<udp_channel *>(handle->data);
+            assert(channel);
+
+            delete reinterpret_cast<adapter::udp_t *>(handle);
+            ATBUS_CHANNEL_REQ_END(channel);
+        }
+
+        static void udp_timer_on_close(uv_handle_t *handle) {
+            udp_channel *channel = reinterpret_cast<udp_channel *>(handle->data);
+            assert(channel);
+
+            free(handle);
+            ATBUS_CHANNEL_REQ_END(channel);
+        }
+
+        static void udp_flush_socket(udp_socket *sock);
+
+        // 关闭后libuv不再回调，handle在关闭回调里释放
+        static void udp_close_handle(udp_socket *sock) {
+            if (NULL == sock->handle) {
+                return;
+            }
+
+            udp_flush_socket(sock);
+            uv_udp_recv_stop(sock->handle);
+
+            // 关闭回调里只需要channel
+            sock->handle->data = sock->channel;
+            ATBUS_CHANNEL_REQ_START(sock->channel);
+            uv_close(reinterpret_cast<uv_handle_t *>(sock->handle), udp_socket_on_close);
+            sock->handle = NULL;
+        }
+
+        int udp_close(udp_channel *channel) {
+            if (NULL == channel) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            for (size_t i = 0; i < channel->socket_pool.size(); ++i) {
+                udp_close_handle(channel->socket_pool[i].get());
+            }
+
+            if (NULL != channel->flush_timer) {
+                uv_timer_stop(channel->flush_timer);
+                uv_close(reinterpret_cast<uv_handle_t *>(channel->flush_timer), udp_timer_on_close);
+                channel->flush_timer = NULL;
+            }
+
+            while (ATBUS_CHANNEL_REQ_ACTIVE(channel)) {
+                uv_run(channel->ev_loop, UV_RUN_ONCE);
+            }
+
+            channel->socket_pool.clear();
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        int udp_make_peer(const channel_address_t &addr, udp_peer_t *peer) {
+            if (NULL == peer) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (0 != UTIL_STRFUNC_STRNCASE_CMP("udp", addr.scheme.c_str(), 3) || addr.port < 0 || addr.port > 65535) {
+                return EN_ATBUS_ERR_CHANNEL_ADDR_INVALID;
+            }
+
+            memset(&peer->addr, 0, sizeof(peer->addr));
+            if (0 == uv_ip4_addr(addr.host.c_str(), addr.port, reinterpret_cast<sockaddr_in *>(&peer->addr))) {
+                return EN_ATBUS_ERR_SUCCESS;
+            }
+
+            if (0 == uv_ip6_addr(addr.host.c_str(), addr.port, reinterpret_cast<sockaddr_in6 *>(&peer->addr))) {
+                return EN_ATBUS_ERR_SUCCESS;
+            }
+
+            return EN_ATBUS_ERR_CHANNEL_ADDR_INVALID;
+        }
+
+        static void udp_on_alloc_fn(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf) {
+            udp_socket *sock = reinterpret_cast<udp_socket *>(handle->data);
+            assert(sock && sock->channel);
+
+            // 回调是串行的，所有socket共用一个缓冲区
+            buf->base = &sock->channel->recv_buffer[0];
+            buf->len = sock->channel->recv_buffer.size();
+        }
+
+        static void udp_on_recv_fn(uv_udp_t *handle, ssize_t nread, const uv_buf_t *buf, const sockaddr *addr, unsigned flags) {
+            udp_socket *sock = reinterpret_cast<udp_socket *>(handle->data);
+            assert(sock && sock->channel);
+            udp_channel *channel = sock->channel;
+
+#ifdef ATBUS_CHANNEL_UDP_RECVMMSG
+            // 缓冲区由channel管理，不需要释放
+            if (0 != (flags & UV_UDP_MMSG_FREE)) {
+                return;
+            }
+#endif
+
+            // 没有更多数据
+            if (0 == nread && NULL == addr) {
+                return;
+            }
+
+            // udp的错误(比如ICMP的端口不可达)不影响后续的数据，只通知上层
+            if (nread < 0) {
+                channel->error_code = static_cast<int>(nread);
+                if (NULL != channel->on_recv) {
+                    channel->on_recv(channel, sock, NULL, EN_ATBUS_ERR_READ_FAILED, NULL, 0);
+                }
+                return;
+            }
+
+            size_t len = static_cast<size_t>(nread);
+            if (0 != (flags & UV_UDP_PARTIAL) || len < ATBUS_CHANNEL_UDP_FRAME_HEAD_SIZE ||
+                len - ATBUS_CHANNEL_UDP_FRAME_HEAD_SIZE > channel->conf.recv_max_size ||
+                ATBUS_CHANNEL_UDP_FRAME_VERSION != static_cast<unsigned char>(buf->base[0])) {
+                ++channel->stat.recv_drop_times;
+                return;
+            }
+
+            uint32_t checksum = 0;
+            memcpy(&checksum, buf->base + 1, sizeof(uint32_t));
+            char *data = buf->base + ATBUS_CHANNEL_UDP_FRAME_HEAD_SIZE;
+            len -= ATBUS_CHANNEL_UDP_FRAME_HEAD_SIZE;
+            if (checksum != ::atbus::detail::crc32c(0, reinterpret_cast<const unsigned char *>(data), len)) {
+                ++channel->stat.recv_drop_times;
+                return;
+            }
+
+            ++channel->stat.recv_times;
+            channel->stat.recv_size += len;
+            if (NULL != channel->on_recv) {
+                channel->on_recv(channel, sock, addr, EN_ATBUS_ERR_SUCCESS, data, len);
+            }
+        }
+
+        static int udp_open_socket(udp_channel *channel, const sockaddr *bind_addr, const channel_address_t &addr, udp_socket **out) {
+            std::shared_ptr<udp_socket> sock = std::make_shared<udp_socket>();
+            if (!sock) {
+                return EN_ATBUS_ERR_MALLOC;
+            }
+
+            adapter::udp_t *handle = new adapter::udp_t();
+            if (NULL == handle) {
+                return EN_ATBUS_ERR_MALLOC;
+            }
+
+            unsigned int flags = bind_addr->sa_family;
+#ifdef ATBUS_CHANNEL_UDP_RECVMMSG
+            if (channel->conf.recv_batch > 1) {
+                flags |= UV_UDP_RECVMMSG;
+            }
+#endif
+
+            int res = uv_udp_init_ex(channel->ev_loop, handle, flags);
+            if (0 != res) {
+                delete handle;
+                channel->error_code = res;
+                return EN_ATBUS_ERR_SOCK_BIND_FAILED;
+            }
+
+            sock->addr = addr;
+            sock->handle = handle;
+            sock->family = bind_addr->sa_family;
+            sock->channel = channel;
+            sock->data = NULL;
+            handle->data = sock.get();
+
+            res = uv_udp_bind(handle, bind_addr, 0);
+            if (0 != res) {
+                channel->error_code = res;
+                udp_close_handle(sock.get());
+                return EN_ATBUS_ERR_SOCK_BIND_FAILED;
+            }
+
+            // 内核缓冲区大小只影响突发流量时的丢包，设置失败不影响使用
+            if (channel->conf.sock_send_buffer > 0) {
+                int val = static_cast<int>(channel->conf.sock_send_buffer);
+                uv_send_buffer_size(reinterpret_cast<uv_handle_t *>(handle), &val);
+            }
+            if (channel->conf.sock_recv_buffer > 0) {
+                int val = static_cast<int>(channel->conf.sock_recv_buffer);
+                uv_recv_buffer_size(reinterpret_cast<uv_handle_t *>(handle), &val);
+            }
+
+            res = uv_udp_recv_start(handle, udp_on_alloc_fn, udp_on_recv_fn);
+            if (0 != res) {
+                channel->error_code = res;
+                udp_close_handle(sock.get());
+                return EN_ATBUS_ERR_READ_FAILED;
+            }
+
+            channel->socket_pool.push_back(sock);
+            if (NULL != out) {
+                *out = sock.get();
+            }
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        int udp_listen(udp_channel *channel, const channel_address_t &addr, udp_socket **socket) {
+            if (NULL == channel) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            udp_peer_t bind_addr;
+            int res = udp_make_peer(addr, &bind_addr);
+            if (res < 0) {
+                return res;
+            }
+
+            return udp_open_socket(channel, reinterpret_cast<const sockaddr *>(&bind_addr.addr), addr, socket);
+        }
+
+        int udp_close_socket(udp_channel *channel, udp_socket *socket) {
+            if (NULL == channel || NULL == socket) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            for (udp_channel::socket_pool_t::iterator iter = channel->socket_pool.begin(); iter != channel->socket_pool.end(); ++iter) {
+                if (iter->get() == socket) {
+                    udp_close_handle(socket);
+                    channel->socket_pool.erase(iter);
+                    return EN_ATBUS_ERR_SUCCESS;
+                }
+            }
+
+            return EN_ATBUS_ERR_CONNECTION_NOT_FOUND;
+        }
+
+#if defined(__linux__)
+        static socklen_t udp_peer_len(const udp_peer_t &peer) {
+            return AF_INET6 == peer.addr.ss_family ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+        }
+#endif
+
+        // 发送所有等待中的数据报，内核缓冲区满时剩下的直接丢弃
+        static void udp_flush_socket(udp_socket *sock) {
+            if (sock->send_blocks.empty() || NULL == sock->handle) {
+                sock->send_blocks.clear();
+                sock->send_buffer.clear();
+                return;
+            }
+
+            udp_channel *channel = sock->channel;
+            size_t total = sock->send_blocks.size();
+            size_t sent = 0;
+
+#if defined(__linux__)
+            adapter::fd_t fd;
+            if (0 == uv_fileno(reinterpret_cast<const uv_handle_t *>(sock->handle), &fd)) {
+                mmsghdr msgs[ATBUS_CHANNEL_UDP_SENDMMSG_MAX];
+                iovec iovs[ATBUS_CHANNEL_UDP_SENDMMSG_MAX];
+
+                while (sent < total) {
+                    size_t number = std::min<size_t>(total - sent, ATBUS_CHANNEL_UDP_SENDMMSG_MAX);
+                    memset(msgs, 0, sizeof(mmsghdr) * number);
+                    for (size_t i = 0; i < number; ++i) {
+                        udp_send_block_t &block = sock->send_blocks[sent + i];
+                        iovs[i].iov_base = &sock->send_buffer[block.offset];
+                        iovs[i].iov_len = block.len;
+                        msgs[i].msg_hdr.msg_name = &block.peer.addr;
+                        msgs[i].msg_hdr.msg_namelen = udp_peer_len(block.peer);
+                        msgs[i].msg_hdr.msg_iov = &iovs[i];
+                        msgs[i].msg_hdr.msg_iovlen = 1;
+                    }
+
+                    int res = sendmmsg(fd, msgs, static_cast<unsigned int>(number), 0);
+                    if (res < 0) {
+                        if (EINTR == errno) {
+                            continue;
+                        }
+
+                        channel->error_code = uv_translate_sys_error(errno);
+                        // 内核缓冲区满了，剩下的都丢弃；其他错误只影响第一个数据报
+                        if (EAGAIN == errno || EWOULDBLOCK == errno || ENOBUFS == errno) {
+                            break;
+                        }
+
+                        ++channel->stat.send_drop_times;
+                        ++sent;
+                        continue;
+                    }
+
+                    ++channel->stat.send_batch_times;
+                    for (int i = 0; i < res; ++i) {
+                        ++channel->stat.send_times;
+                        channel->stat.send_size += sock->send_blocks[sent + i].len - ATBUS_CHANNEL_UDP_FRAME_HEAD_SIZE;
+                    }
+                    sent += static_cast<size_t>(res);
+                }
+            }
+#else
+            for (; sent < total; ++sent) {
+                udp_send_block_t &block = sock->send_blocks[sent];
+                uv_buf_t buf = uv_buf_init(&sock->send_buffer[block.offset], static_cast<unsigned int>(block.len));
+                int res = uv_udp_try_send(sock->handle, &buf, 1, reinterpret_cast<const sockaddr *>(&block.peer.addr));
+                ++channel->stat.send_batch_times;
+                if (res < 0) {
+                    channel->error_code = res;
+                    ++channel->stat.send_drop_times;
+                    continue;
+                }
+
+                ++channel->stat.send_times;
+                channel->stat.send_size += block.len - ATBUS_CHANNEL_UDP_FRAME_HEAD_SIZE;
+            }
+#endif
+
+            channel->stat.send_drop_times += total - sent;
+            sock->send_blocks.clear();
+            sock->send_buffer.clear();
+        }
+
+        static void udp_flush_timer_on_timeout(uv_timer_t *handle) {
+            udp_channel *channel = reinterpret_cast<udp_channel *>(handle->data);
+            assert(channel);
+
+            udp_flush(channel);
+        }
+
+        // 在下一次事件循环发送
+        static int udp_flush_timer_start(udp_channel *channel) {
+            if (NULL == channel->flush_timer) {
+                adapter::timer_t *timer = reinterpret_cast<adapter::timer_t *>(malloc(sizeof(adapter::timer_t)));
+                if (NULL == timer) {
+                    return EN_ATBUS_ERR_MALLOC;
+                }
+
+                if (0 != uv_timer_init(channel->ev_loop, timer)) {
+                    free(timer);
+                    return EN_ATBUS_ERR_EV_RUN;
+                }
+
+                timer->data = channel;
+                channel->flush_timer = timer;
+                // 关闭定时器时计数结束，保证udp_close返回前定时器已经释放
+                ATBUS_CHANNEL_REQ_START(channel);
+            }
+
+            if (uv_is_active(reinterpret_cast<uv_handle_t *>(channel->flush_timer))) {
+                return EN_ATBUS_ERR_SUCCESS;
+            }
+
+            if (0 != uv_timer_start(channel->flush_timer, udp_flush_timer_on_timeout, 0, 0)) {
+                return EN_ATBUS_ERR_EV_RUN;
+            }
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        // 绑定到具体地址的socket不一定能发送到目标地址，所以只使用绑定到通配地址的socket
+        static udp_socket *udp_select_socket(udp_channel *channel, int family) {
+            const char *any_host = AF_INET6 == family ? "::" : "0.0.0.0";
+            for (size_t i = 0; i < channel->socket_pool.size(); ++i) {
+                udp_socket *sock = channel->socket_pool[i].get();
+                if (sock->family == family && NULL != sock->handle && sock->addr.host == any_host) {
+                    return sock;
+                }
+            }
+
+            // 没有可用的socket，创建一个绑定随机端口的
+            udp_peer_t any;
+            memset(&any, 0, sizeof(any));
+            channel_address_t addr;
+            if (AF_INET6 == family) {
+                uv_ip6_addr("::", 0, reinterpret_cast<sockaddr_in6 *>(&any.addr));
+                make_address("udp", "::", 0, addr);
+            } else {
+                uv_ip4_addr("0.0.0.0", 0, reinterpret_cast<sockaddr_in *>(&any.addr));
+                make_address("udp", "0.0.0.0", 0, addr);
+            }
+
+            udp_socket *ret = NULL;
+            if (udp_open_socket(channel, reinterpret_cast<const sockaddr *>(&any.addr), addr, &ret) < 0) {
+                return NULL;
+            }
+            return ret;
+        }
+
+        int udp_send(udp_channel *channel, const udp_peer_t *peer, const void *buf, size_t len) {
+            return udp_send_from(channel, NULL, peer, buf, len);
+        }
+
+        int udp_send_from(udp_channel *channel, udp_socket *sock, const udp_peer_t *peer, const void *buf, size_t len) {
+            if (NULL == channel || NULL == peer || (NULL == buf && len > 0)) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            if (len > channel->conf.send_max_size) {
+                return EN_ATBUS_ERR_INVALID_SIZE;
+            }
+
+            if (NULL == sock) {
+                sock = udp_select_socket(channel, peer->addr.ss_family);
+                if (NULL == sock) {
+                    return EN_ATBUS_ERR_NO_LISTEN;
+                }
+            } else if (channel != sock->channel || NULL == sock->handle || sock->family != peer->addr.ss_family) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            udp_send_block_t block;
+            block.offset = sock->send_buffer.size();
+            block.len = len + ATBUS_CHANNEL_UDP_FRAME_HEAD_SIZE;
+            block.peer = *peer;
+
+            sock->send_buffer.resize(block.offset + block.len);
+            char *head = &sock->send_buffer[block.offset];
+            head[0] = static_cast<char>(ATBUS_CHANNEL_UDP_FRAME_VERSION);
+            uint32_t checksum = ::atbus::detail::crc32c(0, reinterpret_cast<const unsigned char *>(buf), len);
+            memcpy(head + 1, &checksum, sizeof(uint32_t));
+            if (len > 0) {
+                memcpy(head + ATBUS_CHANNEL_UDP_FRAME_HEAD_SIZE, buf, len);
+            }
+            sock->send_blocks.push_back(block);
+
+            if (sock->send_blocks.size() >= channel->conf.send_batch) {
+                udp_flush_socket(sock);
+                return EN_ATBUS_ERR_SUCCESS;
+            }
+
+            // 定时器启动失败时立即发送
+            if (udp_flush_timer_start(channel) < 0) {
+                udp_flush_socket(sock);
+            }
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+
+        int udp_flush(udp_channel *channel) {
+            if (NULL == channel) {
+                return EN_ATBUS_ERR_PARAMS;
+            }
+
+            for (size_t i = 0; i < channel->socket_pool.size(); ++i) {
+                udp_flush_socket(channel->socket_pool[i].get());
+            }
+
+            return EN_ATBUS_ERR_SUCCESS;
+        }
+    }
+}
@@ -220,6 +220,15 @@ namespace atbus {
             return EN_ATBUS_ERR_SUCCESS;
         }
 
+        size_t buffer_manager::front_blocks(buffer_block **blocks, size_t max_number, size_t skip_number) {
+            if (NULL == blocks || 0 == max_number || skip_number >= limit_.cost_number_) {
+                return 0;
+            }
+
+            return is_dynamic_mode() ? dynamic_front_blocks(blocks, max_number, skip_number)
+                                     : static_front_blocks(blocks, max_number, skip_number);
+        }
+
         buffer_block *buffer_manager::back() { return is_dynamic_mode() ? dynamic_back() : static_back(); }
 
         int buffer_manager::back(void *&pointer, size_t &nread, size_t &nwrite) {
@@ -338,6 +347,20 @@ namespace atbus {
                 .circle_index_[(static_buffer_.tail_ + static_buffer_.circle_index_.size() - 1) % static_buffer_.circle_index_.size()];
         }
 
+        size_t buffer_manager::static_front_blocks(buffer_block **blocks, size_t max_number, size_t skip_number) {
+            size_t ret = 0;
+            if (static_empty()) {
+                return ret;
+            }
+
+            for (size_t i = (static_buffer_.head_ + skip_number) % static_buffer_.circle_index_.size();
+                 i != static_buffer_.tail_ && ret < max_number; i = (i + 1) % static_buffer_.circle_index_.size()) {
+                blocks[ret++] = static_buffer_.circle_index_[i];
+            }
+
+            return ret;
+        }
+
         int buffer_manager::static_push_back(void *&pointer, size_t s) {
             assert(static_buffer_.circle_index_.size() >= 2);
 
@@ -765,6 +788,20 @@ namespace atbus {
             return dynamic_buffer_.front();
         }
 
+        size_t buffer_manager::dynamic_front_blocks(buffer_block **blocks, size_t max_number, size_t skip_number) {
+            size_t ret = 0;
+            std::list<buffer_block *>::iterator iter = dynamic_buffer_.begin();
+            for (; iter != dynamic_buffer_.end() && skip_number > 0; ++iter) {
+                --skip_number;
+            }
+
+            for (; iter != dynamic_buffer_.end() && ret < max_number; ++iter) {
+                blocks[ret++] = *iter;
+            }
+
+            return ret;
+        }
+
         buffer_block *buffer_manager::dynamic_back() {
             if (dynamic_empty()) {
                 return NULL;
@@ -365,6 +365,442 @@ CASE_TEST(atbus_node_msg, parent_and_child) {
     unit_test_setup_exit(&ev_loop);
 }
 
+// tcp连接在I/O线程中收发数据的父子节点消息测试
+CASE_TEST(atbus_node_msg, parent_and_child_io_loop) {
+    atbus::node::conf_t conf;
+    atbus::node::default_conf(&conf);
+    conf.children_mask = 16;
+    conf.io_loop_number = 2;
+    uv_loop_t ev_loop;
+    uv_loop_init(&ev_loop);
+
+    conf.ev_loop = &ev_loop;
+
+    {
+        atbus::node::ptr_t node_parent = atbus::node::create();
+        atbus::node::ptr_t node_child = atbus::node::create();
+        node_parent->on_debug = node_msg_test_on_debug;
+        node_child->on_debug = node_msg_test_on_debug;
+        node_parent->set_on_error_handle(node_msg_test_on_error);
+        node_child->set_on_error_handle(node_msg_test_on_error);
+
+        // 发送延迟统计在I/O线程中，不能一起使用
+        conf.flags.set(atbus::node::conf_flag_t::EN_CONF_LATENCY_STAT, true);
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_PARAMS, node_parent->init(0x12345678, &conf));
+        conf.flags.set(atbus::node::conf_flag_t::EN_CONF_LATENCY_STAT, false);
+
+        node_parent->init(0x12345678, &conf);
+
+        conf.children_mask = 8;
+        conf.father_address = "ipv4://127.0.0.1:16387";
+        node_child->init(0x12346789, &conf);
+
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_parent->listen("ipv4://127.0.0.1:16387"));
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_child->listen("ipv4://127.0.0.1:16388"));
+
+        CASE_EXPECT_NE(NULL, node_parent->get_iostream_shards());
+        CASE_EXPECT_NE(NULL, node_child->get_iostream_shards());
+        if (NULL != node_parent->get_iostream_shards()) {
+            CASE_EXPECT_EQ(2, node_parent->get_iostream_shards()->workers.size());
+        }
+
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_parent->start());
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_child->start());
+
+        time_t proc_t = time(NULL) + 1;
+
+        UNITTEST_WAIT_UNTIL(conf.ev_loop, node_child->is_endpoint_available(node_parent->get_id()) &&
+                                              node_parent->is_endpoint_available(node_child->get_id()),
+                            8000, 64) {
+            node_parent->proc(proc_t, 0);
+            node_child->proc(proc_t, 0);
+            ++proc_t;
+        }
+
+        node_child->set_on_recv_handle(node_msg_test_recv_msg_test_record_fn);
+        node_parent->set_on_recv_handle(node_msg_test_recv_msg_test_record_fn);
+
+        int count = recv_msg_history.count;
+
+        // 发消息啦 -  parent to child
+        {
+            std::string send_data;
+            send_data.assign("parent to child\0hello world!\n", sizeof("parent to child\0hello world!\n") - 1);
+
+            node_parent->send_data(node_child->get_id(), 0, send_data.data(), send_data.size());
+            UNITTEST_WAIT_UNTIL(conf.ev_loop, count != recv_msg_history.count, 3000, 0) {}
+
+            CASE_EXPECT_EQ(send_data, recv_msg_history.data);
+        }
+
+        // 发消息啦 - child to parent
+        {
+            std::string send_data;
+            send_data.assign("child to parent\0hello world!\n", sizeof("child to parent\0hello world!\n") - 1);
+
+            count = recv_msg_history.count;
+            node_child->send_data(node_parent->get_id(), 0, send_data.data(), send_data.size());
+            UNITTEST_WAIT_UNTIL(conf.ev_loop, count != recv_msg_history.count, 3000, 0) {}
+
+            CASE_EXPECT_EQ(send_data, recv_msg_history.data);
+        }
+
+        // I/O线程中的连接也可以暂停读取
+        {
+            CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_parent->pause_read(node_child->get_id()));
+            UNITTEST_WAIT_UNTIL(conf.ev_loop, false, 64, 0) {}
+
+            std::string send_data;
+            send_data.assign("child to parent\0hello pause!\n", sizeof("child to parent\0hello pause!\n") - 1);
+
+            count = recv_msg_history.count;
+            node_child->send_data(node_parent->get_id(), 0, send_data.data(), send_data.size());
+            UNITTEST_WAIT_UNTIL(conf.ev_loop, count != recv_msg_history.count, 200, 0) {}
+            CASE_EXPECT_EQ(count, recv_msg_history.count);
+
+            CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_parent->resume_read(node_child->get_id()));
+            UNITTEST_WAIT_UNTIL(conf.ev_loop, count != recv_msg_history.count, 3000, 0) {}
+            CASE_EXPECT_EQ(send_data, recv_msg_history.data);
+        }
+
+        // 数据连接的统计在逻辑线程中
+        atbus::endpoint *ep = node_parent->get_endpoint(node_child->get_id());
+        CASE_EXPECT_NE(NULL, ep);
+        if (NULL != ep) {
+            const atbus::connection *conn = node_parent->get_self_endpoint()->get_data_connection(ep, false);
+            CASE_EXPECT_NE(NULL, conn);
+            if (NULL != conn) {
+                CASE_EXPECT_LT(0, conn->get_statistic().push_success_times);
+                CASE_EXPECT_LT(0, conn->get_statistic().pull_times);
+            }
+        }
+    }
+
+    unit_test_setup_exit(&ev_loop);
+}
+
+#ifdef ATBUS_CHANNEL_SHM_FD
+static bool node_msg_test_has_shm_conn(atbus::node &n, atbus::node::bus_id_t tid) {
+    atbus::endpoint *ep = n.get_endpoint(tid);
+    if (NULL == ep) {
+        return false;
+    }
+
+    const atbus::connection *conn = n.get_self_endpoint()->get_data_connection(ep, false);
+    return NULL != conn && conn->check_flag(atbus::connection::flag_t::ACCESS_SHARE_HOST);
+}
+
+// 同机的unix socket连接升级为匿名共享内存通道测试
+CASE_TEST(atbus_node_msg, parent_and_child_shm_fd) {
+    atbus::node::conf_t conf;
+    atbus::node::default_conf(&conf);
+    conf.children_mask = 16;
+    conf.shm_upgrade_size = ATBUS_MACRO_MSG_LIMIT * 32; // 默认不升级
+    uv_loop_t ev_loop;
+    uv_loop_init(&ev_loop);
+
+    conf.ev_loop = &ev_loop;
+
+    {
+        atbus::node::ptr_t node_parent = atbus::node::create();
+        atbus::node::ptr_t node_child = atbus::node::create();
+        node_parent->on_debug = node_msg_test_on_debug;
+        node_child->on_debug = node_msg_test_on_debug;
+        node_parent->set_on_error_handle(node_msg_test_on_error);
+        node_child->set_on_error_handle(node_msg_test_on_error);
+
+        node_parent->init(0x12345678, &conf);
+
+        conf.children_mask = 8;
+        conf.father_address = "unix://atbus-unit-test-shm-fd-parent.sock";
+        node_child->init(0x12346789, &conf);
+
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_parent->listen("unix://atbus-unit-test-shm-fd-parent.sock"));
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_child->listen("unix://atbus-unit-test-shm-fd-child.sock"));
+
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_parent->start());
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_child->start());
+
+        time_t proc_t = time(NULL) + 1;
+
+        // 注册完成后发起连接的一端会创建共享内存通道并把描述符发给对端
+        UNITTEST_WAIT_UNTIL(conf.ev_loop, node_msg_test_has_shm_conn(*node_parent, node_child->get_id()) &&
+                                              node_msg_test_has_shm_conn(*node_child, node_parent->get_id()),
+                            8000, 64) {
+            node_parent->proc(proc_t, 0);
+            node_child->proc(proc_t, 0);
+            ++proc_t;
+        }
+        CASE_EXPECT_TRUE(node_msg_test_has_shm_conn(*node_parent, node_child->get_id()));
+        CASE_EXPECT_TRUE(node_msg_test_has_shm_conn(*node_child, node_parent->get_id()));
+
+        node_child->set_on_recv_handle(node_msg_test_recv_msg_test_record_fn);
+        node_parent->set_on_recv_handle(node_msg_test_recv_msg_test_record_fn);
+
+        // 发消息啦 -  parent to child
+        {
+            std::string send_data;
+            send_data.assign("parent to child\0hello shm!\n", sizeof("parent to child\0hello shm!\n") - 1);
+
+            int count = recv_msg_history.count;
+            CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_parent->send_data(node_child->get_id(), 0, send_data.data(), send_data.size()));
+            UNITTEST_WAIT_UNTIL(conf.ev_loop, count != recv_msg_history.count, 3000, 8) {
+                node_parent->proc(proc_t, 0);
+                node_child->proc(proc_t, 0);
+            }
+
+            CASE_EXPECT_EQ(send_data, recv_msg_history.data);
+            CASE_EXPECT_TRUE(NULL != recv_msg_history.conn &&
+                             recv_msg_history.conn->check_flag(atbus::connection::flag_t::ACCESS_SHARE_HOST));
+        }
+
+        // 发消息啦 - child to parent
+        {
+            std::string send_data;
+            send_data.assign("child to parent\0hello shm!\n", sizeof("child to parent\0hello shm!\n") - 1);
+
+            int count = recv_msg_history.count;
+            CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_child->send_data(node_parent->get_id(), 0, send_data.data(), send_data.size()));
+            UNITTEST_WAIT_UNTIL(conf.ev_loop, count != recv_msg_history.count, 3000, 8) {
+                node_parent->proc(proc_t, 0);
+                node_child->proc(proc_t, 0);
+            }
+
+            CASE_EXPECT_EQ(send_data, recv_msg_history.data);
+            CASE_EXPECT_TRUE(NULL != recv_msg_history.conn &&
+                             recv_msg_history.conn->check_flag(atbus::connection::flag_t::ACCESS_SHARE_HOST));
+        }
+    }
+
+    unit_test_setup_exit(&ev_loop);
+}
+#endif
+
+// 暂停读取后消息留在对端，恢复后才收到
+CASE_TEST(atbus_node_msg, parent_and_child_pause_read) {
+    atbus::node::conf_t conf;
+    atbus::node::default_conf(&conf);
+    conf.children_mask = 16;
+    uv_loop_t ev_loop;
+    uv_loop_init(&ev_loop);
+
+    conf.ev_loop = &ev_loop;
+
+    {
+        atbus::node::ptr_t node_parent = atbus::node::create();
+        atbus::node::ptr_t node_child = atbus::node::create();
+        node_parent->on_debug = node_msg_test_on_debug;
+        node_child->on_debug = node_msg_test_on_debug;
+        node_parent->set_on_error_handle(node_msg_test_on_error);
+        node_child->set_on_error_handle(node_msg_test_on_error);
+
+        node_parent->init(0x12345678, &conf);
+
+        conf.children_mask = 8;
+        conf.father_address = "ipv4://127.0.0.1:16387";
+        node_child->init(0x12346789, &conf);
+
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_parent->listen("ipv4://127.0.0.1:16387"));
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_child->listen("ipv4://127.0.0.1:16388"));
+
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_parent->start());
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_child->start());
+
+        time_t proc_t = time(NULL) + 1;
+
+        UNITTEST_WAIT_UNTIL(conf.ev_loop, node_child->is_endpoint_available(node_parent->get_id()) &&
+                                              node_parent->is_endpoint_available(node_child->get_id()),
+                            8000, 64) {
+            node_parent->proc(proc_t, 0);
+            node_child->proc(proc_t, 0);
+            ++proc_t;
+        }
+
+        node_child->set_on_recv_handle(node_msg_test_recv_msg_test_record_fn);
+        node_parent->set_on_recv_handle(node_msg_test_recv_msg_test_record_fn);
+
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_ATNODE_NOT_FOUND, node_parent->pause_read(0x12356789));
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_parent->pause_read(node_child->get_id()));
+        CASE_EXPECT_TRUE(node_parent->get_endpoint(node_child->get_id())->get_flag(atbus::endpoint::flag_t::READ_PAUSED));
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_PARAMS,
+                       node_parent->get_endpoint(node_child->get_id())->set_flag(atbus::endpoint::flag_t::READ_PAUSED, false));
+
+        std::string send_data;
+        send_data.assign("child to parent\0hello pause!\n", sizeof("child to parent\0hello pause!\n") - 1);
+
+        int count = recv_msg_history.count;
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_child->send_data(node_parent->get_id(), 0, send_data.data(), send_data.size()));
+        UNITTEST_WAIT_UNTIL(conf.ev_loop, count != recv_msg_history.count, 200, 0) {}
+        CASE_EXPECT_EQ(count, recv_msg_history.count);
+
+        // 控制连接不暂停，暂停期间ping仍然能收到回包
+        atbus::endpoint *child_ep = node_parent->get_endpoint(node_child->get_id());
+        CASE_EXPECT_EQ(0, child_ep->get_stat_last_pong());
+        proc_t += conf.ping_interval;
+        UNITTEST_WAIT_UNTIL(conf.ev_loop, !node_parent->is_endpoint_available(node_child->get_id()) || child_ep->get_stat_last_pong() > 0,
+                            8000, 32) {
+            ++proc_t;
+            node_parent->proc(proc_t, 0);
+            node_child->proc(proc_t, 0);
+        }
+        CASE_EXPECT_TRUE(node_parent->is_endpoint_available(node_child->get_id()));
+        CASE_EXPECT_EQ(count, recv_msg_history.count);
+
+        if (node_parent->is_endpoint_available(node_child->get_id())) {
+            CASE_EXPECT_GT(child_ep->get_stat_last_pong(), 0);
+
+            CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_parent->resume_read(node_child->get_id()));
+            CASE_EXPECT_FALSE(child_ep->get_flag(atbus::endpoint::flag_t::READ_PAUSED));
+            UNITTEST_WAIT_UNTIL(conf.ev_loop, count != recv_msg_history.count, 3000, 0) {}
+
+            CASE_EXPECT_EQ(send_data, recv_msg_history.data);
+        }
+    }
+
+    unit_test_setup_exit(&ev_loop);
+}
+
+// 只有控制连接时没有可以暂停的连接，暂停失败并且不修改状态
+CASE_TEST(atbus_node_msg, pause_read_ctrl_only) {
+    atbus::node::conf_t conf;
+    atbus::node::default_conf(&conf);
+    conf.children_mask = 16;
+    uv_loop_t ev_loop;
+    uv_loop_init(&ev_loop);
+
+    conf.ev_loop = &ev_loop;
+
+    {
+        atbus::node::ptr_t node = atbus::node::create();
+        node->on_debug = node_msg_test_on_debug;
+        node->set_on_error_handle(node_msg_test_on_error);
+        node->init(0x12345678, &conf);
+
+        atbus::connection::ptr_t conn = atbus::connection::create(node.get());
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, conn->connect("ipv4://127.0.0.1:16399"));
+
+        atbus::endpoint::ptr_t ep = atbus::endpoint::create(node.get(), 0x12345679, 8, node->get_pid(), node->get_hostname());
+        CASE_EXPECT_TRUE(ep->add_connection(conn.get(), false));
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node->add_endpoint(ep));
+
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_ATNODE_NO_CONNECTION, node->pause_read(ep->get_id()));
+        CASE_EXPECT_FALSE(ep->get_flag(atbus::endpoint::flag_t::READ_PAUSED));
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node->resume_read(ep->get_id()));
+    }
+
+    unit_test_setup_exit(&ev_loop);
+}
+
+CASE_TEST(atbus_node_msg, parent_and_child_udp) {
+    atbus::node::conf_t conf;
+    atbus::node::default_conf(&conf);
+    conf.children_mask = 16;
+    uv_loop_t ev_loop;
+    uv_loop_init(&ev_loop);
+
+    conf.ev_loop = &ev_loop;
+
+    {
+        atbus::node::ptr_t node_parent = atbus::node::create();
+        atbus::node::ptr_t node_child = atbus::node::create();
+        node_parent->on_debug = node_msg_test_on_debug;
+        node_child->on_debug = node_msg_test_on_debug;
+        node_parent->set_on_error_handle(node_msg_test_on_error);
+        node_child->set_on_error_handle(node_msg_test_on_error);
+
+        node_parent->init(0x12345678, &conf);
+
+        conf.children_mask = 8;
+        conf.father_address = "ipv4://127.0.0.1:16387";
+        node_child->init(0x12346789, &conf);
+
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_parent->listen("ipv4://127.0.0.1:16387"));
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_child->listen("ipv4://127.0.0.1:16388"));
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_child->listen("udp://127.0.0.1:16397"));
+        // 接收端只接受从注册的udp地址发出的数据报，所以发送端也要监听
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_parent->listen("udp://127.0.0.1:16398"));
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_ACCESS_DENY, node_parent->connect("udp://127.0.0.1:16397"));
+
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_parent->start());
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node_child->start());
+
+        time_t proc_t = time(NULL) + 1;
+
+        UNITTEST_WAIT_UNTIL(conf.ev_loop, node_child->is_endpoint_available(node_parent->get_id()) &&
+                                              node_parent->is_endpoint_available(node_child->get_id()),
+                            8000, 64) {
+            node_parent->proc(proc_t, 0);
+            node_child->proc(proc_t, 0);
+            ++proc_t;
+        }
+
+        node_child->set_on_recv_handle(node_msg_test_recv_msg_test_record_fn);
+
+        // 收到注册消息的父节点连接子节点的udp地址
+        atbus::endpoint *ep = node_parent->get_endpoint(node_child->get_id());
+        CASE_EXPECT_NE(NULL, ep);
+        if (NULL == ep) {
+            return;
+        }
+        atbus::connection *conn = node_parent->get_self_endpoint()->get_unreliable_connection(ep);
+        CASE_EXPECT_NE(NULL, conn);
+        if (NULL == conn) {
+            return;
+        }
+        CASE_EXPECT_TRUE(conn->check_flag(atbus::connection::flag_t::UNRELIABLE));
+        CASE_EXPECT_NE(conn, node_parent->get_self_endpoint()->get_data_connection(ep));
+
+        std::string send_data;
+        send_data.assign("parent to child\0hello udp!\n", sizeof("parent to child\0hello udp!\n") - 1);
+
+        int count = recv_msg_history.count;
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS,
+                       node_parent->send_data_unreliable(node_child->get_id(), 0, send_data.data(), send_data.size()));
+        UNITTEST_WAIT_UNTIL(conf.ev_loop, count != recv_msg_history.count, 3000, 0) {}
+
+        CASE_EXPECT_EQ(send_data, recv_msg_history.data);
+        CASE_EXPECT_EQ(1, conn->get_statistic().push_success_times);
+
+        // 冒充父节点但是来源不是父节点注册的udp地址，丢弃
+        {
+            atbus::protocol::msg m;
+            m.init(node_parent->get_id(), ATBUS_CMD_DATA_TRANSFORM_REQ, 0, 0, 1);
+            CASE_EXPECT_NE(NULL, m.body.make_body(m.body.forward));
+            m.body.forward->from = node_parent->get_id();
+            m.body.forward->to = node_child->get_id();
+            m.body.forward->content.ptr = send_data.data();
+            m.body.forward->content.size = send_data.size();
+
+            msgpack::sbuffer packed_buffer;
+            msgpack::pack(packed_buffer, m);
+
+            atbus::channel::udp_channel fake;
+            atbus::channel::udp_init(&fake, &ev_loop, NULL);
+            atbus::channel::channel_address_t addr;
+            atbus::channel::udp_peer_t peer;
+            atbus::channel::make_address("udp://127.0.0.1:16397", addr);
+            CASE_EXPECT_EQ(0, atbus::channel::udp_make_peer(addr, &peer));
+
+            count = recv_msg_history.count;
+            size_t recv_times = node_child->get_udp_channel()->stat.recv_times;
+            CASE_EXPECT_EQ(0, atbus::channel::udp_send(&fake, &peer, packed_buffer.data(), packed_buffer.size()));
+            CASE_EXPECT_EQ(0, atbus::channel::udp_flush(&fake));
+            UNITTEST_WAIT_UNTIL(conf.ev_loop, recv_times != node_child->get_udp_channel()->stat.recv_times, 3000, 0) {}
+
+            CASE_EXPECT_EQ(recv_times + 1, node_child->get_udp_channel()->stat.recv_times);
+            CASE_EXPECT_EQ(count, recv_msg_history.count);
+            atbus::channel::udp_close(&fake);
+        }
+
+        // 超过单个数据报的长度限制
+        std::string big_data(conf.udp_msg_size, 'u');
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_INVALID_SIZE,
+                       node_parent->send_data_unreliable(node_child->get_id(), 0, big_data.data(), big_data.size()));
+    }
+
+    unit_test_setup_exit(&ev_loop);
+}
+
 // 兄弟节点通过父节点转发消息并建立直连测试（测试路由）
 CASE_TEST(atbus_node_msg, transfer_and_connect) {
     atbus::node::conf_t conf;
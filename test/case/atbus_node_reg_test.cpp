@@ -3,6 +3,7 @@
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <vector>
 
 #include "common/string_oprs.h"
 
@@ -284,6 +285,82 @@ CASE_TEST(atbus_node_reg, destruct) {
     unit_test_setup_exit(&ev_loop);
 }
 
+static void node_reg_test_stuck_peer_on_connect(uv_connect_t *req, int status) {
+    CASE_EXPECT_EQ(0, status);
+    *reinterpret_cast<int *>(req->data) = 0 == status ? 1 : -1;
+}
+
+// 对端一直不读取数据时reset也要在close_timeout后返回
+CASE_TEST(atbus_node_reg, reset_with_stuck_peer) {
+    atbus::node::conf_t conf;
+    atbus::node::default_conf(&conf);
+    conf.children_mask = 16;
+    conf.close_timeout = 200;
+    conf.send_buffer_size = 64 * ATBUS_MACRO_MSG_LIMIT;
+    conf.sock_send_buffer = 16 * 1024;
+    uv_loop_t ev_loop;
+    uv_loop_init(&ev_loop);
+
+    conf.ev_loop = &ev_loop;
+
+    {
+        atbus::node::ptr_t node1 = atbus::node::create();
+        node1->on_debug = node_reg_test_on_debug;
+        node1->set_on_error_handle(node_reg_test_on_error);
+        node1->init(0x12345678, &conf);
+
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node1->listen("ipv4://127.0.0.1:16387"));
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, node1->start());
+
+        // 只连接，永远不读取数据的对端
+        uv_tcp_t stuck_peer;
+        uv_connect_t connect_req;
+        int connect_status = 0;
+        sockaddr_in peer_addr;
+        uv_tcp_init(&ev_loop, &stuck_peer);
+        uv_ip4_addr("127.0.0.1", 16387, &peer_addr);
+        connect_req.data = &connect_status;
+        CASE_EXPECT_EQ(0, uv_tcp_connect(&connect_req, &stuck_peer, reinterpret_cast<const sockaddr *>(&peer_addr),
+                                         node_reg_test_stuck_peer_on_connect));
+
+        atbus::channel::io_stream_channel *channel = node1->get_iostream_channel();
+        UNITTEST_WAIT_UNTIL(conf.ev_loop, 0 != connect_status && NULL != channel && 2 == channel->conn_pool.size(), 8000, 0) {}
+        CASE_EXPECT_EQ(1, connect_status);
+
+        // 写满socket缓冲区，剩下的数据堆积在连接的发送缓冲区里
+        atbus::channel::io_stream_connection *stuck_conn = NULL;
+        for (atbus::channel::io_stream_channel::conn_pool_t::iterator iter = channel->conn_pool.begin();
+             iter != channel->conn_pool.end(); ++iter) {
+            if (ATBUS_CHANNEL_IOS_CHECK_FLAG(iter->second->flags, atbus::channel::io_stream_connection::EN_CF_ACCEPT)) {
+                stuck_conn = iter->second.get();
+            }
+        }
+        CASE_EXPECT_NE(NULL, stuck_conn);
+
+        std::vector<char> send_data(ATBUS_MACRO_MSG_LIMIT / 2, 'A');
+        for (int i = 0; NULL != stuck_conn && i < 256 && stuck_conn->write_buffers.limit().cost_size_ < 4 * ATBUS_MACRO_MSG_LIMIT;
+             ++i) {
+            if (0 != atbus::channel::io_stream_send(stuck_conn, &send_data[0], send_data.size())) {
+                break;
+            }
+            uv_run(&ev_loop, UV_RUN_NOWAIT);
+        }
+        CASE_EXPECT_TRUE(NULL != stuck_conn && !stuck_conn->write_buffers.empty());
+
+        uint64_t begin_ms = uv_now(&ev_loop);
+        node1->reset();
+        uv_update_time(&ev_loop);
+        uint64_t cost_ms = uv_now(&ev_loop) - begin_ms;
+        CASE_MSG_INFO() << "reset with a stuck peer cost " << cost_ms << "ms" << std::endl;
+        CASE_EXPECT_GE(cost_ms + 10, static_cast<uint64_t>(conf.close_timeout));
+        CASE_EXPECT_LT(cost_ms, 10 * static_cast<uint64_t>(conf.close_timeout));
+
+        uv_close(reinterpret_cast<uv_handle_t *>(&stuck_peer), NULL);
+    }
+
+    unit_test_setup_exit(&ev_loop);
+}
+
 // 注册成功流程测试
 CASE_TEST(atbus_node_reg, reg_success) {
     atbus::node::conf_t conf;
@@ -1125,3 +1125,67 @@ CASE_TEST(buffer, static_buffer_manager_merge_front)
         CHECK_BUFFER(mgr.front()->raw_data(), sr, 0xea);
     }
 }
+
+CASE_TEST(buffer, buffer_manager_front_blocks)
+{
+    // dynamic mode
+    {
+        atbus::detail::buffer_manager mgr;
+        atbus::detail::buffer_block* blocks[4] = { NULL };
+        CASE_EXPECT_EQ(0, mgr.front_blocks(blocks, 4));
+
+        void* check_ptr[3];
+        for (int i = 0; i < 3; ++ i) {
+            CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, mgr.push_back(check_ptr[i], 16 * (i + 1)));
+        }
+
+        CASE_EXPECT_EQ(0, mgr.front_blocks(blocks, 0));
+        CASE_EXPECT_EQ(2, mgr.front_blocks(blocks, 2));
+        CASE_EXPECT_EQ(mgr.front(), blocks[0]);
+        CASE_EXPECT_EQ(check_ptr[1], blocks[1]->data());
+
+        CASE_EXPECT_EQ(3, mgr.front_blocks(blocks, 4));
+        for (int i = 0; i < 3; ++ i) {
+            CASE_EXPECT_EQ(check_ptr[i], blocks[i]->data());
+            CASE_EXPECT_EQ(16 * (i + 1), blocks[i]->size());
+        }
+
+        // skip blocks
+        CASE_EXPECT_EQ(2, mgr.front_blocks(blocks, 4, 1));
+        CASE_EXPECT_EQ(check_ptr[1], blocks[0]->data());
+        CASE_EXPECT_EQ(check_ptr[2], blocks[1]->data());
+        CASE_EXPECT_EQ(0, mgr.front_blocks(blocks, 4, 3));
+    }
+
+    // static mode, blocks are not continuous after the circle buffer turns around
+    {
+        atbus::detail::buffer_manager mgr;
+        mgr.set_mode(1023, 10);
+        atbus::detail::buffer_block* blocks[4] = { NULL };
+        CASE_EXPECT_EQ(0, mgr.front_blocks(blocks, 4));
+
+        void* check_ptr[3];
+        size_t s = 256 - atbus::detail::buffer_block::head_size(256);
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, mgr.push_back(check_ptr[0], s));
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, mgr.push_back(check_ptr[0], s));
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, mgr.push_back(check_ptr[0], s));
+        mgr.pop_front(s);
+        mgr.pop_front(s);
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, mgr.push_back(check_ptr[1], s));
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SUCCESS, mgr.push_back(check_ptr[2], s));
+
+        CASE_EXPECT_EQ(3, mgr.front_blocks(blocks, 4));
+        CASE_EXPECT_EQ(mgr.front(), blocks[0]);
+        CASE_EXPECT_EQ(mgr.back(), blocks[2]);
+        for (int i = 0; i < 3; ++ i) {
+            CASE_EXPECT_EQ(check_ptr[i], blocks[i]->data());
+        }
+        CASE_EXPECT_TRUE(check_ptr[1] > check_ptr[0]);
+        CASE_EXPECT_TRUE(check_ptr[2] < check_ptr[0]);
+
+        // skip blocks across the bound of circle buffer
+        CASE_EXPECT_EQ(1, mgr.front_blocks(blocks, 4, 2));
+        CASE_EXPECT_EQ(check_ptr[2], blocks[0]->data());
+        CASE_EXPECT_EQ(0, mgr.front_blocks(blocks, 4, 3));
+    }
+}
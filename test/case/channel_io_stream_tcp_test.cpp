@@ -9,6 +9,11 @@
 #include <map>
 #include <memory>
 
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
 
 #include "detail/libatbus_channel_export.h"
 #include "frame/test_macros.h"
@@ -263,6 +268,1684 @@ CASE_TEST(channel, io_stream_tcp_basic) {
     uv_loop_close(&loop);
 }
 
+static std::pair<size_t, size_t> g_written_rec = std::make_pair(0, 0);
+static std::pair<size_t, size_t> g_written_batch_rec = std::make_pair(0, 0);
+static void written_callback_check_fn(atbus::channel::io_stream_channel *channel,       // 事件触发的channel
+                                      atbus::channel::io_stream_connection *connection, // 事件触发的连接
+                                      int status,                                       // libuv传入的转态码
+                                      void *input,                                      // 额外参数(不同事件不同含义)
+                                      size_t s                                          // 额外参数长度
+                                      ) {
+    CASE_EXPECT_EQ(0, status);
+    CASE_EXPECT_NE(NULL, input);
+    ++g_written_rec.first;
+    g_written_rec.second += s;
+}
+
+static void written_batch_callback_check_fn(atbus::channel::io_stream_channel *channel,       // 事件触发的channel
+                                            atbus::channel::io_stream_connection *connection, // 事件触发的连接
+                                            int status,                                       // libuv传入的转态码
+                                            void *input,                                      // 额外参数(不同事件不同含义)
+                                            size_t s                                          // 额外参数长度
+                                            ) {
+    CASE_EXPECT_EQ(0, status);
+    CASE_EXPECT_NE(NULL, input);
+    CASE_EXPECT_EQ(sizeof(atbus::channel::io_stream_write_stat_t), s);
+
+    atbus::channel::io_stream_write_stat_t *stat = reinterpret_cast<atbus::channel::io_stream_write_stat_t *>(input);
+    CASE_EXPECT_GT(stat->frame_number, 0);
+    g_written_batch_rec.first += stat->frame_number;
+    g_written_batch_rec.second += stat->data_size;
+}
+
+CASE_TEST(channel, io_stream_tcp_written_batch) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, NULL);
+    atbus::channel::io_stream_init(&cli, &loop, NULL);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    inited_fds = setup_channel(cli, NULL, "ipv4://127.0.0.1:16387");
+    int check_flag = g_check_flag;
+    while (g_check_flag - check_flag < 2 * inited_fds) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_callback_check_fn;
+    cli.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_WRITEN] = written_callback_check_fn;
+    cli.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_WRITEN_BATCH] = written_batch_callback_check_fn;
+    char *buf = get_test_buffer();
+
+    g_written_rec = std::make_pair(0, 0);
+    g_written_batch_rec = std::make_pair(0, 0);
+    g_recv_rec = std::make_pair(0, 0);
+    check_flag = g_check_flag;
+    size_t sum_size = 0;
+    for (int i = 0; i < 256; ++i) {
+        size_t s = static_cast<size_t>(rand() % 2048);
+        size_t l = (0 == i % 16) ? static_cast<size_t>(rand() % 10240) + 20 * 1024 : static_cast<size_t>(rand() % 256) + 1;
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(cli.conn_pool.begin()->second.get(), buf + s, l));
+        g_check_buff_sequence.push_back(std::make_pair(s, l));
+        sum_size += l;
+    }
+
+    while (g_check_flag - check_flag < 256 || g_written_batch_rec.first < 256) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    CASE_EXPECT_EQ(256, g_written_rec.first);
+    CASE_EXPECT_EQ(sum_size, g_written_rec.second);
+    CASE_EXPECT_EQ(256, g_written_batch_rec.first);
+    CASE_EXPECT_EQ(sum_size, g_written_batch_rec.second);
+    CASE_EXPECT_EQ(sum_size, g_recv_rec.second);
+
+    atbus::channel::io_stream_close(&svr);
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+static size_t g_recv_batch_times = 0;
+static void recv_batch_callback_check_fn(atbus::channel::io_stream_channel *channel,       // 事件触发的channel
+                                         atbus::channel::io_stream_connection *connection, // 事件触发的连接
+                                         int status,                                       // libuv传入的转态码
+                                         void *input,                                      // 额外参数(不同事件不同含义)
+                                         size_t s                                          // 额外参数长度
+                                         ) {
+    CASE_EXPECT_EQ(0, status);
+    CASE_EXPECT_NE(NULL, input);
+    CASE_EXPECT_GT(s, 0);
+    CASE_EXPECT_LE(s, ATBUS_MACRO_IOS_RECV_BATCH_NUMBER);
+
+    ++g_recv_batch_times;
+    atbus::channel::io_stream_recv_msg_t *msgs = reinterpret_cast<atbus::channel::io_stream_recv_msg_t *>(input);
+    for (size_t i = 0; i < s; ++i) {
+        CASE_EXPECT_EQ(0, msgs[i].errcode);
+        recv_callback_check_fn(channel, connection, msgs[i].errcode, msgs[i].data, msgs[i].size);
+    }
+}
+
+CASE_TEST(channel, io_stream_tcp_recv_batch) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, NULL);
+    atbus::channel::io_stream_init(&cli, &loop, NULL);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    inited_fds = setup_channel(cli, NULL, "ipv4://127.0.0.1:16387");
+    int check_flag = g_check_flag;
+    while (g_check_flag - check_flag < 2 * inited_fds) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    // EN_FN_RECVED will not be called when EN_FN_RECVED_BATCH is set
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_callback_check_fn;
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED_BATCH] = recv_batch_callback_check_fn;
+    char *buf = get_test_buffer();
+
+    g_recv_rec = std::make_pair(0, 0);
+    g_recv_batch_times = 0;
+    check_flag = g_check_flag;
+    size_t sum_size = 0;
+    for (int i = 0; i < 512; ++i) {
+        size_t s = static_cast<size_t>(rand() % 2048);
+        size_t l = (0 == i % 64) ? static_cast<size_t>(rand() % 10240) + 20 * 1024 : static_cast<size_t>(rand() % 64) + 1;
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(cli.conn_pool.begin()->second.get(), buf + s, l));
+        g_check_buff_sequence.push_back(std::make_pair(s, l));
+        sum_size += l;
+    }
+
+    while (g_check_flag - check_flag < 512) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    CASE_EXPECT_EQ(512, g_recv_rec.first);
+    CASE_EXPECT_EQ(sum_size, g_recv_rec.second);
+    CASE_EXPECT_LT(g_recv_batch_times, 512);
+    CASE_MSG_INFO() << "recv " << g_recv_rec.first << " packages in " << g_recv_batch_times << " batches." << std::endl;
+
+    atbus::channel::io_stream_close(&svr);
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+
+CASE_TEST(channel, io_stream_tcp_checksum) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, NULL);
+    atbus::channel::io_stream_init(&cli, &loop, NULL);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    inited_fds = setup_channel(cli, NULL, "ipv4://127.0.0.1:16387");
+    int check_flag = g_check_flag;
+    while (g_check_flag - check_flag < 2 * inited_fds) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_callback_check_fn;
+    char *buf = get_test_buffer();
+    atbus::channel::io_stream_connection *conn = cli.conn_pool.begin()->second.get();
+
+    // legacy format at first, and then switch to each checksum type with both small and big messages
+    int checksum_types[] = {atbus::channel::io_stream_checksum_t::EN_CS_LEGACY, atbus::channel::io_stream_checksum_t::EN_CS_CRC32C,
+                            atbus::channel::io_stream_checksum_t::EN_CS_NONE, atbus::channel::io_stream_checksum_t::EN_CS_MURMUR3,
+                            atbus::channel::io_stream_checksum_t::EN_CS_CRC32C};
+    g_recv_rec = std::make_pair(0, 0);
+    check_flag = g_check_flag;
+    size_t sum_size = 0;
+    for (size_t i = 0; i < sizeof(checksum_types) / sizeof(checksum_types[0]); ++i) {
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_set_checksum(conn, checksum_types[i]));
+        CASE_EXPECT_EQ(checksum_types[i], conn->send_checksum);
+
+        for (int j = 0; j < 32; ++j) {
+            size_t s = static_cast<size_t>(rand() % 2048);
+            size_t l = (0 == j % 8) ? static_cast<size_t>(rand() % 10240) + 20 * 1024 : static_cast<size_t>(rand() % 64) + 1;
+            CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(conn, buf + s, l));
+            g_check_buff_sequence.push_back(std::make_pair(s, l));
+            sum_size += l;
+        }
+    }
+
+    // can not switch back to legacy format
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_PARAMS, atbus::channel::io_stream_set_checksum(conn, atbus::channel::io_stream_checksum_t::EN_CS_LEGACY));
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_PARAMS, atbus::channel::io_stream_set_checksum(conn, atbus::channel::io_stream_checksum_t::EN_CS_MAX));
+
+    while (g_check_flag - check_flag < 32 * 5) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    CASE_EXPECT_EQ(32 * 5, g_recv_rec.first);
+    CASE_EXPECT_EQ(sum_size, g_recv_rec.second);
+    for (atbus::channel::io_stream_channel::conn_pool_t::iterator it = svr.conn_pool.begin(); it != svr.conn_pool.end(); ++it) {
+        if (ATBUS_CHANNEL_IOS_CHECK_FLAG(it->second->flags, atbus::channel::io_stream_connection::EN_CF_ACCEPT)) {
+            CASE_EXPECT_TRUE(it->second->recv_frame_flags);
+        }
+    }
+
+    atbus::channel::io_stream_close(&svr);
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+
+CASE_TEST(channel, io_stream_tcp_compress) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, NULL);
+    atbus::channel::io_stream_init(&cli, &loop, NULL);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    inited_fds = setup_channel(cli, NULL, "ipv4://127.0.0.1:16387");
+    int check_flag = g_check_flag;
+    while (g_check_flag - check_flag < 2 * inited_fds) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_callback_check_fn;
+    char *buf = get_test_buffer();
+    atbus::channel::io_stream_connection *conn = cli.conn_pool.begin()->second.get();
+    int algorithm = atbus::channel::io_stream_compress_t::EN_CA_ZLIB;
+
+    // legacy frame head has no flags to mark the compressed frames
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_ACCESS_DENY, atbus::channel::io_stream_set_compression(conn, algorithm, 1024, 1));
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_set_checksum(conn, atbus::channel::io_stream_checksum_t::EN_CS_CRC32C));
+    if (0 == (atbus::channel::io_stream_compress_algorithms() & algorithm)) {
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_ACCESS_DENY, atbus::channel::io_stream_set_compression(conn, algorithm, 1024, 1));
+        CASE_MSG_INFO() << "zlib is not available, skip compression test." << std::endl;
+        atbus::channel::io_stream_close(&svr);
+        atbus::channel::io_stream_close(&cli);
+        uv_loop_close(&loop);
+        return;
+    }
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_set_compression(conn, algorithm, 1024, 1));
+
+    // only messages not less than threshold are compressed, and the test buffer only has 26 different characters
+    g_recv_rec = std::make_pair(0, 0);
+    check_flag = g_check_flag;
+    size_t sum_size = 0;
+    for (int i = 0; i < 64; ++i) {
+        size_t s = static_cast<size_t>(rand() % 2048);
+        size_t l = (0 == i % 4) ? static_cast<size_t>(rand() % 10240) + 20 * 1024 : static_cast<size_t>(rand() % 1024) + 1;
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(conn, buf + s, l));
+        g_check_buff_sequence.push_back(std::make_pair(s, l));
+        sum_size += l;
+    }
+
+    while (g_check_flag - check_flag < 64) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    CASE_EXPECT_EQ(64, g_recv_rec.first);
+    CASE_EXPECT_EQ(sum_size, g_recv_rec.second);
+
+    const atbus::channel::io_stream_compress_stat_t &send_stat = conn->compress_stat;
+    CASE_EXPECT_GE(send_stat.compress_times, 16);
+    CASE_EXPECT_LT(send_stat.compress_size, send_stat.compress_raw_size);
+    for (atbus::channel::io_stream_channel::conn_pool_t::iterator it = svr.conn_pool.begin(); it != svr.conn_pool.end(); ++it) {
+        if (ATBUS_CHANNEL_IOS_CHECK_FLAG(it->second->flags, atbus::channel::io_stream_connection::EN_CF_ACCEPT)) {
+            CASE_EXPECT_EQ(send_stat.compress_times, it->second->compress_stat.decompress_times);
+            CASE_EXPECT_EQ(send_stat.compress_raw_size, it->second->compress_stat.decompress_raw_size);
+            CASE_EXPECT_EQ(send_stat.compress_size, it->second->compress_stat.decompress_size);
+        }
+    }
+    CASE_MSG_INFO() << "compress " << send_stat.compress_times << " packages from " << send_stat.compress_raw_size << " bytes to "
+                    << send_stat.compress_size << " bytes in " << send_stat.compress_nsec << " ns." << std::endl;
+
+    atbus::channel::io_stream_close(&svr);
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+
+static size_t g_written_req_times = 0;
+static void written_req_callback_count_fn(atbus::channel::io_stream_channel *channel,       // 事件触发的channel
+                                          atbus::channel::io_stream_connection *connection, // 事件触发的连接
+                                          int status,                                       // libuv传入的转态码
+                                          void *input,                                      // 额外参数(不同事件不同含义)
+                                          size_t s                                          // 额外参数长度
+                                          ) {
+    written_batch_callback_check_fn(channel, connection, status, input, s);
+    ++g_written_req_times;
+}
+
+CASE_TEST(channel, io_stream_tcp_cork) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, NULL);
+    atbus::channel::io_stream_init(&cli, &loop, NULL);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    inited_fds = setup_channel(cli, NULL, "ipv4://127.0.0.1:16387");
+    int check_flag = g_check_flag;
+    while (g_check_flag - check_flag < 2 * inited_fds) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_callback_check_fn;
+    cli.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_WRITEN_BATCH] = written_req_callback_count_fn;
+    char *buf = get_test_buffer();
+    atbus::channel::io_stream_connection *conn = cli.conn_pool.begin()->second.get();
+
+    // small messages are delayed and written by the timer with one request
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_set_cork(conn, 32 * 1024, 2000));
+    g_written_batch_rec = std::make_pair(0, 0);
+    g_written_req_times = 0;
+    g_recv_rec = std::make_pair(0, 0);
+    check_flag = g_check_flag;
+    size_t sum_size = 0;
+    for (int i = 0; i < 32; ++i) {
+        size_t s = static_cast<size_t>(rand() % 2048);
+        size_t l = static_cast<size_t>(rand() % 256) + 1;
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(conn, buf + s, l));
+        g_check_buff_sequence.push_back(std::make_pair(s, l));
+        sum_size += l;
+    }
+    CASE_EXPECT_TRUE(ATBUS_CHANNEL_IOS_CHECK_FLAG(conn->flags, atbus::channel::io_stream_connection::EN_CF_CORKED));
+    CASE_EXPECT_FALSE(conn->write_buffers.empty());
+    CASE_EXPECT_EQ(1, cli.cork_fds.size());
+
+    while (g_check_flag - check_flag < 32 || g_written_batch_rec.first < 32) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(1, g_written_req_times);
+    CASE_EXPECT_EQ(sum_size, g_recv_rec.second);
+    CASE_EXPECT_EQ(0, cli.cork_fds.size());
+
+    // big message and explicit flush write the delayed messages at once
+    g_written_req_times = 0;
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_set_cork(conn, 32 * 1024, 1000000));
+    for (int i = 0; i < 16; ++i) {
+        size_t s = static_cast<size_t>(rand() % 2048);
+        size_t l = (15 == i) ? 40 * 1024 : static_cast<size_t>(rand() % 256) + 1;
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(conn, buf + s, l));
+        g_check_buff_sequence.push_back(std::make_pair(s, l));
+        sum_size += l;
+    }
+    CASE_EXPECT_FALSE(ATBUS_CHANNEL_IOS_CHECK_FLAG(conn->flags, atbus::channel::io_stream_connection::EN_CF_CORKED));
+
+    for (int i = 0; i < 16; ++i) {
+        size_t s = static_cast<size_t>(rand() % 2048);
+        size_t l = static_cast<size_t>(rand() % 256) + 1;
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(conn, buf + s, l));
+        g_check_buff_sequence.push_back(std::make_pair(s, l));
+        sum_size += l;
+    }
+    CASE_EXPECT_TRUE(ATBUS_CHANNEL_IOS_CHECK_FLAG(conn->flags, atbus::channel::io_stream_connection::EN_CF_CORKED));
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_flush_all(&cli));
+    CASE_EXPECT_FALSE(ATBUS_CHANNEL_IOS_CHECK_FLAG(conn->flags, atbus::channel::io_stream_connection::EN_CF_CORKED));
+
+    while (g_check_flag - check_flag < 64 || g_written_batch_rec.first < 64) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_LE(g_written_req_times, 3);
+    CASE_EXPECT_EQ(sum_size, g_recv_rec.second);
+    CASE_EXPECT_EQ(sum_size, g_written_batch_rec.second);
+
+    atbus::channel::io_stream_close(&svr);
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+
+CASE_TEST(channel, io_stream_tcp_try_write) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, NULL);
+    atbus::channel::io_stream_init(&cli, &loop, NULL);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    inited_fds = setup_channel(cli, NULL, "ipv4://127.0.0.1:16387");
+    int check_flag = g_check_flag;
+    while (g_check_flag - check_flag < 2 * inited_fds) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_callback_check_fn;
+    cli.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_WRITEN_BATCH] = written_req_callback_count_fn;
+    char *buf = get_test_buffer();
+    atbus::channel::io_stream_connection *conn = cli.conn_pool.begin()->second.get();
+
+    // the frame is written directly on the idle connection, but the callback is delayed to the event loop
+    g_written_batch_rec = std::make_pair(0, 0);
+    g_written_req_times = 0;
+    g_recv_rec = std::make_pair(0, 0);
+    check_flag = g_check_flag;
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(conn, buf, 128));
+    g_check_buff_sequence.push_back(std::make_pair(0, 128));
+    CASE_EXPECT_TRUE(conn->write_buffers.empty());
+    CASE_EXPECT_EQ(0, g_written_req_times);
+    CASE_EXPECT_EQ(1, cli.written_fds.size());
+
+    // callbacks of frames written before the event loop runs are merged
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(conn, buf + 128, 256));
+    g_check_buff_sequence.push_back(std::make_pair(128, 256));
+    CASE_EXPECT_EQ(0, g_written_req_times);
+    CASE_EXPECT_EQ(2, conn->try_written_stat.frame_number);
+    CASE_EXPECT_EQ(1, cli.written_fds.size());
+
+    while (g_check_flag - check_flag < 2 || g_written_batch_rec.first < 2) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(384, g_recv_rec.second);
+    CASE_EXPECT_EQ(384, g_written_batch_rec.second);
+    CASE_EXPECT_EQ(1, g_written_req_times);
+    CASE_EXPECT_EQ(0, cli.written_fds.size());
+    CASE_EXPECT_EQ(0, conn->try_written_stat.frame_number);
+    // latency statistics are disabled by default
+    CASE_EXPECT_EQ(NULL, conn->latency_stat.get());
+
+    // pending callbacks are called before EN_FN_DISCONNECTED when the connection is closed
+    g_written_batch_rec = std::make_pair(0, 0);
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(conn, buf, 64));
+    g_check_buff_sequence.push_back(std::make_pair(0, 64));
+    CASE_EXPECT_EQ(0, g_written_batch_rec.first);
+
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(1, g_written_batch_rec.first);
+    atbus::channel::io_stream_close(&svr);
+    g_check_buff_sequence.clear();
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+
+static std::vector<size_t> g_ctrl_recv_index;
+static size_t g_data_recv_number = 0;
+static void recv_ctrl_callback_check_fn(atbus::channel::io_stream_channel *channel,       // 事件触发的channel
+                                        atbus::channel::io_stream_connection *connection, // 事件触发的连接
+                                        int status,                                       // libuv传入的转态码
+                                        void *input,                                      // 额外参数(不同事件不同含义)
+                                        size_t s                                          // 额外参数长度
+                                        ) {
+    CASE_EXPECT_EQ(0, status);
+    CASE_EXPECT_EQ(0, channel->error_code);
+
+    // control messages are short, and the data messages are all 60000 bytes
+    if (s < 64) {
+        CASE_EXPECT_EQ(0, memcmp(input, "control message", s));
+        g_ctrl_recv_index.push_back(g_data_recv_number);
+    } else {
+        CASE_EXPECT_EQ(60000, s);
+        CASE_EXPECT_EQ(0, memcmp(input, get_test_buffer(), s));
+        ++g_data_recv_number;
+    }
+    ++g_check_flag;
+}
+
+CASE_TEST(channel, io_stream_tcp_ctrl_priority) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, NULL);
+    atbus::channel::io_stream_init(&cli, &loop, NULL);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    inited_fds = setup_channel(cli, NULL, "ipv4://127.0.0.1:16387");
+    int check_flag = g_check_flag;
+    while (g_check_flag - check_flag < 2 * inited_fds) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_ctrl_callback_check_fn;
+    char *buf = get_test_buffer();
+    atbus::channel::io_stream_connection *conn = cli.conn_pool.begin()->second.get();
+    const char *ctrl_msg = "control message";
+    size_t ctrl_len = strlen(ctrl_msg);
+
+    // control messages are queued in order before the switch marker is written
+    g_ctrl_recv_index.clear();
+    g_data_recv_number = 0;
+    check_flag = g_check_flag;
+    for (int i = 0; i < 16; ++i) {
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(conn, buf, 60000));
+    }
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_send_ctrl(conn, ctrl_msg, ctrl_len));
+    CASE_EXPECT_TRUE(conn->ctrl_write_buffers.empty());
+
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_set_checksum(conn, atbus::channel::io_stream_checksum_t::EN_CS_CRC32C));
+    if (!conn->write_buffers.empty()) {
+        CASE_EXPECT_GT(conn->ctrl_write_barrier, 0);
+    }
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_send_ctrl(conn, ctrl_msg, ctrl_len));
+    CASE_EXPECT_TRUE(conn->ctrl_write_buffers.empty());
+
+    while (g_check_flag - check_flag < 18) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(2, g_ctrl_recv_index.size());
+    if (2 == g_ctrl_recv_index.size()) {
+        CASE_EXPECT_EQ(16, g_ctrl_recv_index[0]);
+        CASE_EXPECT_EQ(16, g_ctrl_recv_index[1]);
+    }
+    CASE_EXPECT_EQ(0, conn->ctrl_write_barrier);
+
+    // then control messages are written before the queued data messages
+    g_ctrl_recv_index.clear();
+    g_data_recv_number = 0;
+    check_flag = g_check_flag;
+    for (int i = 0; i < 256; ++i) {
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(conn, buf, 60000));
+    }
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_send_ctrl(conn, ctrl_msg, ctrl_len));
+
+    while (g_check_flag - check_flag < 257) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(1, g_ctrl_recv_index.size());
+    if (1 == g_ctrl_recv_index.size()) {
+        CASE_EXPECT_LT(g_ctrl_recv_index[0], 256);
+        CASE_MSG_INFO() << "control message is received after " << g_ctrl_recv_index[0] << " of 256 data messages." << std::endl;
+    }
+    CASE_EXPECT_TRUE(conn->ctrl_write_buffers.empty());
+    CASE_EXPECT_TRUE(conn->write_buffers.empty());
+
+    atbus::channel::io_stream_close(&svr);
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+
+CASE_TEST(channel, io_stream_tcp_pause_read) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    // small kernel buffers, so the sender is blocked soon after the receiver paused
+    atbus::channel::io_stream_conf conf;
+    atbus::channel::io_stream_init_configure(&conf);
+    conf.sock_send_buffer = 64 * 1024;
+    conf.sock_recv_buffer = 64 * 1024;
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, &conf);
+    atbus::channel::io_stream_init(&cli, &loop, &conf);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    inited_fds = setup_channel(cli, NULL, "ipv4://127.0.0.1:16387");
+    int check_flag = g_check_flag;
+    while (g_check_flag - check_flag < 2 * inited_fds) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    atbus::channel::io_stream_connection *accepted = NULL;
+    for (atbus::channel::io_stream_channel::conn_pool_t::iterator it = svr.conn_pool.begin(); it != svr.conn_pool.end(); ++it) {
+        if (ATBUS_CHANNEL_IOS_CHECK_FLAG(it->second->flags, atbus::channel::io_stream_connection::EN_CF_ACCEPT)) {
+            accepted = it->second.get();
+        }
+    }
+    CASE_EXPECT_NE(NULL, accepted);
+    if (NULL == accepted) {
+        atbus::channel::io_stream_close(&svr);
+        atbus::channel::io_stream_close(&cli);
+        uv_loop_close(&loop);
+        return;
+    }
+
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_callback_check_fn;
+    char *buf = get_test_buffer();
+    atbus::channel::io_stream_connection *conn = cli.conn_pool.begin()->second.get();
+
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_PARAMS, atbus::channel::io_stream_pause_read(NULL));
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_pause_read(accepted));
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_pause_read(accepted));
+    CASE_EXPECT_TRUE(ATBUS_CHANNEL_IOS_CHECK_FLAG(accepted->flags, atbus::channel::io_stream_connection::EN_CF_READ_PAUSED));
+
+    g_recv_rec = std::make_pair(0, 0);
+    check_flag = g_check_flag;
+    size_t sum_size = 0;
+    for (int i = 0; i < 64; ++i) {
+        size_t s = static_cast<size_t>(rand() % 1024);
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(conn, buf + s, 60000));
+        g_check_buff_sequence.push_back(std::make_pair(s, 60000));
+        sum_size += 60000;
+    }
+
+    // nothing is received, and the data left in the send buffer of the sender
+    for (int i = 0; i < 64; ++i) {
+        uv_run(&loop, UV_RUN_NOWAIT);
+        CASE_THREAD_SLEEP_MS(1);
+    }
+    CASE_EXPECT_EQ(check_flag, g_check_flag);
+    CASE_EXPECT_FALSE(conn->write_buffers.empty());
+
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_resume_read(accepted));
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_resume_read(accepted));
+    CASE_EXPECT_FALSE(ATBUS_CHANNEL_IOS_CHECK_FLAG(accepted->flags, atbus::channel::io_stream_connection::EN_CF_READ_PAUSED));
+
+    while (g_check_flag - check_flag < 64) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(sum_size, g_recv_rec.second);
+    CASE_EXPECT_TRUE(g_check_buff_sequence.empty());
+
+    atbus::channel::io_stream_close(&svr);
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+
+CASE_TEST(channel, io_stream_tcp_read_head) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, NULL);
+    atbus::channel::io_stream_init(&cli, &loop, NULL);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    inited_fds = setup_channel(cli, NULL, "ipv4://127.0.0.1:16387");
+    int check_flag = g_check_flag;
+    while (g_check_flag - check_flag < 2 * inited_fds) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_callback_check_fn;
+    char *buf = get_test_buffer();
+
+    atbus::channel::io_stream_connection *svr_conn = NULL;
+    for (atbus::channel::io_stream_channel::conn_pool_t::iterator it = svr.conn_pool.begin(); it != svr.conn_pool.end(); ++it) {
+        if (ATBUS_CHANNEL_IOS_CHECK_FLAG(it->second->flags, atbus::channel::io_stream_connection::EN_CF_ACCEPT)) {
+            svr_conn = it->second.get();
+        }
+    }
+    CASE_EXPECT_NE(NULL, svr_conn);
+    if (NULL == svr_conn) {
+        atbus::channel::io_stream_close(&svr);
+        atbus::channel::io_stream_close(&cli);
+        uv_loop_close(&loop);
+        return;
+    }
+
+    // no buffer is held by idle connection
+    CASE_EXPECT_EQ(NULL, svr_conn->read_head.buffer);
+    CASE_EXPECT_EQ(0, svr_conn->read_head.expect_level);
+
+    // medium messages larger than the initial small buffer
+    g_recv_rec = std::make_pair(0, 0);
+    check_flag = g_check_flag;
+    for (int i = 0; i < 256; ++i) {
+        size_t s = static_cast<size_t>(rand() % 2048);
+        size_t l = static_cast<size_t>(rand() % 1024) + ATBUS_MACRO_DATA_SMALL_SIZE;
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(cli.conn_pool.begin()->second.get(), buf + s, l));
+        g_check_buff_sequence.push_back(std::make_pair(s, l));
+    }
+
+    while (g_check_flag - check_flag < 256) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(256, g_recv_rec.first);
+
+    // grow for medium messages and release to pool when all data is processed
+    if (ATBUS_MACRO_IOS_READ_HEAD_LEVELS > 1) {
+        CASE_EXPECT_GT(svr_conn->read_head.expect_level, 0);
+    }
+    CASE_EXPECT_EQ(NULL, svr_conn->read_head.buffer);
+    CASE_EXPECT_EQ(0, svr_conn->read_head.len);
+
+    size_t pool_number = 0;
+    for (size_t i = 0; i < ATBUS_MACRO_IOS_READ_HEAD_LEVELS; ++i) {
+        pool_number += svr.read_head_pool[i].size();
+    }
+    CASE_EXPECT_GT(pool_number, 0);
+
+    atbus::channel::io_stream_close(&svr);
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+    for (size_t i = 0; i < ATBUS_MACRO_IOS_READ_HEAD_LEVELS; ++i) {
+        CASE_EXPECT_TRUE(svr.read_head_pool[i].empty());
+    }
+
+    uv_loop_close(&loop);
+}
+
+CASE_TEST(channel, io_stream_tcp_read_head_burst) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, NULL);
+    atbus::channel::io_stream_init(&cli, &loop, NULL);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    inited_fds = setup_channel(cli, NULL, "ipv4://127.0.0.1:16387");
+    int check_flag = g_check_flag;
+    while (g_check_flag - check_flag < 2 * inited_fds) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_callback_check_fn;
+    char *buf = get_test_buffer();
+
+    // a burst of small messages fills the small buffer, and it should grow to read more data at once
+    g_recv_rec = std::make_pair(0, 0);
+    check_flag = g_check_flag;
+    size_t sum_size = 0;
+    for (int round = 1; round <= 16; ++round) {
+        for (int i = 0; i < 1024; ++i) {
+            size_t s = static_cast<size_t>(rand() % 2048);
+            size_t l = static_cast<size_t>(rand() % 64) + 1;
+            CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(cli.conn_pool.begin()->second.get(), buf + s, l));
+            g_check_buff_sequence.push_back(std::make_pair(s, l));
+            sum_size += l;
+        }
+
+        while (g_check_flag - check_flag < 1024 * round) {
+            uv_run(&loop, UV_RUN_ONCE);
+        }
+    }
+    CASE_EXPECT_EQ(1024 * 16, g_recv_rec.first);
+    CASE_EXPECT_EQ(sum_size, g_recv_rec.second);
+
+    for (atbus::channel::io_stream_channel::conn_pool_t::iterator it = svr.conn_pool.begin(); it != svr.conn_pool.end(); ++it) {
+        if (ATBUS_CHANNEL_IOS_CHECK_FLAG(it->second->flags, atbus::channel::io_stream_connection::EN_CF_ACCEPT)) {
+            if (ATBUS_MACRO_IOS_READ_HEAD_LEVELS > 1 && sum_size > ATBUS_MACRO_DATA_SMALL_SIZE * 2) {
+                CASE_EXPECT_GT(it->second->read_head.expect_level, 0);
+
+                // reading with the smallest buffer needs at least sum_size / ATBUS_MACRO_DATA_SMALL_SIZE reads
+                CASE_EXPECT_LT(it->second->read_times * 2, sum_size / ATBUS_MACRO_DATA_SMALL_SIZE);
+            }
+            CASE_MSG_INFO() << "recv " << sum_size << " bytes in " << it->second->read_times << " reads, "
+                            << sum_size / ATBUS_MACRO_DATA_SMALL_SIZE << " reads at least with the smallest buffer." << std::endl;
+            CASE_EXPECT_EQ(NULL, it->second->read_head.buffer);
+        }
+    }
+
+    atbus::channel::io_stream_close(&svr);
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+
+CASE_TEST(channel, io_stream_tcp_reuse_port) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_conf conf;
+    atbus::channel::io_stream_init_configure(&conf);
+    conf.is_reuse_port = true;
+
+    // both listeners could be in different threads, here we use the same loop for test
+    atbus::channel::io_stream_channel svr1, svr2, svr3, cli;
+    atbus::channel::io_stream_init(&svr1, &loop, &conf);
+    atbus::channel::io_stream_init(&svr2, &loop, &conf);
+    atbus::channel::io_stream_init(&svr3, &loop, NULL);
+    atbus::channel::io_stream_init(&cli, &loop, NULL);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr1, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    // SO_REUSEPORT is not available on all systems
+    inited_fds = setup_channel(svr2, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        CASE_MSG_INFO() << "SO_REUSEPORT is not supported, skip" << std::endl;
+    } else {
+        // listener without SO_REUSEPORT can not bind the same address
+        CASE_EXPECT_EQ(0, setup_channel(svr3, "ipv4://127.0.0.1:16387", NULL));
+
+        int check_flag = g_check_flag;
+        for (int i = 0; i < 16; ++i) {
+            CASE_EXPECT_EQ(1, setup_channel(cli, NULL, "ipv4://127.0.0.1:16387"));
+        }
+
+        // accepted and connected
+        while (g_check_flag - check_flag < 2 * 16) {
+            uv_run(&loop, UV_RUN_ONCE);
+        }
+
+        // one listen connection in each channel
+        CASE_EXPECT_EQ(16, cli.conn_pool.size());
+        CASE_EXPECT_EQ(16 + 2, svr1.conn_pool.size() + svr2.conn_pool.size());
+        CASE_MSG_INFO() << "accept " << (svr1.conn_pool.size() - 1) << " and " << (svr2.conn_pool.size() - 1) << " connections"
+                        << std::endl;
+    }
+
+    atbus::channel::io_stream_close(&svr1);
+    atbus::channel::io_stream_close(&svr2);
+    atbus::channel::io_stream_close(&svr3);
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(0, svr1.conn_pool.size());
+    CASE_EXPECT_EQ(0, svr2.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+
+#if defined(__linux__)
+static void check_tcp_sockopt(atbus::channel::io_stream_connection *conn) {
+    int opt = 0;
+    socklen_t len = sizeof(opt);
+    // linux doubles the value of SO_RCVBUF for bookkeeping overhead
+    CASE_EXPECT_EQ(0, getsockopt(conn->fd, SOL_SOCKET, SO_RCVBUF, &opt, &len));
+    CASE_EXPECT_GE(opt, 96 * 1024);
+
+    len = sizeof(opt);
+    CASE_EXPECT_EQ(0, getsockopt(conn->fd, SOL_SOCKET, SO_SNDBUF, &opt, &len));
+    CASE_EXPECT_GE(opt, 80 * 1024);
+
+    len = sizeof(opt);
+    CASE_EXPECT_EQ(0, getsockopt(conn->fd, IPPROTO_IP, IP_TOS, &opt, &len));
+    CASE_EXPECT_EQ(0x10, opt);
+
+#ifdef TCP_NOTSENT_LOWAT
+    len = sizeof(opt);
+    CASE_EXPECT_EQ(0, getsockopt(conn->fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &opt, &len));
+    CASE_EXPECT_EQ(16384, opt);
+#endif
+}
+
+CASE_TEST(channel, io_stream_tcp_sockopt) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_conf conf;
+    atbus::channel::io_stream_init_configure(&conf);
+    conf.sock_send_buffer = 80 * 1024;
+    conf.sock_recv_buffer = 96 * 1024;
+    conf.sock_notsent_lowat = 16384;
+    conf.sock_tos = 0x10;
+    conf.is_quickack = true;
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, &conf);
+    atbus::channel::io_stream_init(&cli, &loop, &conf);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    int check_flag = g_check_flag;
+    CASE_EXPECT_EQ(1, setup_channel(cli, NULL, "ipv4://127.0.0.1:16387"));
+    while (g_check_flag - check_flag < 2) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    // the listen socket, the accepted connection and the connected connection
+    CASE_EXPECT_EQ(2, svr.conn_pool.size());
+    CASE_EXPECT_EQ(1, cli.conn_pool.size());
+    for (atbus::channel::io_stream_channel::conn_pool_t::iterator it = svr.conn_pool.begin(); it != svr.conn_pool.end(); ++it) {
+        check_tcp_sockopt(it->second.get());
+    }
+    check_tcp_sockopt(cli.conn_pool.begin()->second.get());
+
+    // data still works with quick ack enabled
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_callback_check_fn;
+    char *buf = get_test_buffer();
+    check_flag = g_check_flag;
+    atbus::channel::io_stream_send(cli.conn_pool.begin()->second.get(), buf, 13);
+    g_check_buff_sequence.push_back(std::make_pair(0, 13));
+    atbus::channel::io_stream_send(cli.conn_pool.begin()->second.get(), buf + 1024, 56 * 1024 + 3);
+    g_check_buff_sequence.push_back(std::make_pair(1024, 56 * 1024 + 3));
+
+    while (g_check_flag - check_flag < 2) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    atbus::channel::io_stream_close(&svr);
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+#endif
+
+CASE_TEST(channel, io_stream_tcp_object_pool) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, NULL);
+    atbus::channel::io_stream_init(&cli, &loop, NULL);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    for (int round = 0; round < 2; ++round) {
+        int check_flag = g_check_flag;
+        for (int i = 0; i < 8; ++i) {
+            CASE_EXPECT_EQ(1, setup_channel(cli, NULL, "ipv4://127.0.0.1:16387"));
+        }
+
+        while (g_check_flag - check_flag < 2 * 8) {
+            uv_run(&loop, UV_RUN_ONCE);
+        }
+        CASE_EXPECT_EQ(8, cli.conn_pool.size());
+
+        std::vector<atbus::channel::io_stream_connection *> conns;
+        for (atbus::channel::io_stream_channel::conn_pool_t::iterator it = cli.conn_pool.begin(); it != cli.conn_pool.end(); ++it) {
+            conns.push_back(it->second.get());
+        }
+        for (size_t i = 0; i < conns.size(); ++i) {
+            atbus::channel::io_stream_disconnect(&cli, conns[i], NULL);
+        }
+
+        while (!cli.conn_pool.empty() || !cli.conn_gc_pool.empty() || svr.conn_pool.size() > 1) {
+            uv_run(&loop, UV_RUN_ONCE);
+        }
+    }
+
+    // connection objects and handles of the second round are all reused
+    CASE_EXPECT_NE(NULL, cli.object_pool);
+    CASE_EXPECT_NE(NULL, svr.object_pool);
+    if (NULL != cli.object_pool && NULL != svr.object_pool) {
+        CASE_EXPECT_EQ(2 * 2 * 8, cli.object_pool->alloc_times);
+        CASE_EXPECT_EQ(2 * 8, cli.object_pool->reuse_times);
+        CASE_EXPECT_GE(svr.object_pool->reuse_times, 2 * 8);
+        // only the listen connection is alive
+        CASE_EXPECT_EQ(3, svr.object_pool->ref_count);
+        CASE_EXPECT_EQ(1, cli.object_pool->ref_count);
+    }
+
+    atbus::channel::io_stream_close(&svr);
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+    CASE_EXPECT_EQ(NULL, cli.object_pool);
+
+    uv_loop_close(&loop);
+}
+
+static int g_dns_failed_times = 0;
+static void dns_failed_callback_test_fn(atbus::channel::io_stream_channel *channel,       // 事件触发的channel
+                                        atbus::channel::io_stream_connection *connection, // 事件触发的连接
+                                        int status,                                       // libuv传入的转态码
+                                        void *,                                           // 额外参数(不同事件不同含义)
+                                        size_t s                                          // 额外参数长度
+                                        ) {
+    CASE_EXPECT_NE(NULL, channel);
+    if (EN_ATBUS_ERR_DNS_GETADDR_FAILED == status) {
+        ++g_dns_failed_times;
+    }
+
+    ++g_check_flag;
+}
+
+CASE_TEST(channel, io_stream_tcp_dns_cache) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, NULL);
+    atbus::channel::io_stream_init(&cli, &loop, NULL);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv6://:::16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    int check_flag = g_check_flag;
+    if (0 == setup_channel(cli, NULL, "dns://localhost:16387")) {
+        atbus::channel::io_stream_close(&svr);
+        atbus::channel::io_stream_close(&cli);
+        uv_loop_close(&loop);
+        return;
+    }
+
+    while (g_check_flag - check_flag < 2) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(1, cli.dns_cache.size());
+    CASE_EXPECT_EQ(1, cli.conn_pool.size());
+
+    // the second connection uses the cached address and starts connecting without getaddrinfo
+    check_flag = g_check_flag;
+    CASE_EXPECT_EQ(1, setup_channel(cli, NULL, "dns://localhost:16387"));
+    // only the connect request is pending
+    CASE_EXPECT_EQ(1, cli.active_reqs.get());
+    while (g_check_flag - check_flag < 2) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(2, cli.conn_pool.size());
+
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_flush_dns_cache(&cli, "localhost"));
+    CASE_EXPECT_EQ(0, cli.dns_cache.size());
+
+    // negative cache
+    atbus::channel::channel_address_t addr;
+    atbus::channel::make_address("dns://atbus-test.invalid:16387", addr);
+    check_flag = g_check_flag;
+    g_dns_failed_times = 0;
+    if (0 == atbus::channel::io_stream_connect(&cli, addr, dns_failed_callback_test_fn, NULL, 0)) {
+        while (g_check_flag - check_flag < 1) {
+            uv_run(&loop, UV_RUN_ONCE);
+        }
+    }
+
+    if (1 != g_dns_failed_times) {
+        CASE_MSG_INFO() << "atbus-test.invalid is resolved, skip negative cache" << std::endl;
+    } else {
+        CASE_EXPECT_EQ(1, cli.dns_cache.size());
+        int res = atbus::channel::io_stream_connect(&cli, addr, dns_failed_callback_test_fn, NULL, 0);
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_DNS_GETADDR_FAILED, res);
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_flush_dns_cache(&cli, NULL));
+        CASE_EXPECT_EQ(0, cli.dns_cache.size());
+    }
+
+    atbus::channel::io_stream_close(&svr);
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+
+static int g_connect_any_success = 0;
+static int g_connect_any_failed = 0;
+static void connect_any_callback_test_fn(atbus::channel::io_stream_channel *channel,       // 事件触发的channel
+                                         atbus::channel::io_stream_connection *connection, // 事件触发的连接
+                                         int status,                                       // libuv传入的转态码
+                                         void *,                                           // 额外参数(不同事件不同含义)
+                                         size_t s                                          // 额外参数长度
+                                         ) {
+    CASE_EXPECT_NE(NULL, channel);
+    if (0 == status) {
+        CASE_EXPECT_NE(NULL, connection);
+        CASE_MSG_INFO() << "connect to " << connection->addr.address << " success" << std::endl;
+        ++g_connect_any_success;
+    } else {
+        CASE_EXPECT_EQ(NULL, connection);
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SOCK_CONNECT_FAILED, status);
+        ++g_connect_any_failed;
+    }
+}
+
+CASE_TEST(channel, io_stream_tcp_connect_any) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, NULL);
+    atbus::channel::io_stream_init(&cli, &loop, NULL);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    // assume port 16388 and 16389 are unreachable
+    atbus::channel::channel_address_t addr;
+    std::vector<atbus::channel::channel_address_t> addrs;
+    atbus::channel::make_address("ipv4://127.0.0.1:16388", addr);
+    addrs.push_back(addr);
+    atbus::channel::make_address("ipv4://127.0.0.1:16387", addr);
+    addrs.push_back(addr);
+
+    // the first address is refused and the second one is tried at once
+    g_connect_any_success = g_connect_any_failed = 0;
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_connect_any(&cli, addrs, connect_any_callback_test_fn, NULL, 0));
+    while (0 == g_connect_any_success + g_connect_any_failed || cli.active_reqs.get() > 0) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(1, g_connect_any_success);
+    CASE_EXPECT_EQ(0, g_connect_any_failed);
+    CASE_EXPECT_EQ(1, cli.conn_pool.size());
+
+    // both addresses are connected at the same time, only one is kept
+    cli.conf.connect_attempt_delay = 0;
+    addrs[0] = addr;
+    g_connect_any_success = g_connect_any_failed = 0;
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_connect_any(&cli, addrs, connect_any_callback_test_fn, NULL, 0));
+    while (0 == g_connect_any_success + g_connect_any_failed || cli.active_reqs.get() > 0) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(1, g_connect_any_success);
+    CASE_EXPECT_EQ(0, g_connect_any_failed);
+    CASE_EXPECT_EQ(2, cli.conn_pool.size());
+
+    // all addresses failed, the callback is called once
+    atbus::channel::make_address("ipv4://127.0.0.1:16388", addrs[0]);
+    atbus::channel::make_address("ipv4://127.0.0.1:16389", addrs[1]);
+    cli.conf.connect_attempt_delay = 250;
+    g_connect_any_success = g_connect_any_failed = 0;
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_connect_any(&cli, addrs, connect_any_callback_test_fn, NULL, 0));
+    while (0 == g_connect_any_success + g_connect_any_failed || cli.active_reqs.get() > 0) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(0, g_connect_any_success);
+    CASE_EXPECT_EQ(1, g_connect_any_failed);
+    CASE_EXPECT_EQ(2, cli.conn_pool.size());
+
+    atbus::channel::io_stream_close(&svr);
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+
+static int g_close_async_status = 1;
+static void close_async_callback_test_fn(atbus::channel::io_stream_channel *channel,       // 事件触发的channel
+                                         atbus::channel::io_stream_connection *connection, // 事件触发的连接
+                                         int status,                                       // libuv传入的转态码
+                                         void *,                                           // 额外参数(不同事件不同含义)
+                                         size_t s                                          // 额外参数长度
+                                         ) {
+    CASE_EXPECT_NE(NULL, channel);
+    CASE_EXPECT_EQ(NULL, connection);
+    CASE_EXPECT_EQ(0, channel->conn_pool.size());
+    g_close_async_status = status;
+}
+
+CASE_TEST(channel, io_stream_tcp_close_async) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    // small socket buffers, so the unread data can not be all sent
+    atbus::channel::io_stream_conf conf;
+    atbus::channel::io_stream_init_configure(&conf);
+    conf.sock_send_buffer = 4096;
+    conf.sock_recv_buffer = 4096;
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, &conf);
+    atbus::channel::io_stream_init(&cli, &loop, &conf);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    int check_flag = g_check_flag;
+    CASE_EXPECT_EQ(1, setup_channel(cli, NULL, "ipv4://127.0.0.1:16387"));
+    CASE_EXPECT_EQ(1, setup_channel(cli, NULL, "ipv4://127.0.0.1:16387"));
+    while (g_check_flag - check_flag < 4) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    // pending data is written before the connections are closed
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_callback_check_fn;
+    char *buf = get_test_buffer();
+    check_flag = g_check_flag;
+    for (int i = 0; i < 8; ++i) {
+        atbus::channel::io_stream_send(cli.conn_pool.begin()->second.get(), buf + 1024, 56 * 1024 + 3);
+        g_check_buff_sequence.push_back(std::make_pair(1024, 56 * 1024 + 3));
+    }
+
+    g_close_async_status = 1;
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_close_async(&cli, 10000, close_async_callback_test_fn, NULL, 0));
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_CHANNEL_CLOSING, atbus::channel::io_stream_close_async(&cli, 10000, NULL, NULL, 0));
+    CASE_EXPECT_EQ(1, g_close_async_status);
+    while (1 == g_close_async_status) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(0, g_close_async_status);
+    atbus::channel::io_stream_close(&cli);
+
+    // all data are received by peer
+    while (g_check_flag - check_flag < 8) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    // the peer does not read, the connection is closed after timeout
+    atbus::channel::io_stream_init(&cli, &loop, &conf);
+    check_flag = g_check_flag;
+    CASE_EXPECT_EQ(1, setup_channel(cli, NULL, "ipv4://127.0.0.1:16387"));
+    while (g_check_flag - check_flag < 2) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    for (atbus::channel::io_stream_channel::conn_pool_t::iterator it = svr.conn_pool.begin(); it != svr.conn_pool.end(); ++it) {
+        uv_read_stop(it->second->handle.get());
+    }
+
+    for (int i = 0; i < 256; ++i) {
+        atbus::channel::io_stream_send(cli.conn_pool.begin()->second.get(), buf + 1024, 56 * 1024 + 3);
+    }
+
+    g_close_async_status = 1;
+    uint64_t begin_time = uv_now(&loop);
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_close_async(&cli, 100, close_async_callback_test_fn, NULL, 0));
+    while (1 == g_close_async_status) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_CHANNEL_CLOSE_TIMEOUT, g_close_async_status);
+    CASE_EXPECT_GE(uv_now(&loop) - begin_time, 100);
+    CASE_MSG_INFO() << "close with unread data cost " << (uv_now(&loop) - begin_time) << "ms" << std::endl;
+
+    g_check_buff_sequence.clear();
+    atbus::channel::io_stream_close(&cli);
+    atbus::channel::io_stream_close(&svr);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+
+CASE_TEST(channel, io_stream_latency_histogram) {
+    atbus::channel::io_stream_latency_histogram_t histogram;
+    atbus::channel::io_stream_latency_reset(&histogram);
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_latency_percentile(&histogram, 50.0));
+
+    // 1-1000us
+    for (uint64_t i = 1; i <= 1000; ++i) {
+        atbus::channel::io_stream_latency_record(&histogram, i);
+    }
+    CASE_EXPECT_EQ(1000, histogram.total_count);
+    CASE_EXPECT_EQ(1, histogram.min_value);
+    CASE_EXPECT_EQ(1000, histogram.max_value);
+    CASE_EXPECT_EQ(1, atbus::channel::io_stream_latency_percentile(&histogram, 0.0));
+    CASE_EXPECT_EQ(1000, atbus::channel::io_stream_latency_percentile(&histogram, 100.0));
+
+    // relative error is less than 1/8
+    double percentiles[] = {10.0, 50.0, 90.0, 99.0, 99.9};
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); ++i) {
+        uint64_t expect = static_cast<uint64_t>(percentiles[i] * 10);
+        uint64_t real = atbus::channel::io_stream_latency_percentile(&histogram, percentiles[i]);
+        CASE_EXPECT_GE(real, expect);
+        CASE_EXPECT_LE(real, expect + expect / 8);
+    }
+
+    // too large values are recorded in the last bucket
+    atbus::channel::io_stream_latency_histogram_t large;
+    atbus::channel::io_stream_latency_reset(&large);
+    atbus::channel::io_stream_latency_record(&large, UINT64_MAX);
+    CASE_EXPECT_EQ(1, large.counts[atbus::channel::io_stream_latency_histogram_t::BUCKET_COUNT - 1]);
+    CASE_EXPECT_EQ(UINT64_MAX, large.max_value);
+
+    atbus::channel::io_stream_latency_merge(&histogram, &large);
+    CASE_EXPECT_EQ(1001, histogram.total_count);
+    CASE_EXPECT_EQ(1, histogram.min_value);
+    CASE_EXPECT_EQ(UINT64_MAX, histogram.max_value);
+    CASE_EXPECT_GE(atbus::channel::io_stream_latency_percentile(&histogram, 49.95), 500);
+    CASE_EXPECT_LE(atbus::channel::io_stream_latency_percentile(&histogram, 49.95), 500 + 500 / 8);
+}
+
+static int g_send_ptr_free_count = 0;
+static void send_ptr_free_test_fn(void *buf, size_t) {
+    ++g_send_ptr_free_count;
+    free(buf);
+}
+
+static void *send_ptr_make_test_buffer(size_t offset, size_t len) {
+    void *ret = malloc(len);
+    memcpy(ret, get_test_buffer() + offset, len);
+    return ret;
+}
+
+CASE_TEST(channel, io_stream_tcp_send_ptr) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    // small socket buffers, so most of the data is queued
+    atbus::channel::io_stream_conf conf;
+    atbus::channel::io_stream_init_configure(&conf);
+    conf.sock_send_buffer = 4096;
+    conf.sock_recv_buffer = 4096;
+    conf.send_buffer_max_size = 2 * 1024 * 1024;
+    conf.enable_latency_stat = true;
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, &conf);
+    atbus::channel::io_stream_init(&cli, &loop, &conf);
+
+    g_check_flag = 0;
+    int inited_fds = setup_channel(svr, "ipv4://127.0.0.1:16387", NULL);
+    if (0 == inited_fds) {
+        uv_loop_close(&loop);
+        return;
+    }
+
+    int check_flag = g_check_flag;
+    CASE_EXPECT_EQ(1, setup_channel(cli, NULL, "ipv4://127.0.0.1:16387"));
+    while (g_check_flag - check_flag < 2) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_callback_check_fn;
+    atbus::channel::io_stream_connection *conn = cli.conn_pool.begin()->second.get();
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_PARAMS, atbus::channel::io_stream_send_ptr(conn, NULL, 0, send_ptr_free_test_fn));
+
+    // zero-copy frames and normal frames are received in order
+    g_send_ptr_free_count = 0;
+    check_flag = g_check_flag;
+    for (int i = 0; i < 8; ++i) {
+        size_t len = 48 * 1024 + i * 1024 + 3;
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_send_ptr(conn, send_ptr_make_test_buffer(i, len), len, send_ptr_free_test_fn));
+        g_check_buff_sequence.push_back(std::make_pair(static_cast<size_t>(i), len));
+
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(conn, get_test_buffer() + 256, 1024));
+        g_check_buff_sequence.push_back(std::make_pair(256, 1024));
+    }
+
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_set_checksum(conn, atbus::channel::io_stream_checksum_t::EN_CS_CRC32C));
+    for (int i = 0; i < 8; ++i) {
+        size_t len = 32 * 1024 + i;
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_send_ptr(conn, send_ptr_make_test_buffer(i, len), len, send_ptr_free_test_fn));
+        g_check_buff_sequence.push_back(std::make_pair(static_cast<size_t>(i), len));
+    }
+
+    while (g_check_flag - check_flag < 24) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(16, g_send_ptr_free_count);
+    CASE_EXPECT_TRUE(g_check_buff_sequence.empty());
+    CASE_EXPECT_EQ(0, conn->write_ext_size);
+
+    // every frame is recorded once in both histograms after it's written
+    CASE_EXPECT_NE(NULL, conn->latency_stat.get());
+    if (conn->latency_stat) {
+        CASE_EXPECT_EQ(24, conn->latency_stat->queue.total_count);
+        CASE_EXPECT_EQ(24, conn->latency_stat->written.total_count);
+        CASE_EXPECT_LE(atbus::channel::io_stream_latency_percentile(&conn->latency_stat->queue, 100.0),
+                       atbus::channel::io_stream_latency_percentile(&conn->latency_stat->written, 100.0));
+    }
+
+    // the queued buffers are released when the connection is closed
+    for (atbus::channel::io_stream_channel::conn_pool_t::iterator it = svr.conn_pool.begin(); it != svr.conn_pool.end(); ++it) {
+        uv_read_stop(it->second->handle.get());
+    }
+
+    // zero-copy data is counted in send_buffer_max_size, so it can not be queued without limit
+    g_send_ptr_free_count = 0;
+    int sent_count = 0;
+    int res = 0;
+    for (int i = 0; i < 64 && 0 == res; ++i) {
+        size_t len = 56 * 1024;
+        void *buf = send_ptr_make_test_buffer(0, len);
+        res = atbus::channel::io_stream_send_ptr(conn, buf, len, send_ptr_free_test_fn);
+        if (0 == res) {
+            ++sent_count;
+        } else {
+            free(buf);
+        }
+    }
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_BUFF_LIMIT, res);
+    CASE_EXPECT_GT(sent_count, 0);
+    CASE_EXPECT_LT(g_send_ptr_free_count, sent_count);
+    CASE_EXPECT_LE(conn->write_ext_size, conf.send_buffer_max_size);
+
+    // the peer never reads, so the connection is closed after timeout and the unsent data is dropped
+    g_close_async_status = 1;
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_close_async(&cli, 100, close_async_callback_test_fn, NULL, 0));
+    while (1 == g_close_async_status) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_CHANNEL_CLOSE_TIMEOUT, g_close_async_status);
+    CASE_EXPECT_EQ(sent_count, g_send_ptr_free_count);
+
+    atbus::channel::io_stream_close(&cli);
+    atbus::channel::io_stream_close(&svr);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+
+static int g_shard_listen_status = 1;
+static std::vector<uint64_t> g_shard_conn_ids;
+static int g_shard_disconnected_count = 0;
+static int g_shard_recv_count = 0;
+static int g_shard_send_failed_status = 0;
+static size_t g_shard_send_failed_size = 0;
+
+static void shard_listen_callback_test_fn(atbus::channel::io_stream_shards *shards, uint64_t conn_id, int status, void *, size_t) {
+    CASE_EXPECT_NE(NULL, shards);
+    CASE_EXPECT_EQ(0, conn_id);
+    g_shard_listen_status = status;
+}
+
+static void shard_connected_callback_test_fn(atbus::channel::io_stream_shards *shards, uint64_t conn_id, int status, void *, size_t) {
+    CASE_EXPECT_NE(NULL, shards);
+    CASE_EXPECT_EQ(0, status);
+    CASE_EXPECT_NE(0, conn_id);
+    CASE_EXPECT_LT(atbus::channel::io_stream_shard_index(conn_id), shards->workers.size());
+    g_shard_conn_ids.push_back(conn_id);
+}
+
+static void shard_accepted_callback_test_fn(atbus::channel::io_stream_shards *shards, uint64_t conn_id, int status, void *input,
+                                            size_t s) {
+    CASE_EXPECT_NE(NULL, shards);
+    CASE_EXPECT_EQ(0, status);
+    // the address of peer
+    CASE_EXPECT_EQ("ipv4://127.0.0.1:", std::string(reinterpret_cast<const char *>(input), s).substr(0, 17));
+    CASE_EXPECT_LT(atbus::channel::io_stream_shard_index(conn_id), shards->workers.size());
+    g_shard_conn_ids.push_back(conn_id);
+}
+
+static void shard_disconnected_callback_test_fn(atbus::channel::io_stream_shards *, uint64_t conn_id, int, void *, size_t) {
+    CASE_EXPECT_NE(0, conn_id);
+    ++g_shard_disconnected_count;
+}
+
+static void shard_send_failed_callback_test_fn(atbus::channel::io_stream_shards *, uint64_t conn_id, int status, void *input,
+                                               size_t s) {
+    CASE_EXPECT_NE(0, conn_id);
+    CASE_EXPECT_NE(NULL, input);
+    if (0 == g_shard_send_failed_status) {
+        g_shard_send_failed_status = status;
+        g_shard_send_failed_size = s;
+    }
+}
+
+// echo every message back
+static void shard_recv_callback_test_fn(atbus::channel::io_stream_shards *shards, uint64_t conn_id, int status, void *input, size_t s) {
+    CASE_EXPECT_EQ(0, status);
+    CASE_EXPECT_EQ(0, memcmp(get_test_buffer(), input, s));
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_shard_send(shards, conn_id, input, s));
+    ++g_shard_recv_count;
+}
+
+CASE_TEST(channel, io_stream_tcp_shard) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_shard_conf conf;
+    atbus::channel::io_stream_shard_init_configure(&conf);
+    conf.shard_number = 2;
+    conf.close_timeout = 100;
+
+    atbus::channel::io_stream_shards shards;
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_shard_init(&shards, &loop, &conf));
+    CASE_EXPECT_EQ(2, shards.workers.size());
+    CASE_EXPECT_TRUE(shards.conf.stream_conf.is_reuse_port);
+    CASE_EXPECT_EQ(conf.queue_size, shards.conf.stream_conf.send_buffer_max_size);
+    shards.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_ACCEPTED] = shard_accepted_callback_test_fn;
+    shards.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_DISCONNECTED] = shard_disconnected_callback_test_fn;
+    shards.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = shard_recv_callback_test_fn;
+
+    // listen in all workers
+    atbus::channel::channel_address_t addr;
+    atbus::channel::make_address("ipv4://127.0.0.1:16387", addr);
+    g_shard_listen_status = 1;
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_shard_listen(&shards, addr, shard_listen_callback_test_fn, NULL, 0));
+    while (1 == g_shard_listen_status) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(0, g_shard_listen_status);
+    if (0 != g_shard_listen_status) {
+        atbus::channel::io_stream_shard_close(&shards);
+        while (UV_EBUSY == uv_loop_close(&loop)) {
+            uv_run(&loop, UV_RUN_ONCE);
+        }
+        return;
+    }
+
+    atbus::channel::io_stream_channel cli;
+    atbus::channel::io_stream_init(&cli, &loop, NULL);
+    cli.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_callback_check_fn;
+
+    g_shard_conn_ids.clear();
+    g_shard_disconnected_count = 0;
+    g_shard_recv_count = 0;
+    int check_flag = g_check_flag;
+    for (int i = 0; i < 4; ++i) {
+        CASE_EXPECT_EQ(1, setup_channel(cli, NULL, "ipv4://127.0.0.1:16387"));
+    }
+    while (g_check_flag - check_flag < 4 || g_shard_conn_ids.size() < 4) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    // messages are received and echoed back by the workers in order
+    atbus::channel::io_stream_connection *conn = cli.conn_pool.begin()->second.get();
+    check_flag = g_check_flag;
+    for (int i = 0; i < 16; ++i) {
+        size_t len = 13 + i * 4099;
+        CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(conn, get_test_buffer(), len));
+        g_check_buff_sequence.push_back(std::make_pair(0, len));
+    }
+    while (g_check_flag - check_flag < 16) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(16, g_shard_recv_count);
+    CASE_EXPECT_TRUE(g_check_buff_sequence.empty());
+
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_PARAMS, atbus::channel::io_stream_shard_send(&shards, 0, get_test_buffer(), 13));
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_PARAMS, atbus::channel::io_stream_shard_disconnect(&shards, 0xFFFF));
+
+    // disconnect by the worker
+    cli.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_DISCONNECTED] = disconnected_callback_test_fn;
+    check_flag = g_check_flag;
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_shard_disconnect(&shards, g_shard_conn_ids.front()));
+    while (g_check_flag - check_flag < 1 || g_shard_disconnected_count < 1) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(3, cli.conn_pool.size());
+
+    // the worker returns the message it can not send
+    shards.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_WRITEN] = shard_send_failed_callback_test_fn;
+    g_shard_send_failed_status = 0;
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_shard_send(&shards, g_shard_conn_ids.front(), get_test_buffer(), 13));
+    while (0 == g_shard_send_failed_status) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_CONNECTION_NOT_FOUND, g_shard_send_failed_status);
+    CASE_EXPECT_EQ(13, g_shard_send_failed_size);
+
+    // connect from a worker
+    atbus::channel::io_stream_channel svr;
+    atbus::channel::io_stream_init(&svr, &loop, NULL);
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_callback_check_fn;
+    check_flag = g_check_flag;
+    CASE_EXPECT_EQ(1, setup_channel(svr, "ipv4://127.0.0.1:16388", NULL));
+    while (g_check_flag - check_flag < 1) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    shards.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_ACCEPTED] = NULL;
+    g_shard_conn_ids.clear();
+    atbus::channel::make_address("ipv4://127.0.0.1:16388", addr);
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_shard_connect(&shards, addr, shard_connected_callback_test_fn, NULL, 0));
+    while (g_shard_conn_ids.empty()) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    check_flag = g_check_flag;
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_shard_send(&shards, g_shard_conn_ids.front(), get_test_buffer(), 4096));
+    g_check_buff_sequence.push_back(std::make_pair(0, 4096));
+    while (g_check_flag - check_flag < 1) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_TRUE(g_check_buff_sequence.empty());
+
+    // settings and ctrl messages are run by the worker after the messages sent before them
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_PARAMS, atbus::channel::io_stream_shard_set_checksum(&shards, g_shard_conn_ids.front(),
+                                                                                     atbus::channel::io_stream_checksum_t::EN_CS_LEGACY));
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_PARAMS, atbus::channel::io_stream_shard_set_compression(&shards, g_shard_conn_ids.front(), 3, 0, 0));
+    check_flag = g_check_flag;
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_shard_send(&shards, g_shard_conn_ids.front(), get_test_buffer(), 1024));
+    g_check_buff_sequence.push_back(std::make_pair(0, 1024));
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_shard_set_checksum(&shards, g_shard_conn_ids.front(),
+                                                                   atbus::channel::io_stream_checksum_t::EN_CS_CRC32C));
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_shard_set_cork(&shards, g_shard_conn_ids.front(), 0, 0));
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_shard_send_ctrl(&shards, g_shard_conn_ids.front(), get_test_buffer(), 128));
+    g_check_buff_sequence.push_back(std::make_pair(0, 128));
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_shard_send(&shards, g_shard_conn_ids.front(), get_test_buffer(), 2048));
+    g_check_buff_sequence.push_back(std::make_pair(0, 2048));
+    while (g_check_flag - check_flag < 3) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_TRUE(g_check_buff_sequence.empty());
+
+    // the peer stops reading, data queued in the worker is limited by the send buffer
+    for (atbus::channel::io_stream_channel::conn_pool_t::iterator it = svr.conn_pool.begin(); it != svr.conn_pool.end(); ++it) {
+        uv_read_stop(it->second->handle.get());
+    }
+    g_shard_send_failed_status = 0;
+    for (int i = 0; i < 1024 && 0 == g_shard_send_failed_status; ++i) {
+        atbus::channel::io_stream_shard_send(&shards, g_shard_conn_ids.front(), get_test_buffer(), 60 * 1024);
+        uv_run(&loop, UV_RUN_NOWAIT);
+        CASE_THREAD_SLEEP_MS(1);
+    }
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_BUFF_LIMIT, g_shard_send_failed_status);
+    CASE_EXPECT_EQ(60 * 1024, g_shard_send_failed_size);
+
+    // close the listen sockets in all workers, then the address can be listened without SO_REUSEPORT
+    atbus::channel::make_address("ipv4://127.0.0.1:16387", addr);
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_shard_close_listen(&shards, addr));
+    atbus::channel::io_stream_channel relisten;
+    atbus::channel::io_stream_init(&relisten, &loop, NULL);
+    int relisten_res = EN_ATBUS_ERR_SOCK_LISTEN_FAILED;
+    for (int i = 0; i < 1000 && relisten_res < 0; ++i) {
+        relisten_res = atbus::channel::io_stream_listen(&relisten, addr, NULL, NULL, 0);
+        if (relisten_res < 0) {
+            uv_run(&loop, UV_RUN_NOWAIT);
+            CASE_THREAD_SLEEP_MS(1);
+        }
+    }
+    CASE_EXPECT_EQ(0, relisten_res);
+    atbus::channel::io_stream_close(&relisten);
+
+    // all the connections in workers are closed, and no callback is called after that
+    atbus::channel::io_stream_shard_close(&shards);
+    CASE_EXPECT_EQ(0, shards.workers.size());
+    check_flag = g_check_flag;
+    while (g_check_flag - check_flag < 3 || !cli.conn_pool.empty()) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+
+    atbus::channel::io_stream_close(&cli);
+    atbus::channel::io_stream_close(&svr);
+    while (UV_EBUSY == uv_loop_close(&loop)) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+}
 
 // reset by peer(client)
 CASE_TEST(channel, io_stream_tcp_reset_by_client) {
@@ -15,6 +15,12 @@
 
 #ifndef _WIN32
 
+#include <unistd.h>
+
+#ifdef ATBUS_CHANNEL_SHM_FD
+#include <sys/syscall.h>
+#endif
+
 static const size_t MAX_TEST_BUFFER_LEN = 1024 * 256;
 static int g_check_flag = 0;
 static std::pair<size_t, size_t> g_recv_rec = std::make_pair(0, 0);
@@ -266,6 +272,124 @@ CASE_TEST(channel, io_stream_unix_basic)
     uv_loop_close(&loop);
 }
 
+#ifdef ATBUS_CHANNEL_SHM_FD
+static atbus::channel::shm_channel* g_shm_fd_recv_channel = NULL;
+
+static void recv_shm_fd_callback_check_fn(
+    atbus::channel::io_stream_channel* channel,         // 事件触发的channel
+    atbus::channel::io_stream_connection* connection,   // 事件触发的连接
+    int status,                         // libuv传入的转态码
+    void* input,                        // 额外参数(不同事件不同含义)
+    size_t s                            // 额外参数长度
+    ) {
+    CASE_EXPECT_NE(NULL, channel);
+    CASE_EXPECT_NE(NULL, connection);
+    if (status < 0) {
+        return;
+    }
+
+    atbus::adapter::fd_t fd = -1;
+    int res = atbus::channel::io_stream_recv_fd(connection, &fd);
+    if (3 == s && 0 == memcmp(input, "shm", 3)) {
+        CASE_EXPECT_EQ(0, res);
+        CASE_EXPECT_GE(fd, 0);
+
+        res = atbus::channel::shm_attach_fd(fd, &g_shm_fd_recv_channel, NULL);
+        CASE_EXPECT_EQ(0, res);
+        close(fd);
+    } else {
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_NO_DATA, res);
+    }
+
+    ++g_check_flag;
+}
+
+// pass a memfd shm channel by unix socket
+CASE_TEST(channel, io_stream_unix_shm_fd)
+{
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::io_stream_channel svr, cli;
+    atbus::channel::io_stream_init(&svr, &loop, NULL);
+    atbus::channel::io_stream_init(&cli, &loop, NULL);
+
+    g_check_flag = 0;
+    g_shm_fd_recv_channel = NULL;
+
+    setup_channel(svr, UNIT_TEST_LISTEN_ADDR, NULL);
+    CASE_EXPECT_EQ(1, g_check_flag);
+
+    setup_channel(cli, NULL, UNIT_TEST_LISTEN_ADDR);
+    int check_flag = g_check_flag;
+    while (g_check_flag - check_flag < 2) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_EQ(1, cli.conn_pool.size());
+    if (cli.conn_pool.empty()) {
+        atbus::channel::io_stream_close(&svr);
+        atbus::channel::io_stream_close(&cli);
+        uv_loop_close(&loop);
+        return;
+    }
+    atbus::channel::io_stream_connection* conn = cli.conn_pool.begin()->second.get();
+
+    svr.evt.callbacks[atbus::channel::io_stream_callback_evt_t::EN_FN_RECVED] = recv_shm_fd_callback_check_fn;
+
+    int fd = -1;
+    atbus::channel::shm_channel* send_channel = NULL;
+    int res = atbus::channel::shm_init_fd(64 * 1024, &fd, &send_channel, NULL);
+    CASE_EXPECT_EQ(0, res);
+    CASE_EXPECT_GE(fd, 0);
+
+    // 长度已经固定，接收端不能再截断
+    CASE_EXPECT_NE(0, ftruncate(fd, 4096));
+
+    // 没有固定长度的描述符不允许映射
+    int unsealed_fd = static_cast<int>(syscall(SYS_memfd_create, "unit_test_unsealed", 0));
+    if (unsealed_fd >= 0) {
+        CASE_EXPECT_EQ(0, ftruncate(unsealed_fd, 64 * 1024));
+        atbus::channel::shm_channel* unsealed_channel = NULL;
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_SHM_GET_FAILED, atbus::channel::shm_attach_fd(unsealed_fd, &unsealed_channel, NULL));
+        close(unsealed_fd);
+    }
+
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_PARAMS, atbus::channel::io_stream_send_fd(conn, fd, NULL, 0));
+
+    // 描述符已经复制，发送后可以直接关闭
+    check_flag = g_check_flag;
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_send_fd(conn, fd, "shm", 3));
+    close(fd);
+    CASE_EXPECT_EQ(0, atbus::channel::io_stream_send(conn, "tail", 4));
+
+    while (g_check_flag - check_flag < 2) {
+        uv_run(&loop, UV_RUN_ONCE);
+    }
+    CASE_EXPECT_NE(NULL, g_shm_fd_recv_channel);
+
+    if (NULL != g_shm_fd_recv_channel) {
+        char* buf = get_test_buffer();
+        CASE_EXPECT_EQ(0, atbus::channel::shm_send(send_channel, buf, 1000));
+
+        char recv_buf[2048] = {0};
+        size_t recv_size = 0;
+        CASE_EXPECT_EQ(0, atbus::channel::shm_recv(g_shm_fd_recv_channel, recv_buf, sizeof(recv_buf), &recv_size));
+        CASE_EXPECT_EQ(1000, recv_size);
+        CASE_EXPECT_EQ(0, memcmp(buf, recv_buf, 1000));
+
+        CASE_EXPECT_EQ(0, atbus::channel::shm_close_fd(g_shm_fd_recv_channel));
+    }
+    CASE_EXPECT_EQ(0, atbus::channel::shm_close_fd(send_channel));
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_SHM_NOT_FOUND, atbus::channel::shm_close_fd(send_channel));
+
+    atbus::channel::io_stream_close(&svr);
+    atbus::channel::io_stream_close(&cli);
+    CASE_EXPECT_EQ(0, svr.conn_pool.size());
+    CASE_EXPECT_EQ(0, cli.conn_pool.size());
+
+    uv_loop_close(&loop);
+}
+#endif
 
 // reset by peer(client)
 CASE_TEST(channel, io_stream_unix_reset_by_client)
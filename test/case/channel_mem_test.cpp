@@ -11,6 +11,7 @@
 #include <map>
 #include <memory>
 #include <thread>
+#include <vector>
 
 
 #include "detail/libatbus_channel_export.h"
@@ -124,8 +125,337 @@ CASE_TEST(channel, mem_siso) {
     delete[] buffer;
 }
 
+static size_t g_mem_ptr_free_times = 0;
+static void mem_ptr_test_free_fn(void *buf, size_t) {
+    ++g_mem_ptr_free_times;
+    delete[] reinterpret_cast<char *>(buf);
+}
+
+CASE_TEST(channel, mem_ptr_siso) {
+    using namespace atbus::channel;
+    const size_t buffer_len = 64 * 1024; // 64KB
+    char *buffer = new char[buffer_len];
+
+    mem_channel *channel = NULL;
+
+    CASE_EXPECT_EQ(0, mem_init(buffer, buffer_len, &channel, NULL));
+    CASE_EXPECT_NE(NULL, channel);
+    g_mem_ptr_free_times = 0;
+
+    // 空队列
+    {
+        void *recv_buf = NULL;
+        size_t recv_len = 0;
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_NO_DATA, mem_recv_ptr(channel, &recv_buf, &recv_len, NULL));
+    }
+
+    // 写满
+    size_t send_times = 0;
+    std::vector<void *> sended;
+    while (true) {
+        char *data = new char[1024];
+        memset(data, static_cast<int>(send_times & 0xFF), 1024);
+        int res = mem_send_ptr(channel, data, 1024, mem_ptr_test_free_fn);
+        if (0 != res) {
+            CASE_EXPECT_EQ(EN_ATBUS_ERR_BUFF_LIMIT, res);
+            // 失败时所有权仍然在调用方
+            delete[] data;
+            break;
+        }
+
+        sended.push_back(data);
+        ++send_times;
+    }
+    CASE_EXPECT_GT(send_times, 0);
+
+    // 读出的指针必须和写入的一致，并且保持顺序
+    for (size_t i = 0; i < send_times; ++i) {
+        void *recv_buf = NULL;
+        size_t recv_len = 0;
+        mem_ptr_free_fn_t free_fn = NULL;
+        CASE_EXPECT_EQ(0, mem_recv_ptr(channel, &recv_buf, &recv_len, &free_fn));
+        CASE_EXPECT_EQ(sended[i], recv_buf);
+        CASE_EXPECT_EQ(1024, recv_len);
+        CASE_EXPECT_EQ(static_cast<char>(i & 0xFF), reinterpret_cast<char *>(recv_buf)[1023]);
+        mem_free_ptr(recv_buf, recv_len, free_fn);
+    }
+    CASE_EXPECT_EQ(send_times, g_mem_ptr_free_times);
+
+    // 清理未读取的数据块
+    {
+        CASE_EXPECT_EQ(0, mem_send_ptr(channel, new char[16], 16, mem_ptr_test_free_fn));
+        CASE_EXPECT_EQ(0, mem_send_ptr(channel, new char[16], 16, mem_ptr_test_free_fn));
+        CASE_EXPECT_EQ(2, mem_clear_ptr(channel));
+        CASE_EXPECT_EQ(send_times + 2, g_mem_ptr_free_times);
+    }
+
+    delete[] buffer;
+}
+
+// 同一个发送者交替使用mem_send和mem_send_ptr时，接收顺序必须和发送顺序一致
+CASE_TEST(channel, mem_ptr_mixed_order) {
+    using namespace atbus::channel;
+    const size_t buffer_len = 64 * 1024; // 64KB
+    char *buffer = new char[buffer_len];
+
+    mem_channel *channel = NULL;
+
+    CASE_EXPECT_EQ(0, mem_init(buffer, buffer_len, &channel, NULL));
+    CASE_EXPECT_NE(NULL, channel);
+
+    // 发送顺序: 环形缓冲区 0,1 指针 2 环形缓冲区 3 指针 4,5 环形缓冲区 6
+    const bool use_ptr[] = {false, false, true, false, true, true, false};
+    const size_t msg_number = sizeof(use_ptr) / sizeof(use_ptr[0]);
+    for (size_t i = 0; i < msg_number; ++i) {
+        if (use_ptr[i]) {
+            size_t *data = reinterpret_cast<size_t *>(malloc(sizeof(size_t)));
+            *data = i;
+            CASE_EXPECT_EQ(0, mem_send_ptr(channel, data, sizeof(size_t), NULL));
+        } else {
+            CASE_EXPECT_EQ(0, mem_send(channel, &i, sizeof(i)));
+        }
+    }
+
+    // 环形缓冲区里有更早的数据时，指针队列不能先返回
+    {
+        void *recv_buf = NULL;
+        CASE_EXPECT_EQ(EN_ATBUS_ERR_NO_DATA, mem_recv_ptr(channel, &recv_buf, NULL, NULL));
+    }
+
+    for (size_t i = 0; i < msg_number; ++i) {
+        size_t recv_data = msg_number;
+        size_t recv_len = 0;
+        void *recv_buf = NULL;
+        mem_ptr_free_fn_t free_fn = NULL;
+        if (use_ptr[i]) {
+            CASE_EXPECT_EQ(EN_ATBUS_ERR_NO_DATA, mem_recv(channel, &recv_data, sizeof(recv_data), &recv_len));
+            CASE_EXPECT_EQ(0, mem_recv_ptr(channel, &recv_buf, &recv_len, &free_fn));
+            if (NULL != recv_buf) {
+                recv_data = *reinterpret_cast<size_t *>(recv_buf);
+                mem_free_ptr(recv_buf, recv_len, free_fn);
+            }
+        } else {
+            CASE_EXPECT_EQ(EN_ATBUS_ERR_NO_DATA, mem_recv_ptr(channel, &recv_buf, &recv_len, &free_fn));
+            CASE_EXPECT_EQ(0, mem_recv(channel, &recv_data, sizeof(recv_data), &recv_len));
+        }
+
+        CASE_EXPECT_EQ(sizeof(size_t), recv_len);
+        CASE_EXPECT_EQ(i, recv_data);
+    }
+
+    CASE_EXPECT_EQ(0, mem_clear_ptr(channel));
+    delete[] buffer;
+}
+
+CASE_TEST(channel, mem_migrate) {
+    using namespace atbus::channel;
+    const size_t buffer_len = 64 * 1024; // 64KB
+    char *buffer = new char[buffer_len];
+
+    mem_channel *channel = NULL;
+
+    CASE_EXPECT_EQ(0, mem_init(buffer, buffer_len, &channel, NULL));
+    CASE_EXPECT_NE(NULL, channel);
+
+    char send_buf[128] = {0};
+    char recv_buf[128] = {0};
+    size_t recv_len = 0;
+    CASE_EXPECT_EQ(0, mem_send(channel, send_buf, sizeof(send_buf)));
+    CASE_EXPECT_FALSE(mem_get_migrate(channel, NULL, NULL));
+    CASE_EXPECT_FALSE(mem_migrate_drained(channel));
+
+    CASE_EXPECT_EQ(0, mem_migrate(channel, 0x12345678, 1024 * 1024));
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_ALREADY_INITED, mem_migrate(channel, 0x12345679, 1024 * 1024));
+
+    // 迁移后不能再写入旧通道
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_CHANNEL_MIGRATED, mem_send(channel, send_buf, sizeof(send_buf)));
+    {
+        int64_t key = 0;
+        size_t size = 0;
+        CASE_EXPECT_TRUE(mem_get_migrate(channel, &key, &size));
+        CASE_EXPECT_EQ(0x12345678, key);
+        CASE_EXPECT_EQ(1024 * 1024, size);
+    }
+
+    // 迁移前写入的数据必须读完才算迁移完成
+    CASE_EXPECT_FALSE(mem_migrate_drained(channel));
+    CASE_EXPECT_EQ(0, mem_recv(channel, recv_buf, sizeof(recv_buf), &recv_len));
+    CASE_EXPECT_EQ(sizeof(send_buf), recv_len);
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_NO_DATA, mem_recv(channel, recv_buf, sizeof(recv_buf), &recv_len));
+    CASE_EXPECT_TRUE(mem_migrate_drained(channel));
+
+    delete[] buffer;
+}
+
 #if defined(UTIL_CONFIG_COMPILER_CXX_LAMBDAS) && UTIL_CONFIG_COMPILER_CXX_LAMBDAS
 
+CASE_TEST(channel, mem_ptr_miso) {
+    using namespace atbus::channel;
+    const size_t buffer_len = 4 * 1024 * 1024; // 4MB
+    char *buffer = new char[buffer_len];
+
+    mem_channel *channel = NULL;
+
+    CASE_EXPECT_EQ(0, mem_init(buffer, buffer_len, &channel, NULL));
+    CASE_EXPECT_NE(NULL, channel);
+
+    const size_t wn = 4;
+    const size_t send_times = 100000;
+    util::lock::atomic_int_type<size_t> sum_send_full;
+    sum_send_full.store(0);
+
+    std::thread *write_threads[wn];
+    for (size_t i = 0; i < wn; ++i) {
+        write_threads[i] = new std::thread([&, i] {
+            for (size_t j = 0; j < send_times;) {
+                size_t *data = reinterpret_cast<size_t *>(malloc(sizeof(size_t) * 2));
+                data[0] = i;
+                data[1] = j;
+                int res = mem_send_ptr(channel, data, sizeof(size_t) * 2, NULL);
+                if (0 != res) {
+                    free(data);
+                    ++sum_send_full;
+                    CASE_THREAD_YIELD();
+                } else {
+                    ++j;
+                }
+            }
+        });
+    }
+
+    // 每个写线程的数据必须有序
+    size_t data_seq[wn] = {0};
+    size_t sum_recv_times = 0;
+    while (sum_recv_times < wn * send_times) {
+        void *recv_buf = NULL;
+        size_t recv_len = 0;
+        mem_ptr_free_fn_t free_fn = NULL;
+        int res = mem_recv_ptr(channel, &recv_buf, &recv_len, &free_fn);
+        if (EN_ATBUS_ERR_NO_DATA == res) {
+            CASE_THREAD_YIELD();
+            continue;
+        }
+
+        CASE_EXPECT_EQ(0, res);
+        CASE_EXPECT_EQ(sizeof(size_t) * 2, recv_len);
+        size_t *data = reinterpret_cast<size_t *>(recv_buf);
+        CASE_EXPECT_EQ(data_seq[data[0]], data[1]);
+        data_seq[data[0]] = data[1] + 1;
+        mem_free_ptr(recv_buf, recv_len, free_fn);
+        ++sum_recv_times;
+    }
+
+    for (size_t i = 0; i < wn; ++i) {
+        write_threads[i]->join();
+        delete write_threads[i];
+    }
+
+    CASE_MSG_INFO() << "recv " << sum_recv_times << " times, send full " << sum_send_full.load() << " times" << std::endl;
+    CASE_EXPECT_EQ(0, mem_clear_ptr(channel));
+    delete[] buffer;
+}
+
+// 多个发送者随机使用mem_send和mem_send_ptr，每个发送者的消息都必须有序
+// 写线程在写入中途被挂起太久时环形缓冲区会按超时丢弃这个数据块，所以这里只要求指针传递的数据块一个不少
+CASE_TEST(channel, mem_ptr_mixed_miso) {
+    using namespace atbus::channel;
+    const size_t buffer_len = 4 * 1024 * 1024; // 4MB
+    char *buffer = new char[buffer_len];
+
+    mem_channel *channel = NULL;
+
+    CASE_EXPECT_EQ(0, mem_init(buffer, buffer_len, &channel, NULL));
+    CASE_EXPECT_NE(NULL, channel);
+
+    const size_t wn = 4;
+    const size_t send_times = 100000;
+    util::lock::atomic_int_type<size_t> sum_send_ptr;
+    sum_send_ptr.store(0);
+    util::lock::atomic_int_type<size_t> sum_finished;
+    sum_finished.store(0);
+
+    std::thread *write_threads[wn];
+    for (size_t i = 0; i < wn; ++i) {
+        write_threads[i] = new std::thread([&, i] {
+            for (size_t j = 0; j < send_times;) {
+                size_t data[2] = {i, j};
+                int res;
+                if (rand() & 1) {
+                    size_t *ptr_data = reinterpret_cast<size_t *>(malloc(sizeof(data)));
+                    memcpy(ptr_data, data, sizeof(data));
+                    res = mem_send_ptr(channel, ptr_data, sizeof(data), NULL);
+                    if (0 != res) {
+                        free(ptr_data);
+                    } else {
+                        ++sum_send_ptr;
+                    }
+                } else {
+                    res = mem_send(channel, data, sizeof(data));
+                }
+
+                if (0 != res) {
+                    CASE_THREAD_YIELD();
+                } else {
+                    ++j;
+                }
+            }
+
+            ++sum_finished;
+        });
+    }
+
+    size_t data_seq[wn] = {0};
+    size_t sum_recv_times = 0;
+    size_t sum_recv_ptr = 0;
+    size_t idle_times = 0;
+    while (true) {
+        size_t recv_data[2] = {wn, 0};
+        size_t recv_len = 0;
+        void *recv_buf = NULL;
+        mem_ptr_free_fn_t free_fn = NULL;
+        bool finished = sum_finished.load() >= wn;
+        int res = mem_recv_ptr(channel, &recv_buf, &recv_len, &free_fn);
+        if (0 == res) {
+            CASE_EXPECT_EQ(sizeof(recv_data), recv_len);
+            memcpy(recv_data, recv_buf, sizeof(recv_data));
+            mem_free_ptr(recv_buf, recv_len, free_fn);
+            ++sum_recv_ptr;
+        } else {
+            res = mem_recv(channel, recv_data, sizeof(recv_data), &recv_len);
+            if (EN_ATBUS_ERR_NO_DATA == res) {
+                if (finished && ++idle_times > 16) {
+                    break;
+                }
+                CASE_THREAD_YIELD();
+                continue;
+            }
+
+            if (0 != res) {
+                continue;
+            }
+        }
+
+        idle_times = 0;
+        ++sum_recv_times;
+        CASE_EXPECT_LT(recv_data[0], wn);
+        if (recv_data[0] >= wn) {
+            continue;
+        }
+        CASE_EXPECT_LE(data_seq[recv_data[0]], recv_data[1]);
+        data_seq[recv_data[0]] = recv_data[1] + 1;
+    }
+
+    for (size_t i = 0; i < wn; ++i) {
+        write_threads[i]->join();
+        delete write_threads[i];
+    }
+
+    CASE_MSG_INFO() << "recv " << sum_recv_times << " times, " << sum_recv_ptr << " by pointer" << std::endl;
+    CASE_EXPECT_EQ(sum_send_ptr.load(), sum_recv_ptr);
+    CASE_EXPECT_EQ(0, mem_clear_ptr(channel));
+    delete[] buffer;
+}
+
 CASE_TEST(channel, mem_miso) {
     using namespace atbus::channel;
     const size_t buffer_len = 64 * 1024 * 1024; // 64MB
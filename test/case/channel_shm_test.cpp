@@ -0,0 +1,184 @@
+#include "config/compiler_features.h"
+#include "lock/atomic_int_type.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+
+#include "detail/libatbus_channel_export.h"
+#include "frame/test_macros.h"
+#include <detail/libatbus_error.h>
+
+#if defined(ATBUS_CHANNEL_SHM) && defined(UTIL_CONFIG_COMPILER_CXX_LAMBDAS) && UTIL_CONFIG_COMPILER_CXX_LAMBDAS
+
+// 多个发送者并发写入时连续迁移共享内存通道，每个发送者的消息都不能丢失或乱序
+CASE_TEST(channel, shm_migrate_miso) {
+    using namespace atbus::channel;
+    const key_t keys[] = {0x16242001, 0x16242002, 0x16242003, 0x16242004};
+    const size_t key_number = sizeof(keys) / sizeof(keys[0]);
+    const size_t base_len = 256 * 1024;
+
+    shm_channel *recv_channel = NULL;
+    int res = shm_init(keys[0], base_len, &recv_channel, NULL);
+    CASE_EXPECT_EQ(0, res);
+    if (res < 0) {
+        return;
+    }
+
+    util::lock::atomic_int_type<int> is_running;
+    is_running.store(1);
+    util::lock::atomic_int_type<size_t> sum_seq;
+    sum_seq.store(0);
+    util::lock::atomic_int_type<size_t> sum_send_times;
+    sum_send_times.store(0);
+    util::lock::atomic_int_type<size_t> sum_switch_times;
+    sum_switch_times.store(0);
+    util::lock::atomic_int_type<size_t> sum_send_err;
+    sum_send_err.store(0);
+
+    // 消息内容是 发送者序号 + 发送者内的消息序号
+    const size_t wn = 4;
+    std::vector<std::thread *> write_threads;
+    for (size_t i = 0; i < wn; ++i) {
+        write_threads.push_back(new std::thread([&] {
+            size_t buf_pool[256];
+            size_t sender = sum_seq.fetch_add(1);
+            size_t seq = 0;
+
+            key_t cur_key = keys[0];
+            size_t cur_len = base_len;
+            shm_channel *channel = NULL;
+            if (shm_attach(cur_key, cur_len, &channel, NULL) < 0) {
+                ++sum_send_err;
+                return;
+            }
+
+            while (0 != is_running.load()) {
+                size_t n = 2 + rand() % 254;
+                buf_pool[0] = sender;
+                for (size_t j = 1; j < n; ++j) {
+                    buf_pool[j] = seq;
+                }
+
+                int ret = shm_send(channel, buf_pool, n * sizeof(size_t));
+
+                // 和shm_push_fn一样，在这条消息开始前切换到新通道
+                while (EN_ATBUS_ERR_CHANNEL_MIGRATED == ret) {
+                    key_t new_key;
+                    size_t new_len;
+                    if (!shm_get_migrate(channel, &new_key, &new_len)) {
+                        break;
+                    }
+
+                    shm_channel *new_channel = NULL;
+                    ret = shm_attach(new_key, new_len, &new_channel, NULL);
+                    if (ret < 0) {
+                        break;
+                    }
+
+                    shm_close(cur_key);
+                    cur_key = new_key;
+                    cur_len = new_len;
+                    channel = new_channel;
+                    ++sum_switch_times;
+
+                    ret = shm_send(channel, buf_pool, n * sizeof(size_t));
+                }
+
+                if (0 == ret) {
+                    ++seq;
+                    ++sum_send_times;
+                } else if (EN_ATBUS_ERR_BUFF_LIMIT == ret) {
+                    CASE_THREAD_YIELD();
+                } else {
+                    ++sum_send_err;
+                    CASE_THREAD_YIELD();
+                }
+            }
+
+            shm_close(cur_key);
+        }));
+    }
+
+    std::vector<size_t> data_seq(wn, 0);
+    size_t sum_recv_times = 0;
+    size_t sum_recv_err = 0;
+    size_t key_index = 0;
+    shm_channel *migrate_channel = NULL;
+    size_t buff_recv[256];
+
+    time_t end_time = time(NULL) + 4;
+    size_t idle_times = 0;
+    while (true) {
+        bool stop_sending = time(NULL) >= end_time;
+        if (stop_sending && 0 != is_running.load()) {
+            is_running.store(0);
+            for (size_t i = 0; i < write_threads.size(); ++i) {
+                write_threads[i]->join();
+                delete write_threads[i];
+            }
+            write_threads.clear();
+        }
+
+        // 收到一些消息后发起下一次迁移
+        if (NULL == migrate_channel && key_index + 1 < key_number && sum_recv_times > (key_index + 1) * 2000) {
+            CASE_EXPECT_EQ(0, shm_migrate(recv_channel, keys[key_index + 1], base_len << (key_index + 1), &migrate_channel, NULL));
+        }
+
+        size_t len = 0;
+        res = shm_recv(recv_channel, buff_recv, sizeof(buff_recv), &len);
+        if (EN_ATBUS_ERR_NO_DATA == res) {
+            // 旧通道读完后切换到新通道
+            if (NULL != migrate_channel && shm_migrate_drained(recv_channel)) {
+                CASE_EXPECT_EQ(0, shm_close(keys[key_index]));
+                recv_channel = migrate_channel;
+                migrate_channel = NULL;
+                ++key_index;
+                continue;
+            }
+
+            if (stop_sending && NULL == migrate_channel && ++idle_times > 16) {
+                break;
+            }
+            CASE_THREAD_YIELD();
+            continue;
+        }
+        idle_times = 0;
+
+        if (0 != res) {
+            ++sum_recv_err;
+            continue;
+        }
+
+        ++sum_recv_times;
+        CASE_EXPECT_EQ(0, len % sizeof(size_t));
+        size_t n = len / sizeof(size_t);
+        CASE_EXPECT_GE(n, 2);
+        if (n < 2 || buff_recv[0] >= wn) {
+            ++sum_recv_err;
+            continue;
+        }
+
+        size_t sender = buff_recv[0];
+        CASE_EXPECT_EQ(data_seq[sender], buff_recv[1]);
+        data_seq[sender] = buff_recv[1] + 1;
+    }
+
+    if (NULL != migrate_channel) {
+        shm_close(keys[key_index + 1]);
+    }
+    CASE_EXPECT_EQ(0, shm_close(keys[key_index]));
+
+    CASE_MSG_INFO() << "send " << sum_send_times.load() << " messages with " << sum_switch_times.load() << " switches, recv "
+                    << sum_recv_times << " messages in " << key_index + 1 << " channels" << std::endl;
+    CASE_EXPECT_EQ(key_number - 1, key_index);
+    CASE_EXPECT_EQ(0, sum_send_err.load());
+    CASE_EXPECT_EQ(0, sum_recv_err);
+    CASE_EXPECT_EQ(sum_send_times.load(), sum_recv_times);
+}
+
+#endif
@@ -0,0 +1,220 @@
+﻿#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <list>
+#include <memory>
+
+#include "detail/libatbus_channel_export.h"
+#include "frame/test_macros.h"
+#include <detail/libatbus_error.h>
+
+
+static const size_t MAX_TEST_BUFFER_LEN = 1024 * 64;
+static std::pair<size_t, size_t> g_udp_recv_rec = std::make_pair(0, 0);
+static std::list<std::pair<size_t, size_t> > g_udp_check_buff_sequence;
+
+static char *get_test_buffer() {
+    static char ret[MAX_TEST_BUFFER_LEN] = {0};
+    if (0 != ret[0]) {
+        return ret;
+    }
+
+    for (size_t i = 0; i < MAX_TEST_BUFFER_LEN - 1; ++i) {
+        ret[i] = 'A' + rand() % 26;
+    }
+
+    return ret;
+}
+
+static void udp_recv_callback_check_fn(atbus::channel::udp_channel *channel, // 事件触发的channel
+                                       atbus::channel::udp_socket *socket,   // 收到数据的socket
+                                       const sockaddr *addr,                 // 发送方地址
+                                       int status,                           // 错误码
+                                       void *input,                          // 数据
+                                       size_t s                              // 数据长度
+                                       ) {
+    CASE_EXPECT_NE(NULL, channel);
+    CASE_EXPECT_NE(NULL, socket);
+    CASE_EXPECT_NE(NULL, addr);
+    CASE_EXPECT_EQ(0, status);
+    if (0 != status) {
+        CASE_MSG_INFO() << uv_err_name(channel->error_code) << ":" << uv_strerror(channel->error_code) << std::endl;
+        return;
+    }
+
+    CASE_EXPECT_FALSE(g_udp_check_buff_sequence.empty());
+    if (g_udp_check_buff_sequence.empty()) {
+        return;
+    }
+
+    ++g_udp_recv_rec.first;
+    g_udp_recv_rec.second += s;
+
+    // 本地回环上数据报的顺序不会变
+    CASE_EXPECT_EQ(s, g_udp_check_buff_sequence.front().second);
+    char *buff = get_test_buffer();
+    char *input_buff = reinterpret_cast<char *>(input);
+    for (size_t i = 0; i < g_udp_check_buff_sequence.front().second && i < s; ++i) {
+        CASE_EXPECT_EQ(buff[i + g_udp_check_buff_sequence.front().first], input_buff[i]);
+        if (buff[i + g_udp_check_buff_sequence.front().first] != input_buff[i]) {
+            break;
+        }
+    }
+    g_udp_check_buff_sequence.pop_front();
+}
+
+// udp可能丢包，等待一段时间后放弃
+static void udp_wait_recv(atbus::adapter::loop_t &loop, size_t expect) {
+    for (int i = 0; i < 4000 && g_udp_recv_rec.first < expect; ++i) {
+        uv_run(&loop, UV_RUN_NOWAIT);
+        if (g_udp_recv_rec.first < expect) {
+            CASE_THREAD_SLEEP_MS(1);
+        }
+    }
+}
+
+CASE_TEST(channel, udp_basic) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::udp_channel svr, cli;
+    atbus::channel::udp_init(&svr, &loop, NULL);
+    atbus::channel::udp_init(&cli, &loop, NULL);
+    svr.on_recv = udp_recv_callback_check_fn;
+
+    atbus::channel::channel_address_t addr;
+    atbus::channel::make_address("udp://127.0.0.1:16397", addr);
+    atbus::channel::udp_socket *svr_sock = NULL;
+    int res = atbus::channel::udp_listen(&svr, addr, &svr_sock);
+    if (0 != res) {
+        CASE_MSG_INFO() << uv_err_name(svr.error_code) << ":" << uv_strerror(svr.error_code) << std::endl;
+        atbus::channel::udp_close(&svr);
+        atbus::channel::udp_close(&cli);
+        uv_loop_close(&loop);
+        return;
+    }
+    CASE_EXPECT_NE(NULL, svr_sock);
+
+    atbus::channel::udp_peer_t peer;
+    CASE_EXPECT_EQ(0, atbus::channel::udp_make_peer(addr, &peer));
+
+    atbus::channel::channel_address_t bad_addr;
+    atbus::channel::make_address("udp://localhost:16397", bad_addr);
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_CHANNEL_ADDR_INVALID, atbus::channel::udp_make_peer(bad_addr, &peer));
+    CASE_EXPECT_EQ(0, atbus::channel::udp_make_peer(addr, &peer));
+
+    char *buf = get_test_buffer();
+
+    // 超过单个数据报的长度限制
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_INVALID_SIZE, atbus::channel::udp_send(&cli, &peer, buf, cli.conf.send_max_size + 1));
+    CASE_EXPECT_EQ(0, cli.socket_pool.size());
+
+    g_udp_recv_rec = std::make_pair(0, 0);
+    g_udp_check_buff_sequence.clear();
+    size_t sum_size = 0;
+    for (int i = 0; i < 64; ++i) {
+        size_t s = static_cast<size_t>(rand() % 2048);
+        size_t l = (0 == i % 8) ? cli.conf.send_max_size : static_cast<size_t>(rand() % 256) + 1;
+        CASE_EXPECT_EQ(0, atbus::channel::udp_send(&cli, &peer, buf + s, l));
+        g_udp_check_buff_sequence.push_back(std::make_pair(s, l));
+        sum_size += l;
+    }
+
+    // 发送时自动创建socket
+    CASE_EXPECT_EQ(1, cli.socket_pool.size());
+
+    // 只能使用同一个channel的socket
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_PARAMS, atbus::channel::udp_send_from(&cli, svr_sock, &peer, buf, 16));
+
+    udp_wait_recv(loop, 64);
+
+    CASE_EXPECT_EQ(64, cli.stat.send_times);
+    CASE_EXPECT_EQ(sum_size, cli.stat.send_size);
+    CASE_EXPECT_EQ(0, cli.stat.send_drop_times);
+    CASE_EXPECT_LT(cli.stat.send_batch_times, cli.stat.send_times);
+    CASE_EXPECT_EQ(64, g_udp_recv_rec.first);
+    CASE_EXPECT_EQ(sum_size, g_udp_recv_rec.second);
+    CASE_EXPECT_EQ(g_udp_recv_rec.first, svr.stat.recv_times);
+    CASE_EXPECT_EQ(0, svr.stat.recv_drop_times);
+    CASE_MSG_INFO() << "send " << cli.stat.send_times << " datagrams in " << cli.stat.send_batch_times << " batches." << std::endl;
+
+    CASE_EXPECT_EQ(0, atbus::channel::udp_close_socket(&svr, svr_sock));
+    CASE_EXPECT_EQ(EN_ATBUS_ERR_CONNECTION_NOT_FOUND, atbus::channel::udp_close_socket(&svr, svr_sock));
+    CASE_EXPECT_EQ(0, svr.socket_pool.size());
+
+    atbus::channel::udp_close(&svr);
+    atbus::channel::udp_close(&cli);
+    CASE_EXPECT_EQ(0, cli.socket_pool.size());
+
+    CASE_EXPECT_EQ(0, uv_loop_close(&loop));
+}
+
+CASE_TEST(channel, udp_drop_invalid) {
+    atbus::adapter::loop_t loop;
+    uv_loop_init(&loop);
+
+    atbus::channel::udp_channel svr, cli;
+    atbus::channel::udp_init(&svr, &loop, NULL);
+    atbus::channel::udp_init(&cli, &loop, NULL);
+    svr.on_recv = udp_recv_callback_check_fn;
+
+    atbus::channel::channel_address_t addr;
+    atbus::channel::make_address("udp://127.0.0.1:16397", addr);
+    if (0 != atbus::channel::udp_listen(&svr, addr, NULL)) {
+        CASE_MSG_INFO() << uv_err_name(svr.error_code) << ":" << uv_strerror(svr.error_code) << std::endl;
+        atbus::channel::udp_close(&svr);
+        atbus::channel::udp_close(&cli);
+        uv_loop_close(&loop);
+        return;
+    }
+
+    atbus::channel::udp_peer_t peer;
+    CASE_EXPECT_EQ(0, atbus::channel::udp_make_peer(addr, &peer));
+
+    char *buf = get_test_buffer();
+    g_udp_recv_rec = std::make_pair(0, 0);
+    g_udp_check_buff_sequence.clear();
+
+    // 创建发送socket后直接发送不符合格式的数据报
+    CASE_EXPECT_EQ(0, atbus::channel::udp_send(&cli, &peer, buf, 16));
+    g_udp_check_buff_sequence.push_back(std::make_pair(0, 16));
+    CASE_EXPECT_EQ(0, atbus::channel::udp_flush(&cli));
+    CASE_EXPECT_EQ(1, cli.socket_pool.size());
+
+    const sockaddr *raw_peer = reinterpret_cast<const sockaddr *>(&peer.addr);
+    char bad_version[32] = {0};
+    memcpy(bad_version, buf, sizeof(bad_version));
+    bad_version[0] = 0x7f;
+    uv_buf_t bad_buf = uv_buf_init(bad_version, sizeof(bad_version));
+    CASE_EXPECT_EQ(static_cast<int>(sizeof(bad_version)), uv_udp_try_send(cli.socket_pool[0]->handle, &bad_buf, 1, raw_peer));
+
+    char bad_checksum[32] = {0};
+    memcpy(bad_checksum, buf, sizeof(bad_checksum));
+    bad_checksum[0] = 1;
+    bad_buf = uv_buf_init(bad_checksum, sizeof(bad_checksum));
+    CASE_EXPECT_EQ(static_cast<int>(sizeof(bad_checksum)), uv_udp_try_send(cli.socket_pool[0]->handle, &bad_buf, 1, raw_peer));
+
+    bad_buf = uv_buf_init(bad_checksum, 3);
+    CASE_EXPECT_EQ(3, uv_udp_try_send(cli.socket_pool[0]->handle, &bad_buf, 1, raw_peer));
+
+    CASE_EXPECT_EQ(0, atbus::channel::udp_send(&cli, &peer, buf + 16, 32));
+    g_udp_check_buff_sequence.push_back(std::make_pair(16, 32));
+
+    udp_wait_recv(loop, 2);
+    for (int i = 0; i < 1000 && svr.stat.recv_drop_times < 3; ++i) {
+        uv_run(&loop, UV_RUN_NOWAIT);
+        CASE_THREAD_SLEEP_MS(1);
+    }
+
+    CASE_EXPECT_EQ(2, g_udp_recv_rec.first);
+    CASE_EXPECT_EQ(48, g_udp_recv_rec.second);
+    CASE_EXPECT_EQ(2, svr.stat.recv_times);
+    CASE_EXPECT_EQ(3, svr.stat.recv_drop_times);
+
+    atbus::channel::udp_close(&svr);
+    atbus::channel::udp_close(&cli);
+
+    CASE_EXPECT_EQ(0, uv_loop_close(&loop));
+}